@@ -0,0 +1,495 @@
+/**************************************************************************
+ *
+ * Copyright 2012 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+/*
+ * Measures the overhead of tracing GL calls, by issuing them against the
+ * stub libGL, with and without the tracer preloaded.
+ */
+
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <sys/stat.h>
+
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#define GL_GLEXT_PROTOTYPES
+
+#include "glimports.hpp"
+#include "os_string.hpp"
+#include "os_thread.hpp"
+#include "os_time.hpp"
+
+
+static const char *synopsis = "Benchmark the overhead of tracing GL calls.";
+
+static void
+usage(void)
+{
+    std::cout
+        << "usage: glbench [OPTIONS] [MIX ...]\n"
+        << synopsis << "\n"
+        "\n"
+        "    -h, --help             show this help message and exit\n"
+        "    -w, --wrapper=WRAPPER  also run every mix with the given tracer\n"
+        "                           wrapper (e.g., glxtrace.so) preloaded\n"
+        "    -r, --repeat=N         run every mix N times, and keep the fastest\n"
+        "                           [default: 3]\n"
+        "        --calls=N          calls per thread [default: 1000000]\n"
+        "        --threads=N        number of threads [default: 1]\n"
+        "        --vertices=N       vertices per draw [default: 1024]\n"
+        "        --uniforms=N       vec4 elements per uniform array [default: 16]\n"
+        "        --buffer-size=BYTES\n"
+        "                           size of the mapped buffer ranges [default: 4096]\n"
+        "\n"
+        "    Mixes:\n"
+        "\n"
+        "        state              enables, blend, depth and viewport state\n"
+        "        uniform            uniform arrays and matrices\n"
+        "        map                buffer range mappings\n"
+        "        draw               draws from user memory vertex and index arrays\n"
+        "        mixed              all of the above, interleaved\n"
+        "\n"
+        "    All mixes are run by default.  Bytes are of the compressed trace,\n"
+        "    which is written to the current directory, and removed afterwards.\n"
+        "\n";
+}
+
+enum {
+    CALLS_OPT = CHAR_MAX + 1,
+    THREADS_OPT,
+    VERTICES_OPT,
+    UNIFORMS_OPT,
+    BUFFER_SIZE_OPT,
+    CHILD_OPT,
+};
+
+const static char *
+shortOptions = "hw:r:";
+
+const static struct option
+longOptions[] = {
+    {"help", no_argument, 0, 'h'},
+    {"wrapper", required_argument, 0, 'w'},
+    {"repeat", required_argument, 0, 'r'},
+    {"calls", required_argument, 0, CALLS_OPT},
+    {"threads", required_argument, 0, THREADS_OPT},
+    {"vertices", required_argument, 0, VERTICES_OPT},
+    {"uniforms", required_argument, 0, UNIFORMS_OPT},
+    {"buffer-size", required_argument, 0, BUFFER_SIZE_OPT},
+    {"child", no_argument, 0, CHILD_OPT},
+    {0, 0, 0, 0}
+};
+
+
+static unsigned calls = 1000000;
+static unsigned threads = 1;
+static unsigned vertices = 1024;
+static unsigned uniforms = 16;
+static unsigned bufferSize = 4096;
+
+
+/**
+ * Per thread data, all in user memory, so that the tracer needs to copy it.
+ */
+struct Workload
+{
+    std::vector<GLfloat> vertexData;
+    std::vector<GLushort> indexData;
+    std::vector<GLfloat> uniformData;
+    std::vector<char> bufferData;
+    GLuint buffer;
+
+    /** Calls issued, including the setup ones. */
+    unsigned long long issued;
+};
+
+
+typedef unsigned (*IterationFunction)(Workload &workload);
+
+
+static unsigned
+stateIteration(Workload &workload)
+{
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    glDisable(GL_DEPTH_TEST);
+    glDepthFunc(GL_LEQUAL);
+    glColor4f(1.0f, 0.5f, 0.25f, 1.0f);
+    glViewport(0, 0, 640, 480);
+    glScissor(0, 0, 320, 240);
+    glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+    return 8;
+}
+
+
+static unsigned
+uniformIteration(Workload &workload)
+{
+    glUniform4fv(0, uniforms, &workload.uniformData[0]);
+    glUniformMatrix4fv(1, 1, GL_FALSE, &workload.uniformData[0]);
+    return 2;
+}
+
+
+static unsigned
+mapIteration(Workload &workload)
+{
+    glBindBuffer(GL_ARRAY_BUFFER, workload.buffer);
+    GLvoid *map = glMapBufferRange(GL_ARRAY_BUFFER, 0, bufferSize,
+                                   GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT);
+    if (map) {
+        memcpy(map, &workload.bufferData[0], bufferSize);
+    }
+    glUnmapBuffer(GL_ARRAY_BUFFER);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    return 4;
+}
+
+
+static unsigned
+drawIteration(Workload &workload)
+{
+    glVertexPointer(3, GL_FLOAT, 0, &workload.vertexData[0]);
+    glDrawArrays(GL_TRIANGLES, 0, vertices);
+    glDrawElements(GL_TRIANGLES, vertices, GL_UNSIGNED_SHORT, &workload.indexData[0]);
+    return 3;
+}
+
+
+static unsigned
+mixedIteration(Workload &workload)
+{
+    return stateIteration(workload) +
+           uniformIteration(workload) +
+           mapIteration(workload) +
+           drawIteration(workload);
+}
+
+
+struct Mix
+{
+    const char *name;
+    IterationFunction iteration;
+};
+
+static const Mix
+mixes[] = {
+    {"state", &stateIteration},
+    {"uniform", &uniformIteration},
+    {"map", &mapIteration},
+    {"draw", &drawIteration},
+    {"mixed", &mixedIteration},
+};
+
+static const unsigned numMixes = sizeof mixes / sizeof mixes[0];
+
+
+struct ThreadParams
+{
+    const Mix *mix;
+    Workload workload;
+};
+
+
+static void
+runThread(ThreadParams *params)
+{
+    Workload &workload = params->workload;
+
+    workload.vertexData.resize(vertices * 3);
+    for (unsigned i = 0; i < workload.vertexData.size(); ++i) {
+        workload.vertexData[i] = (GLfloat)(i % 7) / 7.0f;
+    }
+    workload.indexData.resize(vertices);
+    for (unsigned i = 0; i < vertices; ++i) {
+        workload.indexData[i] = (GLushort)((vertices - 1 - i) & 0xffff);
+    }
+    workload.uniformData.resize(uniforms < 4 ? 16 : uniforms * 4);
+    for (unsigned i = 0; i < workload.uniformData.size(); ++i) {
+        workload.uniformData[i] = (GLfloat)i;
+    }
+    workload.bufferData.resize(bufferSize ? bufferSize : 1);
+    for (unsigned i = 0; i < workload.bufferData.size(); ++i) {
+        workload.bufferData[i] = (char)i;
+    }
+
+    glGenBuffers(1, &workload.buffer);
+    glBindBuffer(GL_ARRAY_BUFFER, workload.buffer);
+    glBufferData(GL_ARRAY_BUFFER, bufferSize, NULL, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glEnableClientState(GL_VERTEX_ARRAY);
+    workload.issued = 5;
+
+    IterationFunction iteration = params->mix->iteration;
+    unsigned count = 0;
+    while (count < calls) {
+        count += iteration(workload);
+    }
+    workload.issued += count;
+
+    glDeleteBuffers(1, &workload.buffer);
+    workload.issued += 1;
+}
+
+
+/**
+ * Run a mix on all threads, returning the elapsed seconds, and the number of
+ * calls issued.
+ */
+static double
+runMix(const Mix &mix, unsigned long long &issued)
+{
+    issued = 0;
+    std::vector<ThreadParams> params(threads);
+    std::vector<os::thread *> running(threads);
+
+    long long start = os::getTime();
+    for (unsigned i = 0; i < threads; ++i) {
+        params[i].mix = &mix;
+        running[i] = new os::thread(runThread, &params[i]);
+    }
+    for (unsigned i = 0; i < threads; ++i) {
+        running[i]->join();
+        delete running[i];
+        issued += params[i].workload.issued;
+    }
+    long long end = os::getTime();
+
+    return double(end - start) / os::timeFrequency;
+}
+
+
+static double
+runMixRepeatedly(const Mix &mix, unsigned repeat, unsigned long long &issued)
+{
+    double best = 0;
+    for (unsigned r = 0; r < repeat; ++r) {
+        double seconds = runMix(mix, issued);
+        if (r == 0 || seconds < best) {
+            best = seconds;
+        }
+    }
+    return best;
+}
+
+
+/**
+ * Run a mix in a child process, with the wrapper preloaded.
+ */
+static bool
+runTraced(const Mix &mix, const char *wrapper, unsigned repeat,
+          double &seconds, unsigned long long &issued, unsigned long long &bytes)
+{
+    std::string trace = std::string("glbench-") + mix.name + ".trace";
+
+    std::ostringstream command;
+    command
+        << "LD_PRELOAD='" << wrapper << "' "
+        << "TRACE_FILE='" << trace << "' "
+        << "'" << os::getProcessName().str() << "'"
+        << " --child"
+        << " --repeat=" << repeat
+        << " --calls=" << calls
+        << " --threads=" << threads
+        << " --vertices=" << vertices
+        << " --uniforms=" << uniforms
+        << " --buffer-size=" << bufferSize
+        << " " << mix.name;
+
+    FILE *child = popen(command.str().c_str(), "r");
+    if (!child) {
+        std::cerr << "error: failed to run " << command.str() << "\n";
+        return false;
+    }
+    int matched = fscanf(child, "%lf %llu", &seconds, &issued);
+    int status = pclose(child);
+    if (matched != 2 || status != 0) {
+        std::cerr << "error: traced run of " << mix.name << " failed\n";
+        remove(trace.c_str());
+        return false;
+    }
+
+    struct stat st;
+    if (stat(trace.c_str(), &st) != 0) {
+        std::cerr << "error: no trace written to " << trace << "\n";
+        return false;
+    }
+    bytes = st.st_size;
+    remove(trace.c_str());
+    return true;
+}
+
+
+static void
+printHeader(bool traced)
+{
+    std::cout
+        << std::left << std::setw(10) << "mix" << std::right
+        << std::setw(12) << "ns/call";
+    if (traced) {
+        std::cout
+            << std::setw(12) << "traced"
+            << std::setw(12) << "overhead"
+            << std::setw(12) << "bytes/call";
+    }
+    std::cout << "\n";
+    std::cout.flush();
+}
+
+
+int
+main(int argc, char **argv)
+{
+    const char *wrapper = NULL;
+    unsigned repeat = 3;
+    bool child = false;
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, shortOptions, longOptions, NULL)) != -1) {
+        switch (opt) {
+        case 'h':
+            usage();
+            return 0;
+        case 'w':
+            wrapper = optarg;
+            break;
+        case 'r':
+            repeat = atoi(optarg);
+            if (!repeat) {
+                repeat = 1;
+            }
+            break;
+        case CALLS_OPT:
+            calls = atoi(optarg);
+            break;
+        case THREADS_OPT:
+            threads = atoi(optarg);
+            if (!threads) {
+                threads = 1;
+            }
+            break;
+        case VERTICES_OPT:
+            vertices = atoi(optarg);
+            if (vertices > 65536) {
+                std::cerr << "error: at most 65536 vertices are supported\n";
+                return 1;
+            }
+            break;
+        case UNIFORMS_OPT:
+            uniforms = atoi(optarg);
+            break;
+        case BUFFER_SIZE_OPT:
+            bufferSize = atoi(optarg);
+            break;
+        case CHILD_OPT:
+            child = true;
+            break;
+        default:
+            std::cerr << "error: unexpected option `" << opt << "`\n";
+            usage();
+            return 1;
+        }
+    }
+
+    std::vector<const Mix *> selected;
+    for (int i = optind; i < argc; ++i) {
+        unsigned j;
+        for (j = 0; j < numMixes; ++j) {
+            if (strcmp(argv[i], mixes[j].name) == 0) {
+                selected.push_back(&mixes[j]);
+                break;
+            }
+        }
+        if (j == numMixes) {
+            std::cerr << "error: unknown mix " << argv[i] << "\n";
+            return 1;
+        }
+    }
+    if (selected.empty()) {
+        for (unsigned j = 0; j < numMixes; ++j) {
+            selected.push_back(&mixes[j]);
+        }
+    }
+
+    // Traced child: report the time and calls of a single mix
+    if (child) {
+        if (selected.size() != 1) {
+            return 1;
+        }
+        unsigned long long issued = 0;
+        double seconds = runMixRepeatedly(*selected[0], repeat, issued);
+        printf("%.9f %llu\n", seconds, issued);
+        return 0;
+    }
+
+    printHeader(wrapper != NULL);
+
+    int ret = 0;
+    for (unsigned i = 0; i < selected.size(); ++i) {
+        const Mix &mix = *selected[i];
+
+        unsigned long long issued = 0;
+        double seconds = runMixRepeatedly(mix, repeat, issued);
+        double ns = issued ? seconds * 1e9 / issued : 0;
+
+        std::cout
+            << std::left << std::setw(10) << mix.name << std::right
+            << std::fixed
+            << std::setw(12) << std::setprecision(1) << ns;
+
+        if (wrapper) {
+            double tracedSeconds = 0;
+            unsigned long long tracedIssued = 0;
+            unsigned long long bytes = 0;
+            if (runTraced(mix, wrapper, repeat, tracedSeconds, tracedIssued, bytes)) {
+                double tracedNs = tracedIssued ? tracedSeconds * 1e9 / tracedIssued : 0;
+                std::cout
+                    << std::setw(12) << std::setprecision(1) << tracedNs
+                    << std::setw(11) << std::setprecision(1) << (ns > 0 ? tracedNs / ns : 0) << "x"
+                    << std::setw(12) << std::setprecision(1) << (tracedIssued ? double(bytes) / (tracedIssued * repeat) : 0);
+            } else {
+                std::cout
+                    << std::setw(12) << "-"
+                    << std::setw(12) << "-"
+                    << std::setw(12) << "-";
+                ret = 1;
+            }
+        }
+
+        std::cout << "\n";
+        std::cout.flush();
+    }
+
+    return ret;
+}
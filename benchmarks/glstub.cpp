@@ -0,0 +1,672 @@
+/**************************************************************************
+ *
+ * Copyright 2012 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+/*
+ * The stub entry points which need to behave for the tracer to work: the
+ * tracer queries the client arrays and buffer mappings back from GL, so
+ * these keep just enough state to answer those queries.  Everything else
+ * is a no-op, generated by glstub.py.
+ *
+ * The state is kept per thread, as if every thread had its own current
+ * context.
+ */
+
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <map>
+
+#define GL_GLEXT_PROTOTYPES
+#define GLX_GLXEXT_PROTOTYPES
+
+#include "glimports.hpp"
+#include "os.hpp"
+#include "os_thread.hpp"
+
+#include "glstub.hpp"
+
+
+#define MAX_VERTEX_ATTRIBS 16
+
+
+namespace {
+
+
+struct ClientArray
+{
+    GLboolean enabled;
+    GLint size;
+    GLenum type;
+    GLsizei stride;
+    GLboolean normalized;
+    GLuint buffer;
+    const GLvoid *pointer;
+};
+
+
+struct Buffer
+{
+    GLsizeiptr size;
+    GLenum usage;
+    char *data;
+    bool mapped;
+    GLenum access;
+    GLbitfield accessFlags;
+    GLintptr mapOffset;
+    GLsizeiptr mapLength;
+
+    Buffer() :
+        size(0), usage(GL_STATIC_DRAW), data(NULL),
+        mapped(false), access(GL_READ_WRITE), accessFlags(0),
+        mapOffset(0), mapLength(0)
+    {}
+
+    ~Buffer() {
+        free(data);
+    }
+};
+
+
+typedef std::map<GLuint, Buffer *> BufferMap;
+
+
+struct Context
+{
+    ClientArray vertexArray;
+    ClientArray normalArray;
+    ClientArray colorArray;
+    ClientArray texCoordArray;
+    ClientArray attribArrays[MAX_VERTEX_ATTRIBS];
+
+    std::map<GLenum, GLboolean> capabilities;
+
+    GLuint arrayBuffer;
+    GLuint elementArrayBuffer;
+
+    GLuint nextBuffer;
+    BufferMap buffers;
+
+    Context() :
+        arrayBuffer(0),
+        elementArrayBuffer(0),
+        nextBuffer(1)
+    {
+        memset(&vertexArray, 0, sizeof vertexArray);
+        memset(&normalArray, 0, sizeof normalArray);
+        memset(&colorArray, 0, sizeof colorArray);
+        memset(&texCoordArray, 0, sizeof texCoordArray);
+        memset(attribArrays, 0, sizeof attribArrays);
+    }
+
+    ~Context() {
+        for (BufferMap::iterator it = buffers.begin(); it != buffers.end(); ++it) {
+            delete it->second;
+        }
+    }
+
+    ClientArray *
+    getArray(GLenum array) {
+        switch (array) {
+        case GL_VERTEX_ARRAY:
+            return &vertexArray;
+        case GL_NORMAL_ARRAY:
+            return &normalArray;
+        case GL_COLOR_ARRAY:
+            return &colorArray;
+        case GL_TEXTURE_COORD_ARRAY:
+            return &texCoordArray;
+        default:
+            return NULL;
+        }
+    }
+
+    GLuint *
+    getBinding(GLenum target) {
+        switch (target) {
+        case GL_ARRAY_BUFFER:
+            return &arrayBuffer;
+        case GL_ELEMENT_ARRAY_BUFFER:
+            return &elementArrayBuffer;
+        default:
+            return NULL;
+        }
+    }
+
+    Buffer *
+    getBuffer(GLenum target) {
+        GLuint *binding = getBinding(target);
+        if (!binding || !*binding) {
+            return NULL;
+        }
+        BufferMap::iterator it = buffers.find(*binding);
+        if (it == buffers.end()) {
+            return NULL;
+        }
+        return it->second;
+    }
+};
+
+
+os::thread_specific_ptr<Context> currentContext;
+
+
+static inline Context *
+getContext(void)
+{
+    Context *ctx = currentContext.get();
+    if (!ctx) {
+        ctx = new Context;
+        currentContext.reset(ctx);
+    }
+    return ctx;
+}
+
+
+static void
+setPointer(ClientArray *array, GLint size, GLenum type, GLboolean normalized,
+           GLsizei stride, const GLvoid *pointer)
+{
+    Context *ctx = getContext();
+    array->size = size;
+    array->type = type;
+    array->normalized = normalized;
+    array->stride = stride;
+    array->buffer = ctx->arrayBuffer;
+    array->pointer = pointer;
+}
+
+
+static bool
+getArrayParameter(const ClientArray &array, GLenum pname,
+                  GLenum sizePname, GLenum typePname, GLenum stridePname,
+                  GLenum bindingPname, GLint *params)
+{
+    if (pname == sizePname) {
+        *params = array.size;
+    } else if (pname == typePname) {
+        *params = array.type;
+    } else if (pname == stridePname) {
+        *params = array.stride;
+    } else if (pname == bindingPname) {
+        *params = array.buffer;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+
+} /* anonymous namespace */
+
+
+/*
+ * Capabilities and client arrays.
+ */
+
+extern "C" PUBLIC void APIENTRY
+glEnable(GLenum cap)
+{
+    getContext()->capabilities[cap] = GL_TRUE;
+}
+
+extern "C" PUBLIC void APIENTRY
+glDisable(GLenum cap)
+{
+    getContext()->capabilities[cap] = GL_FALSE;
+}
+
+extern "C" PUBLIC GLboolean APIENTRY
+glIsEnabled(GLenum cap)
+{
+    Context *ctx = getContext();
+    ClientArray *array = ctx->getArray(cap);
+    if (array) {
+        return array->enabled;
+    }
+    std::map<GLenum, GLboolean>::const_iterator it = ctx->capabilities.find(cap);
+    return it != ctx->capabilities.end() ? it->second : GL_FALSE;
+}
+
+extern "C" PUBLIC void APIENTRY
+glEnableClientState(GLenum array)
+{
+    ClientArray *clientArray = getContext()->getArray(array);
+    if (clientArray) {
+        clientArray->enabled = GL_TRUE;
+    }
+}
+
+extern "C" PUBLIC void APIENTRY
+glDisableClientState(GLenum array)
+{
+    ClientArray *clientArray = getContext()->getArray(array);
+    if (clientArray) {
+        clientArray->enabled = GL_FALSE;
+    }
+}
+
+extern "C" PUBLIC void APIENTRY
+glVertexPointer(GLint size, GLenum type, GLsizei stride, const GLvoid *pointer)
+{
+    setPointer(&getContext()->vertexArray, size, type, GL_FALSE, stride, pointer);
+}
+
+extern "C" PUBLIC void APIENTRY
+glNormalPointer(GLenum type, GLsizei stride, const GLvoid *pointer)
+{
+    setPointer(&getContext()->normalArray, 3, type, GL_TRUE, stride, pointer);
+}
+
+extern "C" PUBLIC void APIENTRY
+glColorPointer(GLint size, GLenum type, GLsizei stride, const GLvoid *pointer)
+{
+    setPointer(&getContext()->colorArray, size, type, GL_TRUE, stride, pointer);
+}
+
+extern "C" PUBLIC void APIENTRY
+glTexCoordPointer(GLint size, GLenum type, GLsizei stride, const GLvoid *pointer)
+{
+    setPointer(&getContext()->texCoordArray, size, type, GL_FALSE, stride, pointer);
+}
+
+extern "C" PUBLIC void APIENTRY
+glEnableVertexAttribArray(GLuint index)
+{
+    if (index < MAX_VERTEX_ATTRIBS) {
+        getContext()->attribArrays[index].enabled = GL_TRUE;
+    }
+}
+
+extern "C" PUBLIC void APIENTRY
+glDisableVertexAttribArray(GLuint index)
+{
+    if (index < MAX_VERTEX_ATTRIBS) {
+        getContext()->attribArrays[index].enabled = GL_FALSE;
+    }
+}
+
+extern "C" PUBLIC void APIENTRY
+glVertexAttribPointer(GLuint index, GLint size, GLenum type, GLboolean normalized,
+                      GLsizei stride, const GLvoid *pointer)
+{
+    if (index < MAX_VERTEX_ATTRIBS) {
+        setPointer(&getContext()->attribArrays[index], size, type, normalized, stride, pointer);
+    }
+}
+
+extern "C" PUBLIC void APIENTRY
+glGetVertexAttribiv(GLuint index, GLenum pname, GLint *params)
+{
+    if (index >= MAX_VERTEX_ATTRIBS) {
+        return;
+    }
+    const ClientArray &array = getContext()->attribArrays[index];
+    switch (pname) {
+    case GL_VERTEX_ATTRIB_ARRAY_ENABLED:
+        *params = array.enabled;
+        break;
+    case GL_VERTEX_ATTRIB_ARRAY_NORMALIZED:
+        *params = array.normalized;
+        break;
+    default:
+        if (!getArrayParameter(array, pname,
+                               GL_VERTEX_ATTRIB_ARRAY_SIZE,
+                               GL_VERTEX_ATTRIB_ARRAY_TYPE,
+                               GL_VERTEX_ATTRIB_ARRAY_STRIDE,
+                               GL_VERTEX_ATTRIB_ARRAY_BUFFER_BINDING,
+                               params)) {
+            *params = 0;
+        }
+        break;
+    }
+}
+
+extern "C" PUBLIC void APIENTRY
+glGetVertexAttribPointerv(GLuint index, GLenum pname, GLvoid **pointer)
+{
+    if (index < MAX_VERTEX_ATTRIBS && pname == GL_VERTEX_ATTRIB_ARRAY_POINTER) {
+        *pointer = const_cast<GLvoid *>(getContext()->attribArrays[index].pointer);
+    } else {
+        *pointer = NULL;
+    }
+}
+
+
+/*
+ * Buffer objects.
+ */
+
+extern "C" PUBLIC void APIENTRY
+glGenBuffers(GLsizei n, GLuint *buffers)
+{
+    Context *ctx = getContext();
+    for (GLsizei i = 0; i < n; ++i) {
+        buffers[i] = ctx->nextBuffer++;
+    }
+}
+
+extern "C" PUBLIC void APIENTRY
+glDeleteBuffers(GLsizei n, const GLuint *buffers)
+{
+    Context *ctx = getContext();
+    for (GLsizei i = 0; i < n; ++i) {
+        BufferMap::iterator it = ctx->buffers.find(buffers[i]);
+        if (it != ctx->buffers.end()) {
+            delete it->second;
+            ctx->buffers.erase(it);
+        }
+        if (ctx->arrayBuffer == buffers[i]) {
+            ctx->arrayBuffer = 0;
+        }
+        if (ctx->elementArrayBuffer == buffers[i]) {
+            ctx->elementArrayBuffer = 0;
+        }
+    }
+}
+
+extern "C" PUBLIC void APIENTRY
+glBindBuffer(GLenum target, GLuint buffer)
+{
+    Context *ctx = getContext();
+    GLuint *binding = ctx->getBinding(target);
+    if (!binding) {
+        return;
+    }
+    *binding = buffer;
+    if (buffer) {
+        Buffer * &obj = ctx->buffers[buffer];
+        if (!obj) {
+            obj = new Buffer;
+        }
+    }
+}
+
+extern "C" PUBLIC void APIENTRY
+glBufferData(GLenum target, GLsizeiptr size, const GLvoid *data, GLenum usage)
+{
+    Buffer *buffer = getContext()->getBuffer(target);
+    if (!buffer) {
+        return;
+    }
+    buffer->data = (char *)realloc(buffer->data, size);
+    buffer->size = size;
+    buffer->usage = usage;
+    if (data) {
+        memcpy(buffer->data, data, size);
+    }
+}
+
+extern "C" PUBLIC void APIENTRY
+glBufferSubData(GLenum target, GLintptr offset, GLsizeiptr size, const GLvoid *data)
+{
+    Buffer *buffer = getContext()->getBuffer(target);
+    if (buffer && offset >= 0 && offset + size <= buffer->size) {
+        memcpy(buffer->data + offset, data, size);
+    }
+}
+
+extern "C" PUBLIC GLvoid * APIENTRY
+glMapBufferRange(GLenum target, GLintptr offset, GLsizeiptr length, GLbitfield access)
+{
+    Buffer *buffer = getContext()->getBuffer(target);
+    if (!buffer || buffer->mapped ||
+        offset < 0 || offset + length > buffer->size) {
+        return NULL;
+    }
+    buffer->mapped = true;
+    buffer->accessFlags = access;
+    switch (access & (GL_MAP_READ_BIT | GL_MAP_WRITE_BIT)) {
+    case GL_MAP_READ_BIT:
+        buffer->access = GL_READ_ONLY;
+        break;
+    case GL_MAP_WRITE_BIT:
+        buffer->access = GL_WRITE_ONLY;
+        break;
+    default:
+        buffer->access = GL_READ_WRITE;
+        break;
+    }
+    buffer->mapOffset = offset;
+    buffer->mapLength = length;
+    return buffer->data + offset;
+}
+
+extern "C" PUBLIC GLvoid * APIENTRY
+glMapBuffer(GLenum target, GLenum access)
+{
+    Buffer *buffer = getContext()->getBuffer(target);
+    if (!buffer) {
+        return NULL;
+    }
+    GLbitfield flags;
+    switch (access) {
+    case GL_READ_ONLY:
+        flags = GL_MAP_READ_BIT;
+        break;
+    case GL_WRITE_ONLY:
+        flags = GL_MAP_WRITE_BIT;
+        break;
+    default:
+        flags = GL_MAP_READ_BIT | GL_MAP_WRITE_BIT;
+        break;
+    }
+    return glMapBufferRange(target, 0, buffer->size, flags);
+}
+
+extern "C" PUBLIC GLboolean APIENTRY
+glUnmapBuffer(GLenum target)
+{
+    Buffer *buffer = getContext()->getBuffer(target);
+    if (!buffer || !buffer->mapped) {
+        return GL_FALSE;
+    }
+    buffer->mapped = false;
+    buffer->accessFlags = 0;
+    buffer->mapOffset = 0;
+    buffer->mapLength = 0;
+    return GL_TRUE;
+}
+
+extern "C" PUBLIC void APIENTRY
+glGetBufferParameteriv(GLenum target, GLenum pname, GLint *params)
+{
+    Buffer *buffer = getContext()->getBuffer(target);
+    if (!buffer) {
+        *params = 0;
+        return;
+    }
+    switch (pname) {
+    case GL_BUFFER_SIZE:
+        *params = buffer->size;
+        break;
+    case GL_BUFFER_USAGE:
+        *params = buffer->usage;
+        break;
+    case GL_BUFFER_ACCESS:
+        *params = buffer->access;
+        break;
+    case GL_BUFFER_ACCESS_FLAGS:
+        *params = buffer->accessFlags;
+        break;
+    case GL_BUFFER_MAPPED:
+        *params = buffer->mapped;
+        break;
+    case GL_BUFFER_MAP_OFFSET:
+        *params = buffer->mapOffset;
+        break;
+    case GL_BUFFER_MAP_LENGTH:
+        *params = buffer->mapLength;
+        break;
+    default:
+        *params = 0;
+        break;
+    }
+}
+
+extern "C" PUBLIC void APIENTRY
+glGetBufferPointerv(GLenum target, GLenum pname, GLvoid **params)
+{
+    Buffer *buffer = getContext()->getBuffer(target);
+    if (buffer && buffer->mapped && pname == GL_BUFFER_MAP_POINTER) {
+        *params = buffer->data + buffer->mapOffset;
+    } else {
+        *params = NULL;
+    }
+}
+
+
+/*
+ * State queries.
+ */
+
+extern "C" PUBLIC void APIENTRY
+glGetIntegerv(GLenum pname, GLint *params)
+{
+    Context *ctx = getContext();
+
+    switch (pname) {
+    case GL_MAX_VERTEX_ATTRIBS:
+        *params = MAX_VERTEX_ATTRIBS;
+        return;
+    case GL_MAX_TEXTURE_COORDS:
+    case GL_MAX_TEXTURE_UNITS:
+        *params = 1;
+        return;
+    case GL_CLIENT_ACTIVE_TEXTURE:
+    case GL_ACTIVE_TEXTURE:
+        *params = GL_TEXTURE0;
+        return;
+    case GL_ARRAY_BUFFER_BINDING:
+        *params = ctx->arrayBuffer;
+        return;
+    case GL_ELEMENT_ARRAY_BUFFER_BINDING:
+        *params = ctx->elementArrayBuffer;
+        return;
+    case GL_MAJOR_VERSION:
+        *params = 2;
+        return;
+    case GL_MINOR_VERSION:
+        *params = 1;
+        return;
+    }
+
+    if (getArrayParameter(ctx->vertexArray, pname,
+                          GL_VERTEX_ARRAY_SIZE,
+                          GL_VERTEX_ARRAY_TYPE,
+                          GL_VERTEX_ARRAY_STRIDE,
+                          GL_VERTEX_ARRAY_BUFFER_BINDING,
+                          params) ||
+        getArrayParameter(ctx->normalArray, pname,
+                          GL_NONE,
+                          GL_NORMAL_ARRAY_TYPE,
+                          GL_NORMAL_ARRAY_STRIDE,
+                          GL_NORMAL_ARRAY_BUFFER_BINDING,
+                          params) ||
+        getArrayParameter(ctx->colorArray, pname,
+                          GL_COLOR_ARRAY_SIZE,
+                          GL_COLOR_ARRAY_TYPE,
+                          GL_COLOR_ARRAY_STRIDE,
+                          GL_COLOR_ARRAY_BUFFER_BINDING,
+                          params) ||
+        getArrayParameter(ctx->texCoordArray, pname,
+                          GL_TEXTURE_COORD_ARRAY_SIZE,
+                          GL_TEXTURE_COORD_ARRAY_TYPE,
+                          GL_TEXTURE_COORD_ARRAY_STRIDE,
+                          GL_TEXTURE_COORD_ARRAY_BUFFER_BINDING,
+                          params)) {
+        return;
+    }
+
+    *params = 0;
+}
+
+extern "C" PUBLIC void APIENTRY
+glGetBooleanv(GLenum pname, GLboolean *params)
+{
+    GLint value = 0;
+    glGetIntegerv(pname, &value);
+    *params = value ? GL_TRUE : GL_FALSE;
+}
+
+extern "C" PUBLIC void APIENTRY
+glGetPointerv(GLenum pname, GLvoid **params)
+{
+    Context *ctx = getContext();
+    switch (pname) {
+    case GL_VERTEX_ARRAY_POINTER:
+        *params = const_cast<GLvoid *>(ctx->vertexArray.pointer);
+        break;
+    case GL_NORMAL_ARRAY_POINTER:
+        *params = const_cast<GLvoid *>(ctx->normalArray.pointer);
+        break;
+    case GL_COLOR_ARRAY_POINTER:
+        *params = const_cast<GLvoid *>(ctx->colorArray.pointer);
+        break;
+    case GL_TEXTURE_COORD_ARRAY_POINTER:
+        *params = const_cast<GLvoid *>(ctx->texCoordArray.pointer);
+        break;
+    default:
+        *params = NULL;
+        break;
+    }
+}
+
+extern "C" PUBLIC const GLubyte * APIENTRY
+glGetString(GLenum name)
+{
+    switch (name) {
+    case GL_VENDOR:
+        return (const GLubyte *)"apitrace";
+    case GL_RENDERER:
+        return (const GLubyte *)"glstub";
+    case GL_VERSION:
+        return (const GLubyte *)"2.1";
+    case GL_SHADING_LANGUAGE_VERSION:
+        return (const GLubyte *)"1.20";
+    case GL_EXTENSIONS:
+        return (const GLubyte *)"";
+    default:
+        return NULL;
+    }
+}
+
+
+/*
+ * GLX.
+ */
+
+extern "C" PUBLIC __GLXextFuncPtr
+glXGetProcAddressARB(const GLubyte *procName)
+{
+    return (__GLXextFuncPtr)glstub::getProcAddress((const char *)procName);
+}
+
+extern "C" PUBLIC __GLXextFuncPtr
+glXGetProcAddress(const GLubyte *procName)
+{
+    return (__GLXextFuncPtr)glstub::getProcAddress((const char *)procName);
+}
@@ -0,0 +1,93 @@
+##########################################################################
+#
+# Copyright 2012 VMware, Inc.
+# All Rights Reserved.
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"), to deal
+# in the Software without restriction, including without limitation the rights
+# to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+# copies of the Software, and to permit persons to whom the Software is
+# furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in
+# all copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+# AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+# OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+# THE SOFTWARE.
+#
+##########################################################################/
+
+
+'''Generate no-op definitions of all GL and GLX entry points, for the stub
+libGL.so used to measure the tracing overhead.
+
+The definitions are weak, so that glstub.cpp can override the few that the
+tracer relies on to behave.'''
+
+
+# Adjust path
+import os.path
+import sys
+sys.path.insert(0, os.path.join(os.path.dirname(__file__), '..'))
+
+
+import specs.stdapi as stdapi
+from specs.glapi import glapi
+from specs.glxapi import glxapi
+
+
+def main():
+    api = stdapi.API()
+    api.addApi(glxapi)
+    api.addApi(glapi)
+
+    functions = {}
+    for function in api.functions:
+        if function.name.startswith('gl'):
+            functions.setdefault(function.name, function)
+    names = sorted(functions.keys())
+
+    print '// To validate our prototypes'
+    print '#define GL_GLEXT_PROTOTYPES'
+    print '#define GLX_GLXEXT_PROTOTYPES'
+    print
+    print '#include "glimports.hpp"'
+    print '#include "os.hpp"'
+    print '#include "trace_lookup.hpp"'
+    print
+    print '#include "glstub.hpp"'
+    print
+    print
+
+    for name in names:
+        function = functions[name]
+        print 'extern "C" PUBLIC __attribute__((weak))'
+        print function.prototype() + ' {'
+        if function.type is not stdapi.Void:
+            print '    return 0;'
+        print '}'
+        print
+
+    print
+    print 'static const trace::Entry<void *>'
+    print 'procTable[] = {'
+    for name in names:
+        print '    {"%s", (void *)&%s},' % (name, name)
+    print '};'
+    print
+    print
+    print 'void *'
+    print 'glstub::getProcAddress(const char *name)'
+    print '{'
+    print '    return trace::entryLookup(name, procTable, (void *)0);'
+    print '}'
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,338 @@
+/**************************************************************************
+ *
+ * Copyright 2012 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+
+#include <stdio.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include "trace_writer.hpp"
+
+#include "synthetic.hpp"
+
+
+SyntheticOptions::SyntheticOptions() :
+    frames(100),
+    callsPerFrame(1000),
+    threads(1),
+    signatures(16),
+    scalarWeight(0),
+    blobWeight(0),
+    arrayWeight(0),
+    structWeight(0),
+    blobSize(64*1024),
+    arrayDepth(3),
+    arrayLength(4),
+    seed(1)
+{
+    setMix("mixed");
+}
+
+
+bool
+SyntheticOptions::setMix(const char *mix) {
+    unsigned scalar = 0, blob = 0, array = 0, structure = 0;
+    if (strcmp(mix, "scalar") == 0) {
+        scalar = 1;
+    } else if (strcmp(mix, "blob") == 0) {
+        blob = 1;
+    } else if (strcmp(mix, "array") == 0) {
+        array = 1;
+    } else if (strcmp(mix, "struct") == 0) {
+        structure = 1;
+    } else if (strcmp(mix, "mixed") == 0) {
+        // Mostly state changes, with the occasional upload
+        scalar = 16;
+        blob = 1;
+        array = 4;
+        structure = 2;
+    } else {
+        return false;
+    }
+    scalarWeight = scalar;
+    blobWeight = blob;
+    arrayWeight = array;
+    structWeight = structure;
+    return true;
+}
+
+
+/**
+ * Xorshift generator, so that traces don't depend on the C library.
+ */
+class Random
+{
+    unsigned state;
+
+public:
+    Random(unsigned seed) : state(seed ? seed : 0x9e3779b9) {}
+
+    unsigned
+    next(void) {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        return state;
+    }
+
+    unsigned
+    below(unsigned n) {
+        return n ? next() % n : 0;
+    }
+};
+
+
+static const char *scalarArgNames[] = {"target", "index", "x", "y", "mode"};
+static const char *blobArgNames[] = {"target", "size", "data"};
+static const char *arrayArgNames[] = {"count", "value"};
+static const char *structArgNames[] = {"count", "desc"};
+static const char *swapArgNames[] = {"dpy", "drawable"};
+
+static const char *innerMemberNames[] = {"mode", "flags"};
+static const char *outerMemberNames[] = {"size", "scale", "format"};
+
+static const trace::EnumValue enumValues[] = {
+    {"SYNTHETIC_ZERO", 0},
+    {"SYNTHETIC_ONE", 1},
+    {"SYNTHETIC_TEXTURE", 0x0de1},
+    {"SYNTHETIC_BUFFER", 0x8892},
+    {"SYNTHETIC_FLOAT", 0x1406},
+    {"SYNTHETIC_TRIANGLES", 0x0004},
+};
+
+static const trace::BitmaskFlag bitmaskFlags[] = {
+    {"SYNTHETIC_READ_BIT", 0x1},
+    {"SYNTHETIC_WRITE_BIT", 0x2},
+    {"SYNTHETIC_INVALIDATE_BIT", 0x4},
+};
+
+static const trace::EnumSig enumSig = {
+    0, sizeof enumValues / sizeof enumValues[0], enumValues
+};
+
+static const trace::BitmaskSig bitmaskSig = {
+    0, sizeof bitmaskFlags / sizeof bitmaskFlags[0], bitmaskFlags
+};
+
+static const trace::StructSig innerSig = {
+    0, "SyntheticInner", 2, innerMemberNames
+};
+
+static const trace::StructSig outerSig = {
+    1, "SyntheticOuter", 3, outerMemberNames
+};
+
+
+enum Kind {
+    KIND_SCALAR = 0,
+    KIND_BLOB,
+    KIND_ARRAY,
+    KIND_STRUCT,
+    KIND_COUNT
+};
+
+
+static void
+writeEnum(trace::Writer &writer, Random &random) {
+    writer.writeEnum(&enumSig, enumValues[random.below(sizeof enumValues / sizeof enumValues[0])].value);
+}
+
+
+static void
+writeArray(trace::Writer &writer, Random &random, unsigned depth, unsigned length) {
+    writer.beginArray(length);
+    for (unsigned i = 0; i < length; ++i) {
+        writer.beginElement();
+        if (depth > 1) {
+            writeArray(writer, random, depth - 1, length);
+        } else {
+            writer.writeFloat((float)random.below(1000) / 8.0f);
+        }
+        writer.endElement();
+    }
+    writer.endArray();
+}
+
+
+static void
+writeStruct(trace::Writer &writer, Random &random) {
+    writer.beginStruct(&outerSig);
+    writer.writeUInt(random.below(4096));
+    writer.writeFloat((float)random.below(100) / 4.0f);
+    writer.beginStruct(&innerSig);
+    writeEnum(writer, random);
+    writer.writeBitmask(&bitmaskSig, random.below(8));
+    writer.endStruct();
+    writer.endStruct();
+}
+
+
+unsigned long long
+writeSyntheticTrace(trace::Writer &writer, const SyntheticOptions &options) {
+    Random random(options.seed);
+
+    unsigned signatures = options.signatures ? options.signatures : 1;
+    unsigned threads = options.threads ? options.threads : 1;
+
+    // Functions of every kind, so that names and signatures vary
+    std::vector<std::string> names;
+    std::vector<trace::FunctionSig> sigs(KIND_COUNT * signatures + 1);
+    static const char *prefixes[KIND_COUNT] = {
+        "glSyntheticState", "glSyntheticUpload", "glSyntheticUniform", "glSyntheticDescribe"
+    };
+    static const char **argNames[KIND_COUNT] = {
+        scalarArgNames, blobArgNames, arrayArgNames, structArgNames
+    };
+    static const unsigned numArgs[KIND_COUNT] = {5, 3, 2, 2};
+    names.reserve(sigs.size());
+    for (unsigned kind = 0; kind < KIND_COUNT; ++kind) {
+        for (unsigned i = 0; i < signatures; ++i) {
+            char name[64];
+            snprintf(name, sizeof name, "%s%u", prefixes[kind], i);
+            names.push_back(name);
+        }
+    }
+    for (unsigned i = 0; i < KIND_COUNT * signatures; ++i) {
+        trace::FunctionSig &sig = sigs[i];
+        sig.id = i;
+        sig.name = names[i].c_str();
+        sig.num_args = numArgs[i / signatures];
+        sig.arg_names = argNames[i / signatures];
+    }
+    trace::FunctionSig &swapSig = sigs.back();
+    swapSig.id = sigs.size() - 1;
+    swapSig.name = "glXSwapBuffers";
+    swapSig.num_args = 2;
+    swapSig.arg_names = swapArgNames;
+
+    // Partly random, partly repeated, so that blobs compress as so-so as
+    // actual texture data does
+    std::vector<unsigned char> blob(options.blobSize ? options.blobSize : 1);
+    for (size_t i = 0; i < blob.size(); ++i) {
+        blob[i] = (i & 64) ? (unsigned char)i : (unsigned char)random.next();
+    }
+
+    unsigned weights[KIND_COUNT] = {
+        options.scalarWeight,
+        options.blobWeight,
+        options.arrayWeight,
+        options.structWeight
+    };
+    unsigned totalWeight = 0;
+    for (unsigned kind = 0; kind < KIND_COUNT; ++kind) {
+        totalWeight += weights[kind];
+    }
+    if (!totalWeight) {
+        weights[KIND_SCALAR] = totalWeight = 1;
+    }
+
+    unsigned long long calls = 0;
+    for (unsigned frame = 0; frame < options.frames; ++frame) {
+        for (unsigned i = 0; i < options.callsPerFrame; ++i) {
+            unsigned pick = random.below(totalWeight);
+            unsigned kind = 0;
+            while (pick >= weights[kind]) {
+                pick -= weights[kind];
+                ++kind;
+            }
+
+            const trace::FunctionSig *sig = &sigs[kind * signatures + random.below(signatures)];
+            unsigned thread = random.below(threads);
+
+            unsigned call = writer.beginEnter(sig, thread);
+            switch (kind) {
+            case KIND_SCALAR:
+                writer.beginArg(0);
+                writeEnum(writer, random);
+                writer.endArg();
+                writer.beginArg(1);
+                writer.writeUInt(random.below(16));
+                writer.endArg();
+                writer.beginArg(2);
+                writer.writeFloat((float)random.below(256) / 255.0f);
+                writer.endArg();
+                writer.beginArg(3);
+                writer.writeDouble((double)random.below(1 << 20) / 1024.0);
+                writer.endArg();
+                writer.beginArg(4);
+                writer.writeSInt((int)random.below(2048) - 1024);
+                writer.endArg();
+                break;
+            case KIND_BLOB:
+                writer.beginArg(0);
+                writeEnum(writer, random);
+                writer.endArg();
+                writer.beginArg(1);
+                writer.writeUInt(options.blobSize);
+                writer.endArg();
+                writer.beginArg(2);
+                writer.writeBlob(&blob[0], options.blobSize);
+                writer.endArg();
+                break;
+            case KIND_ARRAY:
+                writer.beginArg(0);
+                writer.writeUInt(options.arrayLength);
+                writer.endArg();
+                writer.beginArg(1);
+                writeArray(writer, random, options.arrayDepth, options.arrayLength);
+                writer.endArg();
+                break;
+            case KIND_STRUCT:
+                writer.beginArg(0);
+                writer.writeUInt(options.arrayLength);
+                writer.endArg();
+                writer.beginArg(1);
+                writer.beginArray(options.arrayLength);
+                for (unsigned j = 0; j < options.arrayLength; ++j) {
+                    writeStruct(writer, random);
+                }
+                writer.endArray();
+                writer.endArg();
+                break;
+            }
+            writer.endEnter();
+            writer.beginLeave(call);
+            writer.endLeave();
+            ++calls;
+        }
+
+        unsigned call = writer.beginEnter(&swapSig, 0);
+        writer.beginArg(0);
+        writer.writePointer(0x1000);
+        writer.endArg();
+        writer.beginArg(1);
+        writer.writeUInt(1);
+        writer.endArg();
+        writer.endEnter();
+        writer.beginLeave(call);
+        writer.endLeave();
+        ++calls;
+    }
+
+    return calls;
+}
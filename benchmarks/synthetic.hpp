@@ -0,0 +1,88 @@
+/**************************************************************************
+ *
+ * Copyright 2012 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+/*
+ * Deterministic synthetic traces, for benchmarking.
+ */
+
+#ifndef _SYNTHETIC_HPP_
+#define _SYNTHETIC_HPP_
+
+
+#include <stddef.h>
+
+
+namespace trace {
+    class Writer;
+}
+
+
+struct SyntheticOptions
+{
+    unsigned frames;
+    unsigned callsPerFrame;
+
+    /** Calls are spread randomly over this many thread ids. */
+    unsigned threads;
+
+    /** Number of distinct functions of every kind. */
+    unsigned signatures;
+
+    /*
+     * Relative frequencies of the kinds of calls: scalar arguments only,
+     * blobs (as in texture and buffer uploads), nested arrays, and nested
+     * structures.
+     */
+    unsigned scalarWeight;
+    unsigned blobWeight;
+    unsigned arrayWeight;
+    unsigned structWeight;
+
+    size_t blobSize;
+    unsigned arrayDepth;
+    unsigned arrayLength;
+
+    unsigned seed;
+
+    SyntheticOptions();
+
+    /**
+     * Set the weights from a mix name: scalar, blob, array, struct, or
+     * mixed.
+     */
+    bool setMix(const char *mix);
+};
+
+
+/**
+ * Write a synthetic trace, the same for the same options, returning the
+ * number of calls written.  Every frame ends with a glXSwapBuffers call.
+ */
+unsigned long long
+writeSyntheticTrace(trace::Writer &writer, const SyntheticOptions &options);
+
+
+#endif /* _SYNTHETIC_HPP_ */
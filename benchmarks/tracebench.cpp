@@ -0,0 +1,536 @@
+/**************************************************************************
+ *
+ * Copyright 2012 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+/*
+ * Throughput benchmarks of the trace reading and writing code.
+ */
+
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+#include "os_time.hpp"
+#include "trace_copier.hpp"
+#include "trace_dump.hpp"
+#include "trace_file.hpp"
+#include "trace_parser.hpp"
+#include "trace_writer.hpp"
+
+#include "synthetic.hpp"
+
+
+static const char *synopsis = "Benchmark the trace reading and writing code.";
+
+static void
+usage(void)
+{
+    std::cout
+        << "usage: tracebench [OPTIONS] [BENCHMARK ...]\n"
+        << synopsis << "\n"
+        "\n"
+        "    -h, --help             show this help message and exit\n"
+        "    -t, --trace=TRACE      benchmark reading an existing trace, instead of a\n"
+        "                           synthetic one\n"
+        "    -o, --output=TRACE     only write the synthetic trace to TRACE\n"
+        "    -r, --repeat=N         run every benchmark N times, and keep the fastest\n"
+        "                           [default: 3]\n"
+        "\n"
+        "    Synthetic trace options:\n"
+        "\n"
+        "        --mix=MIX          kinds of calls: scalar, blob, array, struct, or\n"
+        "                           mixed [default: mixed]\n"
+        "        --frames=N         number of frames [default: 100]\n"
+        "        --calls=N          calls per frame [default: 1000]\n"
+        "        --threads=N        number of threads [default: 1]\n"
+        "        --signatures=N     functions of every kind [default: 16]\n"
+        "        --blob-size=BYTES  size of blobs [default: 65536]\n"
+        "        --array-depth=N    nesting of arrays [default: 3]\n"
+        "        --seed=N           random seed [default: 1]\n"
+        "\n"
+        "    Benchmarks:\n"
+        "\n"
+        "        write              write the synthetic trace\n"
+        "        parse              parse all calls\n"
+        "        scan               scan all calls, as when looking for frames\n"
+        "        dump               dump all calls to text\n"
+        "        trim               copy every other frame to a new trace\n"
+        "        repack             recompress the trace\n"
+        "        seek               parse single calls at random frames\n"
+        "\n"
+        "    All benchmarks are run by default.  MB/s are megabytes of the\n"
+        "    compressed trace.  Scratch files are written to the current\n"
+        "    directory, and removed afterwards.\n"
+        "\n";
+}
+
+enum {
+    MIX_OPT = CHAR_MAX + 1,
+    FRAMES_OPT,
+    CALLS_OPT,
+    THREADS_OPT,
+    SIGNATURES_OPT,
+    BLOB_SIZE_OPT,
+    ARRAY_DEPTH_OPT,
+    SEED_OPT,
+};
+
+const static char *
+shortOptions = "ht:o:r:";
+
+const static struct option
+longOptions[] = {
+    {"help", no_argument, 0, 'h'},
+    {"trace", required_argument, 0, 't'},
+    {"output", required_argument, 0, 'o'},
+    {"repeat", required_argument, 0, 'r'},
+    {"mix", required_argument, 0, MIX_OPT},
+    {"frames", required_argument, 0, FRAMES_OPT},
+    {"calls", required_argument, 0, CALLS_OPT},
+    {"threads", required_argument, 0, THREADS_OPT},
+    {"signatures", required_argument, 0, SIGNATURES_OPT},
+    {"blob-size", required_argument, 0, BLOB_SIZE_OPT},
+    {"array-depth", required_argument, 0, ARRAY_DEPTH_OPT},
+    {"seed", required_argument, 0, SEED_OPT},
+    {0, 0, 0, 0}
+};
+
+
+static SyntheticOptions synthetic;
+
+static const char *scratchTrace = "tracebench-scratch.trace";
+
+
+struct Result
+{
+    unsigned long long calls;
+    unsigned long long bytes;
+    /** When the measurement started, which benchmarks may reset after setting up. */
+    long long start;
+};
+
+
+static unsigned long long
+fileSize(const char *filename) {
+    std::ifstream stream(filename, std::ios::in | std::ios::binary);
+    stream.seekg(0, std::ios::end);
+    return stream ? (unsigned long long)stream.tellg() : 0;
+}
+
+
+static bool
+writeSynthetic(const char *filename, Result &result) {
+    trace::Writer writer;
+    if (!writer.open(filename)) {
+        std::cerr << "error: failed to create " << filename << "\n";
+        return false;
+    }
+    result.calls = writeSyntheticTrace(writer, synthetic);
+    writer.close();
+    result.bytes = fileSize(filename);
+    return true;
+}
+
+
+static bool
+benchWrite(const char *filename, Result &result) {
+    bool ok = writeSynthetic(scratchTrace, result);
+    remove(scratchTrace);
+    return ok;
+}
+
+
+static bool
+benchParse(const char *filename, Result &result) {
+    trace::Parser parser;
+    if (!parser.open(filename)) {
+        return false;
+    }
+    trace::Call *call;
+    while ((call = parser.parse_call())) {
+        ++result.calls;
+        delete call;
+    }
+    return true;
+}
+
+
+static bool
+benchScan(const char *filename, Result &result) {
+    trace::Parser parser;
+    if (!parser.open(filename)) {
+        return false;
+    }
+    trace::Call *call;
+    while ((call = parser.scan_call())) {
+        ++result.calls;
+        delete call;
+    }
+    return true;
+}
+
+
+/**
+ * Discards everything written to it.
+ */
+class NullBuffer : public std::streambuf
+{
+protected:
+    int overflow(int c) {
+        return traits_type::not_eof(c);
+    }
+
+    std::streamsize xsputn(const char *s, std::streamsize n) {
+        return n;
+    }
+};
+
+
+static bool
+benchDump(const char *filename, Result &result) {
+    trace::Parser parser;
+    if (!parser.open(filename)) {
+        return false;
+    }
+    NullBuffer buffer;
+    std::ostream os(&buffer);
+    trace::CallDumper dumper(os, trace::DUMP_FLAG_NO_COLOR);
+    trace::Call *call;
+    while ((call = parser.parse_call())) {
+        dumper.dump(*call);
+        ++result.calls;
+        delete call;
+    }
+    return true;
+}
+
+
+/**
+ * Keeps the even frames.
+ */
+class FrameCopier : public trace::Copier
+{
+public:
+    unsigned long long calls;
+
+    FrameCopier() :
+        calls(0),
+        frame(0)
+    {}
+
+protected:
+    unsigned frame;
+
+    Action
+    filterCall(unsigned call_no, unsigned thread_id,
+               const trace::FunctionSig *sig, trace::CallFlags flags) {
+        ++calls;
+        Action action = frame % 2 ? DROP : COPY;
+        if (flags & trace::CALL_FLAG_END_FRAME) {
+            ++frame;
+        }
+        return action;
+    }
+};
+
+
+static bool
+benchTrim(const char *filename, Result &result) {
+    FrameCopier copier;
+    if (!copier.open(filename)) {
+        return false;
+    }
+    trace::Writer writer;
+    if (!writer.open(scratchTrace)) {
+        return false;
+    }
+    copier.copy(writer);
+    writer.close();
+    copier.close();
+    remove(scratchTrace);
+    result.calls = copier.calls;
+    return true;
+}
+
+
+static bool
+benchRepack(const char *filename, Result &result) {
+    trace::File *inFile = trace::File::createForRead(filename);
+    if (!inFile) {
+        return false;
+    }
+    trace::File *outFile = trace::File::createForWrite(scratchTrace);
+    if (!outFile) {
+        delete inFile;
+        return false;
+    }
+
+    std::vector<char> buf(64*1024);
+    size_t read;
+    while ((read = inFile->read(&buf[0], buf.size())) != 0) {
+        outFile->write(&buf[0], read);
+    }
+
+    inFile->close();
+    outFile->close();
+    delete inFile;
+    delete outFile;
+    remove(scratchTrace);
+    return true;
+}
+
+
+static bool
+benchSeek(const char *filename, Result &result) {
+    trace::Parser parser;
+    if (!parser.open(filename)) {
+        return false;
+    }
+    if (!parser.supportsOffsets()) {
+        std::cerr << "warning: " << filename << " doesn't support seeking\n";
+        return false;
+    }
+
+    // Bookmarks at the start of every frame, as the GUI takes them
+    std::vector<trace::ParseBookmark> bookmarks;
+    trace::ParseBookmark bookmark;
+    parser.getBookmark(bookmark);
+    bookmarks.push_back(bookmark);
+    trace::Call *call;
+    while ((call = parser.scan_call())) {
+        if ((call->flags & trace::CALL_FLAG_END_FRAME) &&
+            !parser.hasPendingCalls()) {
+            parser.getBookmark(bookmark);
+            bookmarks.push_back(bookmark);
+        }
+        delete call;
+    }
+
+    // Don't count the scan above
+    result.bytes = 0;
+    result.start = os::getTime();
+
+    unsigned state = 1;
+    for (unsigned i = 0; i < 1000; ++i) {
+        state = state * 1103515245 + 12345;
+        parser.setBookmark(bookmarks[(state >> 8) % bookmarks.size()]);
+        call = parser.parse_call();
+        if (call) {
+            ++result.calls;
+            delete call;
+        }
+    }
+    return true;
+}
+
+
+struct Benchmark
+{
+    const char *name;
+    bool (*function)(const char *filename, Result &result);
+    /** Whether it reads the whole trace. */
+    bool reads;
+};
+
+static const Benchmark benchmarks[] = {
+    {"write", benchWrite, false},
+    {"parse", benchParse, true},
+    {"scan", benchScan, true},
+    {"dump", benchDump, true},
+    {"trim", benchTrim, true},
+    {"repack", benchRepack, true},
+    {"seek", benchSeek, false},
+};
+
+static const unsigned numBenchmarks = sizeof benchmarks / sizeof benchmarks[0];
+
+
+static bool
+run(const Benchmark &benchmark, const char *filename, unsigned repeat) {
+    double best = 0;
+    Result result;
+    for (unsigned i = 0; i < repeat; ++i) {
+        result.calls = 0;
+        result.bytes = benchmark.reads ? fileSize(filename) : 0;
+
+        result.start = os::getTime();
+        if (!benchmark.function(filename, result)) {
+            std::cerr << "error: " << benchmark.name << " failed\n";
+            return false;
+        }
+        double seconds = (double)(os::getTime() - result.start) / os::timeFrequency;
+
+        if (i == 0 || seconds < best) {
+            best = seconds;
+        }
+    }
+
+    std::cout
+        << std::left << std::setw(10) << benchmark.name << std::right
+        << std::fixed
+        << std::setw(12) << std::setprecision(3) << best;
+    if (result.calls) {
+        std::cout << std::setw(16) << std::setprecision(0) << (best > 0 ? result.calls / best : 0);
+    } else {
+        std::cout << std::setw(16) << "-";
+    }
+    if (result.bytes) {
+        std::cout << std::setw(12) << std::setprecision(1) << (best > 0 ? result.bytes / best / (1024*1024) : 0);
+    } else {
+        std::cout << std::setw(12) << "-";
+    }
+    std::cout << "\n";
+    std::cout.flush();
+    return true;
+}
+
+
+int
+main(int argc, char **argv)
+{
+    const char *trace = NULL;
+    const char *output = NULL;
+    unsigned repeat = 3;
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, shortOptions, longOptions, NULL)) != -1) {
+        switch (opt) {
+        case 'h':
+            usage();
+            return 0;
+        case 't':
+            trace = optarg;
+            break;
+        case 'o':
+            output = optarg;
+            break;
+        case 'r':
+            repeat = atoi(optarg);
+            if (!repeat) {
+                repeat = 1;
+            }
+            break;
+        case MIX_OPT:
+            if (!synthetic.setMix(optarg)) {
+                std::cerr << "error: unknown mix " << optarg << "\n";
+                return 1;
+            }
+            break;
+        case FRAMES_OPT:
+            synthetic.frames = atoi(optarg);
+            break;
+        case CALLS_OPT:
+            synthetic.callsPerFrame = atoi(optarg);
+            break;
+        case THREADS_OPT:
+            synthetic.threads = atoi(optarg);
+            break;
+        case SIGNATURES_OPT:
+            synthetic.signatures = atoi(optarg);
+            break;
+        case BLOB_SIZE_OPT:
+            synthetic.blobSize = atoi(optarg);
+            break;
+        case ARRAY_DEPTH_OPT:
+            synthetic.arrayDepth = atoi(optarg);
+            break;
+        case SEED_OPT:
+            synthetic.seed = atoi(optarg);
+            break;
+        default:
+            std::cerr << "error: unexpected option `" << opt << "`\n";
+            usage();
+            return 1;
+        }
+    }
+
+    if (output) {
+        Result result;
+        if (!writeSynthetic(output, result)) {
+            return 1;
+        }
+        std::cout << output << ": " << result.calls << " calls, " << result.bytes << " bytes\n";
+        return 0;
+    }
+
+    std::vector<const Benchmark *> selected;
+    for (int i = optind; i < argc; ++i) {
+        unsigned j;
+        for (j = 0; j < numBenchmarks; ++j) {
+            if (strcmp(argv[i], benchmarks[j].name) == 0) {
+                selected.push_back(&benchmarks[j]);
+                break;
+            }
+        }
+        if (j == numBenchmarks) {
+            std::cerr << "error: unknown benchmark " << argv[i] << "\n";
+            return 1;
+        }
+    }
+    if (selected.empty()) {
+        for (unsigned j = 0; j < numBenchmarks; ++j) {
+            selected.push_back(&benchmarks[j]);
+        }
+    }
+
+    std::string syntheticTrace;
+    if (!trace) {
+        syntheticTrace = "tracebench-synthetic.trace";
+        trace = syntheticTrace.c_str();
+        Result result;
+        if (!writeSynthetic(trace, result)) {
+            return 1;
+        }
+    }
+
+    std::cout
+        << std::left << std::setw(10) << "benchmark" << std::right
+        << std::setw(12) << "seconds"
+        << std::setw(16) << "calls/s"
+        << std::setw(12) << "MB/s" << "\n";
+
+    int ret = 0;
+    for (unsigned i = 0; i < selected.size(); ++i) {
+        if (!run(*selected[i], trace, repeat)) {
+            ret = 1;
+        }
+    }
+
+    if (!syntheticTrace.empty()) {
+        remove(syntheticTrace.c_str());
+    }
+
+    return ret;
+}
@@ -47,6 +47,7 @@ extern const Command dump_command;
 extern const Command dump_images_command;
 extern const Command pickle_command;
 extern const Command repack_command;
+extern const Command stats_command;
 extern const Command trace_command;
 extern const Command trim_command;
 
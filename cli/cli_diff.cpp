@@ -25,45 +25,1002 @@
  *
  *********************************************************************/
 
+#include <assert.h>
 #include <string.h>
+#include <limits.h> // for CHAR_MAX
+#include <getopt.h>
+#ifndef _WIN32
+#include <unistd.h> // for isatty()
+#endif
+
+#include <algorithm>
 #include <iostream>
+#include <map>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
 
 #include "cli.hpp"
+#include "cli_pager.hpp"
 #include "os_string.hpp"
 #include "os_process.hpp"
+#include "os_thread.hpp"
+#include "trace_callset.hpp"
+#include "trace_dump.hpp"
+#include "trace_parser.hpp"
+#include "trace_analyzer.hpp"
 #include "trace_resource.hpp"
 
+
 static const char *synopsis = "Identify differences between two traces.";
 
-static os::String
-find_command(void)
+static void
+usage(void)
 {
-    return trace::findScript("tracediff.py");
+    std::cout
+        << "usage: apitrace diff [OPTIONS] TRACE_FILE TRACE_FILE\n"
+        << synopsis << "\n"
+        "\n"
+        "    -h, --help               show this help message and exit\n"
+        "    -v, --verbose            also compare verbose calls (e.g., glGetError)\n"
+        "    -c, --calls=CALLSET      calls to compare [default: all]\n"
+        "        --ref-calls=CALLSET  calls to compare from the reference trace\n"
+        "        --src-calls=CALLSET  calls to compare from the source trace\n"
+        "        --ignore-pointers    ignore the value of opaque pointers\n"
+        "        --ignore-handles     ignore object names (OpenGL only)\n"
+        "    -U, --context=NUM        calls of context around differences [default: 3]\n"
+        "        --color[=WHEN]\n"
+        "        --colour[=WHEN]      colored output\n"
+        "                             WHEN is 'auto', 'always', or 'never'\n"
+        "\n"
+        "  Side by side comparison of the dumped traces, with scripts/tracediff.py:\n"
+        "\n"
+        "    -d, --diff=PROGRAM       diff program: wdiff, sdiff, or diff\n"
+        "    -w, --width=NUM          columns\n"
+        "\n"
+    ;
 }
 
-static void
-usage(void)
+enum {
+    REF_CALLS_OPT = CHAR_MAX + 1,
+    SRC_CALLS_OPT,
+    IGNORE_POINTERS_OPT,
+    IGNORE_HANDLES_OPT,
+    COLOR_OPT,
+};
+
+const static char *
+shortOptions = "hvc:U:d:w:";
+
+const static struct option
+longOptions[] = {
+    {"help", no_argument, 0, 'h'},
+    {"verbose", no_argument, 0, 'v'},
+    {"calls", required_argument, 0, 'c'},
+    {"ref-calls", required_argument, 0, REF_CALLS_OPT},
+    {"src-calls", required_argument, 0, SRC_CALLS_OPT},
+    {"ignore-pointers", no_argument, 0, IGNORE_POINTERS_OPT},
+    {"ignore-handles", no_argument, 0, IGNORE_HANDLES_OPT},
+    {"context", required_argument, 0, 'U'},
+    {"colour", optional_argument, 0, COLOR_OPT},
+    {"color", optional_argument, 0, COLOR_OPT},
+    {"diff", required_argument, 0, 'd'},
+    {"width", required_argument, 0, 'w'},
+    {0, 0, 0, 0}
+};
+
+static bool verbose = false;
+static bool ignorePointers = false;
+static bool ignoreHandles = false;
+
+
+typedef unsigned long long Hash;
+
+static inline Hash
+mix(Hash hash, unsigned long long value) {
+    hash = (hash ^ value) * 0x9e3779b97f4a7c15ULL;
+    return hash ^ (hash >> 29);
+}
+
+static Hash
+mix(Hash hash, const char *data, size_t size) {
+    hash = mix(hash, size);
+    while (size >= sizeof(unsigned long long)) {
+        unsigned long long value;
+        memcpy(&value, data, sizeof value);
+        hash = mix(hash, value);
+        data += sizeof value;
+        size -= sizeof value;
+    }
+    if (size) {
+        unsigned long long value = 0;
+        memcpy(&value, data, size);
+        hash = mix(hash, value);
+    }
+    return hash;
+}
+
+
+/**
+ * Reduces every call of a trace to a hash of its name, arguments, and return
+ * value.  Values are hashed as they are decoded, without building the call
+ * model.
+ */
+class CallHasher : protected trace::Parser
 {
-    os::String command = find_command();
-    if (!command.length()) {
+public:
+    using Parser::open;
+
+    trace::CallSet callSet;
+
+    /** Hash and number of every compared call, in the order they were left. */
+    std::vector<Hash> hashes;
+    std::vector<unsigned> callNos;
+
+    /** Index of the first call of each frame. */
+    std::vector<size_t> frameStarts;
+
+    /** Calls to format, as indices, and their text, by call number. */
+    std::vector<size_t> wanted;
+    std::map<unsigned, std::string> texts;
+
+    CallHasher() :
+        callSet(trace::FREQUENCY_ALL),
+        zero(false)
+    {}
+
+    void hash(void);
+
+    void format(const char *filename);
+
+    unsigned
+    frameOf(size_t index) const {
+        return std::upper_bound(frameStarts.begin(), frameStarts.end(), index) - frameStarts.begin() - 1;
+    }
+
+    size_t
+    frameStart(size_t frame) const {
+        return frame < frameStarts.size() ? frameStarts[frame] : hashes.size();
+    }
+
+private:
+    struct SigInfo {
+        bool initialized;
+        Hash hash;
+        std::vector<bool> ignoredArgs;
+        bool ignoredRet;
+
+        SigInfo() : initialized(false), hash(0), ignoredRet(false) {}
+    };
+
+    std::vector<SigInfo> sigs;
+
+    struct PendingCall {
+        unsigned no;
+        FunctionSigFlags *sig;
+        bool compared;
+        Hash hash;
+    };
+
+    // Calls entered but not left yet, usually no more than one per thread
+    std::vector<PendingCall> pending;
+
+    /**
+     * Where to resume parsing to get to each frame.  Taken when no calls are
+     * pending, so it may belong to an earlier frame.
+     */
+    struct FrameMark {
+        trace::ParseBookmark bookmark;
+        unsigned frame;
+    };
+
+    std::vector<FrameMark> frameMarks;
+
+    // Whether the last value hashed was numerically zero
+    bool zero;
+
+    std::vector<char> buffer;
+
+    const SigInfo &
+    lookupSig(FunctionSigFlags *sig);
+
+    void hash_enter(void);
+    void hash_leave(void);
+    void finish_call(PendingCall &call);
+    void hash_call_details(PendingCall &call);
+    void skip_call_details(void);
+    Hash hash_value(Hash hash);
+    const char *read_bytes(size_t size);
+};
+
+
+const CallHasher::SigInfo &
+CallHasher::lookupSig(FunctionSigFlags *sig) {
+    if (sig->id >= sigs.size()) {
+        sigs.resize(sig->id + 1);
+    }
+
+    SigInfo &info = sigs[sig->id];
+    if (!info.initialized) {
+        info.initialized = true;
+        info.hash = mix(0, sig->name, strlen(sig->name));
+        info.ignoredArgs.resize(sig->num_args);
+        if (ignoreHandles) {
+            const AnalyzerFunction &function = lookupAnalyzerFunction(sig->name);
+            for (const AnalyzerHandle *handle = function.handles; handle->kind; ++handle) {
+                if (handle->index < 0) {
+                    info.ignoredRet = true;
+                } else if ((unsigned)handle->index < info.ignoredArgs.size()) {
+                    info.ignoredArgs[handle->index] = true;
+                }
+            }
+        }
+    }
+    return info;
+}
+
+
+void
+CallHasher::hash(void) {
+    frameStarts.push_back(0);
+    frameMarks.push_back(FrameMark());
+    bool marked = false;
+
+    int c;
+    do {
+        if (!marked && pending.empty()) {
+            getBookmark(frameMarks.back().bookmark);
+            frameMarks.back().frame = frameStarts.size() - 1;
+            marked = true;
+        }
+
+        c = file->getc();
+        switch (c) {
+        case trace::EVENT_ENTER:
+            hash_enter();
+            break;
+        case trace::EVENT_LEAVE:
+            {
+                size_t frames = frameStarts.size();
+                hash_leave();
+                if (frameStarts.size() != frames) {
+                    frameMarks.push_back(frameMarks.back());
+                    marked = false;
+                }
+            }
+            break;
+        case -1:
+            break;
+        default:
+            std::cerr << "error: unknown event " << c << "\n";
+            exit(1);
+        }
+    } while (c != -1);
+
+    // Calls which were never left
+    while (!pending.empty()) {
+        finish_call(pending.front());
+        pending.erase(pending.begin());
+    }
+}
+
+
+void
+CallHasher::hash_enter(void) {
+    // Thread ids are not compared
+    if (version >= 4) {
+        skip_uint();
+    }
+
+    FunctionSigFlags *sig = parse_function_sig();
+
+    PendingCall call;
+    call.no = next_call_no++;
+    call.sig = sig;
+    call.compared = callSet.contains(call.no, sig->flags) &&
+                    (verbose || !(sig->flags & trace::CALL_FLAG_VERBOSE));
+    if (call.compared) {
+        call.hash = lookupSig(sig).hash;
+        hash_call_details(call);
+    } else {
+        skip_call_details();
+    }
+
+    pending.push_back(call);
+}
+
+
+void
+CallHasher::hash_leave(void) {
+    unsigned call_no = read_call_no();
+
+    for (std::vector<PendingCall>::iterator it = pending.begin(); it != pending.end(); ++it) {
+        if (it->no == call_no) {
+            PendingCall call = *it;
+            pending.erase(it);
+            if (call.compared) {
+                hash_call_details(call);
+            } else {
+                skip_call_details();
+            }
+            finish_call(call);
+            return;
+        }
+    }
+
+    skip_call_details();
+}
+
+
+void
+CallHasher::finish_call(PendingCall &call) {
+    if (call.compared) {
+        hashes.push_back(call.hash);
+        callNos.push_back(call.no);
+    }
+    if (call.sig->flags & trace::CALL_FLAG_END_FRAME) {
+        frameStarts.push_back(hashes.size());
+    }
+}
+
+
+void
+CallHasher::hash_call_details(PendingCall &call) {
+    const SigInfo &info = lookupSig(call.sig);
+    do {
+        int c = file->getc();
+        switch (c) {
+        case trace::CALL_END:
+            return;
+        case trace::CALL_ARG:
+            {
+                unsigned index = read_uint();
+                call.hash = mix(call.hash, index + 1);
+                if (index < info.ignoredArgs.size() && info.ignoredArgs[index]) {
+                    scan_value();
+                } else {
+                    call.hash = hash_value(call.hash);
+                }
+            }
+            break;
+        case trace::CALL_RET:
+            if (info.ignoredRet) {
+                scan_value();
+            } else {
+                call.hash = hash_value(call.hash);
+                // Same as Parser::adjust_call_flags
+                if (call.sig == glGetErrorSig && zero && !verbose) {
+                    call.compared = false;
+                }
+            }
+            break;
+        case trace::CALL_TIME:
+            // Timings never match
+            skip_uint();
+            skip_uint();
+            break;
+        default:
+            std::cerr << "error: unknown call detail " << c << "\n";
+            exit(1);
+        case -1:
+            return;
+        }
+    } while(true);
+}
+
+
+void
+CallHasher::skip_call_details(void) {
+    do {
+        int c = file->getc();
+        switch (c) {
+        case trace::CALL_END:
+            return;
+        case trace::CALL_ARG:
+            skip_uint();
+            scan_value();
+            break;
+        case trace::CALL_RET:
+            scan_value();
+            break;
+        case trace::CALL_TIME:
+            skip_uint();
+            skip_uint();
+            break;
+        default:
+            std::cerr << "error: unknown call detail " << c << "\n";
+            exit(1);
+        case -1:
+            return;
+        }
+    } while(true);
+}
+
+
+Hash
+CallHasher::hash_value(Hash hash) {
+    int c = file->getc();
+    hash = mix(hash, c);
+    zero = false;
+    switch (c) {
+    case trace::TYPE_NULL:
+    case trace::TYPE_FALSE:
+    case trace::TYPE_TRUE:
+        break;
+    case trace::TYPE_SINT:
+    case trace::TYPE_UINT:
+        {
+            unsigned long long value = read_uint();
+            hash = mix(hash, value);
+            zero = value == 0;
+        }
+        break;
+    case trace::TYPE_FLOAT:
+        {
+            float value;
+            file->read(&value, sizeof value);
+            hash = mix(hash, (const char *)&value, sizeof value);
+        }
+        break;
+    case trace::TYPE_DOUBLE:
+        {
+            double value;
+            file->read(&value, sizeof value);
+            hash = mix(hash, (const char *)&value, sizeof value);
+        }
+        break;
+    case trace::TYPE_STRING:
+    case trace::TYPE_BLOB:
+        {
+            size_t size = read_uint();
+            hash = mix(hash, read_bytes(size), size);
+        }
+        break;
+    case trace::TYPE_ENUM:
+        {
+            signed long long value;
+            if (version >= 3) {
+                parse_enum_sig();
+                value = read_sint();
+            } else {
+                trace::EnumSig *sig = parse_old_enum_sig();
+                assert(sig->num_values == 1);
+                value = sig->values->value;
+            }
+            hash = mix(hash, value);
+            zero = value == 0;
+        }
+        break;
+    case trace::TYPE_BITMASK:
+        parse_bitmask_sig();
+        hash = mix(hash, read_uint());
+        break;
+    case trace::TYPE_ARRAY:
+        {
+            size_t len = read_uint();
+            hash = mix(hash, len);
+            for (size_t i = 0; i < len; ++i) {
+                hash = hash_value(hash);
+            }
+            zero = false;
+        }
+        break;
+    case trace::TYPE_STRUCT:
+        {
+            trace::StructSig *sig = parse_struct_sig();
+            for (size_t i = 0; i < sig->num_members; ++i) {
+                hash = hash_value(hash);
+            }
+            zero = false;
+        }
+        break;
+    case trace::TYPE_OPAQUE:
+        if (ignorePointers) {
+            skip_uint();
+        } else {
+            hash = mix(hash, read_uint());
+        }
+        break;
+    case trace::TYPE_REPR:
+        hash = hash_value(hash);
+        hash = hash_value(hash);
+        zero = false;
+        break;
+    default:
+        std::cerr << "error: unknown type " << c << "\n";
         exit(1);
+    case -1:
+        break;
     }
+    return hash;
+}
 
-    char *args[4];
-    args[0] = (char *) "python";
-    args[1] = (char *) command.str();
-    args[2] = (char *) "--help";
-    args[3] = NULL;
 
-    os::execute(args);
+const char *
+CallHasher::read_bytes(size_t size) {
+    if (buffer.size() < size + 1) {
+        buffer.resize(size + 1);
+    }
+    if (size) {
+        file->read(&buffer[0], size);
+    }
+    return &buffer[0];
 }
 
-static int
-command(int argc, char *argv[])
+
+/**
+ * Parse again the calls to show, skipping the frames that have none when the
+ * file allows seeking.
+ */
+void
+CallHasher::format(const char *filename) {
+    trace::Parser parser;
+    if (!parser.open(filename)) {
+        std::cerr << "error: failed to open " << filename << "\n";
+        exit(1);
+    }
+    parser.copySignatures(*this);
+
+    bool seekable = parser.supportsOffsets();
+    unsigned frame = 0;
+
+    size_t i = 0;
+    while (i < wanted.size()) {
+        unsigned target = frameOf(wanted[i]);
+
+        std::set<unsigned> nos;
+        while (i < wanted.size() && frameOf(wanted[i]) == target) {
+            nos.insert(callNos[wanted[i]]);
+            ++i;
+        }
+
+        if (seekable && frameMarks[target].frame > frame) {
+            parser.setBookmark(frameMarks[target].bookmark);
+            frame = frameMarks[target].frame;
+        }
+
+        trace::Call *call;
+        while (!nos.empty() && (call = parser.parse_call())) {
+            if (nos.erase(call->no)) {
+                std::ostringstream os;
+                trace::dump(*call, os, trace::DUMP_FLAG_NO_COLOR);
+                std::string text = os.str();
+                while (!text.empty() && text[text.length() - 1] == '\n') {
+                    text.resize(text.length() - 1);
+                }
+                texts[call->no] = text;
+            }
+            if (call->flags & trace::CALL_FLAG_END_FRAME) {
+                ++frame;
+            }
+            delete call;
+        }
+    }
+}
+
+
+static void
+hashTrace(CallHasher *hasher) {
+    hasher->hash();
+}
+
+
+struct FormatJob {
+    CallHasher *hasher;
+    const char *filename;
+};
+
+static void
+formatTrace(FormatJob *job) {
+    job->hasher->format(job->filename);
+}
+
+
+/**
+ * Run of equal elements in both sequences.
+ */
+struct Match {
+    size_t a;
+    size_t b;
+    size_t length;
+
+    Match(size_t _a, size_t _b, size_t _length) :
+        a(_a), b(_b), length(_length)
+    {}
+};
+
+typedef std::vector<Match> MatchList;
+
+
+/**
+ * Myers' O(ND) difference algorithm, in linear space, bisecting the
+ * sequences at the middle snake of the shortest edit script.  Searches
+ * costing more than a few thousand edits settle for the furthest reaching
+ * path instead, like GNU diff does without --minimal.
+ */
+class Differ
 {
-    int i;
+public:
+    Differ(const Hash *_a, const Hash *_b, MatchList &_matches) :
+        a(_a), b(_b), matches(_matches)
+    {}
+
+    void
+    compare(size_t aLo, size_t aHi, size_t bLo, size_t bHi);
 
-    os::String command = find_command();
+private:
+    const Hash *a;
+    const Hash *b;
+    MatchList &matches;
+
+    std::vector<long> forward;
+    std::vector<long> backward;
+
+    void
+    match(size_t aPos, size_t bPos, size_t length) {
+        if (length) {
+            matches.push_back(Match(aPos, bPos, length));
+        }
+    }
+
+    bool
+    split(size_t aLo, size_t aHi, size_t bLo, size_t bHi,
+          size_t &aMid, size_t &bMid);
+};
+
+
+void
+Differ::compare(size_t aLo, size_t aHi, size_t bLo, size_t bHi) {
+    while (true) {
+        size_t prefix = 0;
+        while (aLo + prefix < aHi && bLo + prefix < bHi &&
+               a[aLo + prefix] == b[bLo + prefix]) {
+            ++prefix;
+        }
+        match(aLo, bLo, prefix);
+        aLo += prefix;
+        bLo += prefix;
+
+        size_t suffix = 0;
+        while (aLo < aHi - suffix && bLo < bHi - suffix &&
+               a[aHi - suffix - 1] == b[bHi - suffix - 1]) {
+            ++suffix;
+        }
+        aHi -= suffix;
+        bHi -= suffix;
+
+        size_t aMid, bMid;
+        if (aLo == aHi || bLo == bHi ||
+            !split(aLo, aHi, bLo, bHi, aMid, bMid)) {
+            match(aHi, bHi, suffix);
+            return;
+        }
+
+        compare(aLo, aMid, bLo, bMid);
+
+        // The suffix must come after the second half
+        if (suffix) {
+            compare(aMid, aHi, bMid, bHi);
+            match(aHi, bHi, suffix);
+            return;
+        }
+
+        aLo = aMid;
+        bLo = bMid;
+    }
+}
+
+
+/**
+ * Find a point on an optimal (or good enough) path through the edit graph,
+ * given that the sequences have no common prefix or suffix.  The diagonals
+ * are numbered k = x - y, and both searches store the x they reached along
+ * each diagonal.
+ */
+bool
+Differ::split(size_t aLo, size_t aHi, size_t bLo, size_t bHi,
+              size_t &aMid, size_t &bMid) {
+    const Hash *x0 = a + aLo;
+    const Hash *y0 = b + bLo;
+    long n = aHi - aLo;
+    long m = bHi - bLo;
+
+    long offset = m + 1;
+    forward.assign(n + m + 3, -1);
+    backward.assign(n + m + 3, LONG_MAX);
+    long *fv = &forward[offset];
+    long *bv = &backward[offset];
+
+    long delta = n - m;
+    bool odd = delta & 1;
+
+    long fmin = 0, fmax = 0;
+    long bmin = delta, bmax = delta;
+    fv[0] = 0;
+    bv[delta] = n;
+
+    long maxCost = 4096;
+
+    for (long cost = 1; ; ++cost) {
+        if (fmin > -m) {
+            fv[--fmin - 1] = -1;
+        } else {
+            ++fmin;
+        }
+        if (fmax < n) {
+            fv[++fmax + 1] = -1;
+        } else {
+            --fmax;
+        }
+        for (long k = fmax; k >= fmin; k -= 2) {
+            long x;
+            if (fv[k - 1] >= fv[k + 1]) {
+                x = fv[k - 1] + 1;
+            } else {
+                x = fv[k + 1];
+            }
+            long y = x - k;
+            while (x < n && y < m && x0[x] == y0[y]) {
+                ++x;
+                ++y;
+            }
+            fv[k] = x;
+            if (odd && bmin <= k && k <= bmax && bv[k] <= x) {
+                aMid = aLo + x;
+                bMid = bLo + y;
+                return true;
+            }
+        }
+
+        if (bmin > -m) {
+            bv[--bmin - 1] = LONG_MAX;
+        } else {
+            ++bmin;
+        }
+        if (bmax < n) {
+            bv[++bmax + 1] = LONG_MAX;
+        } else {
+            --bmax;
+        }
+        for (long k = bmax; k >= bmin; k -= 2) {
+            long x;
+            if (bv[k - 1] < bv[k + 1]) {
+                x = bv[k - 1];
+            } else {
+                x = bv[k + 1] - 1;
+            }
+            long y = x - k;
+            while (x > 0 && y > 0 && x0[x - 1] == y0[y - 1]) {
+                --x;
+                --y;
+            }
+            bv[k] = x;
+            if (!odd && fmin <= k && k <= fmax && x <= fv[k]) {
+                aMid = aLo + x;
+                bMid = bLo + y;
+                return true;
+            }
+        }
+
+        if (cost >= maxCost) {
+            // Too expensive: take the forward path that got the furthest
+            long best = -1;
+            for (long k = fmax; k >= fmin; k -= 2) {
+                long x = fv[k];
+                long y = x - k;
+                if (x <= n && y <= m && (best < 0 || x + y > (long)(aMid + bMid))) {
+                    best = k;
+                    aMid = x;
+                    bMid = y;
+                }
+            }
+            if (best < 0 || (long)(aMid + bMid) >= n + m) {
+                return false;
+            }
+            aMid += aLo;
+            bMid += bLo;
+            return true;
+        }
+    }
+}
+
+
+/**
+ * Frames that occur exactly once in each trace, and in the same order,
+ * following the patience diff algorithm.
+ */
+static void
+anchorFrames(const std::vector<Hash> &refFrames,
+             const std::vector<Hash> &srcFrames,
+             MatchList &anchors) {
+    // Occurrences in each trace, and index of the last one
+    typedef std::map<Hash, std::pair<unsigned, size_t> > Occurrences;
+    Occurrences refOccurrences;
+    Occurrences srcOccurrences;
+    for (size_t i = 0; i < refFrames.size(); ++i) {
+        std::pair<unsigned, size_t> &occurrence = refOccurrences[refFrames[i]];
+        ++occurrence.first;
+        occurrence.second = i;
+    }
+    for (size_t i = 0; i < srcFrames.size(); ++i) {
+        std::pair<unsigned, size_t> &occurrence = srcOccurrences[srcFrames[i]];
+        ++occurrence.first;
+        occurrence.second = i;
+    }
+
+    std::vector<Match> unique;
+    for (size_t i = 0; i < refFrames.size(); ++i) {
+        if (refOccurrences[refFrames[i]].first == 1) {
+            Occurrences::const_iterator it = srcOccurrences.find(refFrames[i]);
+            if (it != srcOccurrences.end() && it->second.first == 1) {
+                unique.push_back(Match(i, it->second.second, 1));
+            }
+        }
+    }
+
+    // Longest increasing subsequence of the source indices, by patience
+    // sorting: tops holds the index of the top of each pile, and previous
+    // the top of the previous pile when each was placed
+    std::vector<size_t> tops;
+    std::vector<size_t> previous(unique.size());
+    for (size_t i = 0; i < unique.size(); ++i) {
+        size_t lo = 0, hi = tops.size();
+        while (lo < hi) {
+            size_t mid = (lo + hi) / 2;
+            if (unique[tops[mid]].b < unique[i].b) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        previous[i] = lo ? tops[lo - 1] : (size_t)-1;
+        if (lo == tops.size()) {
+            tops.push_back(i);
+        } else {
+            tops[lo] = i;
+        }
+    }
+
+    size_t first = anchors.size();
+    for (size_t i = tops.empty() ? (size_t)-1 : tops.back(); i != (size_t)-1; i = previous[i]) {
+        anchors.push_back(unique[i]);
+    }
+    std::reverse(anchors.begin() + first, anchors.end());
+}
+
+
+/**
+ * Diff the frames first, and then the calls of the frames which differ, so
+ * that identical frames are matched in time proportional to their number.
+ *
+ * Frames are anchored on the ones that are unique in both traces, like the
+ * patience diff does with lines, as scenes often repeat identical frames,
+ * which would otherwise be matched to arbitrary ones.  The runs of equal
+ * frames around the anchors are matched too.
+ */
+static void
+diffTraces(const CallHasher &ref, const CallHasher &src, MatchList &matches) {
+    std::vector<Hash> refFrames;
+    std::vector<Hash> srcFrames;
+
+    const CallHasher *hashers[2] = {&ref, &src};
+    std::vector<Hash> *frameHashes[2] = {&refFrames, &srcFrames};
+    for (unsigned i = 0; i < 2; ++i) {
+        const CallHasher &hasher = *hashers[i];
+        for (unsigned frame = 0; frame < hasher.frameStarts.size(); ++frame) {
+            size_t end = hasher.frameStart(frame + 1);
+            Hash hash = 0;
+            for (size_t call = hasher.frameStarts[frame]; call < end; ++call) {
+                hash = mix(hash, hasher.hashes[call]);
+            }
+            frameHashes[i]->push_back(mix(hash, end - hasher.frameStarts[frame]));
+        }
+    }
+
+    MatchList anchors;
+    anchorFrames(refFrames, srcFrames, anchors);
+    anchors.push_back(Match(refFrames.size(), srcFrames.size(), 0));
+
+    Differ differ(ref.hashes.empty() ? NULL : &ref.hashes[0],
+                  src.hashes.empty() ? NULL : &src.hashes[0],
+                  matches);
+
+    size_t refFrame = 0;
+    size_t srcFrame = 0;
+    for (MatchList::const_iterator it = anchors.begin(); it != anchors.end(); ++it) {
+        // Extend the previous anchor forward, and this one backward
+        size_t refBegin = refFrame;
+        size_t srcBegin = srcFrame;
+        while (refFrame < it->a && srcFrame < it->b &&
+               refFrames[refFrame] == srcFrames[srcFrame]) {
+            ++refFrame;
+            ++srcFrame;
+        }
+        size_t refEnd = it->a;
+        size_t srcEnd = it->b;
+        while (refEnd > refFrame && srcEnd > srcFrame &&
+               refFrames[refEnd - 1] == srcFrames[srcEnd - 1]) {
+            --refEnd;
+            --srcEnd;
+        }
+
+        size_t length = ref.frameStart(refFrame) - ref.frameStart(refBegin);
+        if (length) {
+            matches.push_back(Match(ref.frameStart(refBegin), src.frameStart(srcBegin), length));
+        }
+
+        differ.compare(ref.frameStart(refFrame), ref.frameStart(refEnd),
+                       src.frameStart(srcFrame), src.frameStart(srcEnd));
+
+        refFrame = it->a + it->length;
+        srcFrame = it->b + it->length;
+
+        length = ref.frameStart(refFrame) - ref.frameStart(refEnd);
+        if (length) {
+            matches.push_back(Match(ref.frameStart(refEnd), src.frameStart(srcEnd), length));
+        }
+    }
+}
+
+
+enum ColorOption {
+    COLOR_OPTION_NEVER = 0,
+    COLOR_OPTION_ALWAYS = 1,
+    COLOR_OPTION_AUTO = -1
+};
+
+static const char *hunkColor = "\33[36m";
+static const char *deleteColor = "\33[31m";
+static const char *insertColor = "\33[32m";
+static const char *normalColor = "\33[0m";
+
+
+/**
+ * A run of differing calls.
+ */
+struct Change {
+    size_t aBegin, aEnd;
+    size_t bBegin, bEnd;
+};
+
+
+static void
+printCall(const CallHasher &hasher, size_t index, const char *prefix, const char *color) {
+    std::map<unsigned, std::string>::const_iterator it = hasher.texts.find(hasher.callNos[index]);
+    if (color) {
+        std::cout << color;
+    }
+    std::cout << prefix;
+    if (it != hasher.texts.end()) {
+        std::cout << it->second;
+    } else {
+        std::cout << hasher.callNos[index] << " ...";
+    }
+    if (color) {
+        std::cout << normalColor;
+    }
+    std::cout << "\n";
+}
+
+
+static unsigned
+hunkCallNo(const CallHasher &hasher, size_t index) {
+    if (index < hasher.callNos.size()) {
+        return hasher.callNos[index];
+    }
+    return hasher.callNos.empty() ? 0 : hasher.callNos.back() + 1;
+}
+
+
+/**
+ * Run the side by side comparison of scripts/tracediff.py, with the
+ * original arguments.
+ */
+static int
+sideBySide(const std::vector<char *> &arguments)
+{
+    os::String command = trace::findScript("tracediff.py");
     if (!command.length()) {
         return 1;
     }
@@ -75,14 +1032,220 @@ command(int argc, char *argv[])
     args.push_back(command.str());
     args.push_back("--apitrace");
     args.push_back(apitracePath.str());
-    for (i = 1; i < argc; i++) {
-        args.push_back(argv[i]);
+    for (size_t i = 1; i < arguments.size(); ++i) {
+        args.push_back(arguments[i]);
     }
     args.push_back(NULL);
 
     return os::execute((char * const *)&args[0]);
 }
 
+
+static int
+command(int argc, char *argv[])
+{
+    ColorOption color = COLOR_OPTION_AUTO;
+    size_t context = 3;
+    bool script = false;
+
+    CallHasher ref;
+    CallHasher src;
+
+    // Kept before getopt_long() reorders them
+    std::vector<char *> arguments(argv, argv + argc);
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, shortOptions, longOptions, NULL)) != -1) {
+        switch (opt) {
+        case 'h':
+            usage();
+            return 0;
+        case 'v':
+            verbose = true;
+            break;
+        case 'c':
+            ref.callSet = trace::CallSet(optarg);
+            src.callSet = trace::CallSet(optarg);
+            break;
+        case REF_CALLS_OPT:
+            ref.callSet = trace::CallSet(optarg);
+            break;
+        case SRC_CALLS_OPT:
+            src.callSet = trace::CallSet(optarg);
+            break;
+        case IGNORE_POINTERS_OPT:
+            ignorePointers = true;
+            break;
+        case IGNORE_HANDLES_OPT:
+            ignoreHandles = true;
+            break;
+        case 'U':
+            context = atoi(optarg);
+            break;
+        case COLOR_OPT:
+            if (!optarg ||
+                !strcmp(optarg, "always")) {
+                color = COLOR_OPTION_ALWAYS;
+            } else if (!strcmp(optarg, "auto")) {
+                color = COLOR_OPTION_AUTO;
+            } else if (!strcmp(optarg, "never")) {
+                color = COLOR_OPTION_NEVER;
+            } else {
+                std::cerr << "error: unknown color argument " << optarg << "\n";
+                return 1;
+            }
+            break;
+        case 'd':
+        case 'w':
+            script = true;
+            break;
+        default:
+            std::cerr << "error: unexpected option `" << opt << "`\n";
+            usage();
+            return 1;
+        }
+    }
+
+    if (argc - optind != 2) {
+        std::cerr << "error: two trace files must be specified\n";
+        usage();
+        return 1;
+    }
+
+    if (script) {
+        return sideBySide(arguments);
+    }
+
+    const char *refFilename = argv[optind];
+    const char *srcFilename = argv[optind + 1];
+
+    if (!ref.open(refFilename)) {
+        std::cerr << "error: failed to open " << refFilename << "\n";
+        return 1;
+    }
+    if (!src.open(srcFilename)) {
+        std::cerr << "error: failed to open " << srcFilename << "\n";
+        return 1;
+    }
+
+    {
+        os::thread thread(hashTrace, &ref);
+        hashTrace(&src);
+        thread.join();
+    }
+
+    MatchList matches;
+    diffTraces(ref, src, matches);
+    matches.push_back(Match(ref.hashes.size(), src.hashes.size(), 0));
+
+    std::vector<Change> changes;
+    size_t aPos = 0;
+    size_t bPos = 0;
+    for (MatchList::const_iterator it = matches.begin(); it != matches.end(); ++it) {
+        if (it->a > aPos || it->b > bPos) {
+            Change change;
+            change.aBegin = aPos;
+            change.aEnd = it->a;
+            change.bBegin = bPos;
+            change.bEnd = it->b;
+            changes.push_back(change);
+        }
+        aPos = it->a + it->length;
+        bPos = it->b + it->length;
+    }
+
+    if (changes.empty()) {
+        return 0;
+    }
+
+    // Group the changes into hunks, and find out which calls to show
+    std::vector<std::pair<size_t, size_t> > hunks;
+    for (size_t i = 0; i < changes.size(); ) {
+        size_t j = i + 1;
+        while (j < changes.size() &&
+               changes[j].aBegin - changes[j - 1].aEnd <= 2 * context) {
+            ++j;
+        }
+        hunks.push_back(std::make_pair(i, j));
+
+        const Change &first = changes[i];
+        const Change &last = changes[j - 1];
+        size_t begin = first.aBegin - std::min(context, std::min(first.aBegin, first.bBegin));
+        size_t end = last.aEnd + std::min(context, ref.hashes.size() - last.aEnd);
+        for (size_t index = begin; index < end; ++index) {
+            ref.wanted.push_back(index);
+        }
+        for (size_t k = i; k < j; ++k) {
+            for (size_t index = changes[k].bBegin; index < changes[k].bEnd; ++index) {
+                src.wanted.push_back(index);
+            }
+        }
+
+        i = j;
+    }
+
+    {
+        FormatJob refJob = {&ref, refFilename};
+        FormatJob srcJob = {&src, srcFilename};
+        os::thread thread(formatTrace, &refJob);
+        formatTrace(&srcJob);
+        thread.join();
+    }
+
+    if (color == COLOR_OPTION_AUTO) {
+#ifdef _WIN32
+        color = COLOR_OPTION_ALWAYS;
+#else
+        color = isatty(1) ? COLOR_OPTION_ALWAYS : COLOR_OPTION_NEVER;
+        pipepager();
+#endif
+    }
+
+    bool colored = color == COLOR_OPTION_ALWAYS;
+
+    for (size_t h = 0; h < hunks.size(); ++h) {
+        const Change &first = changes[hunks[h].first];
+        const Change &last = changes[hunks[h].second - 1];
+        size_t before = std::min(context, std::min(first.aBegin, first.bBegin));
+        size_t after = std::min(context, ref.hashes.size() - last.aEnd);
+
+        size_t aBegin = first.aBegin - before;
+        size_t bBegin = first.bBegin - before;
+        size_t aEnd = last.aEnd + after;
+        size_t bEnd = last.bEnd + after;
+
+        if (colored) {
+            std::cout << hunkColor;
+        }
+        std::cout << "@@ -" << hunkCallNo(ref, aBegin) << "," << (aEnd - aBegin)
+                  << " +" << hunkCallNo(src, bBegin) << "," << (bEnd - bBegin)
+                  << " @@ frame " << ref.frameOf(std::min(aBegin, ref.hashes.size()));
+        if (colored) {
+            std::cout << normalColor;
+        }
+        std::cout << "\n";
+
+        size_t a = aBegin;
+        for (size_t k = hunks[h].first; k < hunks[h].second; ++k) {
+            const Change &change = changes[k];
+            for (; a < change.aBegin; ++a) {
+                printCall(ref, a, "  ", NULL);
+            }
+            for (; a < change.aEnd; ++a) {
+                printCall(ref, a, "- ", colored ? deleteColor : NULL);
+            }
+            for (size_t b = change.bBegin; b < change.bEnd; ++b) {
+                printCall(src, b, "+ ", colored ? insertColor : NULL);
+            }
+        }
+        for (; a < aEnd; ++a) {
+            printCall(ref, a, "  ", NULL);
+        }
+    }
+
+    return 0;
+}
+
 const Command diff_command = {
     "diff",
     synopsis,
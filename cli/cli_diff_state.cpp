@@ -25,15 +25,37 @@
  *
  *********************************************************************/
 
+/*
+ * Comparison of two state dumps, as written by `glretrace -D`, in either the
+ * JSON or the binary format.
+ *
+ * Both documents are read into a compact tree in a single pass.  Objects are
+ * matched member by member, arrays element by element, floating point
+ * numbers are compared within a relative tolerance, and embedded images are
+ * only decoded when their encoded data differs, to compare their pixels.
+ */
+
+#include <assert.h>
+#include <errno.h>
+#include <limits.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <getopt.h>
 
+#include <algorithm>
+#include <fstream>
 #include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <snappy.h>
 
 #include "cli.hpp"
-#include "os_string.hpp"
-#include "os_process.hpp"
-#include "trace_resource.hpp"
+#include "image.hpp"
+
 
 static const char *synopsis = "Identify differences between two state dumps.";
 
@@ -41,30 +63,1206 @@ static void
 usage(void)
 {
     std::cout
-        << "usage: apitrace diff-state <state-1> <state-2>\n"
+        << "usage: apitrace diff-state [OPTIONS] STATE_FILE STATE_FILE\n"
         << synopsis << "\n"
         "\n"
-        "    Both input files should be the result of running 'glretrace -D XYZ <trace>'.\n";
+        "    Both input files should be the result of running 'glretrace -D XYZ <trace>'.\n"
+        "\n"
+        "    -h, --help            show this help message and exit\n"
+        "        --tolerance=REL   relative tolerance of floating point numbers\n"
+        "                          [default: 2^-24]\n"
+        "    -t, --threshold=BITS  minimum precision of images [default: 12]\n"
+        "        --ignore-images   do not compare images\n"
+        "        --ignore-added    ignore members only found in the second state\n"
+        "\n";
 }
 
+enum {
+    TOLERANCE_OPT = CHAR_MAX + 1,
+    IGNORE_IMAGES_OPT,
+    IGNORE_ADDED_OPT,
+};
+
 const static char *
-shortOptions = "h";
+shortOptions = "ht:";
 
 const static struct option
 longOptions[] = {
     {"help", no_argument, 0, 'h'},
+    {"tolerance", required_argument, 0, TOLERANCE_OPT},
+    {"threshold", required_argument, 0, 't'},
+    {"ignore-images", no_argument, 0, IGNORE_IMAGES_OPT},
+    {"ignore-added", no_argument, 0, IGNORE_ADDED_OPT},
     {0, 0, 0, 0}
 };
 
+
+class Node
+{
+public:
+    enum Kind {
+        NODE_NULL,
+        NODE_BOOL,
+        NODE_UINT,
+        NODE_SINT,
+        NODE_REAL,
+        NODE_STRING,
+        NODE_ARRAY,
+        NODE_OBJECT,
+        NODE_PIXELS,
+    };
+
+    typedef std::pair<std::string, Node *> Member;
+
+    Kind kind;
+
+    union {
+        bool b;
+        unsigned long long uint;
+        signed long long sint;
+        double real;
+    };
+
+    // Real read from a single precision float, rather than a double
+    bool single;
+
+    // String value, or encoded pixels
+    std::string string;
+
+    // Array elements
+    std::vector<Node *> elements;
+
+    // Object members, sorted by name
+    std::vector<Member> members;
+
+    // Pixels from binary dumps
+    unsigned width;
+    unsigned height;
+    unsigned channels;
+    unsigned encoding;
+
+    Node(Kind _kind) :
+        kind(_kind),
+        uint(0),
+        single(false),
+        width(0),
+        height(0),
+        channels(0),
+        encoding(0)
+    {}
+
+    ~Node() {
+        for (size_t i = 0; i < elements.size(); ++i) {
+            delete elements[i];
+        }
+        for (size_t i = 0; i < members.size(); ++i) {
+            delete members[i].second;
+        }
+    }
+
+    const Node *
+    member(const char *name) const {
+        for (size_t i = 0; i < members.size(); ++i) {
+            if (members[i].first == name) {
+                return members[i].second;
+            }
+        }
+        return NULL;
+    }
+
+    bool
+    isImage(void) const {
+        const Node *node = member("__class__");
+        return node && node->kind == NODE_STRING && node->string == "image";
+    }
+
+    bool
+    isNumber(void) const {
+        return kind == NODE_UINT || kind == NODE_SINT || kind == NODE_REAL;
+    }
+
+    double
+    toReal(void) const {
+        switch (kind) {
+        case NODE_UINT:
+            return (double)uint;
+        case NODE_SINT:
+            return (double)sint;
+        case NODE_REAL:
+            return real;
+        default:
+            return 0.0;
+        }
+    }
+};
+
+
+static bool
+memberLess(const Node::Member &a, const Node::Member &b) {
+    return a.first < b.first;
+}
+
+
+/**
+ * Common parts of the document parsers.
+ */
+class DocumentParser
+{
+protected:
+    const char *data;
+    const char *end;
+    const char *pos;
+    std::string error;
+
+    DocumentParser(const std::string &document) :
+        data(document.data()),
+        end(document.data() + document.size()),
+        pos(document.data())
+    {}
+
+    bool
+    fail(const char *message) {
+        if (error.empty()) {
+            std::ostringstream os;
+            os << message << " at offset " << (pos - data);
+            error = os.str();
+        }
+        pos = end;
+        return false;
+    }
+
+public:
+    const std::string &
+    getError(void) const {
+        return error;
+    }
+};
+
+
+/**
+ * JSON, with the // comments that hand written reference states may have.
+ */
+class JSONParser : public DocumentParser
+{
+public:
+    JSONParser(const std::string &document) :
+        DocumentParser(document)
+    {}
+
+    Node *
+    parse(void) {
+        Node *node = parseValue();
+        if (!error.empty()) {
+            delete node;
+            return NULL;
+        }
+        return node;
+    }
+
+private:
+    void
+    skipSpace(void) {
+        while (pos < end) {
+            if (*pos == ' ' || *pos == '\t' || *pos == '\r' || *pos == '\n') {
+                ++pos;
+            } else if (*pos == '/' && pos + 1 < end && pos[1] == '/') {
+                while (pos < end && *pos != '\n') {
+                    ++pos;
+                }
+            } else {
+                break;
+            }
+        }
+    }
+
+    bool
+    literal(const char *word) {
+        size_t len = strlen(word);
+        if ((size_t)(end - pos) >= len && memcmp(pos, word, len) == 0) {
+            pos += len;
+            return true;
+        }
+        return false;
+    }
+
+    static void
+    appendUTF8(std::string &s, unsigned c) {
+        if (c < 0x80) {
+            s += (char)c;
+        } else if (c < 0x800) {
+            s += (char)(0xc0 | (c >> 6));
+            s += (char)(0x80 | (c & 0x3f));
+        } else if (c < 0x10000) {
+            s += (char)(0xe0 | (c >> 12));
+            s += (char)(0x80 | ((c >> 6) & 0x3f));
+            s += (char)(0x80 | (c & 0x3f));
+        } else {
+            s += (char)(0xf0 | (c >> 18));
+            s += (char)(0x80 | ((c >> 12) & 0x3f));
+            s += (char)(0x80 | ((c >> 6) & 0x3f));
+            s += (char)(0x80 | (c & 0x3f));
+        }
+    }
+
+    unsigned
+    parseHex4(void) {
+        if (end - pos < 4) {
+            fail("truncated escape");
+            return 0;
+        }
+        unsigned c = 0;
+        for (unsigned i = 0; i < 4; ++i) {
+            char h = *pos++;
+            c <<= 4;
+            if (h >= '0' && h <= '9') {
+                c |= h - '0';
+            } else if (h >= 'a' && h <= 'f') {
+                c |= h - 'a' + 10;
+            } else if (h >= 'A' && h <= 'F') {
+                c |= h - 'A' + 10;
+            } else {
+                fail("invalid escape");
+                return 0;
+            }
+        }
+        return c;
+    }
+
+    bool
+    parseString(std::string &s) {
+        assert(*pos == '"');
+        ++pos;
+
+        // Most strings, including the base64 image data, have no escapes
+        const char *start = pos;
+        while (pos < end && *pos != '"' && *pos != '\\') {
+            ++pos;
+        }
+        s.assign(start, pos);
+
+        while (pos < end && *pos != '"') {
+            char c = *pos++;
+            if (c != '\\') {
+                s += c;
+                continue;
+            }
+            if (pos >= end) {
+                break;
+            }
+            c = *pos++;
+            switch (c) {
+            case 'b': s += '\b'; break;
+            case 'f': s += '\f'; break;
+            case 'n': s += '\n'; break;
+            case 'r': s += '\r'; break;
+            case 't': s += '\t'; break;
+            case 'u':
+                {
+                    unsigned code = parseHex4();
+                    if (code >= 0xd800 && code < 0xdc00 &&
+                        end - pos >= 6 && pos[0] == '\\' && pos[1] == 'u') {
+                        pos += 2;
+                        unsigned low = parseHex4();
+                        code = 0x10000 + ((code - 0xd800) << 10) + (low - 0xdc00);
+                    }
+                    appendUTF8(s, code);
+                }
+                break;
+            default:
+                s += c;
+                break;
+            }
+        }
+
+        if (pos >= end) {
+            return fail("unterminated string");
+        }
+        ++pos;
+        return true;
+    }
+
+    Node *
+    parseNumber(void) {
+        const char *start = pos;
+        bool integer = true;
+        if (pos < end && *pos == '-') {
+            ++pos;
+        }
+        while (pos < end) {
+            char c = *pos;
+            if (c >= '0' && c <= '9') {
+                // digit
+            } else if (c == '.' || c == 'e' || c == 'E' || c == '+' || c == '-') {
+                integer = false;
+            } else {
+                break;
+            }
+            ++pos;
+        }
+
+        std::string text(start, pos);
+        if (text.empty() || text == "-") {
+            fail("invalid number");
+            return NULL;
+        }
+
+        Node *node;
+        if (integer) {
+            char *stop;
+            errno = 0;
+            if (text[0] == '-') {
+                node = new Node(Node::NODE_SINT);
+                node->sint = strtoll(text.c_str(), &stop, 10);
+            } else {
+                node = new Node(Node::NODE_UINT);
+                node->uint = strtoull(text.c_str(), &stop, 10);
+            }
+            if (errno == 0) {
+                return node;
+            }
+            delete node;
+        }
+
+        node = new Node(Node::NODE_REAL);
+        node->real = strtod(text.c_str(), NULL);
+        return node;
+    }
+
+    Node *
+    parseValue(void) {
+        skipSpace();
+        if (pos >= end) {
+            fail("unexpected end of document");
+            return NULL;
+        }
+
+        Node *node;
+        switch (*pos) {
+        case '{':
+            ++pos;
+            node = new Node(Node::NODE_OBJECT);
+            skipSpace();
+            if (pos < end && *pos == '}') {
+                ++pos;
+                return node;
+            }
+            while (pos < end) {
+                skipSpace();
+                if (pos >= end || *pos != '"') {
+                    fail("expected member name");
+                    break;
+                }
+                Node::Member member;
+                parseString(member.first);
+                skipSpace();
+                if (pos >= end || *pos != ':') {
+                    fail("expected ':'");
+                    break;
+                }
+                ++pos;
+                member.second = parseValue();
+                if (!member.second) {
+                    break;
+                }
+                node->members.push_back(member);
+                skipSpace();
+                if (pos < end && *pos == ',') {
+                    ++pos;
+                } else if (pos < end && *pos == '}') {
+                    ++pos;
+                    std::sort(node->members.begin(), node->members.end(), memberLess);
+                    return node;
+                } else {
+                    fail("expected ',' or '}'");
+                }
+            }
+            return node;
+
+        case '[':
+            ++pos;
+            node = new Node(Node::NODE_ARRAY);
+            skipSpace();
+            if (pos < end && *pos == ']') {
+                ++pos;
+                return node;
+            }
+            while (pos < end) {
+                Node *element = parseValue();
+                if (!element) {
+                    break;
+                }
+                node->elements.push_back(element);
+                skipSpace();
+                if (pos < end && *pos == ',') {
+                    ++pos;
+                } else if (pos < end && *pos == ']') {
+                    ++pos;
+                    return node;
+                } else {
+                    fail("expected ',' or ']'");
+                }
+            }
+            return node;
+
+        case '"':
+            node = new Node(Node::NODE_STRING);
+            parseString(node->string);
+            return node;
+
+        default:
+            if (literal("null")) {
+                return new Node(Node::NODE_NULL);
+            } else if (literal("true")) {
+                node = new Node(Node::NODE_BOOL);
+                node->b = true;
+                return node;
+            } else if (literal("false")) {
+                node = new Node(Node::NODE_BOOL);
+                node->b = false;
+                return node;
+            } else if (literal("inf") || literal("-inf")) {
+                // As written by std::ostream
+                node = new Node(Node::NODE_REAL);
+                node->real = pos[-4] == '-' ? -HUGE_VAL : HUGE_VAL;
+                return node;
+            }
+            return parseNumber();
+        }
+    }
+};
+
+
+/**
+ * See createBinaryStateWriter() in retrace/state_writer.hpp for the format.
+ */
+class BinaryParser : public DocumentParser
+{
+public:
+    static const char magic[];
+
+    BinaryParser(const std::string &document) :
+        DocumentParser(document)
+    {}
+
+    Node *
+    parse(void) {
+        size_t len = strlen(magic);
+        if ((size_t)(end - pos) < len || memcmp(pos, magic, len) != 0) {
+            fail("not a binary state dump");
+            return NULL;
+        }
+        pos += len;
+
+        unsigned long long version = readUInt();
+        if (version != 1) {
+            fail("unsupported binary state version");
+            return NULL;
+        }
+
+        Node *node = parseValue();
+        if (!error.empty()) {
+            delete node;
+            return NULL;
+        }
+        return node;
+    }
+
+private:
+    unsigned long long
+    readUInt(void) {
+        unsigned long long value = 0;
+        unsigned shift = 0;
+        while (pos < end) {
+            unsigned char c = *pos++;
+            value |= (unsigned long long)(c & 0x7f) << shift;
+            shift += 7;
+            if (!(c & 0x80)) {
+                return value;
+            }
+        }
+        fail("truncated number");
+        return 0;
+    }
+
+    bool
+    readBytes(std::string &s) {
+        unsigned long long size = readUInt();
+        if (size > (unsigned long long)(end - pos)) {
+            return fail("truncated string");
+        }
+        s.assign(pos, (size_t)size);
+        pos += size;
+        return true;
+    }
+
+    template <class T>
+    T
+    readNumber(void) {
+        T value = 0;
+        if ((size_t)(end - pos) < sizeof value) {
+            fail("truncated number");
+            return value;
+        }
+        memcpy(&value, pos, sizeof value);
+        pos += sizeof value;
+        return value;
+    }
+
+    Node *
+    parseValue(void) {
+        if (pos >= end) {
+            fail("unexpected end of document");
+            return NULL;
+        }
+
+        Node *node;
+        char marker = *pos++;
+        switch (marker) {
+        case 'Z':
+            return new Node(Node::NODE_NULL);
+        case 'T':
+        case 'F':
+            node = new Node(Node::NODE_BOOL);
+            node->b = marker == 'T';
+            return node;
+        case 'u':
+            node = new Node(Node::NODE_UINT);
+            node->uint = readUInt();
+            return node;
+        case 's':
+            node = new Node(Node::NODE_SINT);
+            node->sint = -(signed long long)readUInt();
+            return node;
+        case 'f':
+            {
+                // Round to the precision JSON dumps use for floats, so that
+                // both formats can be compared
+                char buf[32];
+                snprintf(buf, sizeof buf, "%.7g", readNumber<float>());
+                node = new Node(Node::NODE_REAL);
+                node->real = strtod(buf, NULL);
+                node->single = true;
+            }
+            return node;
+        case 'd':
+            node = new Node(Node::NODE_REAL);
+            node->real = readNumber<double>();
+            return node;
+        case 'S':
+            node = new Node(Node::NODE_STRING);
+            readBytes(node->string);
+            return node;
+        case '[':
+            node = new Node(Node::NODE_ARRAY);
+            while (pos < end && *pos != ']') {
+                Node *element = parseValue();
+                if (!element) {
+                    return node;
+                }
+                node->elements.push_back(element);
+            }
+            ++pos;
+            return node;
+        case '{':
+            node = new Node(Node::NODE_OBJECT);
+            while (pos < end && *pos != '}') {
+                Node::Member member;
+                if (*pos++ != 'S') {
+                    fail("expected member name");
+                    return node;
+                }
+                readBytes(member.first);
+                member.second = parseValue();
+                if (!member.second) {
+                    return node;
+                }
+                node->members.push_back(member);
+            }
+            ++pos;
+            std::sort(node->members.begin(), node->members.end(), memberLess);
+            return node;
+        case 'P':
+            node = new Node(Node::NODE_PIXELS);
+            node->width = readUInt();
+            node->height = readUInt();
+            node->channels = readUInt();
+            node->encoding = readUInt();
+            readBytes(node->string);
+            return node;
+        default:
+            --pos;
+            fail("unexpected marker");
+            return NULL;
+        }
+    }
+};
+
+const char BinaryParser::magic[] = "APISTATE";
+
+
+static Node *
+load(const char *filename) {
+    std::ifstream stream(filename, std::ios::in | std::ios::binary);
+    if (!stream) {
+        std::cerr << "error: failed to open " << filename << "\n";
+        return NULL;
+    }
+
+    std::string document;
+    stream.seekg(0, std::ios::end);
+    document.resize((size_t)stream.tellg());
+    stream.seekg(0, std::ios::beg);
+    if (!document.empty()) {
+        stream.read(&document[0], document.size());
+    }
+
+    Node *node;
+    std::string error;
+    if (document.compare(0, strlen(BinaryParser::magic), BinaryParser::magic) == 0) {
+        BinaryParser parser(document);
+        node = parser.parse();
+        error = parser.getError();
+    } else {
+        JSONParser parser(document);
+        node = parser.parse();
+        error = parser.getError();
+    }
+
+    if (!node) {
+        std::cerr << "error: failed to parse " << filename << ": " << error << "\n";
+    }
+    return node;
+}
+
+
+static bool
+decodeBase64(const std::string &text, std::string &bytes) {
+    static signed char table[256];
+    static bool initialized = false;
+    if (!initialized) {
+        const char *alphabet = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+        memset(table, -1, sizeof table);
+        for (unsigned i = 0; i < 64; ++i) {
+            table[(unsigned char)alphabet[i]] = i;
+        }
+        initialized = true;
+    }
+
+    bytes.clear();
+    bytes.reserve(text.size() / 4 * 3);
+
+    unsigned value = 0;
+    unsigned bits = 0;
+    for (size_t i = 0; i < text.size(); ++i) {
+        unsigned char c = text[i];
+        if (c == '=') {
+            break;
+        }
+        if (c == '\n' || c == '\r') {
+            // Line breaks, as written by the JSON writer
+            continue;
+        }
+        if (table[c] < 0) {
+            return false;
+        }
+        value = (value << 6) | table[c];
+        bits += 6;
+        if (bits >= 8) {
+            bits -= 8;
+            bytes += (char)((value >> bits) & 0xff);
+        }
+    }
+    return true;
+}
+
+
+/**
+ * Decode the pixels of an image object to RGBA, or return NULL.
+ */
+static image::Image *
+decodeImage(const Node *data) {
+    if (data->kind == Node::NODE_STRING) {
+        // Base64 encoded PNG
+        std::string png;
+        if (!decodeBase64(data->string, png)) {
+            return NULL;
+        }
+        return image::readPNG(png.data(), png.size());
+    }
+
+    if (data->kind != Node::NODE_PIXELS ||
+        data->channels < 1 || data->channels > 4) {
+        return NULL;
+    }
+
+    std::string uncompressed;
+    const std::string *pixels = &data->string;
+    if (data->encoding == 1) {
+        if (!snappy::Uncompress(data->string.data(), data->string.size(), &uncompressed)) {
+            return NULL;
+        }
+        pixels = &uncompressed;
+    } else if (data->encoding != 0) {
+        return NULL;
+    }
+
+    size_t count = (size_t)data->width * data->height;
+    if (pixels->size() != count * data->channels) {
+        return NULL;
+    }
+
+    // Expand to RGBA like PNG images are, keeping the rows bottom up
+    image::Image *image = new image::Image(data->width, data->height, 4, true);
+    const unsigned char *src = (const unsigned char *)pixels->data();
+    unsigned char *dst = image->pixels;
+    for (size_t i = 0; i < count; ++i) {
+        switch (data->channels) {
+        case 1:
+            dst[0] = dst[1] = dst[2] = src[0];
+            dst[3] = 0xff;
+            break;
+        case 2:
+            dst[0] = dst[1] = dst[2] = src[0];
+            dst[3] = src[1];
+            break;
+        case 3:
+            dst[0] = src[0];
+            dst[1] = src[1];
+            dst[2] = src[2];
+            dst[3] = 0xff;
+            break;
+        case 4:
+            memcpy(dst, src, 4);
+            break;
+        }
+        src += data->channels;
+        dst += 4;
+    }
+    return image;
+}
+
+
+class StateDiffer
+{
+public:
+    double tolerance;
+    double threshold;
+    bool ignoreImages;
+    bool ignoreAdded;
+
+    unsigned differences;
+
+    StateDiffer() :
+        tolerance(1.0/(1 << 24)),
+        threshold(12.0),
+        ignoreImages(false),
+        ignoreAdded(false),
+        differences(0)
+    {}
+
+    void
+    diff(const Node *a, const Node *b, std::string &path);
+
+private:
+    bool
+    equalNumbers(const Node *a, const Node *b) const;
+
+    bool
+    equal(const Node *a, const Node *b) const;
+
+    void
+    diffImages(const Node *a, const Node *b, std::string &path);
+
+    void
+    report(const std::string &path, const Node *a, const Node *b);
+
+    void
+    report(const std::string &path, const std::string &message);
+
+    static void
+    format(std::ostream &os, const Node *node);
+};
+
+
+bool
+StateDiffer::equalNumbers(const Node *a, const Node *b) const {
+    if (a->kind != Node::NODE_REAL && b->kind != Node::NODE_REAL) {
+        return a->kind == b->kind && a->uint == b->uint;
+    }
+
+    double x = a->toReal();
+    double y = b->toReal();
+    if (x == y) {
+        return true;
+    }
+    if (x == 0) {
+        return fabs(y) < tolerance;
+    }
+    return fabs((y - x)/x) < tolerance;
+}
+
+
+/**
+ * Quick check, without reporting anything.
+ */
+bool
+StateDiffer::equal(const Node *a, const Node *b) const {
+    if (a->isNumber() && b->isNumber()) {
+        return equalNumbers(a, b);
+    }
+
+    if (a->kind != b->kind) {
+        return false;
+    }
+
+    switch (a->kind) {
+    case Node::NODE_NULL:
+        return true;
+    case Node::NODE_BOOL:
+        return a->b == b->b;
+    case Node::NODE_STRING:
+        return a->string == b->string;
+    case Node::NODE_PIXELS:
+        return a->width == b->width &&
+               a->height == b->height &&
+               a->channels == b->channels &&
+               a->encoding == b->encoding &&
+               a->string == b->string;
+    case Node::NODE_ARRAY:
+        if (a->elements.size() != b->elements.size()) {
+            return false;
+        }
+        for (size_t i = 0; i < a->elements.size(); ++i) {
+            if (!equal(a->elements[i], b->elements[i])) {
+                return false;
+            }
+        }
+        return true;
+    case Node::NODE_OBJECT:
+        if (a->members.size() != b->members.size()) {
+            return false;
+        }
+        for (size_t i = 0; i < a->members.size(); ++i) {
+            if (a->members[i].first != b->members[i].first ||
+                !equal(a->members[i].second, b->members[i].second)) {
+                return false;
+            }
+        }
+        return true;
+    default:
+        return false;
+    }
+}
+
+
+void
+StateDiffer::diff(const Node *a, const Node *b, std::string &path) {
+    if (a->kind == Node::NODE_OBJECT && b->kind == Node::NODE_OBJECT) {
+        if (a->isImage() || b->isImage()) {
+            if (!ignoreImages) {
+                diffImages(a, b, path);
+            }
+            return;
+        }
+
+        size_t length = path.length();
+        std::vector<Node::Member>::const_iterator ita = a->members.begin();
+        std::vector<Node::Member>::const_iterator itb = b->members.begin();
+        while (ita != a->members.end() || itb != b->members.end()) {
+            int order;
+            if (ita == a->members.end()) {
+                order = 1;
+            } else if (itb == b->members.end()) {
+                order = -1;
+            } else {
+                order = ita->first.compare(itb->first);
+            }
+
+            const std::string &name = order <= 0 ? ita->first : itb->first;
+            if (length) {
+                path += '.';
+            }
+            path += name;
+
+            if (order < 0) {
+                report(path, ita->second, NULL);
+                ++ita;
+            } else if (order > 0) {
+                if (!ignoreAdded) {
+                    report(path, NULL, itb->second);
+                }
+                ++itb;
+            } else {
+                diff(ita->second, itb->second, path);
+                ++ita;
+                ++itb;
+            }
+
+            path.resize(length);
+        }
+        return;
+    }
+
+    if (a->kind == Node::NODE_ARRAY && b->kind == Node::NODE_ARRAY &&
+        !equal(a, b)) {
+        size_t length = path.length();
+        size_t count = std::max(a->elements.size(), b->elements.size());
+        for (size_t i = 0; i < count; ++i) {
+            std::ostringstream index;
+            index << '[' << i << ']';
+            path += index.str();
+            if (i >= b->elements.size()) {
+                report(path, a->elements[i], NULL);
+            } else if (i >= a->elements.size()) {
+                report(path, NULL, b->elements[i]);
+            } else {
+                diff(a->elements[i], b->elements[i], path);
+            }
+            path.resize(length);
+        }
+        return;
+    }
+
+    if (!equal(a, b)) {
+        report(path, a, b);
+    }
+}
+
+
+/**
+ * Compare the image descriptions, and then the pixels, but only decoding
+ * them when their encoded data differs.
+ */
+void
+StateDiffer::diffImages(const Node *a, const Node *b, std::string &path) {
+    if (!a->isImage() || !b->isImage()) {
+        report(path, a, b);
+        return;
+    }
+
+    static const char *properties[] = {
+        "__width__",
+        "__height__",
+        "__depth__",
+        "__format__",
+        "__channels__",
+    };
+    for (unsigned i = 0; i < sizeof properties / sizeof properties[0]; ++i) {
+        const Node *pa = a->member(properties[i]);
+        const Node *pb = b->member(properties[i]);
+        if (pa && pb && !equal(pa, pb)) {
+            size_t length = path.length();
+            path += '.';
+            path += properties[i];
+            report(path, pa, pb);
+            path.resize(length);
+            return;
+        }
+    }
+
+    const Node *da = a->member("__data__");
+    const Node *db = b->member("__data__");
+    if (!da || !db || equal(da, db)) {
+        return;
+    }
+
+    image::Image *ia = decodeImage(da);
+    image::Image *ib = decodeImage(db);
+    if (!ia || !ib) {
+        report(path, "failed to decode image");
+    } else if (ia->width != ib->width || ia->height != ib->height) {
+        std::ostringstream os;
+        os << "image " << ia->width << "x" << ia->height
+           << " -> " << ib->width << "x" << ib->height;
+        report(path, os.str());
+    } else {
+        double precision = ib->compare(*ia);
+        if (precision < threshold) {
+            std::ostringstream os;
+            os << "image precision of " << precision << " bits";
+            report(path, os.str());
+        }
+    }
+    delete ia;
+    delete ib;
+}
+
+
+/**
+ * Print a real with enough digits to tell apart any two differing values,
+ * i.e., up to 9 for floats and 17 for doubles, but no more than needed to
+ * read the same value back.
+ */
+static void
+formatReal(std::ostream &os, double real, bool single) {
+    int maxDigits = single ? 9 : 17;
+    char buf[32];
+    for (int digits = 6; ; ++digits) {
+        snprintf(buf, sizeof buf, "%.*g", digits, real);
+        if (digits >= maxDigits ||
+            (single ? (float)strtod(buf, NULL) == (float)real
+                    : strtod(buf, NULL) == real)) {
+            break;
+        }
+    }
+    os << buf;
+}
+
+
+/**
+ * Whether a string is summarized by its length, like shader sources are.
+ */
+static inline bool
+isLongString(const std::string &string) {
+    return string.length() > 64 ||
+           string.find('\n') != std::string::npos;
+}
+
+
+/**
+ * Quote the line starting at offset, shortened if too long.
+ */
+static void
+formatLine(std::ostream &os, const std::string &string, size_t offset) {
+    size_t end = string.find('\n', offset);
+    if (end == std::string::npos) {
+        end = string.length();
+    }
+    if (end - offset > 64) {
+        os << '"' << string.substr(offset, 64) << "...\"";
+    } else {
+        os << '"' << string.substr(offset, end - offset) << '"';
+    }
+}
+
+
+/**
+ * Show the first line where two long strings differ.
+ */
+static void
+formatStringDifference(std::ostream &os, const std::string &a, const std::string &b) {
+    size_t offset = 0;
+    while (offset < a.length() && offset < b.length() &&
+           a[offset] == b[offset]) {
+        ++offset;
+    }
+
+    // Both strings are equal up to the start of the line
+    size_t start = offset ? a.rfind('\n', offset - 1) : std::string::npos;
+    start = start == std::string::npos ? 0 : start + 1;
+    unsigned line = 1 + std::count(a.begin(), a.begin() + start, '\n');
+
+    os << ", line " << line << ": ";
+    formatLine(os, a, start);
+    os << " -> ";
+    formatLine(os, b, start);
+}
+
+
+void
+StateDiffer::format(std::ostream &os, const Node *node) {
+    if (!node) {
+        os << "(missing)";
+        return;
+    }
+
+    switch (node->kind) {
+    case Node::NODE_NULL:
+        os << "null";
+        break;
+    case Node::NODE_BOOL:
+        os << (node->b ? "true" : "false");
+        break;
+    case Node::NODE_UINT:
+        os << node->uint;
+        break;
+    case Node::NODE_SINT:
+        os << node->sint;
+        break;
+    case Node::NODE_REAL:
+        formatReal(os, node->real, node->single);
+        break;
+    case Node::NODE_STRING:
+        // Shader sources and the like span many lines
+        if (isLongString(node->string)) {
+            os << "string(" << node->string.length() << ")";
+        } else {
+            os << '"' << node->string << '"';
+        }
+        break;
+    case Node::NODE_ARRAY:
+        if (node->elements.size() <= 16) {
+            os << '[';
+            for (size_t i = 0; i < node->elements.size(); ++i) {
+                if (i) {
+                    os << ", ";
+                }
+                format(os, node->elements[i]);
+            }
+            os << ']';
+        } else {
+            os << "array(" << node->elements.size() << ")";
+        }
+        break;
+    case Node::NODE_OBJECT:
+        if (node->isImage()) {
+            os << "image";
+        } else {
+            os << "object(" << node->members.size() << ")";
+        }
+        break;
+    case Node::NODE_PIXELS:
+        os << "pixels(" << node->width << "x" << node->height << ")";
+        break;
+    }
+}
+
+
+void
+StateDiffer::report(const std::string &path, const Node *a, const Node *b) {
+    std::ostringstream os;
+    format(os, a);
+    os << " -> ";
+    format(os, b);
+    if (a && b &&
+        a->kind == Node::NODE_STRING && b->kind == Node::NODE_STRING &&
+        (isLongString(a->string) || isLongString(b->string))) {
+        formatStringDifference(os, a->string, b->string);
+    }
+    report(path, os.str());
+}
+
+
+void
+StateDiffer::report(const std::string &path, const std::string &message) {
+    std::cout << (path.empty() ? "." : path) << ": " << message << "\n";
+    ++differences;
+}
+
+
 static int
 command(int argc, char *argv[])
 {
+    StateDiffer differ;
+
     int opt;
     while ((opt = getopt_long(argc, argv, shortOptions, longOptions, NULL)) != -1) {
         switch (opt) {
         case 'h':
             usage();
             return 0;
+        case TOLERANCE_OPT:
+            differ.tolerance = atof(optarg);
+            break;
+        case 't':
+            differ.threshold = atof(optarg);
+            break;
+        case IGNORE_IMAGES_OPT:
+            differ.ignoreImages = true;
+            break;
+        case IGNORE_ADDED_OPT:
+            differ.ignoreAdded = true;
+            break;
         default:
             std::cerr << "error: unexpected option `" << opt << "`\n";
             usage();
@@ -78,22 +1276,23 @@ command(int argc, char *argv[])
         return 1;
     }
 
-    char *file1, *file2;
-
-    file1 = argv[optind];
-    file2 = argv[optind + 1];
-
-    os::String command = trace::findScript("jsondiff.py");
+    Node *a = load(argv[optind]);
+    if (!a) {
+        return 1;
+    }
+    Node *b = load(argv[optind + 1]);
+    if (!b) {
+        delete a;
+        return 1;
+    }
 
-    char *args[5];
+    std::string path;
+    differ.diff(a, b, path);
 
-    args[0] = const_cast<char *>("python");
-    args[1] = const_cast<char *>(command.str());
-    args[2] = file1;
-    args[3] = file2;
-    args[4] = NULL;
+    delete a;
+    delete b;
 
-    return os::execute(args);
+    return 0;
 }
 
 const Command diff_state_command = {
@@ -70,6 +70,8 @@ usage(void)
         "    --thread-ids=[=BOOL] dump thread ids [default: no]\n"
         "    --call-nos[=BOOL]    dump call numbers[default: yes]\n"
         "    --arg-names[=BOOL]   dump argument names [default: yes]\n"
+        "    --call-times[=BOOL]  dump when calls were made and how long they took,\n"
+        "                         in nanoseconds [default: no]\n"
         "\n"
     ;
 }
@@ -80,6 +82,7 @@ enum {
     THREAD_IDS_OPT,
     CALL_NOS_OPT,
     ARG_NAMES_OPT,
+    CALL_TIMES_OPT,
 };
 
 const static char *
@@ -95,6 +98,7 @@ longOptions[] = {
     {"thread-ids", optional_argument, 0, THREAD_IDS_OPT},
     {"call-nos", optional_argument, 0, CALL_NOS_OPT},
     {"arg-names", optional_argument, 0, ARG_NAMES_OPT},
+    {"call-times", optional_argument, 0, CALL_TIMES_OPT},
     {0, 0, 0, 0}
 };
 
@@ -165,6 +169,13 @@ command(int argc, char *argv[])
                 dumpFlags |= trace::DUMP_FLAG_NO_ARG_NAMES;
             }
             break;
+        case CALL_TIMES_OPT:
+            if (boolOption(optarg)) {
+                dumpFlags |= trace::DUMP_FLAG_CALL_TIMES;
+            } else {
+                dumpFlags &= ~trace::DUMP_FLAG_CALL_TIMES;
+            }
+            break;
         default:
             std::cerr << "error: unexpected option `" << opt << "`\n";
             usage();
@@ -185,10 +196,17 @@ command(int argc, char *argv[])
         dumpFlags |= trace::DUMP_FLAG_NO_COLOR;
     }
 
+    if (dumpThreadIds) {
+        dumpFlags |= trace::DUMP_FLAG_THREAD_IDS;
+    }
+
+    trace::CallDumper dumper(std::cout, dumpFlags);
+
     for (int i = optind; i < argc; ++i) {
         trace::Parser p;
 
         if (!p.open(argv[i])) {
+            dumper.flush();
             std::cerr << "error: failed to open " << argv[i] << "\n";
             return 1;
         }
@@ -198,10 +216,7 @@ command(int argc, char *argv[])
             if (calls.contains(*call)) {
                 if (verbose ||
                     !(call->flags & trace::CALL_FLAG_VERBOSE)) {
-                    if (dumpThreadIds) {
-                        std::cout << std::hex << call->thread_id << std::dec << " ";
-                    }
-                    trace::dump(*call, std::cout, dumpFlags);
+                    dumper.dump(*call);
                 }
             }
             delete call;
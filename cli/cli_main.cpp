@@ -73,6 +73,7 @@ static const Command * commands[] = {
     &dump_images_command,
     &pickle_command,
     &repack_command,
+    &stats_command,
     &trace_command,
     &trim_command,
     &help_command
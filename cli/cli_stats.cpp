@@ -0,0 +1,922 @@
+/**************************************************************************
+ *
+ * Copyright 2012 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+
+/*
+ * Trace statistics, gathered without building the call model.
+ */
+
+
+#include <string.h>
+#include <limits.h>
+#include <getopt.h>
+
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <vector>
+
+#include "cli.hpp"
+#include "json.hpp"
+#include "trace_parser.hpp"
+
+
+static const char *synopsis = "Print statistics about a trace.";
+
+static void
+usage(void)
+{
+    std::cout
+        << "usage: apitrace stats [OPTIONS] TRACE_FILE\n"
+        << synopsis << "\n"
+        "\n"
+        "    -h, --help           show this help message and exit\n"
+        "    -n, --top=N          number of functions and frames to list [default: 10,\n"
+        "                         0 for all]\n"
+        "        --sort=KEY       sort functions and frames by calls, bytes, or time\n"
+        "                         [default: bytes]\n"
+        "        --format=FORMAT  output format: text, csv, or json [default: text]\n"
+        "        --table=TABLE    table to output as CSV: functions, frames, blobs, or\n"
+        "                         threads [default: functions]\n"
+        "\n"
+        "    Bytes are those the calls take in the uncompressed trace, and blob bytes\n"
+        "    the part of them that are blobs, such as texture and buffer uploads.\n"
+        "    Time is the CPU time spent in the calls while tracing, and the elapsed\n"
+        "    time of frames spans from their first call to their last one, when the\n"
+        "    trace recorded call times.\n"
+        "\n";
+}
+
+enum {
+    SORT_OPT = CHAR_MAX + 1,
+    FORMAT_OPT,
+    TABLE_OPT,
+};
+
+const static char *
+shortOptions = "hn:";
+
+const static struct option
+longOptions[] = {
+    {"help", no_argument, 0, 'h'},
+    {"top", required_argument, 0, 'n'},
+    {"sort", required_argument, 0, SORT_OPT},
+    {"format", required_argument, 0, FORMAT_OPT},
+    {"table", required_argument, 0, TABLE_OPT},
+    {0, 0, 0, 0}
+};
+
+enum Format {
+    FORMAT_TEXT,
+    FORMAT_CSV,
+    FORMAT_JSON,
+};
+
+enum SortKey {
+    SORT_BYTES,
+    SORT_CALLS,
+    SORT_TIME,
+};
+
+static unsigned top = 10;
+static SortKey sortKey = SORT_BYTES;
+static Format format = FORMAT_TEXT;
+static std::string table = "functions";
+
+
+/**
+ * Pass-through file which counts the bytes read from the underlying one.
+ */
+class CountingFile : public trace::File
+{
+public:
+    unsigned long long count;
+
+    CountingFile(trace::File *_file) :
+        count(0),
+        file(_file)
+    {
+        m_mode = File::Read;
+        m_isOpened = true;
+    }
+
+    ~CountingFile() {
+        delete file;
+    }
+
+    bool supportsOffsets() const {
+        return file->supportsOffsets();
+    }
+
+    File::Offset currentOffset() {
+        return file->currentOffset();
+    }
+
+    unsigned segmentCallBase() {
+        return file->segmentCallBase();
+    }
+
+protected:
+    bool rawOpen(const std::string &filename, File::Mode mode) {
+        return false;
+    }
+
+    bool rawWrite(const void *buffer, size_t length) {
+        return false;
+    }
+
+    size_t rawRead(void *buffer, size_t length) {
+        size_t read = file->read(buffer, length);
+        count += read;
+        return read;
+    }
+
+    int rawGetc() {
+        int c = file->getc();
+        if (c != -1) {
+            ++count;
+        }
+        return c;
+    }
+
+    void rawClose() {
+        file->close();
+    }
+
+    void rawFlush() {
+    }
+
+    bool rawSkip(size_t length) {
+        if (!file->skip(length)) {
+            return false;
+        }
+        count += length;
+        return true;
+    }
+
+    int rawPercentRead() {
+        return file->percentRead();
+    }
+
+private:
+    trace::File *file;
+};
+
+
+struct Totals
+{
+    unsigned long long calls;
+    unsigned long long bytes;
+    unsigned long long blobs;
+    unsigned long long blobBytes;
+    // Nanoseconds spent in the calls
+    unsigned long long time;
+
+    Totals() : calls(0), bytes(0), blobs(0), blobBytes(0), time(0) {}
+
+    void
+    add(const Totals &other) {
+        calls += other.calls;
+        bytes += other.bytes;
+        blobs += other.blobs;
+        blobBytes += other.blobBytes;
+        time += other.time;
+    }
+};
+
+
+struct FunctionStats : public Totals
+{
+    const char *name;
+
+    FunctionStats() : name(NULL) {}
+};
+
+
+struct FrameStats : public Totals
+{
+    unsigned no;
+    unsigned firstCall;
+    // When the first timed call was entered, and the last one returned
+    bool timed;
+    unsigned long long start;
+    unsigned long long end;
+
+    FrameStats() : no(0), firstCall(0), timed(false), start(0), end(0) {}
+
+    unsigned long long
+    elapsed(void) const {
+        return end - start;
+    }
+};
+
+
+/**
+ * Number of bits needed to represent a blob size, so that bucket N holds
+ * sizes in [2^(N-1), 2^N).
+ */
+static unsigned
+bucketOf(unsigned long long size) {
+    unsigned bucket = 0;
+    while (size) {
+        size >>= 1;
+        ++bucket;
+    }
+    return bucket;
+}
+
+
+class StatsScanner : protected trace::Parser
+{
+public:
+    std::vector<FunctionStats> functions;
+    std::vector<FrameStats> frames;
+    std::map<unsigned, unsigned long long> threads;
+    std::vector<Totals> buckets;
+    Totals total;
+    bool timed;
+
+    StatsScanner() : timed(false), current(NULL), currentCall(NULL) {}
+
+    bool open(const char *filename) {
+        if (!Parser::open(filename)) {
+            return false;
+        }
+        counter = new CountingFile(file);
+        file = counter;
+        return true;
+    }
+
+    void scan(void);
+
+private:
+    CountingFile *counter;
+
+    struct PendingCall {
+        unsigned no;
+        FunctionSigFlags *sig;
+        Totals totals;
+        bool timed;
+        unsigned long long start;
+    };
+
+    // Calls entered but not left yet, usually no more than one per thread
+    std::vector<PendingCall> pending;
+
+    // Statistics of the event being scanned
+    Totals *current;
+    PendingCall *currentCall;
+
+    void scan_enter(void);
+    void scan_leave(void);
+    void finish_call(PendingCall &call);
+    void scan_call_details(void);
+    void scan_value(void);
+};
+
+
+void
+StatsScanner::scan(void) {
+    frames.push_back(FrameStats());
+
+    int c;
+    do {
+        unsigned long long start = counter->count;
+        PendingCall *call = NULL;
+
+        c = file->getc();
+        switch (c) {
+        case trace::EVENT_ENTER:
+            scan_enter();
+            call = &pending.back();
+            break;
+        case trace::EVENT_LEAVE:
+            scan_leave();
+            break;
+        case -1:
+            break;
+        default:
+            std::cerr << "error: unknown event " << c << "\n";
+            exit(1);
+        }
+
+        if (call) {
+            call->totals.bytes += counter->count - start;
+        }
+    } while (c != -1);
+
+    // Calls which were never left
+    while (!pending.empty()) {
+        finish_call(pending.front());
+        pending.erase(pending.begin());
+    }
+
+    if (frames.back().calls == 0) {
+        frames.pop_back();
+    }
+}
+
+
+void
+StatsScanner::scan_enter(void) {
+    unsigned thread_id = 0;
+    if (version >= 4) {
+        thread_id = read_uint();
+    }
+
+    PendingCall call;
+    call.sig = parse_function_sig();
+    call.no = next_call_no++;
+    call.timed = false;
+    call.start = 0;
+
+    ++threads[thread_id];
+
+    pending.push_back(call);
+    current = &pending.back().totals;
+    currentCall = &pending.back();
+    scan_call_details();
+}
+
+
+void
+StatsScanner::scan_leave(void) {
+    unsigned long long start = counter->count - 1;
+    unsigned call_no = read_call_no();
+
+    Totals totals;
+    current = &totals;
+    currentCall = NULL;
+
+    for (std::vector<PendingCall>::iterator it = pending.begin(); it != pending.end(); ++it) {
+        if (it->no == call_no) {
+            current = &it->totals;
+            currentCall = &*it;
+            scan_call_details();
+            it->totals.bytes += counter->count - start;
+            PendingCall call = *it;
+            pending.erase(it);
+            finish_call(call);
+            return;
+        }
+    }
+
+    scan_call_details();
+}
+
+
+void
+StatsScanner::finish_call(PendingCall &call) {
+    call.totals.calls = 1;
+
+    if (call.sig->id >= functions.size()) {
+        functions.resize(call.sig->id + 1);
+    }
+    FunctionStats &function = functions[call.sig->id];
+    function.name = call.sig->name;
+    function.add(call.totals);
+
+    FrameStats &frame = frames.back();
+    if (frame.calls == 0) {
+        frame.firstCall = call.no;
+    }
+    if (call.timed) {
+        unsigned long long end = call.start + call.totals.time;
+        if (!frame.timed) {
+            frame.timed = true;
+            frame.start = call.start;
+            frame.end = end;
+        } else {
+            frame.start = std::min(frame.start, call.start);
+            frame.end = std::max(frame.end, end);
+        }
+    }
+    frame.add(call.totals);
+
+    total.add(call.totals);
+
+    if (call.sig->flags & trace::CALL_FLAG_END_FRAME) {
+        frames.push_back(FrameStats());
+        frames.back().no = frames.size() - 1;
+    }
+}
+
+
+void
+StatsScanner::scan_call_details(void) {
+    do {
+        int c = file->getc();
+        switch (c) {
+        case trace::CALL_END:
+            return;
+        case trace::CALL_ARG:
+            skip_uint();
+            scan_value();
+            break;
+        case trace::CALL_RET:
+            scan_value();
+            break;
+        case trace::CALL_TIME:
+            {
+                unsigned long long start = read_uint();
+                unsigned long long duration = read_uint();
+                if (currentCall) {
+                    currentCall->timed = true;
+                    currentCall->start = start;
+                }
+                current->time += duration;
+                timed = true;
+            }
+            break;
+        default:
+            std::cerr << "error: unknown call detail " << c << "\n";
+            exit(1);
+        case -1:
+            return;
+        }
+    } while(true);
+}
+
+
+/**
+ * Like Parser::scan_value, but accounting blobs, wherever they are nested.
+ */
+void
+StatsScanner::scan_value(void) {
+    int c = file->getc();
+    switch (c) {
+    case trace::TYPE_NULL:
+    case trace::TYPE_FALSE:
+    case trace::TYPE_TRUE:
+        break;
+    case trace::TYPE_SINT:
+        scan_sint();
+        break;
+    case trace::TYPE_UINT:
+        scan_uint();
+        break;
+    case trace::TYPE_FLOAT:
+        scan_float();
+        break;
+    case trace::TYPE_DOUBLE:
+        scan_double();
+        break;
+    case trace::TYPE_STRING:
+        scan_string();
+        break;
+    case trace::TYPE_ENUM:
+        scan_enum();
+        break;
+    case trace::TYPE_BITMASK:
+        scan_bitmask();
+        break;
+    case trace::TYPE_ARRAY:
+        {
+            size_t len = read_uint();
+            for (size_t i = 0; i < len; ++i) {
+                scan_value();
+            }
+        }
+        break;
+    case trace::TYPE_STRUCT:
+        {
+            trace::StructSig *sig = parse_struct_sig();
+            for (size_t i = 0; i < sig->num_members; ++i) {
+                scan_value();
+            }
+        }
+        break;
+    case trace::TYPE_BLOB:
+        {
+            unsigned long long size = read_uint();
+            if (size) {
+                file->skip(size);
+            }
+            current->blobs += 1;
+            current->blobBytes += size;
+
+            unsigned bucket = bucketOf(size);
+            if (bucket >= buckets.size()) {
+                buckets.resize(bucket + 1);
+            }
+            buckets[bucket].blobs += 1;
+            buckets[bucket].blobBytes += size;
+        }
+        break;
+    case trace::TYPE_OPAQUE:
+        scan_opaque();
+        break;
+    case trace::TYPE_REPR:
+        scan_value();
+        scan_value();
+        break;
+    default:
+        std::cerr << "error: unknown type " << c << "\n";
+        exit(1);
+    case -1:
+        break;
+    }
+}
+
+
+static bool
+heavier(const Totals *a, const Totals *b) {
+    switch (sortKey) {
+    case SORT_CALLS:
+        return a->calls > b->calls || (a->calls == b->calls && a->bytes > b->bytes);
+    case SORT_TIME:
+        return a->time > b->time || (a->time == b->time && a->calls > b->calls);
+    case SORT_BYTES:
+    default:
+        return a->bytes > b->bytes || (a->bytes == b->bytes && a->calls > b->calls);
+    }
+}
+
+
+template <class T>
+static std::vector<const T *>
+sorted(const std::vector<T> &items) {
+    std::vector<const T *> result;
+    for (size_t i = 0; i < items.size(); ++i) {
+        if (items[i].calls) {
+            result.push_back(&items[i]);
+        }
+    }
+    std::stable_sort(result.begin(), result.end(), heavier);
+    return result;
+}
+
+
+/**
+ * Lower bound of a blob size bucket.
+ */
+static unsigned long long
+bucketStart(unsigned bucket) {
+    return bucket ? 1ULL << (bucket - 1) : 0;
+}
+
+static unsigned long long
+bucketEnd(unsigned bucket) {
+    return bucket ? (1ULL << bucket) - 1 : 0;
+}
+
+
+static std::string
+percentage(unsigned long long part, unsigned long long whole) {
+    std::ostringstream os;
+    os << std::fixed << std::setprecision(1)
+       << (whole ? 100.0 * part / whole : 0.0) << "%";
+    return os.str();
+}
+
+
+static std::string
+milliseconds(unsigned long long ns) {
+    std::ostringstream os;
+    os << std::fixed << std::setprecision(3) << ns * 1.0e-6;
+    return os.str();
+}
+
+
+static void
+writeText(StatsScanner &stats) {
+    const Totals &total = stats.total;
+
+    std::cout
+        << "calls: " << total.calls << "\n"
+        << "frames: " << stats.frames.size() << "\n"
+        << "threads: " << stats.threads.size() << "\n"
+        << "bytes: " << total.bytes << "\n"
+        << "blob bytes: " << total.blobBytes
+        << " (" << percentage(total.blobBytes, total.bytes) << ")\n";
+    if (stats.timed) {
+        std::cout << "call time: " << milliseconds(total.time) << " ms\n";
+    }
+
+    const char *key = sortKey == SORT_CALLS ? "calls" :
+                      sortKey == SORT_TIME ? "time" : "bytes";
+
+    std::vector<const FunctionStats *> functions = sorted(stats.functions);
+    size_t count = top ? std::min<size_t>(top, functions.size()) : functions.size();
+    std::cout
+        << "\n"
+        << "functions by " << key << ":\n"
+        << std::setw(12) << "calls" << std::setw(8) << ""
+        << std::setw(14) << "bytes" << std::setw(8) << ""
+        << std::setw(14) << "blob bytes";
+    if (stats.timed) {
+        std::cout
+            << std::setw(14) << "time (ms)" << std::setw(8) << "";
+    }
+    std::cout << "  name\n";
+    for (size_t i = 0; i < count; ++i) {
+        const FunctionStats &function = *functions[i];
+        std::cout
+            << std::setw(12) << function.calls
+            << std::setw(8) << percentage(function.calls, total.calls)
+            << std::setw(14) << function.bytes
+            << std::setw(8) << percentage(function.bytes, total.bytes)
+            << std::setw(14) << function.blobBytes;
+        if (stats.timed) {
+            std::cout
+                << std::setw(14) << milliseconds(function.time)
+                << std::setw(8) << percentage(function.time, total.time);
+        }
+        std::cout << "  " << function.name << "\n";
+    }
+
+    std::vector<const FrameStats *> frames = sorted(stats.frames);
+    count = top ? std::min<size_t>(top, frames.size()) : frames.size();
+    std::cout
+        << "\n"
+        << "frames by " << key << ":\n"
+        << std::setw(8) << "frame"
+        << std::setw(12) << "first call"
+        << std::setw(12) << "calls"
+        << std::setw(14) << "bytes"
+        << std::setw(14) << "blob bytes";
+    if (stats.timed) {
+        std::cout
+            << std::setw(14) << "time (ms)"
+            << std::setw(14) << "elapsed (ms)";
+    }
+    std::cout << "\n";
+    for (size_t i = 0; i < count; ++i) {
+        const FrameStats &frame = *frames[i];
+        std::cout
+            << std::setw(8) << frame.no
+            << std::setw(12) << frame.firstCall
+            << std::setw(12) << frame.calls
+            << std::setw(14) << frame.bytes
+            << std::setw(14) << frame.blobBytes;
+        if (stats.timed) {
+            std::cout
+                << std::setw(14) << milliseconds(frame.time)
+                << std::setw(14) << milliseconds(frame.elapsed());
+        }
+        std::cout << "\n";
+    }
+
+    std::cout
+        << "\n"
+        << "blob sizes:\n"
+        << std::setw(25) << "size"
+        << std::setw(12) << "blobs"
+        << std::setw(14) << "bytes" << "\n";
+    for (unsigned i = 0; i < stats.buckets.size(); ++i) {
+        const Totals &bucket = stats.buckets[i];
+        if (bucket.blobs) {
+            std::ostringstream range;
+            range << bucketStart(i) << "-" << bucketEnd(i);
+            std::cout
+                << std::setw(25) << range.str()
+                << std::setw(12) << bucket.blobs
+                << std::setw(14) << bucket.blobBytes << "\n";
+        }
+    }
+
+    std::cout
+        << "\n"
+        << "threads:\n"
+        << std::setw(8) << "thread"
+        << std::setw(12) << "calls" << "\n";
+    std::map<unsigned, unsigned long long>::const_iterator it;
+    for (it = stats.threads.begin(); it != stats.threads.end(); ++it) {
+        std::cout
+            << std::setw(8) << it->first
+            << std::setw(12) << it->second << "\n";
+    }
+}
+
+
+static int
+writeCSV(StatsScanner &stats) {
+    if (table == "functions") {
+        std::vector<const FunctionStats *> functions = sorted(stats.functions);
+        std::cout << "name,calls,bytes,blobs,blob_bytes,time_ns\n";
+        for (size_t i = 0; i < functions.size(); ++i) {
+            const FunctionStats &function = *functions[i];
+            std::cout
+                << function.name << ","
+                << function.calls << ","
+                << function.bytes << ","
+                << function.blobs << ","
+                << function.blobBytes << ","
+                << function.time << "\n";
+        }
+    } else if (table == "frames") {
+        std::cout << "frame,first_call,calls,bytes,blobs,blob_bytes,time_ns,start_ns,elapsed_ns\n";
+        for (size_t i = 0; i < stats.frames.size(); ++i) {
+            const FrameStats &frame = stats.frames[i];
+            std::cout
+                << frame.no << ","
+                << frame.firstCall << ","
+                << frame.calls << ","
+                << frame.bytes << ","
+                << frame.blobs << ","
+                << frame.blobBytes << ","
+                << frame.time << ","
+                << frame.start << ","
+                << frame.elapsed() << "\n";
+        }
+    } else if (table == "blobs") {
+        std::cout << "min_size,max_size,blobs,bytes\n";
+        for (unsigned i = 0; i < stats.buckets.size(); ++i) {
+            const Totals &bucket = stats.buckets[i];
+            if (bucket.blobs) {
+                std::cout
+                    << bucketStart(i) << ","
+                    << bucketEnd(i) << ","
+                    << bucket.blobs << ","
+                    << bucket.blobBytes << "\n";
+            }
+        }
+    } else if (table == "threads") {
+        std::cout << "thread,calls\n";
+        std::map<unsigned, unsigned long long>::const_iterator it;
+        for (it = stats.threads.begin(); it != stats.threads.end(); ++it) {
+            std::cout << it->first << "," << it->second << "\n";
+        }
+    } else {
+        std::cerr << "error: unknown table " << table << "\n";
+        return 1;
+    }
+    return 0;
+}
+
+
+static void
+writeTotals(JSONWriter &json, const Totals &totals) {
+    json.writeNumberMember("calls", totals.calls);
+    json.writeNumberMember("bytes", totals.bytes);
+    json.writeNumberMember("blobs", totals.blobs);
+    json.writeNumberMember("blob_bytes", totals.blobBytes);
+    json.writeNumberMember("time_ns", totals.time);
+}
+
+
+static void
+writeJSON(StatsScanner &stats) {
+    JSONWriter json(std::cout);
+
+    writeTotals(json, stats.total);
+    json.writeNumberMember("frame_count", stats.frames.size());
+
+    json.beginMember("functions");
+    json.beginArray();
+    std::vector<const FunctionStats *> functions = sorted(stats.functions);
+    for (size_t i = 0; i < functions.size(); ++i) {
+        json.beginObject();
+        json.writeStringMember("name", functions[i]->name);
+        writeTotals(json, *functions[i]);
+        json.endObject();
+    }
+    json.endArray();
+    json.endMember();
+
+    json.beginMember("frames");
+    json.beginArray();
+    for (size_t i = 0; i < stats.frames.size(); ++i) {
+        json.beginObject();
+        json.writeNumberMember("first_call", stats.frames[i].firstCall);
+        writeTotals(json, stats.frames[i]);
+        json.writeNumberMember("start_ns", stats.frames[i].start);
+        json.writeNumberMember("elapsed_ns", stats.frames[i].elapsed());
+        json.endObject();
+    }
+    json.endArray();
+    json.endMember();
+
+    json.beginMember("blob_sizes");
+    json.beginArray();
+    for (unsigned i = 0; i < stats.buckets.size(); ++i) {
+        if (stats.buckets[i].blobs) {
+            json.beginObject();
+            json.writeNumberMember("min_size", bucketStart(i));
+            json.writeNumberMember("max_size", bucketEnd(i));
+            json.writeNumberMember("blobs", stats.buckets[i].blobs);
+            json.writeNumberMember("bytes", stats.buckets[i].blobBytes);
+            json.endObject();
+        }
+    }
+    json.endArray();
+    json.endMember();
+
+    json.beginMember("threads");
+    json.beginArray();
+    std::map<unsigned, unsigned long long>::const_iterator it;
+    for (it = stats.threads.begin(); it != stats.threads.end(); ++it) {
+        json.beginObject();
+        json.writeNumberMember("thread", it->first);
+        json.writeNumberMember("calls", it->second);
+        json.endObject();
+    }
+    json.endArray();
+    json.endMember();
+}
+
+
+static int
+command(int argc, char *argv[])
+{
+    int opt;
+    while ((opt = getopt_long(argc, argv, shortOptions, longOptions, NULL)) != -1) {
+        switch (opt) {
+        case 'h':
+            usage();
+            return 0;
+        case 'n':
+            top = atoi(optarg);
+            break;
+        case SORT_OPT:
+            if (strcmp(optarg, "calls") == 0) {
+                sortKey = SORT_CALLS;
+            } else if (strcmp(optarg, "bytes") == 0) {
+                sortKey = SORT_BYTES;
+            } else if (strcmp(optarg, "time") == 0) {
+                sortKey = SORT_TIME;
+            } else {
+                std::cerr << "error: unknown sort key " << optarg << "\n";
+                return 1;
+            }
+            break;
+        case FORMAT_OPT:
+            if (strcmp(optarg, "text") == 0) {
+                format = FORMAT_TEXT;
+            } else if (strcmp(optarg, "csv") == 0) {
+                format = FORMAT_CSV;
+            } else if (strcmp(optarg, "json") == 0) {
+                format = FORMAT_JSON;
+            } else {
+                std::cerr << "error: unknown format " << optarg << "\n";
+                return 1;
+            }
+            break;
+        case TABLE_OPT:
+            table = optarg;
+            break;
+        default:
+            std::cerr << "error: unexpected option `" << opt << "`\n";
+            usage();
+            return 1;
+        }
+    }
+
+    if (argc != optind + 1) {
+        std::cerr << "error: stats requires exactly one trace file as argument.\n";
+        usage();
+        return 1;
+    }
+
+    StatsScanner stats;
+    if (!stats.open(argv[optind])) {
+        std::cerr << "error: failed to open " << argv[optind] << "\n";
+        return 1;
+    }
+
+    stats.scan();
+
+    switch (format) {
+    case FORMAT_TEXT:
+        writeText(stats);
+        break;
+    case FORMAT_CSV:
+        return writeCSV(stats);
+    case FORMAT_JSON:
+        writeJSON(stats);
+        break;
+    }
+
+    return 0;
+}
+
+const Command stats_command = {
+    "stats",
+    synopsis,
+    usage,
+    command
+};
@@ -34,8 +34,9 @@
 #include "os_string.hpp"
 
 #include "trace_callset.hpp"
+#include "trace_copier.hpp"
 #include "trace_parser.hpp"
-#include "trace_writer.hpp"
+#include "trace_analyzer.hpp"
 
 static const char *synopsis = "Create a new trace by trimming an existing trace.";
 
@@ -48,15 +49,109 @@ usage(void)
         "\n"
         "    -h, --help               show this help message and exit\n"
         "        --calls=CALLSET      only retain specified calls\n"
+        "        --frames=FRAMESET    only retain calls from specified frames\n"
         "        --thread=THREAD_ID   only retain calls from specified thread\n"
+        "        --deps               also retain the earlier calls needed to\n"
+        "                             replay the retained ones (OpenGL only)\n"
         "    -o, --output=TRACE_FILE  output trace file\n"
         "\n"
     ;
 }
 
+struct TrimSelection
+{
+    trace::CallSet calls;
+    trace::CallSet frames;
+    int thread;
+
+    TrimSelection() :
+        calls(trace::FREQUENCY_ALL),
+        frames(trace::FREQUENCY_ALL),
+        thread(-1)
+    {}
+
+    inline bool
+    contains(unsigned call_no, unsigned thread_id, trace::CallFlags flags,
+             unsigned frame) const {
+        return calls.contains(call_no, flags) &&
+               frames.contains(frame) &&
+               (thread == -1 || thread_id == (unsigned)thread);
+    }
+};
+
+class TrimCopier : public trace::Copier
+{
+public:
+    const TrimSelection &selection;
+    const TraceAnalyzer *analyzer;
+    unsigned frame;
+
+    TrimCopier(const TrimSelection &_selection, const TraceAnalyzer *_analyzer) :
+        selection(_selection),
+        analyzer(_analyzer),
+        frame(0)
+    {}
+
+protected:
+    Action
+    filterCall(unsigned call_no, unsigned thread_id,
+               const trace::FunctionSig *sig, trace::CallFlags flags) {
+        bool keep;
+        if (analyzer) {
+            keep = analyzer->isRequired(call_no);
+        } else {
+            keep = selection.contains(call_no, thread_id, flags, frame);
+        }
+
+        if (flags & trace::CALL_FLAG_END_FRAME) {
+            ++frame;
+        }
+
+        return keep ? COPY : DROP;
+    }
+};
+
+/**
+ * Determine which calls the selected calls depend on.
+ */
+static bool
+analyze(const char *filename, const TrimSelection &selection,
+        TraceAnalyzer &analyzer)
+{
+    trace::Parser p;
+    if (!p.open(filename)) {
+        return false;
+    }
+
+    trace::CallNo lastCall = selection.calls.getLast();
+    trace::CallNo lastFrame = selection.frames.getLast();
+    unsigned frame = 0;
+
+    trace::Call *call;
+    while ((call = p.parse_call())) {
+        if (call->no > lastCall || frame > lastFrame) {
+            delete call;
+            break;
+        }
+
+        analyzer.analyze(call, selection.contains(call->no, call->thread_id,
+                                                  call->flags, frame));
+
+        if (call->flags & trace::CALL_FLAG_END_FRAME) {
+            ++frame;
+        }
+
+        delete call;
+    }
+
+    return true;
+}
+
 enum {
     CALLS_OPT = CHAR_MAX + 1,
+    FRAMES_OPT,
     THREAD_OPT,
+    DEPS_OPT,
 };
 
 const static char *
@@ -66,7 +161,9 @@ const static struct option
 longOptions[] = {
     {"help", no_argument, 0, 'h'},
     {"calls", required_argument, 0, CALLS_OPT},
+    {"frames", required_argument, 0, FRAMES_OPT},
     {"thread", required_argument, 0, THREAD_OPT},
+    {"deps", no_argument, 0, DEPS_OPT},
     {"output", required_argument, 0, 'o'},
     {0, 0, 0, 0}
 };
@@ -75,8 +172,8 @@ static int
 command(int argc, char *argv[])
 {
     std::string output;
-    trace::CallSet calls(trace::FREQUENCY_ALL);
-    int thread = -1;
+    TrimSelection selection;
+    bool deps = false;
     int i;
 
     int opt;
@@ -86,10 +183,16 @@ command(int argc, char *argv[])
             usage();
             return 0;
         case CALLS_OPT:
-            calls = trace::CallSet(optarg);
+            selection.calls = trace::CallSet(optarg);
+            break;
+        case FRAMES_OPT:
+            selection.frames = trace::CallSet(optarg);
             break;
         case THREAD_OPT:
-            thread = atoi(optarg);
+            selection.thread = atoi(optarg);
+            break;
+        case DEPS_OPT:
+            deps = true;
             break;
         case 'o':
             output = optarg;
@@ -108,7 +211,13 @@ command(int argc, char *argv[])
     }
 
     for (i = optind; i < argc; ++i) {
-        trace::Parser p;
+        TraceAnalyzer analyzer;
+        if (deps && !analyze(argv[i], selection, analyzer)) {
+            std::cerr << "error: failed to open " << argv[i] << "\n";
+            return 1;
+        }
+
+        TrimCopier p(selection, deps ? &analyzer : NULL);
         if (!p.open(argv[i])) {
             std::cerr << "error: failed to open " << argv[i] << "\n";
             return 1;
@@ -127,14 +236,7 @@ command(int argc, char *argv[])
             return 1;
         }
 
-        trace::Call *call;
-        while ((call = p.parse_call())) {
-            if (calls.contains(*call) &&
-                (thread == -1 || call->thread_id == thread)) {
-                writer.writeCall(call);
-            }
-            delete call;
-        }
+        p.copy(writer);
 
         std::cout << "Trimmed trace is available as " << output << "\n";
     }
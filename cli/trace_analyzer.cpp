@@ -0,0 +1,1020 @@
+/**************************************************************************
+ *
+ * Copyright 2012 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+#include <stdio.h>
+#include <string.h>
+
+#include "glimports.hpp"
+#include "trace_analyzer.hpp"
+
+
+static bool
+startsWith(const std::string &s, const char *prefix)
+{
+    return s.compare(0, strlen(prefix), prefix) == 0;
+}
+
+
+static std::string
+toString(signed long long n)
+{
+    char buf[32];
+    snprintf(buf, sizeof buf, "%lld", n);
+    return buf;
+}
+
+
+/**
+ * Strip the vendor suffix, so that extension functions are treated like
+ * their core counterparts.
+ */
+static std::string
+stripSuffix(const std::string &name)
+{
+    static const char *suffixes[] = {
+        "ARB", "EXT", "OES", "NV", "AMD", "ATI", "APPLE", "SGIS", "SGIX",
+        "KHR", "MESA", "IBM", "INTEL", "SUN"
+    };
+
+    for (unsigned i = 0; i < sizeof suffixes / sizeof suffixes[0]; ++i) {
+        size_t len = strlen(suffixes[i]);
+        if (name.size() > len &&
+            name.compare(name.size() - len, len, suffixes[i]) == 0) {
+            return name.substr(0, name.size() - len);
+        }
+    }
+
+    return name;
+}
+
+
+static const trace::Value *
+getArg(trace::Call *call, int index)
+{
+    if (index < 0) {
+        return call->ret;
+    }
+    if ((unsigned)index >= call->args.size()) {
+        return NULL;
+    }
+    return call->args[index].value;
+}
+
+
+static bool
+getNumber(const trace::Value *value, signed long long &n)
+{
+    if (const trace::SInt *sint = dynamic_cast<const trace::SInt *>(value)) {
+        n = sint->value;
+        return true;
+    }
+    if (const trace::UInt *uint = dynamic_cast<const trace::UInt *>(value)) {
+        n = (signed long long)uint->value;
+        return true;
+    }
+    return false;
+}
+
+
+static signed long long
+getArgNumber(trace::Call *call, int index)
+{
+    signed long long n = 0;
+    getNumber(getArg(call, index), n);
+    return n;
+}
+
+
+static void
+getNumbers(const trace::Value *value, std::vector<signed long long> &numbers)
+{
+    const trace::Array *array = dynamic_cast<const trace::Array *>(value);
+    if (array) {
+        for (size_t i = 0; i < array->size(); ++i) {
+            getNumbers(array->values[i], numbers);
+        }
+        return;
+    }
+
+    signed long long n;
+    if (getNumber(value, n)) {
+        numbers.push_back(n);
+    }
+}
+
+
+/**
+ * Whether an integer argument selects which state a call sets, rather than
+ * being the value it is set to.
+ */
+static bool
+isSelector(const char *argName)
+{
+    return strcmp(argName, "index") == 0 ||
+           strcmp(argName, "buf") == 0 ||
+           strcmp(argName, "unit") == 0 ||
+           strcmp(argName, "plane") == 0 ||
+           strcmp(argName, "light") == 0;
+}
+
+
+static std::string
+textureBinding(unsigned unit, signed long long target)
+{
+    if (target >= GL_TEXTURE_CUBE_MAP_POSITIVE_X &&
+        target <= GL_TEXTURE_CUBE_MAP_NEGATIVE_Z) {
+        target = GL_TEXTURE_CUBE_MAP;
+    }
+    return "binding:texture:" + toString(unit) + ":" + toString(target);
+}
+
+
+static const char *
+framebufferBinding(signed long long target)
+{
+    if (target == GL_READ_FRAMEBUFFER) {
+        return "binding:framebuffer:read";
+    } else {
+        return "binding:framebuffer:draw";
+    }
+}
+
+
+/**
+ * Pixel store parameters which affect how pixels are unpacked from memory.
+ */
+static const GLenum
+unpackParameters[] = {
+    GL_UNPACK_SWAP_BYTES,
+    GL_UNPACK_LSB_FIRST,
+    GL_UNPACK_ROW_LENGTH,
+    GL_UNPACK_SKIP_ROWS,
+    GL_UNPACK_SKIP_PIXELS,
+    GL_UNPACK_ALIGNMENT,
+    GL_UNPACK_IMAGE_HEIGHT,
+    GL_UNPACK_SKIP_IMAGES,
+    GL_UNPACK_COMPRESSED_BLOCK_WIDTH,
+    GL_UNPACK_COMPRESSED_BLOCK_HEIGHT,
+    GL_UNPACK_COMPRESSED_BLOCK_DEPTH,
+    GL_UNPACK_COMPRESSED_BLOCK_SIZE,
+};
+
+
+TraceAnalyzer::TraceAnalyzer() :
+    requiring(false),
+    generation(0),
+    activeTexture(0),
+    matrixMode(GL_MODELVIEW),
+    mappedBuffer(NULL),
+    mappedWhole(false),
+    currentList(NULL),
+    inBeginEnd(false)
+{
+}
+
+
+TraceAnalyzer::~TraceAnalyzer()
+{
+    for (unsigned i = 0; i < functions.size(); ++i) {
+        delete functions[i];
+    }
+    for (unsigned i = 0; i < allResources.size(); ++i) {
+        delete allResources[i];
+    }
+}
+
+
+const TraceAnalyzer::FunctionInfo &
+TraceAnalyzer::lookupFunction(trace::Call *call)
+{
+    const trace::FunctionSig *sig = call->sig;
+
+    if (sig->id >= functions.size()) {
+        functions.resize(sig->id + 1);
+    } else if (functions[sig->id]) {
+        return *functions[sig->id];
+    }
+
+    const AnalyzerFunction &spec = lookupAnalyzerFunction(sig->name);
+
+    FunctionInfo *info = new FunctionInfo;
+    info->handles = spec.handles;
+
+    std::string name = stripSuffix(sig->name);
+    if (startsWith(name, "glDisable")) {
+        name = "glEnable" + name.substr(strlen("glDisable"));
+    }
+    info->stateName = name;
+
+    bool output = false;
+    bool input = false;
+    for (const AnalyzerHandle *handle = spec.handles; handle->kind; ++handle) {
+        if (handle->output) {
+            output = true;
+        } else {
+            input = true;
+        }
+    }
+
+    Kind kind;
+    if (name == "memcpy") {
+        kind = KIND_MEMCPY;
+    } else if (startsWith(name, "glX") ||
+               startsWith(name, "wgl") ||
+               startsWith(name, "egl") ||
+               startsWith(name, "CGL")) {
+        if (call->flags & (trace::CALL_FLAG_NO_SIDE_EFFECTS |
+                           trace::CALL_FLAG_END_FRAME)) {
+            kind = KIND_IGNORE;
+        } else {
+            kind = KIND_KEEP;
+        }
+    } else if (!startsWith(name, "gl")) {
+        kind = KIND_IGNORE;
+    } else if ((spec.known && !spec.sideEffects) ||
+               (call->flags & (trace::CALL_FLAG_NO_SIDE_EFFECTS |
+                               trace::CALL_FLAG_END_FRAME))) {
+        kind = KIND_IGNORE;
+    } else if (name == "glBegin") {
+        kind = KIND_BEGIN;
+    } else if (name == "glEnd") {
+        kind = KIND_END;
+    } else if (name == "glNewList") {
+        kind = KIND_NEW_LIST;
+    } else if (name == "glEndList") {
+        kind = KIND_END_LIST;
+    } else if (call->flags & trace::CALL_FLAG_RENDER) {
+        kind = KIND_RENDER;
+    } else if (output) {
+        kind = KIND_CREATE;
+    } else if (input && startsWith(name, "glDelete")) {
+        kind = KIND_DELETE;
+    } else if (input &&
+               (startsWith(name, "glBind") || startsWith(name, "glUseProgram")) &&
+               name.find("Location") == std::string::npos) {
+        kind = KIND_BIND;
+    } else if (name == "glActiveTexture") {
+        kind = KIND_ACTIVE_TEXTURE;
+    } else if (startsWith(name, "glTexParameter")) {
+        kind = KIND_TEXTURE_PARAMETER;
+    } else if (startsWith(name, "glTexImage") ||
+               startsWith(name, "glTexSubImage") ||
+               startsWith(name, "glTexStorage") ||
+               startsWith(name, "glTexBuffer") ||
+               startsWith(name, "glCompressedTexImage") ||
+               startsWith(name, "glCompressedTexSubImage") ||
+               startsWith(name, "glCopyTexImage") ||
+               startsWith(name, "glCopyTexSubImage") ||
+               name == "glGenerateMipmap") {
+        kind = KIND_TEXTURE;
+    } else if (name == "glBufferData" ||
+               name == "glBufferStorage") {
+        kind = KIND_BUFFER_DATA;
+    } else if (name == "glBufferSubData" ||
+               name == "glMapBuffer" ||
+               name == "glMapBufferRange" ||
+               name == "glFlushMappedBufferRange" ||
+               name == "glUnmapBuffer") {
+        kind = KIND_BUFFER_SUBDATA;
+    } else if (startsWith(name, "glFramebufferTexture") ||
+               name == "glFramebufferRenderbuffer") {
+        kind = KIND_FRAMEBUFFER_ATTACHMENT;
+    } else if (startsWith(name, "glRenderbufferStorage")) {
+        kind = KIND_RENDERBUFFER;
+    } else if (startsWith(name, "glUniform") ||
+               startsWith(name, "glProgramUniform")) {
+        kind = KIND_UNIFORM;
+    } else if (startsWith(name, "glVertexAttribPointer") ||
+               startsWith(name, "glVertexAttribIPointer") ||
+               startsWith(name, "glVertexAttribLPointer") ||
+               startsWith(name, "glVertexAttribDivisor") ||
+               name == "glEnableVertexAttribArray" ||
+               name == "glVertexPointer" ||
+               name == "glNormalPointer" ||
+               name == "glColorPointer" ||
+               name == "glSecondaryColorPointer" ||
+               name == "glIndexPointer" ||
+               name == "glTexCoordPointer" ||
+               name == "glFogCoordPointer" ||
+               name == "glEdgeFlagPointer" ||
+               name == "glInterleavedArrays") {
+        kind = KIND_VERTEX_ARRAY;
+    } else if (input) {
+        kind = KIND_OBJECT;
+    } else if (name == "glMatrixMode") {
+        kind = KIND_MATRIX_MODE;
+    } else if (name == "glLoadIdentity" ||
+               startsWith(name, "glLoadMatrix") ||
+               startsWith(name, "glLoadTransposeMatrix")) {
+        kind = KIND_MATRIX_LOAD;
+    } else if (startsWith(name, "glMultMatrix") ||
+               startsWith(name, "glMultTransposeMatrix") ||
+               startsWith(name, "glTranslate") ||
+               startsWith(name, "glRotate") ||
+               startsWith(name, "glScale") ||
+               name == "glOrtho" ||
+               name == "glFrustum") {
+        kind = KIND_MATRIX_MULT;
+    } else if (name == "glPushMatrix" ||
+               name == "glPushAttrib" ||
+               name == "glPushClientAttrib") {
+        kind = KIND_PUSH;
+    } else if (name == "glPopMatrix" ||
+               name == "glPopAttrib" ||
+               name == "glPopClientAttrib") {
+        kind = KIND_POP;
+    } else {
+        kind = KIND_STATE;
+    }
+    info->kind = kind;
+
+    functions[sig->id] = info;
+    return *info;
+}
+
+
+/**
+ * Append the state slots whose key starts with the given prefix.
+ */
+void
+TraceAnalyzer::appendState(Slot &slot, const std::string &prefix)
+{
+    SlotMap::const_iterator it;
+    for (it = state.lower_bound(prefix);
+         it != state.end() && startsWith(it->first, prefix.c_str());
+         ++it) {
+        slot.append(it->second);
+    }
+}
+
+
+void
+TraceAnalyzer::requireSlot(const Slot &slot)
+{
+    requiredCalls.insert(slot.calls.begin(), slot.calls.end());
+    std::set<Resource *>::const_iterator it;
+    for (it = slot.links.begin(); it != slot.links.end(); ++it) {
+        requireResource(*it);
+    }
+}
+
+
+void
+TraceAnalyzer::requireResource(Resource *resource)
+{
+    if (resource->generation == generation) {
+        return;
+    }
+    resource->generation = generation;
+
+    requireSlot(resource->base);
+    SlotMap::const_iterator it;
+    for (it = resource->state.begin(); it != resource->state.end(); ++it) {
+        requireSlot(it->second);
+    }
+}
+
+
+TraceAnalyzer::Resource *
+TraceAnalyzer::createResource(const std::string &name)
+{
+    Resource *resource = new Resource;
+    allResources.push_back(resource);
+    resources[name] = resource;
+    return resource;
+}
+
+
+/**
+ * Lookup an object by name, creating it if it was not generated before, as
+ * binding unused names implicitly creates objects in legacy GL.
+ */
+TraceAnalyzer::Resource *
+TraceAnalyzer::lookupResource(const std::string &name)
+{
+    ResourceMap::iterator it = resources.find(name);
+    if (it != resources.end()) {
+        return it->second;
+    }
+    return createResource(name);
+}
+
+
+TraceAnalyzer::Resource *
+TraceAnalyzer::boundResource(const std::string &binding, const Slot **bindingSlot)
+{
+    static const Slot unbound;
+
+    SlotMap::const_iterator it = state.find(binding);
+    if (it == state.end()) {
+        *bindingSlot = &unbound;
+        return NULL;
+    }
+
+    *bindingSlot = &it->second;
+    if (it->second.links.empty()) {
+        return NULL;
+    }
+    return *it->second.links.begin();
+}
+
+
+void
+TraceAnalyzer::getResources(trace::Call *call, const FunctionInfo &info, bool output,
+                            std::vector<Resource *> &result,
+                            std::vector<std::string> *names)
+{
+    for (const AnalyzerHandle *handle = info.handles; handle->kind; ++handle) {
+        if (handle->output != output) {
+            continue;
+        }
+
+        std::vector<signed long long> numbers;
+        getNumbers(getArg(call, handle->index), numbers);
+
+        for (unsigned i = 0; i < numbers.size(); ++i) {
+            if (numbers[i] == 0) {
+                continue;
+            }
+            std::string name = std::string(handle->kind) + "-" + toString(numbers[i]);
+            result.push_back(output ? createResource(name) : lookupResource(name));
+            if (names) {
+                names->push_back(name);
+            }
+        }
+    }
+}
+
+
+/**
+ * Rendering is only of interest when targetting a framebuffer object, whose
+ * attachments may be used later on, in which case the call and the state
+ * it depends on are recorded as the framebuffer contents.
+ */
+void
+TraceAnalyzer::render(trace::Call *call, const FunctionInfo &info)
+{
+    const Slot *binding;
+    Resource *framebuffer = boundResource("binding:framebuffer:draw", &binding);
+    if (!framebuffer) {
+        return;
+    }
+
+    Slot &contents = framebuffer->state["contents"];
+
+    if (info.stateName == "glClear") {
+        contents = Slot();
+    }
+
+    // Calls between glBegin and glEnd need no state of their own
+    if (!inBeginEnd || info.kind == KIND_BEGIN) {
+        SlotMap::const_iterator it;
+        for (it = state.begin(); it != state.end(); ++it) {
+            contents.append(it->second);
+        }
+    }
+
+    std::vector<Resource *> inputs;
+    getResources(call, info, false, inputs);
+    contents.links.insert(inputs.begin(), inputs.end());
+
+    contents.calls.insert(call->no);
+}
+
+
+/**
+ * Require everything the current state refers to, including the state saved
+ * by glPush* calls, which the matching glPop* calls will restore.
+ */
+void
+TraceAnalyzer::requireState(void)
+{
+    ++generation;
+
+    SlotMap::const_iterator it;
+    for (it = state.begin(); it != state.end(); ++it) {
+        requireSlot(it->second);
+    }
+
+    // Default objects are in use whenever no other is bound
+    static const char *defaults[] = {"array-0", "texture-0"};
+    for (unsigned i = 0; i < sizeof defaults / sizeof defaults[0]; ++i) {
+        ResourceMap::const_iterator resource = resources.find(defaults[i]);
+        if (resource != resources.end()) {
+            requireResource(resource->second);
+        }
+    }
+
+    std::map<std::string, std::vector<SlotMap> >::const_iterator stack;
+    for (stack = stacks.begin(); stack != stacks.end(); ++stack) {
+        for (unsigned i = 0; i < stack->second.size(); ++i) {
+            const SlotMap &saved = stack->second[i];
+            for (it = saved.begin(); it != saved.end(); ++it) {
+                requireSlot(it->second);
+            }
+        }
+    }
+}
+
+
+void
+TraceAnalyzer::analyze(trace::Call *call, bool required)
+{
+    const FunctionInfo &info = lookupFunction(call);
+
+    if (required) {
+        if (!requiring) {
+            requireState();
+            requiring = true;
+        }
+
+        requireCall(call->no);
+
+        std::vector<Resource *> inputs;
+        getResources(call, info, false, inputs);
+        for (unsigned i = 0; i < inputs.size(); ++i) {
+            requireResource(inputs[i]);
+        }
+    } else {
+        requiring = false;
+    }
+
+    if (info.kind == KIND_KEEP) {
+        requireCall(call->no);
+        return;
+    }
+
+    if (currentList && info.kind != KIND_END_LIST) {
+        // Compiled into the display list
+        currentList->base.calls.insert(call->no);
+        std::vector<Resource *> inputs;
+        getResources(call, info, false, inputs);
+        currentList->base.links.insert(inputs.begin(), inputs.end());
+        return;
+    }
+
+    if (inBeginEnd) {
+        render(call, info);
+        if (info.kind == KIND_END) {
+            inBeginEnd = false;
+        }
+        return;
+    }
+
+    update(call, info);
+}
+
+
+void
+TraceAnalyzer::update(trace::Call *call, const FunctionInfo &info)
+{
+    const Slot *binding;
+    Slot slot;
+    slot.calls.insert(call->no);
+
+    switch (info.kind) {
+    case KIND_IGNORE:
+    case KIND_KEEP:
+        break;
+
+    case KIND_MEMCPY:
+        if (mappedBuffer) {
+            Slot &data = mappedBuffer->state["data"];
+            if (mappedWhole &&
+                (unsigned long long)getArgNumber(call, 2) >= mappedBuffer->size) {
+                data = mapping;
+            }
+            data.calls.insert(call->no);
+        }
+        break;
+
+    case KIND_STATE:
+        {
+            std::string key = info.stateName;
+            for (unsigned i = 0; i < call->args.size(); ++i) {
+                const trace::Value *value = call->args[i].value;
+                signed long long n;
+                if (!value ||
+                    !getNumber(value, n) ||
+                    (!dynamic_cast<const trace::Enum *>(value) &&
+                     !isSelector(call->sig->arg_names[i]))) {
+                    break;
+                }
+                key += ":" + toString(n);
+            }
+            state[key] = slot;
+        }
+        break;
+
+    case KIND_RENDER:
+        render(call, info);
+        break;
+
+    case KIND_BEGIN:
+        inBeginEnd = true;
+        render(call, info);
+        break;
+
+    case KIND_END:
+        break;
+
+    case KIND_CREATE:
+        {
+            std::vector<Resource *> outputs;
+            getResources(call, info, true, outputs);
+            for (unsigned i = 0; i < outputs.size(); ++i) {
+                outputs[i]->base = slot;
+            }
+        }
+        break;
+
+    case KIND_DELETE:
+        {
+            std::vector<Resource *> inputs;
+            std::vector<std::string> names;
+            getResources(call, info, false, inputs, &names);
+            for (unsigned i = 0; i < inputs.size(); ++i) {
+                // Deleting unbinds the object, except for current programs,
+                // which live on until no longer in use
+                bool current = false;
+                SlotMap::iterator it = state.begin();
+                while (it != state.end()) {
+                    SlotMap::iterator next = it;
+                    ++next;
+                    if (startsWith(it->first, "binding:") &&
+                        it->second.links.count(inputs[i])) {
+                        if (it->first == "binding:program" ||
+                            it->first == "binding:handleARB") {
+                            current = true;
+                        } else {
+                            state.erase(it);
+                        }
+                    }
+                    it = next;
+                }
+                if (!current) {
+                    resources.erase(names[i]);
+                }
+                if (inputs[i] == mappedBuffer) {
+                    mappedBuffer = NULL;
+                }
+            }
+        }
+        break;
+
+    case KIND_BIND:
+        {
+            const AnalyzerHandle *handle = info.handles;
+            std::string kind = handle->kind;
+
+            std::vector<Resource *> inputs;
+            getResources(call, info, false, inputs);
+            slot.links.insert(inputs.begin(), inputs.end());
+
+            if (kind == "framebuffer") {
+                signed long long target = getArgNumber(call, 0);
+                if (target == GL_FRAMEBUFFER) {
+                    state[framebufferBinding(GL_DRAW_FRAMEBUFFER)] = slot;
+                    state[framebufferBinding(GL_READ_FRAMEBUFFER)] = slot;
+                } else {
+                    state[framebufferBinding(target)] = slot;
+                }
+                break;
+            }
+
+            std::string key;
+            if (kind == "texture") {
+                Slot bindingSlot = state["glActiveTexture"];
+                bindingSlot.append(slot);
+                slot = bindingSlot;
+                key = textureBinding(activeTexture, getArgNumber(call, 0));
+            } else {
+                key = "binding:" + kind;
+                for (int i = 0; i < handle->index; ++i) {
+                    key += ":" + toString(getArgNumber(call, i));
+                }
+            }
+            state[key] = slot;
+
+            // The element array buffer binding is vertex array state
+            if (kind == "buffer" &&
+                getArgNumber(call, 0) == GL_ELEMENT_ARRAY_BUFFER) {
+                Resource *array = boundResource("binding:array", &binding);
+                if (!array) {
+                    array = lookupResource("array-0");
+                }
+                Slot &element = array->state["element"];
+                element = *binding;
+                element.append(slot);
+            }
+        }
+        break;
+
+    case KIND_OBJECT:
+        {
+            std::vector<Resource *> inputs;
+            getResources(call, info, false, inputs);
+            if (inputs.empty()) {
+                break;
+            }
+            Resource *object = inputs[0];
+            object->base.calls.insert(call->no);
+            for (unsigned i = 1; i < inputs.size(); ++i) {
+                object->base.links.insert(inputs[i]);
+                // Attachments depend on what is rendered into framebuffers
+                if (startsWith(info.handles->kind, "framebuffer")) {
+                    inputs[i]->base.links.insert(object);
+                }
+            }
+        }
+        break;
+
+    case KIND_ACTIVE_TEXTURE:
+        activeTexture = getArgNumber(call, 0) - GL_TEXTURE0;
+        state["glActiveTexture"] = slot;
+        break;
+
+    case KIND_TEXTURE:
+    case KIND_TEXTURE_PARAMETER:
+        {
+            Resource *texture = boundResource(textureBinding(activeTexture, getArgNumber(call, 0)), &binding);
+            if (!texture) {
+                texture = lookupResource("texture-0");
+            }
+
+            std::vector<Resource *> inputs;
+            getResources(call, info, false, inputs);
+
+            Slot update = *binding;
+            update.append(slot);
+            update.links.insert(inputs.begin(), inputs.end());
+
+            // Uploads read pixels as the unpack state and buffer say, and
+            // copies read them from the read framebuffer
+            if (startsWith(info.stateName, "glTexImage") ||
+                startsWith(info.stateName, "glTexSubImage") ||
+                startsWith(info.stateName, "glCompressedTex")) {
+                for (unsigned i = 0; i < sizeof unpackParameters / sizeof unpackParameters[0]; ++i) {
+                    std::string pname = toString(unpackParameters[i]);
+                    appendState(update, "glPixelStorei:" + pname);
+                    appendState(update, "glPixelStoref:" + pname);
+                }
+                boundResource("binding:buffer:" + toString(GL_PIXEL_UNPACK_BUFFER), &binding);
+                update.append(*binding);
+            } else if (startsWith(info.stateName, "glCopyTex")) {
+                boundResource(framebufferBinding(GL_READ_FRAMEBUFFER), &binding);
+                update.append(*binding);
+                appendState(update, "glReadBuffer:");
+            }
+
+            if (info.kind == KIND_TEXTURE_PARAMETER) {
+                texture->state[info.stateName + ":" + toString(getArgNumber(call, 1))] = update;
+            } else {
+                texture->base.append(update);
+            }
+        }
+        break;
+
+    case KIND_BUFFER_DATA:
+    case KIND_BUFFER_SUBDATA:
+        {
+            Resource *buffer = boundResource("binding:buffer:" + toString(getArgNumber(call, 0)), &binding);
+            if (!buffer) {
+                break;
+            }
+
+            Slot update = *binding;
+            update.append(slot);
+
+            // Forget the previous contents when wholly overwritten
+            Slot &data = buffer->state["data"];
+            if (info.kind == KIND_BUFFER_DATA) {
+                buffer->state["storage"] = update;
+                buffer->size = getArgNumber(call, 1);
+                data = Slot();
+            } else if (info.stateName == "glBufferSubData") {
+                if (getArgNumber(call, 1) == 0 &&
+                    (unsigned long long)getArgNumber(call, 2) >= buffer->size) {
+                    data = update;
+                } else {
+                    data.append(update);
+                }
+            } else if (info.stateName == "glMapBuffer") {
+                data.append(update);
+                mappedBuffer = buffer;
+                mappedWhole = true;
+                mapping = update;
+            } else if (info.stateName == "glMapBufferRange") {
+                if (getArgNumber(call, 3) & GL_MAP_INVALIDATE_BUFFER_BIT) {
+                    data = update;
+                } else {
+                    data.append(update);
+                }
+                mappedBuffer = buffer;
+                mappedWhole = getArgNumber(call, 1) == 0 &&
+                              (unsigned long long)getArgNumber(call, 2) >= buffer->size;
+                mapping = update;
+            } else {
+                data.append(update);
+                if (info.stateName == "glUnmapBuffer") {
+                    mappedBuffer = NULL;
+                }
+            }
+        }
+        break;
+
+    case KIND_FRAMEBUFFER_ATTACHMENT:
+        {
+            Resource *framebuffer = boundResource(framebufferBinding(getArgNumber(call, 0)), &binding);
+            if (!framebuffer) {
+                break;
+            }
+
+            std::vector<Resource *> inputs;
+            getResources(call, info, false, inputs);
+
+            Slot update = *binding;
+            update.append(slot);
+            update.links.insert(inputs.begin(), inputs.end());
+            framebuffer->state[info.stateName + ":" + toString(getArgNumber(call, 1))] = update;
+
+            // Attachments depend on what is rendered into framebuffers
+            for (unsigned i = 0; i < inputs.size(); ++i) {
+                inputs[i]->base.links.insert(framebuffer);
+            }
+        }
+        break;
+
+    case KIND_RENDERBUFFER:
+        {
+            Resource *renderbuffer = boundResource("binding:renderbuffer:" + toString(getArgNumber(call, 0)), &binding);
+            if (renderbuffer) {
+                renderbuffer->base.append(*binding);
+                renderbuffer->base.append(slot);
+            }
+        }
+        break;
+
+    case KIND_UNIFORM:
+        {
+            std::vector<Resource *> inputs;
+            getResources(call, info, false, inputs);
+
+            Resource *program;
+            signed long long location;
+            Slot update;
+            if (!inputs.empty()) {
+                program = inputs[0];
+                location = getArgNumber(call, 1);
+            } else {
+                program = boundResource("binding:program", &binding);
+                if (!program) {
+                    program = boundResource("binding:handleARB", &binding);
+                }
+                location = getArgNumber(call, 0);
+                update = *binding;
+            }
+            if (!program) {
+                break;
+            }
+
+            update.append(slot);
+            program->state[info.stateName + ":" + toString(location)] = update;
+        }
+        break;
+
+    case KIND_VERTEX_ARRAY:
+        {
+            Resource *array = boundResource("binding:array", &binding);
+            if (!array) {
+                array = lookupResource("array-0");
+            }
+
+            Slot update = *binding;
+
+            std::string key = info.stateName;
+            if (info.stateName.find("VertexAttrib") != std::string::npos) {
+                key += ":" + toString(getArgNumber(call, 0));
+            }
+
+            // Pointers refer to the bound array buffer
+            if (info.stateName.find("Pointer") != std::string::npos ||
+                info.stateName == "glInterleavedArrays") {
+                boundResource("binding:buffer:" + toString(GL_ARRAY_BUFFER), &binding);
+                update.append(*binding);
+            }
+
+            update.append(slot);
+            array->state[key] = update;
+        }
+        break;
+
+    case KIND_MATRIX_MODE:
+        matrixMode = getArgNumber(call, 0);
+        state["glMatrixMode"] = slot;
+        break;
+
+    case KIND_MATRIX_LOAD:
+    case KIND_MATRIX_MULT:
+        {
+            Slot &matrix = state["matrix:" + toString(matrixMode)];
+            if (info.kind == KIND_MATRIX_LOAD) {
+                matrix = state["glMatrixMode"];
+            } else {
+                matrix.append(state["glMatrixMode"]);
+            }
+            matrix.append(slot);
+        }
+        break;
+
+    case KIND_PUSH:
+        // Save the state that the matching pop will restore, so that the
+        // calls in between can be forgotten
+        if (info.stateName == "glPushMatrix") {
+            std::string key = "matrix:" + toString(matrixMode);
+            SlotMap saved;
+            saved[key] = state[key];
+            saved["push"] = slot;
+            stacks[key].push_back(saved);
+        } else {
+            stacks[info.stateName].push_back(state);
+            stacks[info.stateName].back()["push"] = slot;
+        }
+        break;
+
+    case KIND_POP:
+        {
+            std::string stack;
+            if (info.stateName == "glPopMatrix") {
+                stack = "matrix:" + toString(matrixMode);
+            } else {
+                stack = "glPush" + info.stateName.substr(strlen("glPop"));
+            }
+
+            std::vector<SlotMap> &saved = stacks[stack];
+            if (saved.empty()) {
+                break;
+            }
+            saved.back().erase("push");
+
+            if (info.stateName == "glPopMatrix") {
+                state[stack] = saved.back()[stack];
+            } else {
+                // Attributes do not include the matrices and the bindings
+                // of objects other than textures
+                SlotMap::iterator it;
+                for (it = state.begin(); it != state.end(); ++it) {
+                    if (startsWith(it->first, "matrix:") ||
+                        (startsWith(it->first, "binding:") &&
+                         !startsWith(it->first, "binding:texture:"))) {
+                        saved.back()[it->first] = it->second;
+                    }
+                }
+                state.swap(saved.back());
+            }
+            saved.pop_back();
+        }
+        break;
+
+    case KIND_NEW_LIST:
+        {
+            std::vector<Resource *> inputs;
+            getResources(call, info, false, inputs);
+            if (!inputs.empty()) {
+                currentList = inputs[0];
+                currentList->base = slot;
+            }
+        }
+        break;
+
+    case KIND_END_LIST:
+        if (currentList) {
+            currentList->base.calls.insert(call->no);
+            currentList = NULL;
+        }
+        break;
+    }
+}
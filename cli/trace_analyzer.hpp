@@ -0,0 +1,254 @@
+/**************************************************************************
+ *
+ * Copyright 2012 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ **************************************************************************/
+
+/*
+ * Dependency analysis of GL traces, used to trim traces down to the calls
+ * needed to replay a subset of them.
+ */
+
+#ifndef _TRACE_ANALYZER_HPP_
+#define _TRACE_ANALYZER_HPP_
+
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "trace_lookup.hpp"
+#include "trace_model.hpp"
+
+
+/**
+ * An object handle referred by a function.
+ */
+struct AnalyzerHandle
+{
+    /** Argument index, or -1 for the return value. */
+    int index;
+    /** Object kind, as named in the specs (e.g., "texture"). */
+    const char *kind;
+    /** Whether the handles are created by the call. */
+    bool output;
+};
+
+
+/**
+ * What the specs say about a function.
+ */
+struct AnalyzerFunction
+{
+    bool known;
+    bool sideEffects;
+    /** Terminated by an entry with a NULL kind. */
+    const AnalyzerHandle *handles;
+};
+
+
+/**
+ * Generated from the specs by trace_analyzer_gl.py.
+ */
+const AnalyzerFunction &
+lookupAnalyzerFunction(const char *name);
+
+
+/**
+ * Tracks which earlier calls each call depends on, in order to determine
+ * the smallest set of calls needed to replay the required ones.
+ *
+ * Calls must be analyzed in trace order.  The analysis models:
+ *
+ * - the lifetime of GL objects (creation, deletion), along with the calls
+ *   that defined them (e.g., glTexImage2D on a bound texture) and the other
+ *   objects they refer to (e.g., a framebuffer's attachments);
+ *
+ * - the binding points, and the state set by any other GL call, of which
+ *   only the last write per state is kept;
+ *
+ * - window system calls (context creation, make current), which are always
+ *   kept.
+ *
+ * When the first required call is analyzed, everything the current state
+ * refers to becomes required too.
+ */
+class TraceAnalyzer
+{
+public:
+    TraceAnalyzer();
+    ~TraceAnalyzer();
+
+    void analyze(trace::Call *call, bool required);
+
+    inline bool
+    isRequired(unsigned call_no) const {
+        return requiredCalls.find(call_no) != requiredCalls.end();
+    }
+
+    inline size_t
+    requiredCount(void) const {
+        return requiredCalls.size();
+    }
+
+private:
+    struct Resource;
+
+    /**
+     * A sequence of calls, along with the objects they refer to.
+     */
+    struct Slot {
+        /** A set, as the same state gets appended over and over. */
+        std::set<unsigned> calls;
+        std::set<Resource *> links;
+
+        void
+        append(const Slot &other) {
+            calls.insert(other.calls.begin(), other.calls.end());
+            links.insert(other.links.begin(), other.links.end());
+        }
+    };
+
+    typedef std::map<std::string, Slot> SlotMap;
+
+    /**
+     * A GL object.  It outlives its deletion, as other objects may still
+     * refer to it (e.g., a shader attached to a program).
+     */
+    struct Resource {
+        /** Calls that created and defined the object, in order. */
+        Slot base;
+        /** Last calls that set each of its states. */
+        SlotMap state;
+        /** Size of the data store, for buffers. */
+        unsigned long long size;
+        unsigned generation;
+
+        Resource() : size(0), generation(0) {}
+    };
+
+    typedef std::map<std::string, Resource *> ResourceMap;
+
+    enum Kind {
+        KIND_IGNORE = 0,
+        KIND_KEEP,
+        KIND_STATE,
+        KIND_RENDER,
+        KIND_BEGIN,
+        KIND_END,
+        KIND_CREATE,
+        KIND_DELETE,
+        KIND_BIND,
+        KIND_OBJECT,
+        KIND_ACTIVE_TEXTURE,
+        KIND_TEXTURE,
+        KIND_TEXTURE_PARAMETER,
+        KIND_BUFFER_DATA,
+        KIND_BUFFER_SUBDATA,
+        KIND_MEMCPY,
+        KIND_FRAMEBUFFER_ATTACHMENT,
+        KIND_RENDERBUFFER,
+        KIND_UNIFORM,
+        KIND_VERTEX_ARRAY,
+        KIND_MATRIX_MODE,
+        KIND_MATRIX_LOAD,
+        KIND_MATRIX_MULT,
+        KIND_PUSH,
+        KIND_POP,
+        KIND_NEW_LIST,
+        KIND_END_LIST
+    };
+
+    struct FunctionInfo {
+        Kind kind;
+        const AnalyzerHandle *handles;
+        /** Name without vendor suffix, and with Disable* mapped to Enable*. */
+        std::string stateName;
+    };
+
+    std::vector<FunctionInfo *> functions;
+
+    std::set<unsigned> requiredCalls;
+    bool requiring;
+    unsigned generation;
+
+    ResourceMap resources;
+    std::vector<Resource *> allResources;
+
+    /** Global state, including the object bindings. */
+    SlotMap state;
+
+    /** Saved states, by stack name. */
+    std::map<std::string, std::vector<SlotMap> > stacks;
+
+    unsigned activeTexture;
+    unsigned matrixMode;
+    Resource *mappedBuffer;
+    bool mappedWhole;
+    Slot mapping;
+    Resource *currentList;
+    bool inBeginEnd;
+
+    const FunctionInfo &
+    lookupFunction(trace::Call *call);
+
+    void
+    requireCall(unsigned call_no) {
+        requiredCalls.insert(call_no);
+    }
+
+    void
+    appendState(Slot &slot, const std::string &prefix);
+
+    void
+    requireSlot(const Slot &slot);
+
+    void
+    requireResource(Resource *resource);
+
+    void
+    requireState(void);
+
+    Resource *
+    createResource(const std::string &name);
+
+    Resource *
+    lookupResource(const std::string &name);
+
+    Resource *
+    boundResource(const std::string &binding, const Slot **bindingSlot);
+
+    void
+    getResources(trace::Call *call, const FunctionInfo &info, bool output,
+                 std::vector<Resource *> &result,
+                 std::vector<std::string> *names = NULL);
+
+    void
+    render(trace::Call *call, const FunctionInfo &info);
+
+    void
+    update(trace::Call *call, const FunctionInfo &info);
+};
+
+
+#endif /* _TRACE_ANALYZER_HPP_ */
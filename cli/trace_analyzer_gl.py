@@ -0,0 +1,118 @@
+##########################################################################
+#
+# Copyright 2012 VMware, Inc.
+# All Rights Reserved.
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"), to deal
+# in the Software without restriction, including without limitation the rights
+# to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+# copies of the Software, and to permit persons to whom the Software is
+# furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in
+# all copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+# AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+# OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+# THE SOFTWARE.
+#
+##########################################################################/
+
+
+'''Generate the table of GL object handles used by the trim dependency
+analysis, from the API specs.'''
+
+
+# Adjust path
+import os.path
+import sys
+sys.path.insert(0, os.path.join(os.path.dirname(__file__), '..'))
+
+
+import specs.stdapi as stdapi
+import specs.glapi as glapi
+import specs.glesapi as glesapi
+
+
+class HandleCollector(stdapi.Traverser):
+    '''Collect the names of the handles referred by a type.'''
+
+    def __init__(self):
+        self.names = []
+
+    def visitHandle(self, handle):
+        # Locations are not objects, but indices in their program
+        if handle.name != 'location' and handle.name not in self.names:
+            self.names.append(handle.name)
+
+
+def getHandles(type):
+    collector = HandleCollector()
+    collector.visit(type)
+    return collector.names
+
+
+def main():
+    api = stdapi.API()
+    api.addApi(glapi.glapi)
+    api.addApi(glesapi.glesapi)
+
+    functions = {}
+    for function in api.functions:
+        functions.setdefault(function.name, function)
+
+    print '#include "trace_analyzer.hpp"'
+    print
+    print
+    print 'static const AnalyzerHandle _noHandles[] = {'
+    print '    {0, NULL, false}'
+    print '};'
+    print
+
+    entries = []
+    for name in sorted(functions.keys()):
+        function = functions[name]
+
+        handles = []
+        for arg in function.args:
+            for handle in getHandles(arg.type):
+                handles.append((arg.index, handle, arg.output))
+        for handle in getHandles(function.type):
+            handles.append((-1, handle, True))
+
+        if not handles and function.sideeffects:
+            continue
+
+        if handles:
+            print 'static const AnalyzerHandle _%s_handles[] = {' % name
+            for index, handle, output in handles:
+                print '    {%i, "%s", %s},' % (index, handle, str(output).lower())
+            print '    {0, NULL, false}'
+            print '};'
+            print
+            entries.append((name, function.sideeffects, '_%s_handles' % name))
+        else:
+            entries.append((name, function.sideeffects, '_noHandles'))
+
+    print 'static const trace::Entry<AnalyzerFunction>'
+    print 'functionTable[] = {'
+    for name, sideeffects, handles in entries:
+        print '    {"%s", {true, %s, %s}},' % (name, str(sideeffects).lower(), handles)
+    print '};'
+    print
+    print
+    print 'const AnalyzerFunction &'
+    print 'lookupAnalyzerFunction(const char *name)'
+    print '{'
+    print '    static const AnalyzerFunction unknown = {false, true, _noHandles};'
+    print '    return trace::entryLookup(name, functionTable, unknown);'
+    print '}'
+
+
+if __name__ == '__main__':
+    main()
@@ -32,6 +32,7 @@
 
 
 #include <iostream>
+#include <string>
 
 
 namespace formatter {
@@ -45,6 +46,12 @@ public:
     virtual ~Attribute() {}
 
     virtual void apply(std::ostream &) const {}
+
+    /**
+     * Text with the same effect as apply(), or NULL if the attribute can
+     * only be applied to the stream directly.
+     */
+    virtual const char *text(void) const { return ""; }
 };
 
 
@@ -69,11 +76,14 @@ public:
 
 class AnsiAttribute : public Attribute {
 protected:
-    const char *escape;
+    std::string sequence;
 public:
-    AnsiAttribute(const char *_escape) : escape(_escape) {}
+    AnsiAttribute(const char *_escape) : sequence(std::string("\33[") + _escape) {}
     void apply(std::ostream& os) const {
-        os << "\33[" << escape;
+        os << sequence;
+    }
+    const char *text(void) const {
+        return sequence.c_str();
     }
 };
 
@@ -166,6 +176,9 @@ public:
 
         SetConsoleTextAttribute(hConsoleOutput, wAttributes);
     }
+    const char *text(void) const {
+        return NULL;
+    }
 };
 
 
@@ -30,12 +30,56 @@
 
 #include <algorithm>
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define HAVE_SSE2 1
+#include <emmintrin.h>
+#endif
+
 #include "image.hpp"
 
 
 namespace image {
 
 
+/**
+ * Sum of the squared differences of two byte arrays.
+ */
+static unsigned long long
+sumSquaredDifferences(const unsigned char *a, const unsigned char *b, size_t n)
+{
+    unsigned long long sum = 0;
+    size_t i = 0;
+
+#ifdef HAVE_SSE2
+    const __m128i zero = _mm_setzero_si128();
+    while (n - i >= 16) {
+        // Each iteration adds at most 4 * 255^2 to each 32bit lane, so flush
+        // them to the 64bit sum before they may overflow
+        size_t end = i + std::min<size_t>((n - i) & ~(size_t)15, 4096 * 16);
+        __m128i acc = zero;
+        for (; i < end; i += 16) {
+            __m128i va = _mm_loadu_si128((const __m128i *)(a + i));
+            __m128i vb = _mm_loadu_si128((const __m128i *)(b + i));
+            __m128i lo = _mm_sub_epi16(_mm_unpacklo_epi8(va, zero), _mm_unpacklo_epi8(vb, zero));
+            __m128i hi = _mm_sub_epi16(_mm_unpackhi_epi8(va, zero), _mm_unpackhi_epi8(vb, zero));
+            acc = _mm_add_epi32(acc, _mm_madd_epi16(lo, lo));
+            acc = _mm_add_epi32(acc, _mm_madd_epi16(hi, hi));
+        }
+        unsigned int lanes[4];
+        _mm_storeu_si128((__m128i *)lanes, acc);
+        sum += (unsigned long long)lanes[0] + lanes[1] + lanes[2] + lanes[3];
+    }
+#endif
+
+    for (; i < n; ++i) {
+        int delta = a[i] - b[i];
+        sum += delta*delta;
+    }
+
+    return sum;
+}
+
+
 double Image::compare(Image &ref)
 {
     if (width != ref.width ||
@@ -57,12 +101,17 @@ double Image::compare(Image &ref)
 
     unsigned long long error = 0;
     for (unsigned y = 0; y < height; ++y) {
-        for (unsigned  x = 0; x < width; ++x) {
-            // FIXME: Ignore alpha channel until we are able to pick a visual
-            // that matches the traces
-            for (unsigned  c = 0; c < minChannels; ++c) {
-                int delta = pSrc[x*channels + c] - pRef[x*ref.channels + c];
-                error += delta*delta;
+        if (channels == ref.channels) {
+            // Rows are contiguous
+            error += sumSquaredDifferences(pSrc, pRef, width*channels);
+        } else {
+            for (unsigned  x = 0; x < width; ++x) {
+                // FIXME: Ignore alpha channel until we are able to pick a visual
+                // that matches the traces
+                for (unsigned  c = 0; c < minChannels; ++c) {
+                    int delta = pSrc[x*channels + c] - pRef[x*ref.channels + c];
+                    error += delta*delta;
+                }
             }
         }
 
@@ -31,6 +31,7 @@
 #include <assert.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include <fstream>
 
@@ -122,42 +123,35 @@ no_fp:
 }
 
 
-Image *
-readPNG(const char *filename)
+/*
+ * Read an image, converted to RGBA8, from a PNG read structure whose input
+ * was already set up.  The structure is destroyed.
+ */
+static Image *
+readPNG(png_structp png_ptr)
 {
-    FILE *fp;
-    png_structp png_ptr;
     png_infop info_ptr;
     png_infop end_info;
-    Image *image;
-
-    fp = fopen(filename, "rb");
-    if (!fp)
-        goto no_fp;
-
-    png_ptr = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
-    if (!png_ptr)
-        goto no_png;
+    Image * volatile image = NULL;
 
     info_ptr = png_create_info_struct(png_ptr);
     if (!info_ptr) {
         png_destroy_read_struct(&png_ptr, NULL, NULL);
-        goto no_png;
+        return NULL;
     }
 
     end_info = png_create_info_struct(png_ptr);
     if (!end_info) {
         png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
-        goto no_png;
+        return NULL;
     }
 
     if (setjmp(png_jmpbuf(png_ptr))) {
         png_destroy_read_struct(&png_ptr, &info_ptr, &end_info);
-        goto no_png;
+        delete image;
+        return NULL;
     }
 
-    png_init_io(png_ptr, fp);
-
     png_read_info(png_ptr, info_ptr);
 
     png_uint_32 width, height;
@@ -169,16 +163,19 @@ readPNG(const char *filename)
                  &compression_type, &filter_method);
 
     image = new Image(width, height);
-    if (!image)
-        goto no_image;
 
     /* Convert to RGBA8 */
     if (color_type == PNG_COLOR_TYPE_PALETTE)
         png_set_palette_to_rgb(png_ptr);
     if (color_type == PNG_COLOR_TYPE_GRAY && bit_depth < 8)
         png_set_expand_gray_1_2_4_to_8(png_ptr);
+    if (color_type == PNG_COLOR_TYPE_GRAY ||
+        color_type == PNG_COLOR_TYPE_GRAY_ALPHA)
+        png_set_gray_to_rgb(png_ptr);
     if (png_get_valid(png_ptr, info_ptr, PNG_INFO_tRNS))
         png_set_tRNS_to_alpha(png_ptr);
+    else if (!(color_type & PNG_COLOR_MASK_ALPHA))
+        png_set_add_alpha(png_ptr, 0xff, PNG_FILLER_AFTER);
     if (bit_depth == 16)
         png_set_strip_16(png_ptr);
 
@@ -189,15 +186,71 @@ readPNG(const char *filename)
 
     png_read_end(png_ptr, info_ptr);
     png_destroy_read_struct(&png_ptr, &info_ptr, &end_info);
-    fclose(fp);
     return image;
+}
+
+
+Image *
+readPNG(const char *filename)
+{
+    FILE *fp;
+    png_structp png_ptr;
+    Image *image;
+
+    fp = fopen(filename, "rb");
+    if (!fp)
+        return NULL;
+
+    png_ptr = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+    if (!png_ptr) {
+        fclose(fp);
+        return NULL;
+    }
+
+    png_init_io(png_ptr, fp);
+
+    image = readPNG(png_ptr);
 
-no_image:
-    png_destroy_read_struct(&png_ptr, &info_ptr, &end_info);
-no_png:
     fclose(fp);
-no_fp:
-    return NULL;
+    return image;
+}
+
+
+struct png_read_buffer
+{
+    const char *buffer;
+    size_t size;
+};
+
+static void
+pngReadCallback(png_structp png_ptr, png_bytep data, png_size_t length)
+{
+    struct png_read_buffer *buf = (struct png_read_buffer*) png_get_io_ptr(png_ptr);
+
+    if (length > buf->size)
+        png_error(png_ptr, "Unexpected end of buffer");
+
+    memcpy(data, buf->buffer, length);
+    buf->buffer += length;
+    buf->size -= length;
+}
+
+Image *
+readPNG(const char *buffer, size_t size)
+{
+    struct png_read_buffer png_mem;
+    png_structp png_ptr;
+
+    png_mem.buffer = buffer;
+    png_mem.size = size;
+
+    png_ptr = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+    if (!png_ptr)
+        return NULL;
+
+    png_set_read_fn(png_ptr, &png_mem, pngReadCallback);
+
+    return readPNG(png_ptr);
 }
 
 
@@ -75,6 +75,10 @@ void abort(void);
 void setExceptionCallback(void (*callback)(void));
 void resetExceptionCallback(void);
 
+#ifndef _WIN32
+bool setSignalHandler(int sig, void (*handler)(int));
+#endif
+
 } /* namespace os */
 
 #endif /* _OS_HPP_ */
@@ -305,5 +305,38 @@ resetExceptionCallback(void)
     gCallback = NULL;
 }
 
+/*
+ * Handle a signal which the application leaves with its default action,
+ * instead of treating it as a crash.  Returns false if the application
+ * already handles or ignores it.
+ */
+bool
+setSignalHandler(int sig, void (*handler)(int))
+{
+    struct sigaction old_action;
+    if (sigaction(sig, NULL, &old_action) < 0) {
+        return false;
+    }
+
+    if (sig < NUM_SIGNALS &&
+        (old_action.sa_flags & SA_SIGINFO) &&
+        old_action.sa_sigaction == signalHandler) {
+        // Look past our own exception handler, at what the application had
+        old_action = old_actions[sig];
+    }
+
+    if ((old_action.sa_flags & SA_SIGINFO) ||
+        old_action.sa_handler != SIG_DFL) {
+        return false;
+    }
+
+    struct sigaction new_action;
+    memset(&new_action, 0, sizeof new_action);
+    new_action.sa_handler = handler;
+    sigemptyset(&new_action.sa_mask);
+    new_action.sa_flags = SA_RESTART;
+    return sigaction(sig, &new_action, NULL) >= 0;
+}
+
 } /* namespace os */
 
@@ -94,6 +94,71 @@ namespace os {
     };
 
 
+    /**
+     * Like std::thread, but only for functions taking a single argument.
+     */
+    class thread
+    {
+    public:
+#ifdef _WIN32
+        typedef HANDLE native_handle_type;
+#else
+        typedef pthread_t native_handle_type;
+#endif
+
+        template <typename Function, typename Arg>
+        explicit thread(Function function, Arg arg) {
+            typedef Launcher<Function, Arg> L;
+            L *launcher = new L(function, arg);
+#ifdef _WIN32
+            DWORD id = 0;
+            _native_handle = CreateThread(NULL, 0, &L::run, static_cast<void *>(launcher), 0, &id);
+#else
+            pthread_create(&_native_handle, NULL, &L::run, static_cast<void *>(launcher));
+#endif
+        }
+
+        inline void
+        join(void) {
+#ifdef _WIN32
+            WaitForSingleObject(_native_handle, INFINITE);
+            CloseHandle(_native_handle);
+#else
+            pthread_join(_native_handle, NULL);
+#endif
+        }
+
+    private:
+        native_handle_type _native_handle;
+
+        template <typename Function, typename Arg>
+        struct Launcher {
+            Function function;
+            Arg arg;
+
+            Launcher(Function _function, Arg _arg) :
+                function(_function),
+                arg(_arg)
+            {}
+
+#ifdef _WIN32
+            static DWORD WINAPI
+#else
+            static void *
+#endif
+            run(void *param) {
+                Launcher *launcher = static_cast<Launcher *>(param);
+                launcher->function(launcher->arg);
+                delete launcher;
+                return 0;
+            }
+        };
+
+        thread(const thread &);
+        thread & operator = (const thread &);
+    };
+
+
     template <typename T>
     class thread_specific_ptr
     {
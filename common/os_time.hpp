@@ -56,7 +56,8 @@ namespace os {
     static const long long timeFrequency = 1000000LL;
 #endif
 
-    // Time from an unknown base in a unit determined by timeFrequency
+    // Monotonic time from an unknown base in a unit determined by
+    // timeFrequency
     inline long long
     getTime(void) {
 #if defined(_WIN32)
@@ -70,7 +71,7 @@ namespace os {
         return counter.QuadPart;
 #elif defined(__linux__)
         struct timespec tp;
-        if (clock_gettime(CLOCK_REALTIME, &tp) == -1) {
+        if (clock_gettime(CLOCK_MONOTONIC, &tp) == -1) {
             return 0;
         }
         return tp.tv_sec * 1000000000LL + tp.tv_nsec;
@@ -137,6 +137,19 @@ namespace trace {
             }
         }
 
+        // Upper bound of the calls in the set
+        CallNo
+        getLast() const {
+            CallNo last = 0;
+            RangeList::const_iterator it;
+            for (it = ranges.begin(); it != ranges.end(); ++it) {
+                if (it->stop > last) {
+                    last = it->stop;
+                }
+            }
+            return last;
+        }
+
         inline bool
         contains(CallNo callNo, CallFlags callFlags = FREQUENCY_ALL) const {
             if (empty()) {
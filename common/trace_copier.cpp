@@ -0,0 +1,327 @@
+/**************************************************************************
+ *
+ * Copyright 2012 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+#include <assert.h>
+#include <stdlib.h>
+
+#include <iostream>
+
+#include "trace_copier.hpp"
+
+
+namespace trace {
+
+
+Copier::Copier()
+{
+}
+
+
+Copier::~Copier()
+{
+}
+
+
+void Copier::copy(Writer &writer) {
+    int c;
+    while ((c = file->getc()) != -1) {
+        switch (c) {
+        case trace::EVENT_ENTER:
+            copy_enter(writer);
+            break;
+        case trace::EVENT_LEAVE:
+            copy_leave(writer);
+            break;
+        default:
+            std::cerr << "error: unknown event " << c << "\n";
+            exit(1);
+        }
+    }
+
+    // Calls to rewrite which were never left
+    while (!calls.empty()) {
+        Call *call = calls.front();
+        calls.pop_front();
+        call->flags |= CALL_FLAG_INCOMPLETE;
+        adjust_call_flags(call);
+        rewriteCall(writer, call);
+        delete call;
+    }
+
+    // Calls copied which were never left need no further action, as their
+    // leave events are simply missing in the output too
+    copied.clear();
+}
+
+
+void Copier::copy_enter(Writer &writer) {
+    unsigned thread_id;
+
+    if (version >= 4) {
+        thread_id = read_uint();
+    } else {
+        thread_id = 0;
+    }
+
+    FunctionSigFlags *sig = parse_function_sig();
+
+    unsigned call_no = next_call_no++;
+
+    switch (filterCall(call_no, thread_id, sig, sig->flags)) {
+    case COPY:
+        copied[call_no] = writer.beginEnter(sig, thread_id);
+        copy_call_details(writer);
+        writer.endEnter();
+        break;
+    case DROP:
+        skip_call_details();
+        break;
+    case REWRITE:
+        {
+            Call *call = new Call(sig, sig->flags, thread_id);
+            call->no = call_no;
+            if (parse_call_details(call, FULL)) {
+                calls.push_back(call);
+            } else {
+                delete call;
+            }
+        }
+        break;
+    }
+}
+
+
+void Copier::copy_leave(Writer &writer) {
+    unsigned call_no = read_call_no();
+
+    CallNoMap::iterator it = copied.find(call_no);
+    if (it != copied.end()) {
+        writer.beginLeave(it->second);
+        copied.erase(it);
+        copy_call_details(writer);
+        writer.endLeave();
+        return;
+    }
+
+    for (CallList::iterator it = calls.begin(); it != calls.end(); ++it) {
+        Call *call = *it;
+        if (call->no == call_no) {
+            calls.erase(it);
+            if (parse_call_details(call, FULL)) {
+                adjust_call_flags(call);
+                rewriteCall(writer, call);
+            }
+            delete call;
+            return;
+        }
+    }
+
+    // Dropped call
+    skip_call_details();
+}
+
+
+bool Copier::copy_call_details(Writer &writer) {
+    do {
+        int c = file->getc();
+        switch (c) {
+        case trace::CALL_END:
+            return true;
+        case trace::CALL_ARG:
+            writer.beginArg(read_uint());
+            copy_value(writer);
+            writer.endArg();
+            break;
+        case trace::CALL_RET:
+            writer.beginReturn();
+            copy_value(writer);
+            writer.endReturn();
+            break;
+        case trace::CALL_TIME:
+            {
+                unsigned long long time = read_uint();
+                unsigned long long duration = read_uint();
+                writer.writeTime(time, duration);
+            }
+            break;
+        default:
+            std::cerr << "error: unknown call detail " << c << "\n";
+            exit(1);
+        case -1:
+            return false;
+        }
+    } while(true);
+}
+
+
+bool Copier::skip_call_details(void) {
+    do {
+        int c = file->getc();
+        switch (c) {
+        case trace::CALL_END:
+            return true;
+        case trace::CALL_ARG:
+            skip_uint();
+            scan_value();
+            break;
+        case trace::CALL_RET:
+            scan_value();
+            break;
+        case trace::CALL_TIME:
+            skip_uint();
+            skip_uint();
+            break;
+        default:
+            std::cerr << "error: unknown call detail " << c << "\n";
+            exit(1);
+        case -1:
+            return false;
+        }
+    } while(true);
+}
+
+
+void Copier::copy_value(Writer &writer) {
+    int c = file->getc();
+    switch (c) {
+    case trace::TYPE_NULL:
+        writer.writeNull();
+        break;
+    case trace::TYPE_FALSE:
+        writer.writeBool(false);
+        break;
+    case trace::TYPE_TRUE:
+        writer.writeBool(true);
+        break;
+    case trace::TYPE_SINT:
+        writer.writeSInt(-(signed long long)read_uint());
+        break;
+    case trace::TYPE_UINT:
+        writer.writeUInt(read_uint());
+        break;
+    case trace::TYPE_FLOAT:
+        {
+            float value;
+            file->read(&value, sizeof value);
+            writer.writeFloat(value);
+        }
+        break;
+    case trace::TYPE_DOUBLE:
+        {
+            double value;
+            file->read(&value, sizeof value);
+            writer.writeDouble(value);
+        }
+        break;
+    case trace::TYPE_STRING:
+        {
+            size_t len = read_uint();
+            writer.writeString(read_bytes(len), len);
+        }
+        break;
+    case trace::TYPE_ENUM:
+        {
+            EnumSig *sig;
+            signed long long value;
+            if (version >= 3) {
+                sig = parse_enum_sig();
+                value = read_sint();
+            } else {
+                sig = parse_old_enum_sig();
+                assert(sig->num_values == 1);
+                value = sig->values->value;
+            }
+            writer.writeEnum(sig, value);
+        }
+        break;
+    case trace::TYPE_BITMASK:
+        {
+            BitmaskSig *sig = parse_bitmask_sig();
+            writer.writeBitmask(sig, read_uint());
+        }
+        break;
+    case trace::TYPE_ARRAY:
+        {
+            size_t len = read_uint();
+            writer.beginArray(len);
+            for (size_t i = 0; i < len; ++i) {
+                writer.beginElement();
+                copy_value(writer);
+                writer.endElement();
+            }
+            writer.endArray();
+        }
+        break;
+    case trace::TYPE_STRUCT:
+        {
+            StructSig *sig = parse_struct_sig();
+            writer.beginStruct(sig);
+            for (size_t i = 0; i < sig->num_members; ++i) {
+                copy_value(writer);
+            }
+            writer.endStruct();
+        }
+        break;
+    case trace::TYPE_BLOB:
+        {
+            size_t size = read_uint();
+            writer.writeBlob(read_bytes(size), size);
+        }
+        break;
+    case trace::TYPE_OPAQUE:
+        writer.writePointer(read_uint());
+        break;
+    case trace::TYPE_REPR:
+        writer.beginRepr();
+        copy_value(writer);
+        copy_value(writer);
+        writer.endRepr();
+        break;
+    default:
+        std::cerr << "error: unknown type " << c << "\n";
+        exit(1);
+    case -1:
+        break;
+    }
+}
+
+
+/**
+ * Read raw bytes into a buffer reused across calls.  The returned pointer is
+ * never NULL, even for zero sizes, as NULL would be written as a null value.
+ */
+const char *Copier::read_bytes(size_t size) {
+    if (buffer.size() < size + 1) {
+        buffer.resize(size + 1);
+    }
+    if (size) {
+        file->read(&buffer[0], size);
+    }
+    return &buffer[0];
+}
+
+
+} /* namespace trace */
@@ -0,0 +1,117 @@
+/**************************************************************************
+ *
+ * Copyright 2012 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ **************************************************************************/
+
+/*
+ * Trace to trace copying, without building the call model.
+ */
+
+#ifndef _TRACE_COPIER_HPP_
+#define _TRACE_COPIER_HPP_
+
+
+#include <map>
+#include <vector>
+
+#include "trace_parser.hpp"
+#include "trace_writer.hpp"
+
+
+namespace trace {
+
+
+/**
+ * Copies the events of a trace into a writer.
+ *
+ * Call details are decoded one token at a time and re-encoded straight
+ * away, so no Call or Value objects are created for the calls copied
+ * unchanged.  Signatures are written again the first time they are used in
+ * the output, and calls are renumbered, so that any subset of the calls
+ * can be copied.
+ */
+class Copier : protected Parser
+{
+public:
+    enum Action {
+        COPY = 0,
+        DROP,
+        /**
+         * Fully parse the call, and pass it to rewriteCall() once left.
+         */
+        REWRITE
+    };
+
+    using Parser::version;
+    using Parser::open;
+    using Parser::close;
+
+    Copier();
+
+    virtual ~Copier();
+
+    /**
+     * Copy all remaining events.
+     */
+    void copy(Writer &writer);
+
+protected:
+    /**
+     * Decide what to do with a call, when it is entered.
+     */
+    virtual Action
+    filterCall(unsigned call_no, unsigned thread_id,
+               const FunctionSig *sig, CallFlags flags) {
+        return COPY;
+    }
+
+    /**
+     * Write a call chosen for rewriting, which is deleted afterwards.  The
+     * default implementation writes it as is.
+     */
+    virtual void
+    rewriteCall(Writer &writer, Call *call) {
+        writer.writeCall(call);
+    }
+
+private:
+    // Input to output call numbers of the calls copied but not left yet
+    typedef std::map<unsigned, unsigned> CallNoMap;
+    CallNoMap copied;
+
+    std::vector<char> buffer;
+
+    void copy_enter(Writer &writer);
+    void copy_leave(Writer &writer);
+
+    bool copy_call_details(Writer &writer);
+    bool skip_call_details(void);
+    void copy_value(Writer &writer);
+
+    const char *read_bytes(size_t size);
+};
+
+
+} /* namespace trace */
+
+#endif /* _TRACE_COPIER_HPP_ */
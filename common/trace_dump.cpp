@@ -24,6 +24,12 @@
  **************************************************************************/
 
 
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
 #include <limits>
 
 #include "formatter.hpp"
@@ -33,114 +39,348 @@
 namespace trace {
 
 
+/*
+ * How every byte of a string is written.  Printable characters are copied as
+ * they are, carriage returns dropped, and anything else escaped in octal.
+ *
+ * The octal escapes repeat the middle digit instead of the most significant
+ * one, which is wrong, but kept so that the output stays comparable with
+ * older dumps.
+ */
+class EscapeTable
+{
+public:
+    bool plain[256];
+    unsigned char length[256];
+    char text[256][4];
+
+    EscapeTable() {
+        for (unsigned c = 0; c < 256; ++c) {
+            char *p = text[c];
+            plain[c] = false;
+            if (c == '\"') {
+                *p++ = '\\';
+                *p++ = '\"';
+            } else if (c == '\\') {
+                *p++ = '\\';
+                *p++ = '\\';
+            } else if ((c >= 0x20 && c <= 0x7e) || c == '\t') {
+                plain[c] = true;
+                *p++ = c;
+            } else if (c == '\r') {
+                // Ignore carriage-return
+            } else if (c == '\n') {
+                // Handled by the caller, as it resets the formatting
+                *p++ = '\n';
+            } else {
+                unsigned octal0 = c & 0x7;
+                unsigned octal1 = (c >> 3) & 0x7;
+                unsigned octal2 = (c >> 3) & 0x7;
+                *p++ = '\\';
+                if (octal2)
+                    *p++ = '0' + octal2;
+                if (octal1)
+                    *p++ = '0' + octal1;
+                *p++ = '0' + octal0;
+            }
+            length[c] = p - text[c];
+        }
+        // Terminates the strings
+        plain[0] = false;
+    }
+};
+
+static const EscapeTable escapeTable;
+
+
+/**
+ * Formats into a buffer, which is only written to the stream when flushed,
+ * so that the output ends up in large writes.  The buffer starts inline, so
+ * that dumping a single call needs no allocation, and grows as needed.  Integers and the most common
+ * floating point values are formatted by hand, with the same output
+ * std::ostream would give.
+ */
 class Dumper : public Visitor
 {
 protected:
     std::ostream &os;
     DumpFlags dumpFlags;
+    bool color;
     formatter::Formatter *formatter;
-    formatter::Attribute *normal;
-    formatter::Attribute *bold;
-    formatter::Attribute *italic;
-    formatter::Attribute *strike;
-    formatter::Attribute *red;
-    formatter::Attribute *pointer;
-    formatter::Attribute *literal;
+
+    struct Style {
+        formatter::Attribute *attribute;
+        const char *text;
+        size_t length;
+
+        void init(formatter::Attribute *_attribute) {
+            attribute = _attribute;
+            text = attribute->text();
+            length = text ? strlen(text) : 0;
+        }
+    };
+
+    Style normal;
+    Style bold;
+    Style italic;
+    Style strike;
+    Style red;
+    Style pointer;
+    Style literal;
+
+    // Text accumulated before CallDumper flushes it
+    static const size_t flushSize = 32*1024;
+
+    char *buf;
+    size_t size;
+    size_t capacity;
+    char inlineBuf[1024];
 
 public:
     Dumper(std::ostream &_os, DumpFlags _flags) : 
         os(_os),
-        dumpFlags(_flags)
+        dumpFlags(_flags),
+        buf(inlineBuf),
+        size(0),
+        capacity(sizeof inlineBuf)
     {
-        bool color = !(dumpFlags & DUMP_FLAG_NO_COLOR);
+        color = !(dumpFlags & DUMP_FLAG_NO_COLOR);
         formatter = formatter::defaultFormatter(color);
-        normal = formatter->normal();
-        bold = formatter->bold();
-        italic = formatter->italic();
-        strike = formatter->strike();
-        red = formatter->color(formatter::RED);
-        pointer = formatter->color(formatter::GREEN);
-        literal = formatter->color(formatter::BLUE);
+        normal.init(formatter->normal());
+        bold.init(formatter->bold());
+        italic.init(formatter->italic());
+        strike.init(formatter->strike());
+        red.init(formatter->color(formatter::RED));
+        pointer.init(formatter->color(formatter::GREEN));
+        literal.init(formatter->color(formatter::BLUE));
     }
 
-    ~Dumper() {
-        delete normal;
-        delete bold;
-        delete italic;
-        delete strike;
-        delete red;
-        delete pointer;
-        delete literal;
+    virtual ~Dumper() {
+        flush();
+        if (buf != inlineBuf) {
+            free(buf);
+        }
+        delete normal.attribute;
+        delete bold.attribute;
+        delete italic.attribute;
+        delete strike.attribute;
+        delete red.attribute;
+        delete pointer.attribute;
+        delete literal.attribute;
         delete formatter;
     }
 
+    void flush(void) {
+        if (size) {
+            os.write(buf, size);
+            size = 0;
+        }
+    }
+
+    /**
+     * Flush once enough text was accumulated.
+     */
+    void checkFlush(void) {
+        if (size >= flushSize) {
+            flush();
+        }
+    }
+
+protected:
+    bool grow(size_t needed) {
+        size_t newCapacity = capacity;
+        while (needed > newCapacity) {
+            newCapacity *= 2;
+        }
+        char *newBuf = (char *)malloc(newCapacity);
+        if (!newBuf) {
+            return false;
+        }
+        memcpy(newBuf, buf, size);
+        if (buf != inlineBuf) {
+            free(buf);
+        }
+        buf = newBuf;
+        capacity = newCapacity;
+        return true;
+    }
+
+    /**
+     * Room for length more bytes, or NULL if there is no memory for them,
+     * which can't happen for lengths up to the inline buffer size.
+     */
+    char *reserve(size_t length) {
+        if (size + length > capacity && !grow(size + length)) {
+            // Make do with the buffer we have
+            flush();
+            if (length > capacity) {
+                return NULL;
+            }
+        }
+        return buf + size;
+    }
+
+    inline void write(const char *s, size_t length) {
+        char *p = reserve(length);
+        if (p) {
+            memcpy(p, s, length);
+            size += length;
+        } else {
+            os.write(s, length);
+        }
+    }
+
+    inline void write(const char *s) {
+        write(s, strlen(s));
+    }
+
+    inline void write(char c) {
+        *reserve(1) = c;
+        ++size;
+    }
+
+    inline void write(const Style &style) {
+        if (!color) {
+            return;
+        }
+        if (style.text) {
+            write(style.text, style.length);
+        } else {
+            // Console attributes must be applied in sequence with the text
+            flush();
+            style.attribute->apply(os);
+        }
+    }
+
+    void writeUInt(unsigned long long value) {
+        char digits[20];
+        char *p = digits + sizeof digits;
+        do {
+            *--p = '0' + value % 10;
+            value /= 10;
+        } while (value);
+        write(p, digits + sizeof digits - p);
+    }
+
+    void writeSInt(signed long long value) {
+        if (value < 0) {
+            write('-');
+            writeUInt(-(unsigned long long)value);
+        } else {
+            writeUInt(value);
+        }
+    }
+
+    void writeHex(unsigned long long value) {
+        static const char hexDigits[] = "0123456789abcdef";
+        char digits[16];
+        char *p = digits + sizeof digits;
+        do {
+            *--p = hexDigits[value & 0xf];
+            value >>= 4;
+        } while (value);
+        write(p, digits + sizeof digits - p);
+    }
+
+    /**
+     * Same as writing to a stream with the given precision, i.e., printf's
+     * %.*g, but with integral values, by far the most common, done by hand.
+     */
+    void writeReal(double value, int precision, double limit) {
+        if (value > -limit && value < limit) {
+            signed long long integer = (signed long long)value;
+            if ((double)integer == value) {
+                if (integer == 0 && 1.0/value < 0) {
+                    write('-');
+                }
+                writeSInt(integer);
+                return;
+            }
+        }
+
+        char *p = reserve(32);
+        size += snprintf(p, 32, "%.*g", precision, value);
+    }
+
+public:
     void visit(Null *) {
-        os << literal << "NULL" << normal;
+        write(literal);
+        write("NULL", 4);
+        write(normal);
     }
 
     void visit(Bool *node) {
-        os << literal << (node->value ? "true" : "false") << normal;
+        write(literal);
+        if (node->value) {
+            write("true", 4);
+        } else {
+            write("false", 5);
+        }
+        write(normal);
     }
 
     void visit(SInt *node) {
-        os << literal << node->value << normal;
+        write(literal);
+        writeSInt(node->value);
+        write(normal);
     }
 
     void visit(UInt *node) {
-        os << literal << node->value << normal;
+        write(literal);
+        writeUInt(node->value);
+        write(normal);
     }
 
     void visit(Float *node) {
-        std::streamsize oldPrecision = os.precision(std::numeric_limits<float>::digits10 + 1);
-        os << literal << node->value << normal;
-        os.precision(oldPrecision);
+        write(literal);
+        writeReal(node->value, std::numeric_limits<float>::digits10 + 1, 1e7);
+        write(normal);
     }
 
     void visit(Double *node) {
-        std::streamsize oldPrecision = os.precision(std::numeric_limits<double>::digits10 + 1);
-        os << literal << node->value << normal;
-        os.precision(oldPrecision);
+        write(literal);
+        writeReal(node->value, std::numeric_limits<double>::digits10 + 1, 1e16);
+        write(normal);
     }
 
     void visit(String *node) {
-        os << literal << "\"";
-        for (const char *it = node->value; *it; ++it) {
-            unsigned char c = (unsigned char) *it;
-            if (c == '\"')
-                os << "\\\"";
-            else if (c == '\\')
-                os << "\\\\";
-            else if (c >= 0x20 && c <= 0x7e)
-                os << c;
-            else if (c == '\t') {
-                os << "\t";
-            } else if (c == '\r') {
-                // Ignore carriage-return
-            } else if (c == '\n') {
+        write(literal);
+        write('\"');
+        const unsigned char *run = (const unsigned char *)node->value;
+        const unsigned char *it = run;
+        while (true) {
+            unsigned char c = *it;
+            if (escapeTable.plain[c]) {
+                ++it;
+                continue;
+            }
+            write((const char *)run, it - run);
+            if (!c) {
+                break;
+            }
+            if (c == '\n') {
                 // Reset formatting so that it looks correct with 'less -R'
-                os << normal << '\n' << literal;
+                write(normal);
+                write('\n');
+                write(literal);
             } else {
-                unsigned octal0 = c & 0x7;
-                unsigned octal1 = (c >> 3) & 0x7;
-                unsigned octal2 = (c >> 3) & 0x7;
-                os << "\\";
-                if (octal2)
-                    os << octal2;
-                if (octal1)
-                    os << octal1;
-                os << octal0;
+                write(escapeTable.text[c], escapeTable.length[c]);
             }
+            run = ++it;
         }
-        os << "\"" << normal;
+        write('\"');
+        write(normal);
     }
 
     void visit(Enum *node) {
         const EnumValue *it = node->lookup();
+        write(literal);
         if (it) {
-            os << literal << it->name << normal;
-            return;
+            write(it->name);
+        } else {
+            writeSInt(node->value);
         }
-        os << literal << node->value << normal;
+        write(normal);
     }
 
     void visit(Bitmask *bitmask) {
@@ -152,9 +392,11 @@ public:
             if ((it->value && (value & it->value) == it->value) ||
                 (!it->value && value == 0)) {
                 if (!first) {
-                    os << " | ";
+                    write(" | ", 3);
                 }
-                os << literal << it->name << normal;
+                write(literal);
+                write(it->name);
+                write(normal);
                 value &= ~it->value;
                 first = false;
             }
@@ -164,46 +406,60 @@ public:
         }
         if (value || first) {
             if (!first) {
-                os << " | ";
+                write(" | ", 3);
             }
-            os << literal << "0x" << std::hex << value << std::dec << normal;
+            write(literal);
+            write("0x", 2);
+            writeHex(value);
+            write(normal);
         }
     }
 
     void visit(Struct *s) {
-        const char *sep = "";
-        os << "{";
+        write('{');
         for (unsigned i = 0; i < s->members.size(); ++i) {
-            os << sep << italic << s->sig->member_names[i] << normal << " = ";
+            if (i) {
+                write(", ", 2);
+            }
+            write(italic);
+            write(s->sig->member_names[i]);
+            write(normal);
+            write(" = ", 3);
             _visit(s->members[i]);
-            sep = ", ";
         }
-        os << "}";
+        write('}');
     }
 
     void visit(Array *array) {
         if (array->values.size() == 1) {
-            os << "&";
+            write('&');
             _visit(array->values[0]);
         }
         else {
-            const char *sep = "";
-            os << "{";
+            write('{');
             for (std::vector<Value *>::iterator it = array->values.begin(); it != array->values.end(); ++it) {
-                os << sep;
+                if (it != array->values.begin()) {
+                    write(", ", 2);
+                }
                 _visit(*it);
-                sep = ", ";
             }
-            os << "}";
+            write('}');
         }
     }
 
     void visit(Blob *blob) {
-        os << pointer << "blob(" << blob->size << ")" << normal;
+        write(pointer);
+        write("blob(", 5);
+        writeUInt(blob->size);
+        write(')');
+        write(normal);
     }
 
     void visit(Pointer *p) {
-        os << pointer << "0x" << std::hex << p->value << std::dec << normal;
+        write(pointer);
+        write("0x", 2);
+        writeHex(p->value);
+        write(normal);
     }
 
     void visit(Repr *r) {
@@ -212,49 +468,70 @@ public:
 
     void visit(Call *call) {
         CallFlags callFlags = call->flags;
-        
+
+        if (dumpFlags & DUMP_FLAG_THREAD_IDS) {
+            writeHex(call->thread_id);
+            write(' ');
+        }
+
         if (!(dumpFlags & DUMP_FLAG_NO_CALL_NO)) {
-            os << call->no << " ";
+            writeUInt(call->no);
+            write(' ');
         }
 
         if (callFlags & CALL_FLAG_NON_REPRODUCIBLE) {
-            os << strike;
+            write(strike);
         } else if (callFlags & (CALL_FLAG_FAKE | CALL_FLAG_NO_SIDE_EFFECTS)) {
-            os << normal;
+            write(normal);
         } else {
-            os << bold;
+            write(bold);
         }
-        os << call->sig->name << normal;
+        write(call->sig->name);
+        write(normal);
 
-        os << "(";
-        const char *sep = "";
+        write('(');
         for (unsigned i = 0; i < call->args.size(); ++i) {
-            os << sep;
+            if (i) {
+                write(", ", 2);
+            }
             if (!(dumpFlags & DUMP_FLAG_NO_ARG_NAMES)) {
-                os << italic << call->sig->arg_names[i] << normal << " = ";
+                write(italic);
+                write(call->sig->arg_names[i]);
+                write(normal);
+                write(" = ", 3);
             }
             if (call->args[i].value) {
                 _visit(call->args[i].value);
             } else {
-               os << "?";
+                write('?');
             }
-            sep = ", ";
         }
-        os << ")";
+        write(')');
 
         if (call->ret) {
-            os << " = ";
+            write(" = ", 3);
             _visit(call->ret);
         }
         
         if (callFlags & CALL_FLAG_INCOMPLETE) {
-            os << " // " << red << "incomplete" << normal;
+            write(" // ", 4);
+            write(red);
+            write("incomplete", 10);
+            write(normal);
+        }
+
+        if ((dumpFlags & DUMP_FLAG_CALL_TIMES) && call->timed) {
+            write(" // time = ", 11);
+            writeUInt(call->time);
+            write(" ns, duration = ", 16);
+            writeUInt(call->duration);
+            write(" ns", 3);
         }
         
-        os << "\n";
+        write('\n');
 
         if (callFlags & CALL_FLAG_END_FRAME) {
-            os << "\n";
+            write('\n');
         }
     }
 };
@@ -272,4 +549,26 @@ void dump(Call &call, std::ostream &os, DumpFlags flags) {
 }
 
 
+CallDumper::CallDumper(std::ostream &os, DumpFlags flags) :
+    dumper(new Dumper(os, flags))
+{
+}
+
+
+CallDumper::~CallDumper() {
+    delete dumper;
+}
+
+
+void CallDumper::dump(Call &call) {
+    dumper->visit(&call);
+    dumper->checkFlush();
+}
+
+
+void CallDumper::flush(void) {
+    dumper->flush();
+}
+
+
 } /* namespace trace */
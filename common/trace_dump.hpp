@@ -45,6 +45,8 @@ enum {
     DUMP_FLAG_NO_COLOR                 = (1 << 0),
     DUMP_FLAG_NO_ARG_NAMES             = (1 << 1),
     DUMP_FLAG_NO_CALL_NO               = (1 << 2),
+    DUMP_FLAG_THREAD_IDS               = (1 << 3),
+    DUMP_FLAG_CALL_TIMES               = (1 << 4),
 };
 
 
@@ -68,6 +70,38 @@ inline std::ostream & operator <<(std::ostream &os, Call &call) {
 }
 
 
+class Dumper;
+
+
+/**
+ * Dumps many calls to the same stream.
+ *
+ * Unlike dump(), which sets up the formatting for every call and writes
+ * the text as it goes, the formatting is set up once, and the text of
+ * several calls written to the stream at a time, so this should be preferred
+ * for dumping whole traces.
+ */
+class CallDumper
+{
+public:
+    CallDumper(std::ostream &os, DumpFlags flags = 0);
+    ~CallDumper();
+
+    void dump(Call &call);
+
+    /**
+     * Write out the text of the calls dumped so far.
+     */
+    void flush(void);
+
+private:
+    Dumper *dumper;
+
+    CallDumper(const CallDumper &);
+    CallDumper & operator = (const CallDumper &);
+};
+
+
 } /* namespace trace */
 
 #endif /* _TRACE_DUMP_HPP_ */
@@ -40,12 +40,19 @@ public:
         Write
     };
     struct Offset {
-        Offset(uint64_t _chunk = 0, uint32_t _offsetInChunk = 0)
+        Offset(uint64_t _chunk = 0, uint32_t _offsetInChunk = 0,
+               uint32_t _segment = 0)
             : chunk(_chunk),
-              offsetInChunk(_offsetInChunk)
+              offsetInChunk(_offsetInChunk),
+              segment(_segment)
         {}
         uint64_t chunk;
         uint32_t offsetInChunk;
+        /**
+         * Segment of a segmented trace, counting from one, or zero for
+         * plain trace files.
+         */
+        uint32_t segment;
     };
 
 public:
@@ -53,6 +60,8 @@ public:
     static bool isSnappyCompressed(const std::string &filename);
     static File *createZLib(void);
     static File *createSnappy(void);
+    static bool isSegmentList(const std::string &filename);
+    static File *createSegmented(void);
     static File *createForRead(const char *filename);
     static File *createForWrite(const char *filename);
 public:
@@ -75,6 +84,15 @@ public:
     virtual bool supportsOffsets() const = 0;
     virtual File::Offset currentOffset() = 0;
     virtual void setCurrentOffset(const File::Offset &offset);
+
+    /**
+     * Segmented traces number the calls of every segment from zero, so that
+     * each segment can be parsed on its own.  This is the number of calls
+     * in the segments before the current one.
+     */
+    virtual unsigned segmentCallBase() {
+        return 0;
+    }
 protected:
     virtual bool rawOpen(const std::string &filename, File::Mode mode) = 0;
     virtual bool rawWrite(const void *buffer, size_t length) = 0;
@@ -170,22 +188,24 @@ inline bool File::skip(size_t length)
 inline bool
 operator<(const File::Offset &one, const File::Offset &two)
 {
-    return one.chunk < two.chunk ||
-            (one.chunk == two.chunk && one.offsetInChunk < two.offsetInChunk);
+    return one.segment < two.segment ||
+            (one.segment == two.segment &&
+             (one.chunk < two.chunk ||
+              (one.chunk == two.chunk && one.offsetInChunk < two.offsetInChunk)));
 }
 
 inline bool
 operator==(const File::Offset &one, const File::Offset &two)
 {
-    return one.chunk == two.chunk &&
+    return one.segment == two.segment &&
+            one.chunk == two.chunk &&
             one.offsetInChunk == two.offsetInChunk;
 }
 
 inline bool
 operator>=(const File::Offset &one, const File::Offset &two)
 {
-    return one.chunk > two.chunk ||
-            (one.chunk == two.chunk && one.offsetInChunk >= two.offsetInChunk);
+    return !(one < two);
 }
 
 inline bool
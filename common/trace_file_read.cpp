@@ -36,7 +36,9 @@ File::createForRead(const char *filename)
 {
     File *file;
 
-    if (File::isSnappyCompressed(filename)) {
+    if (File::isSegmentList(filename)) {
+        file = File::createSegmented();
+    } else if (File::isSnappyCompressed(filename)) {
         file = File::createSnappy();
     } else if (File::isZLibCompressed(filename)) {
         file = File::createZLib();
@@ -0,0 +1,274 @@
+/**************************************************************************
+ *
+ * Copyright 2012 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "os.hpp"
+#include "os_string.hpp"
+#include "trace_file.hpp"
+#include "trace_segments.hpp"
+
+
+#define SEGMENT_LIST_MAGIC "# apitrace segments"
+
+
+namespace trace {
+
+
+bool
+readSegmentList(const char *filename, SegmentList &segments)
+{
+    FILE *fp = fopen(filename, "rt");
+    if (!fp) {
+        return false;
+    }
+
+    segments.clear();
+
+    char line[4096];
+    while (fgets(line, sizeof line, fp)) {
+        if (line[0] == '#' || line[0] == '\n' || line[0] == '\r') {
+            continue;
+        }
+
+        char name[4096];
+        Segment segment;
+        if (sscanf(line, "%4095s %u %u %u %u", name,
+                   &segment.firstCall, &segment.lastCall,
+                   &segment.firstFrame, &segment.lastFrame) != 5) {
+            os::log("error: malformed segment list entry in %s: %s", filename, line);
+            fclose(fp);
+            return false;
+        }
+        segment.filename = name;
+        segments.push_back(segment);
+    }
+
+    fclose(fp);
+    return true;
+}
+
+
+bool
+writeSegmentList(const char *filename, const SegmentList &segments)
+{
+    std::string tmpname = std::string(filename) + ".tmp";
+
+    FILE *fp = fopen(tmpname.c_str(), "wt");
+    if (!fp) {
+        return false;
+    }
+
+    fprintf(fp, "%s\n", SEGMENT_LIST_MAGIC);
+    fprintf(fp, "# file first_call last_call first_frame last_frame\n");
+    for (SegmentList::const_iterator it = segments.begin(); it != segments.end(); ++it) {
+        fprintf(fp, "%s %u %u %u %u\n", it->filename.c_str(),
+                it->firstCall, it->lastCall, it->firstFrame, it->lastFrame);
+    }
+
+    if (fclose(fp) != 0) {
+        remove(tmpname.c_str());
+        return false;
+    }
+
+#ifdef _WIN32
+    // rename() does not replace existing files on Windows
+    remove(filename);
+#endif
+
+    return rename(tmpname.c_str(), filename) == 0;
+}
+
+
+/**
+ * Reads the segments of a segment list as a single file.
+ *
+ * The version header of every segment but the first is skipped, and the
+ * offsets tell the segment they belong to, so that the parser sees one
+ * trace.
+ */
+class SegmentedFile : public File {
+public:
+    SegmentedFile(void) :
+        m_current(NULL),
+        m_index(0)
+    {}
+
+    ~SegmentedFile() {
+        close();
+    }
+
+    virtual bool supportsOffsets() const {
+        return m_current && m_current->supportsOffsets();
+    }
+
+    virtual File::Offset currentOffset() {
+        File::Offset offset = m_current->currentOffset();
+        offset.segment = m_index + 1;
+        return offset;
+    }
+
+    virtual void setCurrentOffset(const File::Offset &offset) {
+        assert(offset.segment > 0 && offset.segment <= m_segments.size());
+        if (offset.segment != m_index + 1) {
+            openSegment(offset.segment - 1);
+        }
+        File::Offset segmentOffset = offset;
+        segmentOffset.segment = 0;
+        m_current->setCurrentOffset(segmentOffset);
+    }
+
+    virtual unsigned segmentCallBase() {
+        return m_segments[m_index].firstCall;
+    }
+
+protected:
+    virtual bool rawOpen(const std::string &filename, File::Mode mode) {
+        if (mode != File::Read) {
+            return false;
+        }
+
+        if (!readSegmentList(filename.c_str(), m_segments) ||
+            m_segments.empty()) {
+            os::log("error: no segments listed in %s\n", filename.c_str());
+            return false;
+        }
+
+        os::String dir(filename.c_str());
+        dir.trimFilename();
+        m_dir = dir.str();
+
+        return openSegment(0);
+    }
+
+    virtual bool rawWrite(const void *buffer, size_t length) {
+        return false;
+    }
+
+    virtual size_t rawRead(void *buffer, size_t length) {
+        size_t read;
+        while ((read = m_current->read(buffer, length)) == 0) {
+            if (!nextSegment()) {
+                return 0;
+            }
+        }
+        return read;
+    }
+
+    virtual int rawGetc() {
+        int c;
+        while ((c = m_current->getc()) == -1) {
+            if (!nextSegment()) {
+                return -1;
+            }
+        }
+        return c;
+    }
+
+    virtual void rawClose() {
+        delete m_current;
+        m_current = NULL;
+        m_segments.clear();
+        m_index = 0;
+    }
+
+    virtual void rawFlush() {
+    }
+
+    virtual bool rawSkip(size_t length) {
+        return m_current->skip(length);
+    }
+
+    virtual int rawPercentRead() {
+        return (m_index * 100 + m_current->percentRead()) / m_segments.size();
+    }
+
+private:
+    File *m_current;
+    unsigned m_index;
+    SegmentList m_segments;
+    std::string m_dir;
+
+    bool openSegment(unsigned index) {
+        os::String path(m_dir.c_str());
+        path.join(m_segments[index].filename.c_str());
+
+        File *file = File::createForRead(path.str());
+        if (!file) {
+            return false;
+        }
+
+        delete m_current;
+        m_current = file;
+        m_index = index;
+        return true;
+    }
+
+    bool nextSegment(void) {
+        if (m_index + 1 >= m_segments.size() ||
+            !openSegment(m_index + 1)) {
+            return false;
+        }
+
+        // Skip the version, which the parser only expects once
+        int c;
+        do {
+            c = m_current->getc();
+        } while (c != -1 && (c & 0x80));
+
+        return true;
+    }
+};
+
+
+bool
+File::isSegmentList(const std::string &filename)
+{
+    FILE *fp = fopen(filename.c_str(), "rt");
+    if (!fp) {
+        return false;
+    }
+
+    char line[sizeof SEGMENT_LIST_MAGIC];
+    bool result = fgets(line, sizeof line, fp) &&
+                  strcmp(line, SEGMENT_LIST_MAGIC) == 0;
+
+    fclose(fp);
+    return result;
+}
+
+
+File *
+File::createSegmented(void)
+{
+    return new SegmentedFile;
+}
+
+
+} /* namespace trace */
@@ -59,6 +59,7 @@
 #include <string.h>
 
 #include "trace_file.hpp"
+#include "trace_writer_stats.hpp"
 
 
 #define SNAPPY_CHUNK_SIZE (1 * 1024 * 1024)
@@ -253,15 +254,16 @@ void SnappyFile::rawClose()
         flushWriteCache();
     }
     m_stream.close();
-    delete [] m_cache;
-    m_cache = NULL;
-    m_cachePtr = NULL;
+    // Keep the cache around, in case the file is opened again
+    m_cachePtr = m_cache;
+    m_cacheSize = 0;
 }
 
 void SnappyFile::rawFlush()
 {
     assert(m_mode == File::Write);
     flushWriteCache();
+    WriterPhaseTimer timer(PHASE_DISK);
     m_stream.flush();
 }
 
@@ -272,9 +274,13 @@ void SnappyFile::flushWriteCache()
     if (inputLength) {
         size_t compressedLength;
 
-        ::snappy::RawCompress(m_cache, inputLength,
-                              m_compressedCache, &compressedLength);
+        {
+            WriterPhaseTimer timer(PHASE_COMPRESS);
+            ::snappy::RawCompress(m_cache, inputLength,
+                                  m_compressedCache, &compressedLength);
+        }
 
+        WriterPhaseTimer timer(PHASE_DISK);
         writeCompressedLength(compressedLength);
         m_stream.write(m_compressedCache, compressedLength);
         m_cachePtr = m_cache;
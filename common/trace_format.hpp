@@ -69,8 +69,12 @@ namespace trace {
  *
  * - version 4:
  *   - call enter events include thread ID
+ *
+ * - version 5:
+ *   - call leave events may include the time the call was entered and its
+ *   duration, in nanoseconds
  */
-#define TRACE_VERSION 4
+#define TRACE_VERSION 5
 
 
 /*
@@ -85,6 +89,7 @@ namespace trace {
  *
  *   call_detail = ARG index value
  *               | RET value
+ *               | TIME start duration
  *               | END
  *
  *   value = NULL
@@ -127,6 +132,7 @@ enum CallDetail {
     CALL_ARG,
     CALL_RET,
     CALL_THREAD,
+    CALL_TIME,
 };
 
 enum Type {
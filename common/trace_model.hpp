@@ -469,12 +469,23 @@ public:
 
     CallFlags flags;
 
+    /**
+     * When the call was entered, since the start of the trace, and how long
+     * it took, in nanoseconds.  Only valid if timed.
+     */
+    bool timed;
+    unsigned long long time;
+    unsigned long long duration;
+
     Call(FunctionSig *_sig, const CallFlags &_flags, unsigned _thread_id) :
         thread_id(_thread_id), 
         sig(_sig), 
         args(_sig->num_args), 
         ret(0),
-        flags(_flags) {
+        flags(_flags),
+        timed(false),
+        time(0),
+        duration(0) {
     }
 
     ~Call();
@@ -42,6 +42,7 @@ namespace trace {
 Parser::Parser() {
     file = NULL;
     next_call_no = 0;
+    filter = NULL;
     version = 0;
     api = API_UNKNOWN;
 
@@ -155,6 +156,89 @@ void Parser::close(void) {
 }
 
 
+static const char *
+copyString(const char *s) {
+    size_t len = strlen(s);
+    char *copy = new char[len + 1];
+    memcpy(copy, s, len + 1);
+    return copy;
+}
+
+
+void Parser::copySignatures(const Parser &other) {
+    assert(functions.empty());
+    assert(structs.empty());
+    assert(enums.empty());
+    assert(bitmasks.empty());
+
+    api = other.api;
+    glGetErrorSig = NULL;
+
+    functions.resize(other.functions.size());
+    for (size_t id = 0; id < other.functions.size(); ++id) {
+        const FunctionSigState *src = other.functions[id];
+        if (src) {
+            FunctionSigState *sig = new FunctionSigState(*src);
+            sig->name = copyString(src->name);
+            const char **arg_names = new const char *[sig->num_args];
+            for (unsigned i = 0; i < sig->num_args; ++i) {
+                arg_names[i] = copyString(src->arg_names[i]);
+            }
+            sig->arg_names = arg_names;
+            functions[id] = sig;
+            if (src == other.glGetErrorSig) {
+                glGetErrorSig = sig;
+            }
+        }
+    }
+
+    structs.resize(other.structs.size());
+    for (size_t id = 0; id < other.structs.size(); ++id) {
+        const StructSigState *src = other.structs[id];
+        if (src) {
+            StructSigState *sig = new StructSigState(*src);
+            sig->name = copyString(src->name);
+            const char **member_names = new const char *[sig->num_members];
+            for (unsigned i = 0; i < sig->num_members; ++i) {
+                member_names[i] = copyString(src->member_names[i]);
+            }
+            sig->member_names = member_names;
+            structs[id] = sig;
+        }
+    }
+
+    enums.resize(other.enums.size());
+    for (size_t id = 0; id < other.enums.size(); ++id) {
+        const EnumSigState *src = other.enums[id];
+        if (src) {
+            EnumSigState *sig = new EnumSigState(*src);
+            EnumValue *values = new EnumValue[sig->num_values];
+            for (unsigned i = 0; i < sig->num_values; ++i) {
+                values[i].name = copyString(src->values[i].name);
+                values[i].value = src->values[i].value;
+            }
+            sig->values = values;
+            enums[id] = sig;
+        }
+    }
+
+    bitmasks.resize(other.bitmasks.size());
+    for (size_t id = 0; id < other.bitmasks.size(); ++id) {
+        const BitmaskSigState *src = other.bitmasks[id];
+        if (src) {
+            BitmaskSigState *sig = new BitmaskSigState(*src);
+            BitmaskFlag *flags = new BitmaskFlag[sig->num_flags];
+            for (unsigned i = 0; i < sig->num_flags; ++i) {
+                flags[i].name = copyString(src->flags[i].name);
+                flags[i].value = src->flags[i].value;
+            }
+            sig->flags = flags;
+            bitmasks[id] = sig;
+        }
+    }
+}
+
+
 void Parser::getBookmark(ParseBookmark &bookmark) {
     bookmark.offset = file->currentOffset();
     bookmark.next_call_no = next_call_no;
@@ -231,7 +315,7 @@ Parser::parse_function_sig(void) {
         }
         sig->arg_names = arg_names;
         sig->flags = lookupCallFlags(sig->name);
-        sig->offset = file->currentOffset();
+        setDefinitionOffset(sig);
         functions[id] = sig;
 
         /**
@@ -268,13 +352,14 @@ Parser::parse_function_sig(void) {
             glGetErrorSig = sig;
         }
 
-    } else if (file->currentOffset() < sig->offset) {
+    } else if (hasDefinition(sig)) {
         /* skip over the signature */
         skip_string(); /* name */
         unsigned num_args = read_uint();
         for (unsigned i = 0; i < num_args; ++i) {
              skip_string(); /*arg_name*/
         }
+        setDefinitionOffset(sig);
     }
 
     assert(sig);
@@ -298,15 +383,16 @@ StructSig *Parser::parse_struct_sig() {
             member_names[i] = read_string();
         }
         sig->member_names = member_names;
-        sig->offset = file->currentOffset();
+        setDefinitionOffset(sig);
         structs[id] = sig;
-    } else if (file->currentOffset() < sig->offset) {
+    } else if (hasDefinition(sig)) {
         /* skip over the signature */
         skip_string(); /* name */
         unsigned num_members = read_uint();
         for (unsigned i = 0; i < num_members; ++i) {
             skip_string(); /* member_name */
         }
+        setDefinitionOffset(sig);
     }
 
     assert(sig);
@@ -334,12 +420,13 @@ EnumSig *Parser::parse_old_enum_sig() {
         values->name = read_string();
         values->value = read_sint();
         sig->values = values;
-        sig->offset = file->currentOffset();
+        setDefinitionOffset(sig);
         enums[id] = sig;
-    } else if (file->currentOffset() < sig->offset) {
+    } else if (hasDefinition(sig)) {
         /* skip over the signature */
         skip_string(); /*name*/
         scan_value();
+        setDefinitionOffset(sig);
     }
 
     assert(sig);
@@ -363,15 +450,16 @@ EnumSig *Parser::parse_enum_sig() {
             it->value = read_sint();
         }
         sig->values = values;
-        sig->offset = file->currentOffset();
+        setDefinitionOffset(sig);
         enums[id] = sig;
-    } else if (file->currentOffset() < sig->offset) {
+    } else if (hasDefinition(sig)) {
         /* skip over the signature */
         int num_values = read_uint();
         for (int i = 0; i < num_values; ++i) {
             skip_string(); /*name */
             skip_sint(); /* value */
         }
+        setDefinitionOffset(sig);
     }
 
     assert(sig);
@@ -398,15 +486,16 @@ BitmaskSig *Parser::parse_bitmask_sig() {
             }
         }
         sig->flags = flags;
-        sig->offset = file->currentOffset();
+        setDefinitionOffset(sig);
         bitmasks[id] = sig;
-    } else if (file->currentOffset() < sig->offset) {
+    } else if (hasDefinition(sig)) {
         /* skip over the signature */
         int num_flags = read_uint();
         for (int i = 0; i < num_flags; ++i) {
             skip_string(); /*name */
             skip_uint(); /* value */
         }
+        setDefinitionOffset(sig);
     }
 
     assert(sig);
@@ -425,6 +514,10 @@ void Parser::parse_enter(Mode mode) {
 
     FunctionSigFlags *sig = parse_function_sig();
 
+    if (mode == SCAN && filter && filter(sig)) {
+        mode = FULL;
+    }
+
     Call *call = new Call(sig, sig->flags, thread_id);
 
     call->no = next_call_no++;
@@ -438,7 +531,7 @@ void Parser::parse_enter(Mode mode) {
 
 
 Call *Parser::parse_leave(Mode mode) {
-    unsigned call_no = read_uint();
+    unsigned call_no = read_call_no();
     Call *call = NULL;
     for (CallList::iterator it = calls.begin(); it != calls.end(); ++it) {
         if ((*it)->no == call_no) {
@@ -451,6 +544,10 @@ Call *Parser::parse_leave(Mode mode) {
         return NULL;
     }
 
+    if (mode == SCAN && filter && filter(call->sig)) {
+        mode = FULL;
+    }
+
     if (parse_call_details(call, mode)) {
         return call;
     } else {
@@ -472,6 +569,11 @@ bool Parser::parse_call_details(Call *call, Mode mode) {
         case trace::CALL_RET:
             call->ret = parse_value(mode);
             break;
+        case trace::CALL_TIME:
+            call->timed = true;
+            call->time = read_uint();
+            call->duration = read_uint();
+            break;
         default:
             std::cerr << "error: ("<<call->name()<< ") unknown call detail "
                       << c << "\n";
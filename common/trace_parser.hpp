@@ -29,6 +29,7 @@
 
 #include <iostream>
 #include <list>
+#include <vector>
 
 #include "trace_file.hpp"
 #include "trace_format.hpp"
@@ -68,10 +69,13 @@ protected:
     // parsing information.
     template< class T >
     struct SigState : public T {
-        // Offset in the file of where signature was defined.  It is used when
-        // reparsing to determine whether the signature definition is to be
-        // expected next or not.
-        File::Offset offset;
+        // Offset in the file of where signature was defined, by segment.  It
+        // is used when reparsing to determine whether the signature definition
+        // is to be expected next or not.  Plain traces have a single segment
+        // zero, while segmented traces define the signatures again in every
+        // segment using them, and have null offsets for the segments where
+        // they weren't seen yet.
+        std::vector<File::Offset> offsets;
     };
 
     typedef SigState<FunctionSigFlags> FunctionSigState;
@@ -93,6 +97,12 @@ protected:
 
     unsigned next_call_no;
 
+public:
+    typedef bool (*CallFilter)(const FunctionSig *sig);
+
+protected:
+    CallFilter filter;
+
 public:
     unsigned long long version;
     API api;
@@ -101,10 +111,20 @@ public:
 
     ~Parser();
 
+    static CallFlags
+    lookupCallFlags(const char *name);
+
     bool open(const char *filename);
 
     void close(void);
 
+    /**
+     * Copy the signatures another parser of the same file has seen so far, so
+     * that this parser can be set to any bookmark taken by the other one,
+     * without having to parse the trace from its beginning.
+     */
+    void copySignatures(const Parser &other);
+
     Call *parse_call(void) {
         return parse_call(FULL);
     }
@@ -116,6 +136,15 @@ public:
 
     void getBookmark(ParseBookmark &bookmark);
 
+    /**
+     * Whether some calls were entered but not left yet, in which case they
+     * would be missed when parsing again from the current bookmark.
+     */
+    bool hasPendingCalls() const
+    {
+        return !calls.empty();
+    }
+
     void setBookmark(const ParseBookmark &bookmark);
 
     int percentRead()
@@ -127,6 +156,17 @@ public:
         return parse_call(SCAN);
     }
 
+    /**
+     * Like scan_call(), but fully parse the calls whose signature is
+     * accepted by the given filter.
+     */
+    Call *scan_call(CallFilter callFilter) {
+        filter = callFilter;
+        Call *call = parse_call(SCAN);
+        filter = NULL;
+        return call;
+    }
+
 protected:
     Call *parse_call(Mode mode);
 
@@ -136,8 +176,37 @@ protected:
     EnumSig *parse_enum_sig();
     BitmaskSig *parse_bitmask_sig();
     
-    static CallFlags
-    lookupCallFlags(const char *name);
+    template< class T >
+    void setDefinitionOffset(SigState<T> *sig) {
+        File::Offset offset = file->currentOffset();
+        if (offset.segment >= sig->offsets.size()) {
+            sig->offsets.resize(offset.segment + 1);
+        }
+        sig->offsets[offset.segment] = offset;
+    }
+
+    /**
+     * Whether the definition of a signature seen before follows, as it does
+     * when reparsing from before it, or in a new segment.
+     */
+    template< class T >
+    bool hasDefinition(const SigState<T> *sig) {
+        File::Offset offset = file->currentOffset();
+        if (offset.segment < sig->offsets.size()) {
+            const File::Offset &definition = sig->offsets[offset.segment];
+            if (offset.segment == 0 || !(definition == File::Offset())) {
+                return offset < definition;
+            }
+        }
+        return true;
+    }
+
+    /**
+     * Read the number of the call a leave event refers to.
+     */
+    unsigned read_call_no(void) {
+        return read_uint() + file->segmentCallBase();
+    }
 
     Call *parse_Call(Mode mode);
 
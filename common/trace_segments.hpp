@@ -0,0 +1,83 @@
+/**************************************************************************
+ *
+ * Copyright 2012 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+/*
+ * Segmented traces.
+ *
+ * The tracer can split its output into several segment files, each a
+ * complete trace on its own, rotated at frame boundaries.  A segment list
+ * (or manifest) names them, along with the calls and frames each one
+ * holds, and is opened as a single trace by the parser.
+ *
+ * Segment lists are text files, such as:
+ *
+ *   # apitrace segments
+ *   # file first_call last_call first_frame last_frame
+ *   app.0000.trace 0 12345 0 99
+ *   app.0001.trace 12346 25031 100 199
+ *
+ * where the file names are relative to the segment list's directory.
+ */
+
+#ifndef _TRACE_SEGMENTS_HPP_
+#define _TRACE_SEGMENTS_HPP_
+
+
+#include <string>
+#include <vector>
+
+
+namespace trace {
+
+
+struct Segment
+{
+    std::string filename;
+    unsigned firstCall;
+    unsigned lastCall;
+    unsigned firstFrame;
+    unsigned lastFrame;
+};
+
+
+typedef std::vector<Segment> SegmentList;
+
+
+bool
+readSegmentList(const char *filename, SegmentList &segments);
+
+
+/**
+ * Write the segment list atomically, so that it can be read at any time
+ * while the tracer appends segments to it.
+ */
+bool
+writeSegmentList(const char *filename, const SegmentList &segments);
+
+
+} /* namespace trace */
+
+#endif /* _TRACE_SEGMENTS_HPP_ */
@@ -40,7 +40,8 @@ namespace trace {
 
 
 Writer::Writer() :
-    call_no(0)
+    call_no(0),
+    written(0)
 {
     m_file = File::createSnappy();
     close();
@@ -79,6 +80,7 @@ Writer::open(const char *filename) {
 
 void inline
 Writer::_write(const void *sBuffer, size_t dwBytesToWrite) {
+    written += dwBytesToWrite;
     m_file->write(sBuffer, dwBytesToWrite);
 }
 
@@ -172,6 +174,12 @@ void Writer::beginReturn(void) {
     _writeByte(trace::CALL_RET);
 }
 
+void Writer::writeTime(unsigned long long time, unsigned long long duration) {
+    _writeByte(trace::CALL_TIME);
+    _writeUInt(time);
+    _writeUInt(duration);
+}
+
 void Writer::beginArray(size_t length) {
     _writeByte(trace::TYPE_ARRAY);
     _writeUInt(length);
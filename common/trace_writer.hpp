@@ -46,6 +46,9 @@ namespace trace {
         File *m_file;
         unsigned call_no;
 
+        // Uncompressed bytes written so far, across all files
+        unsigned long long written;
+
         std::vector<bool> functions;
         std::vector<bool> structs;
         std::vector<bool> enums;
@@ -70,6 +73,8 @@ namespace trace {
         void beginReturn(void);
         inline void endReturn(void) {}
 
+        void writeTime(unsigned long long time, unsigned long long duration);
+
         void beginArray(size_t length);
         inline void endArray(void) {}
 
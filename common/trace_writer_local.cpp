@@ -25,15 +25,20 @@
 
 
 #include <assert.h>
+#include <signal.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
+
+#include <algorithm>
 
 #include "os.hpp"
 #include "os_thread.hpp"
 #include "os_string.hpp"
 #include "trace_file.hpp"
+#include "trace_parser.hpp"
 #include "trace_writer_local.hpp"
 #include "trace_format.hpp"
 
@@ -60,17 +65,143 @@ static void exceptionCallback(void)
 }
 
 
+#ifndef _WIN32
+static volatile sig_atomic_t statsRequested = 0;
+
+static void statsSignalHandler(int sig)
+{
+    // Written by the next call to leave, as it's not safe to do here
+    statsRequested = 1;
+}
+#else
+static const int statsRequested = 0;
+#endif
+
+
+/**
+ * Match a function name against a pattern, where `*` matches any sequence of
+ * characters and `?` any single character.
+ */
+static bool
+matchPattern(const char *pattern, const char *name)
+{
+    while (*pattern) {
+        if (*pattern == '*') {
+            ++pattern;
+            do {
+                if (matchPattern(pattern, name)) {
+                    return true;
+                }
+            } while (*name++);
+            return false;
+        }
+        if (!*name || (*pattern != '?' && *pattern != *name)) {
+            return false;
+        }
+        ++pattern;
+        ++name;
+    }
+    return *name == 0;
+}
+
+
 LocalWriter::LocalWriter() :
-    acquired(0)
+    acquired(0),
+    filtering(false),
+    filterQueries(false),
+    callTimes(false),
+    segmenting(false),
+    segmentMaxSize(0),
+    segmentMaxFrames(0),
+    frames(0),
+    inFlight(0),
+    frameEndCall(0),
+    frameEndPending(false),
+    frameBoundary(false),
+    partialFrame(false),
+    timeBase(0),
+    eventSig(NULL),
+    eventStart(0),
+    lockedTime(0)
 {
     // Install the signal handlers as early as possible, to prevent
     // interfering with the application's signal handling.
     os::setExceptionCallback(exceptionCallback);
+
+    /*
+     * TRACE_FILTER is a comma or space separated list of function names,
+     * optionally with `*` and `?` wildcards, or `@queries` for all functions
+     * without side effects (glGet*, glIs*, etc.)
+     */
+    memset((void *)filtered, FILTER_UNKNOWN, sizeof filtered);
+    const char *filter = getenv("TRACE_FILTER");
+    if (filter) {
+        const char *p = filter;
+        while (*p) {
+            size_t len = strcspn(p, ", ");
+            if (len) {
+                std::string pattern(p, len);
+                if (pattern == "@queries") {
+                    filterQueries = true;
+                } else {
+                    filterPatterns.push_back(pattern);
+                }
+                filtering = true;
+            }
+            p += len;
+            if (*p) {
+                ++p;
+            }
+        }
+    }
+
+    const char *callTimesEnv = getenv("TRACE_CALL_TIMES");
+    if (callTimesEnv && *callTimesEnv && strcmp(callTimesEnv, "0") != 0) {
+        callTimes = true;
+    }
+
+    const char *segmentSize = getenv("TRACE_SEGMENT_SIZE");
+    if (segmentSize) {
+        segmentMaxSize = strtoull(segmentSize, NULL, 0) * 1024 * 1024;
+    }
+    const char *segmentFrames = getenv("TRACE_SEGMENT_FRAMES");
+    if (segmentFrames) {
+        segmentMaxFrames = strtoul(segmentFrames, NULL, 0);
+    }
+    segmenting = segmentMaxSize || segmentMaxFrames;
+
+    /*
+     * TRACE_STATS is either 1, to write the statistics to the log, or the
+     * file name to write them to.
+     */
+    const char *stats = getenv("TRACE_STATS");
+    if (stats && *stats && strcmp(stats, "0") != 0) {
+        writerStatsEnabled = true;
+        if (strcmp(stats, "1") != 0) {
+            statsFileName = stats;
+        }
+#ifndef _WIN32
+        // Don't take SIGUSR1 over from applications which already use it
+        if (!os::setSignalHandler(SIGUSR1, statsSignalHandler)) {
+            os::log("apitrace: warning: SIGUSR1 already handled, statistics will only be written at exit\n");
+        }
+#endif
+    }
 }
 
 LocalWriter::~LocalWriter()
 {
     os::resetExceptionCallback();
+
+    if (segmenting && m_file->isOpened()) {
+        closeSegment();
+    }
+
+    if (writerStatsEnabled) {
+        // Account the final flush
+        Writer::close();
+        writeStats();
+    }
 }
 
 void
@@ -117,6 +248,26 @@ LocalWriter::open(void) {
 
     os::log("apitrace: tracing to %s\n", lpFileName);
 
+    if (filtering) {
+        os::log("apitrace: filtering out calls matching %s\n", getenv("TRACE_FILTER"));
+    }
+
+    timeBase = os::getTime();
+
+    if (segmenting) {
+        segmentListName = lpFileName;
+        segmentPrefix = lpFileName;
+        size_t len = segmentPrefix.length();
+        if (len > 6 && segmentPrefix.compare(len - 6, 6, ".trace") == 0) {
+            segmentPrefix.resize(len - 6);
+        }
+        segments.clear();
+        segment.firstCall = 0;
+        segment.firstFrame = 0;
+        openSegment();
+        return;
+    }
+
     if (!Writer::open(lpFileName)) {
         os::log("apitrace: error: failed to open %s\n", lpFileName);
         os::abort();
@@ -128,12 +279,108 @@ LocalWriter::open(void) {
 #endif
 }
 
+void LocalWriter::openSegment(void) {
+    segmentPath = os::String::format("%s.%04u.trace", segmentPrefix.c_str(), (unsigned)segments.size()).str();
+
+    os::String filename(segmentPath.c_str());
+    filename.trimDirectory();
+    segment.filename = filename.str();
+
+    if (!Writer::open(segmentPath.c_str())) {
+        os::log("apitrace: error: failed to open %s\n", segmentPath.c_str());
+        os::abort();
+    }
+}
+
+void LocalWriter::getCurrentSegment(Segment &current) {
+    current = segment;
+    current.lastCall = segment.firstCall + call_no - 1;
+    current.lastFrame = partialFrame || frames == segment.firstFrame ? frames : frames - 1;
+}
+
+void LocalWriter::closeSegment(void) {
+    Segment current;
+    getCurrentSegment(current);
+    Writer::close();
+
+    segments.push_back(current);
+    if (!writeSegmentList(segmentListName.c_str(), segments)) {
+        os::log("apitrace: warning: failed to write %s\n", segmentListName.c_str());
+    }
+
+    segment.firstCall = current.lastCall + 1;
+    segment.firstFrame = frames;
+}
+
+bool LocalWriter::isSegmentFull(void) {
+    if (segmentMaxFrames && frames - segment.firstFrame >= segmentMaxFrames) {
+        return true;
+    }
+
+    if (segmentMaxSize) {
+        // Only what was flushed so far, but checked seldom enough
+        struct stat st;
+        if (stat(segmentPath.c_str(), &st) == 0 &&
+            (unsigned long long)st.st_size >= segmentMaxSize) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool LocalWriter::isFrameEnd(const FunctionSig *sig) {
+    enum {
+        FRAME_END_UNKNOWN = 0,
+        FRAME_END_NO,
+        FRAME_END_YES
+    };
+
+    if (sig->id >= frameEnds.size()) {
+        frameEnds.resize(sig->id + 1, FRAME_END_UNKNOWN);
+    }
+
+    unsigned char &state = frameEnds[sig->id];
+    if (state == FRAME_END_UNKNOWN) {
+        CallFlags flags = Parser::lookupCallFlags(sig->name);
+        state = flags & CALL_FLAG_END_FRAME ? FRAME_END_YES : FRAME_END_NO;
+    }
+    return state == FRAME_END_YES;
+}
+
 static unsigned next_thread_id = 0;
 static os::thread_specific_ptr<unsigned> thread_id_specific_ptr;
 
-unsigned LocalWriter::beginEnter(const FunctionSig *sig) {
+void LocalWriter::lock(void) {
+    if (!writerStatsEnabled) {
+        mutex.lock();
+        ++acquired;
+        return;
+    }
+
+    long long start = os::getTime();
     mutex.lock();
     ++acquired;
+    lockedTime = os::getTime();
+    addWriterPhase(PHASE_LOCK, lockedTime - start);
+    eventStart = written;
+}
+
+void LocalWriter::unlock(void) {
+    if (writerStatsEnabled) {
+        addWriterPhase(PHASE_WRITE, os::getTime() - lockedTime);
+        if (eventSig) {
+            functionStats[eventSig->id].bytes += written - eventStart;
+            eventSig = NULL;
+        }
+    }
+
+    --acquired;
+    mutex.unlock();
+}
+
+unsigned LocalWriter::beginEnter(const FunctionSig *sig) {
+    lock();
 
     if (!m_file->isOpened()) {
         open();
@@ -150,25 +397,175 @@ unsigned LocalWriter::beginEnter(const FunctionSig *sig) {
         thread_id_specific_ptr.reset(thread_id_ptr);
     }
 
-    return Writer::beginEnter(sig, thread_id);
+    if (segmenting) {
+        if (frameBoundary) {
+            frameBoundary = false;
+            if (inFlight == 0 && isSegmentFull()) {
+                closeSegment();
+                openSegment();
+            }
+        }
+
+        ++inFlight;
+        partialFrame = true;
+    }
+
+    unsigned call = Writer::beginEnter(sig, thread_id);
+
+    if (segmenting && isFrameEnd(sig)) {
+        frameEndCall = call;
+        frameEndPending = true;
+    }
+
+    if (writerStatsEnabled) {
+        if (sig->id >= functionStats.size()) {
+            WriterFunctionStats empty = {NULL, 0, 0};
+            functionStats.resize(sig->id + 1, empty);
+        }
+        WriterFunctionStats &function = functionStats[sig->id];
+        function.name = sig->name;
+        function.calls += 1;
+        statsPending.push_back(std::make_pair(call, sig));
+        eventSig = sig;
+    }
+
+    return call;
 }
 
 void LocalWriter::endEnter(void) {
     Writer::endEnter();
-    --acquired;
-    mutex.unlock();
+    unlock();
 }
 
 void LocalWriter::beginLeave(unsigned call) {
-    mutex.lock();
-    ++acquired;
+    lock();
+
+    if (segmenting && frameEndPending && call == frameEndCall) {
+        frameEndPending = false;
+        frameBoundary = true;
+        partialFrame = false;
+        ++frames;
+    }
+
+    if (writerStatsEnabled) {
+        for (size_t i = 0; i < statsPending.size(); ++i) {
+            if (statsPending[i].first == call) {
+                eventSig = statsPending[i].second;
+                statsPending.erase(statsPending.begin() + i);
+                break;
+            }
+        }
+    }
+
     Writer::beginLeave(call);
 }
 
 void LocalWriter::endLeave(void) {
     Writer::endLeave();
-    --acquired;
+    if (segmenting) {
+        --inFlight;
+    }
+    if (statsRequested) {
+        statsRequested = 0;
+        writeStats();
+    }
+    unlock();
+}
+
+static bool
+heavierFunction(const WriterFunctionStats *a, const WriterFunctionStats *b) {
+    return a->bytes > b->bytes;
+}
+
+void LocalWriter::writeStats(void) {
+    std::vector<WriterThreadStats> threads;
+    getWriterStats(threads);
+
+    WriterThreadStats total;
+    memset(&total, 0, sizeof total);
+    for (size_t i = 0; i < threads.size(); ++i) {
+        for (unsigned phase = 0; phase < PHASE_COUNT; ++phase) {
+            total.counts[phase] += threads[i].counts[phase];
+            total.times[phase] += threads[i].times[phase];
+        }
+    }
+
+    std::vector<std::string> lines;
+    char line[256];
+
+    lines.push_back("apitrace: tracer statistics, in milliseconds:\n");
+    snprintf(line, sizeof line, "%8s %12s %12s %12s %12s %12s %12s %12s\n",
+             "thread", "events", "lock", "write", "compress", "disk", "queries", "query");
+    lines.push_back(line);
+    for (size_t i = 0; i <= threads.size(); ++i) {
+        const WriterThreadStats &stats = i < threads.size() ? threads[i] : total;
+        char no[16];
+        if (i < threads.size()) {
+            snprintf(no, sizeof no, "%u", stats.no);
+        } else {
+            strcpy(no, "total");
+        }
+        snprintf(line, sizeof line, "%8s %12llu %12.3f %12.3f %12.3f %12.3f %12llu %12.3f\n",
+                 no,
+                 stats.counts[PHASE_WRITE],
+                 toNanoseconds(stats.times[PHASE_LOCK]) * 1.0e-6,
+                 toNanoseconds(stats.times[PHASE_WRITE]) * 1.0e-6,
+                 toNanoseconds(stats.times[PHASE_COMPRESS]) * 1.0e-6,
+                 toNanoseconds(stats.times[PHASE_DISK]) * 1.0e-6,
+                 stats.counts[PHASE_QUERY],
+                 toNanoseconds(stats.times[PHASE_QUERY]) * 1.0e-6);
+        lines.push_back(line);
+    }
+
+    std::vector<const WriterFunctionStats *> functions;
+    for (size_t i = 0; i < functionStats.size(); ++i) {
+        if (functionStats[i].calls) {
+            functions.push_back(&functionStats[i]);
+        }
+    }
+    std::stable_sort(functions.begin(), functions.end(), heavierFunction);
+
+    snprintf(line, sizeof line, "%12s %14s  %s\n", "calls", "bytes", "function");
+    lines.push_back(line);
+    for (size_t i = 0; i < functions.size(); ++i) {
+        snprintf(line, sizeof line, "%12llu %14llu  %s\n",
+                 functions[i]->calls, functions[i]->bytes, functions[i]->name);
+        lines.push_back(line);
+    }
+
+    if (statsFileName.empty()) {
+        for (size_t i = 0; i < lines.size(); ++i) {
+            os::log("%s", lines[i].c_str());
+        }
+        return;
+    }
+
+    FILE *fp = fopen(statsFileName.c_str(), "wt");
+    if (!fp) {
+        os::log("apitrace: warning: failed to write %s\n", statsFileName.c_str());
+        return;
+    }
+    for (size_t i = 0; i < lines.size(); ++i) {
+        fputs(lines[i].c_str(), fp);
+    }
+    fclose(fp);
+}
+
+bool LocalWriter::checkFilter(const FunctionSig *sig, bool sideEffects) {
+    mutex.lock();
+
+    bool drop = filterQueries && !sideEffects;
+    for (unsigned i = 0; !drop && i < filterPatterns.size(); ++i) {
+        drop = matchPattern(filterPatterns[i].c_str(), sig->name);
+    }
+
+    if (sig->id < MAX_FILTER_SIGS) {
+        filtered[sig->id] = drop ? FILTER_DROP : FILTER_KEEP;
+    }
+
     mutex.unlock();
+
+    return drop;
 }
 
 void LocalWriter::flush(void) {
@@ -186,6 +583,14 @@ void LocalWriter::flush(void) {
         if (m_file->isOpened()) {
             os::log("apitrace: flushing trace due to an exception\n");
             m_file->flush();
+
+            if (segmenting) {
+                SegmentList list = segments;
+                Segment current;
+                getCurrentSegment(current);
+                list.push_back(current);
+                writeSegmentList(segmentListName.c_str(), list);
+            }
         }
         --acquired;
     }
@@ -33,8 +33,14 @@
 
 #include <stdint.h>
 
+#include <string>
+#include <vector>
+
 #include "os_thread.hpp"
+#include "os_time.hpp"
+#include "trace_segments.hpp"
 #include "trace_writer.hpp"
+#include "trace_writer_stats.hpp"
 
 
 namespace trace {
@@ -52,6 +58,7 @@ namespace trace {
      * - uses mutexes to allow tracing from multiple threades
      * - flushes the output to ensure the last call is traced in event of
      *   abnormal termination
+     * - optionally leaves calls out, or splits the output in segments
      */
     class LocalWriter : public Writer {
     protected:
@@ -61,6 +68,92 @@ namespace trace {
         os::recursive_mutex mutex;
         int acquired;
 
+        /**
+         * Calls filtered out with the TRACE_FILTER environment variable.
+         */
+        bool filtering;
+        bool filterQueries;
+        std::vector<std::string> filterPatterns;
+
+        bool callTimes;
+
+        enum {
+            FILTER_UNKNOWN = 0,
+            FILTER_KEEP,
+            FILTER_DROP
+        };
+
+        /**
+         * Filter decision of each function, by signature id.  It is read
+         * without taking the mutex, as entries only ever change once, from
+         * FILTER_UNKNOWN to their final value.  Functions with larger ids are
+         * always looked up with the mutex held.
+         */
+        enum { MAX_FILTER_SIGS = 16384 };
+        volatile unsigned char filtered[MAX_FILTER_SIGS];
+
+        bool checkFilter(const FunctionSig *sig, bool sideEffects);
+
+        /**
+         * Output split into segments, as requested with the
+         * TRACE_SEGMENT_SIZE (in megabytes) or TRACE_SEGMENT_FRAMES
+         * environment variables.  Segments are only rotated at frame
+         * boundaries, and when no call is in progress, so that every segment
+         * is a complete trace.
+         */
+        bool segmenting;
+        unsigned long long segmentMaxSize;
+        unsigned segmentMaxFrames;
+        std::string segmentListName;
+        std::string segmentPrefix;
+        std::string segmentPath;
+        SegmentList segments;
+        Segment segment;
+        unsigned frames;
+        unsigned inFlight;
+        unsigned frameEndCall;
+        bool frameEndPending;
+        bool frameBoundary;
+        bool partialFrame;
+        std::vector<unsigned char> frameEnds;
+
+        void openSegment(void);
+        void closeSegment(void);
+        bool isSegmentFull(void);
+        bool isFrameEnd(const FunctionSig *sig);
+        void getCurrentSegment(Segment &current);
+
+        /**
+         * When the trace was opened, as given by os::getTime(), which call
+         * times are relative to.
+         */
+        long long timeBase;
+
+        static inline unsigned long long
+        toNanoseconds(long long time) {
+            if (os::timeFrequency == 1000000000LL) {
+                return time;
+            }
+            return (unsigned long long)(time * (1.0e9 / os::timeFrequency));
+        }
+
+        /**
+         * Statistics about the tracer itself, as requested with the
+         * TRACE_STATS environment variable, written at exit or when SIGUSR1
+         * is received.  See also trace_writer_stats.hpp.
+         */
+        std::string statsFileName;
+        std::vector<WriterFunctionStats> functionStats;
+        // Calls entered but not left yet
+        std::vector<std::pair<unsigned, const FunctionSig *> > statsPending;
+        const FunctionSig *eventSig;
+        unsigned long long eventStart;
+        long long lockedTime;
+
+        void lock(void);
+        void unlock(void);
+        void writeStats(void);
+
     public:
         /**
          * Should never called directly -- use localWriter singleton below instead.
@@ -76,7 +169,45 @@ namespace trace {
         void beginLeave(unsigned call);
         void endLeave(void);
 
+        /**
+         * Whether call times are recorded, as requested with the
+         * TRACE_CALL_TIMES environment variable.
+         */
+        inline bool
+        timingCalls(void) const {
+            return callTimes;
+        }
+
+        /**
+         * Record the time a call was entered and returned, as given by
+         * os::getTime(), between beginLeave() and endLeave().
+         */
+        inline void
+        writeCallTime(long long start, long long end) {
+            writeTime(toNanoseconds(start - timeBase), toNanoseconds(end - start));
+        }
+
         void flush(void);
+
+        /**
+         * Whether calls to the given function must not be traced at all.
+         *
+         * Filtered calls are still dispatched, but don't consume a call
+         * number, so that the traced calls remain numbered consecutively.
+         */
+        inline bool
+        isFiltered(const FunctionSig *sig, bool sideEffects) {
+            if (!filtering) {
+                return false;
+            }
+            if (sig->id < MAX_FILTER_SIGS) {
+                unsigned char state = filtered[sig->id];
+                if (state != FILTER_UNKNOWN) {
+                    return state == FILTER_DROP;
+                }
+            }
+            return checkFilter(sig, sideEffects);
+        }
     };
 
     /**
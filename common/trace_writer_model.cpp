@@ -123,6 +123,9 @@ public:
             _visit(call->ret);
             writer.endReturn();
         }
+        if (call->timed) {
+            writer.writeTime(call->time, call->duration);
+        }
         writer.endLeave();
     }
 };
@@ -0,0 +1,112 @@
+/**************************************************************************
+ *
+ * Copyright 2012 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+
+#include <string.h>
+
+#include "os_thread.hpp"
+#include "trace_writer_stats.hpp"
+
+
+namespace trace {
+
+
+const char *writerPhaseNames[PHASE_COUNT] = {
+    "lock",
+    "write",
+    "compress",
+    "disk",
+    "query",
+};
+
+bool writerStatsEnabled = false;
+
+
+/*
+ * Threads only hold a reference to their statistics, so that these outlive
+ * them.  Nothing here is ever destroyed, as the statistics are written after
+ * other static objects may be gone.
+ */
+struct WriterThreadStatsRef
+{
+    WriterThreadStats *stats;
+};
+
+static os::recursive_mutex &
+threadStatsMutex(void) {
+    static os::recursive_mutex *mutex = new os::recursive_mutex;
+    return *mutex;
+}
+
+static std::vector<WriterThreadStats *> &
+threadStats(void) {
+    static std::vector<WriterThreadStats *> *stats = new std::vector<WriterThreadStats *>;
+    return *stats;
+}
+
+static os::thread_specific_ptr<WriterThreadStatsRef> &
+threadStatsRef(void) {
+    static os::thread_specific_ptr<WriterThreadStatsRef> *ref = new os::thread_specific_ptr<WriterThreadStatsRef>;
+    return *ref;
+}
+
+
+WriterThreadStats &
+getWriterThreadStats(void) {
+    os::thread_specific_ptr<WriterThreadStatsRef> &refPtr = threadStatsRef();
+    WriterThreadStatsRef *ref = refPtr.get();
+    if (!ref) {
+        WriterThreadStats *stats = new WriterThreadStats;
+        memset(stats, 0, sizeof *stats);
+
+        os::recursive_mutex &mutex = threadStatsMutex();
+        mutex.lock();
+        stats->no = threadStats().size();
+        threadStats().push_back(stats);
+        mutex.unlock();
+
+        ref = new WriterThreadStatsRef;
+        ref->stats = stats;
+        refPtr.reset(ref);
+    }
+    return *ref->stats;
+}
+
+
+void
+getWriterStats(std::vector<WriterThreadStats> &threads) {
+    os::recursive_mutex &mutex = threadStatsMutex();
+    mutex.lock();
+    std::vector<WriterThreadStats *> &stats = threadStats();
+    threads.clear();
+    for (size_t i = 0; i < stats.size(); ++i) {
+        threads.push_back(*stats[i]);
+    }
+    mutex.unlock();
+}
+
+
+} /* namespace trace */
@@ -0,0 +1,136 @@
+/**************************************************************************
+ *
+ * Copyright 2012 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+/*
+ * Statistics about the tracer itself, telling where the time spent tracing
+ * goes.
+ */
+
+#ifndef _TRACE_WRITER_STATS_HPP_
+#define _TRACE_WRITER_STATS_HPP_
+
+
+#include <vector>
+
+#include "os_time.hpp"
+
+
+namespace trace {
+
+
+enum WriterPhase {
+    // Waiting for the writer lock
+    PHASE_LOCK = 0,
+    // Writing events, with the lock held, including compression and disk
+    PHASE_WRITE,
+    // Compressing the written events
+    PHASE_COMPRESS,
+    // Writing the compressed events to disk
+    PHASE_DISK,
+    // Querying state and scanning indices needed to trace a call, such as
+    // user arrays
+    PHASE_QUERY,
+    PHASE_COUNT
+};
+
+extern const char *writerPhaseNames[PHASE_COUNT];
+
+
+struct WriterThreadStats
+{
+    // In the order threads were first seen
+    unsigned no;
+    unsigned long long counts[PHASE_COUNT];
+    // In os::getTime() units
+    long long times[PHASE_COUNT];
+};
+
+
+struct WriterFunctionStats
+{
+    const char *name;
+    unsigned long long calls;
+    // Uncompressed
+    unsigned long long bytes;
+};
+
+
+/**
+ * Whether the statistics are gathered, as requested with the TRACE_STATS
+ * environment variable.  Set once when the writer is created.
+ */
+extern bool writerStatsEnabled;
+
+
+/**
+ * Statistics of the calling thread, which only it updates.
+ */
+WriterThreadStats &
+getWriterThreadStats(void);
+
+/**
+ * Copy of the statistics of every thread seen so far.
+ */
+void
+getWriterStats(std::vector<WriterThreadStats> &threads);
+
+
+inline void
+addWriterPhase(WriterPhase phase, long long time) {
+    WriterThreadStats &stats = getWriterThreadStats();
+    stats.counts[phase] += 1;
+    stats.times[phase] += time;
+}
+
+
+/**
+ * Times the phase for as long as it is in scope, if enabled.
+ */
+class WriterPhaseTimer
+{
+public:
+    inline
+    WriterPhaseTimer(WriterPhase _phase) :
+        phase(_phase),
+        start(writerStatsEnabled ? os::getTime() : 0)
+    {}
+
+    inline
+    ~WriterPhaseTimer() {
+        if (start) {
+            addWriterPhase(phase, os::getTime() - start);
+        }
+    }
+
+private:
+    WriterPhase phase;
+    long long start;
+};
+
+
+} /* namespace trace */
+
+#endif /* _TRACE_WRITER_STATS_HPP_ */
@@ -53,6 +53,17 @@
 #define GL_GPU_MEMORY_INFO_EVICTION_COUNT_NVX            0x904A
 #define GL_GPU_MEMORY_INFO_EVICTED_MEMORY_NVX            0x904B
 
+// GL_ARB_buffer_storage
+#ifndef GL_MAP_PERSISTENT_BIT
+#define GL_MAP_PERSISTENT_BIT                            0x0040
+#define GL_MAP_COHERENT_BIT                              0x0080
+#define GL_DYNAMIC_STORAGE_BIT                           0x0100
+#define GL_CLIENT_STORAGE_BIT                            0x0200
+#define GL_CLIENT_MAPPED_BUFFER_BARRIER_BIT              0x00004000
+#define GL_BUFFER_IMMUTABLE_STORAGE                      0x821F
+#define GL_BUFFER_STORAGE_FLAGS                          0x8220
+#endif
+
 
 #if defined(_WIN32)
 
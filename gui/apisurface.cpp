@@ -35,6 +35,12 @@ void ApiSurface::contentsFromBase64(const QByteArray &base64)
     m_thumb = thumbnail(m_image);
 }
 
+void ApiSurface::setImage(const QImage &image)
+{
+    m_image = image;
+    m_thumb = thumbnail(m_image);
+}
+
 QImage ApiSurface::image() const
 {
     return m_image;
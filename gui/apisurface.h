@@ -23,6 +23,7 @@ public:
     void setFormatName(const QString &str);
 
     void contentsFromBase64(const QByteArray &base64);
+    void setImage(const QImage &image);
 
     QImage image() const;
     QImage thumb() const;
@@ -7,8 +7,14 @@
 #include <QDir>
 #include <QThread>
 
+/* Default budget for the frames loaded in memory */
+#define FRAME_CACHE_SIZE (512 * 1024 * 1024)
+
 ApiTrace::ApiTrace()
-    : m_needsSaving(false)
+    : m_needsSaving(false),
+      m_cachedFramesSize(0),
+      m_frameCacheSize(FRAME_CACHE_SIZE),
+      m_pendingLookups(0)
 {
     m_loader = new TraceLoader();
 
@@ -43,7 +49,9 @@ ApiTrace::ApiTrace()
     connect(this, SIGNAL(loaderFindCallIndex(int)),
             m_loader, SLOT(findCallIndex(int)));
     connect(m_loader, SIGNAL(foundCallIndex(ApiTraceCall*)),
-            this, SIGNAL(foundCallIndex(ApiTraceCall*)));
+            this, SLOT(loaderFoundCallIndex(ApiTraceCall*)));
+    connect(this, SIGNAL(loaderFrameUnloaded(ApiTraceFrame*)),
+            m_loader, SLOT(forgetFrame(ApiTraceFrame*)));
 
 
     connect(m_loader, SIGNAL(startedParsing()),
@@ -123,6 +131,11 @@ void ApiTrace::setFileName(const QString &name)
         m_errors.clear();
         m_editedCalls.clear();
         m_queuedErrors.clear();
+        m_loadingFrames.clear();
+        m_cachedFrames.clear();
+        m_cachedFramesSize = 0;
+        m_pinnedFrames.clear();
+        m_pendingLookups = 0;
         m_needsSaving = false;
         emit invalidated();
 
@@ -269,10 +282,13 @@ void ApiTrace::loaderFrameLoaded(ApiTraceFrame *frame,
     Q_ASSERT(frame->numChildrenToLoad() == calls.size());
 
     if (!frame->isLoaded()) {
+        /* frames the loader prefetched on its own are the first to go */
+        bool requested = isFrameLoading(frame);
         emit beginLoadingFrame(frame, calls.size());
         frame->setCalls(calls, binaryDataSize);
         emit endLoadingFrame(frame);
         m_loadingFrames.remove(frame);
+        cacheFrame(frame, requested);
     }
 
     if (!m_queuedErrors.isEmpty()) {
@@ -299,6 +315,8 @@ void ApiTrace::loaderFrameLoaded(ApiTraceFrame *frame,
             }
         }
     }
+
+    unloadFrames();
 }
 
 void ApiTrace::findNext(ApiTraceFrame *frame,
@@ -329,6 +347,7 @@ void ApiTrace::findNext(ApiTraceFrame *frame,
         ApiTraceFrame *frame = m_frames[i];
         request.frame = frame;
         if (!frame->isLoaded()) {
+            ++m_pendingLookups;
             emit loaderSearch(request);
             return;
         } else {
@@ -369,6 +388,7 @@ void ApiTrace::findPrev(ApiTraceFrame *frame,
         ApiTraceFrame *frame = m_frames[i];
         request.frame = frame;
         if (!frame->isLoaded()) {
+            ++m_pendingLookups;
             emit loaderSearch(request);
             return;
         } else {
@@ -388,9 +408,22 @@ void ApiTrace::loaderSearchResult(const ApiTrace::SearchRequest &request,
 {
     //qDebug()<<"Search result = "<<result
     //       <<", call is = "<<call;
+    --m_pendingLookups;
+    if (call) {
+        cacheFrame(call->parentFrame(), true);
+    }
     emit findResult(request, result, call);
 }
 
+void ApiTrace::loaderFoundCallIndex(ApiTraceCall *call)
+{
+    --m_pendingLookups;
+    if (call) {
+        cacheFrame(call->parentFrame(), true);
+    }
+    emit foundCallIndex(call);
+}
+
 void ApiTrace::findFrameStart(ApiTraceFrame *frame)
 {
     if (frame->isLoaded()) {
@@ -426,6 +459,7 @@ void ApiTrace::findCallIndex(int index)
             ApiTraceCall *call = frame->callWithIndex(index);
             emit foundCallIndex(call);
         } else {
+            ++m_pendingLookups;
             emit loaderFindCallIndex(index);
         }
     }
@@ -481,6 +515,115 @@ bool ApiTrace::isFrameLoading(ApiTraceFrame *frame) const
     return m_loadingFrames.contains(frame);
 }
 
+quint64 ApiTrace::frameCacheSize() const
+{
+    return m_frameCacheSize;
+}
+
+void ApiTrace::setFrameCacheSize(quint64 bytes)
+{
+    m_frameCacheSize = bytes;
+    unloadFrames();
+}
+
+/*
+ * Pinned frames are kept loaded, e.g. while one of their calls is selected,
+ * regardless of the cache budget.
+ */
+void ApiTrace::pinFrame(ApiTraceFrame *frame)
+{
+    if (frame) {
+        ++m_pinnedFrames[frame];
+        cacheFrame(frame, true);
+    }
+}
+
+void ApiTrace::unpinFrame(ApiTraceFrame *frame)
+{
+    if (!frame) {
+        return;
+    }
+
+    QHash<ApiTraceFrame*, int>::iterator itr = m_pinnedFrames.find(frame);
+    if (itr != m_pinnedFrames.end() && --itr.value() <= 0) {
+        m_pinnedFrames.erase(itr);
+        unloadFrames();
+    }
+}
+
+void ApiTrace::cacheFrame(ApiTraceFrame *frame, bool recentlyUsed)
+{
+    if (!frame || !frame->isLoaded()) {
+        return;
+    }
+
+    if (m_cachedFrames.removeOne(frame)) {
+        m_cachedFramesSize -= frame->memoryUsage();
+    }
+
+    if (recentlyUsed) {
+        m_cachedFrames.append(frame);
+    } else {
+        m_cachedFrames.prepend(frame);
+    }
+    m_cachedFramesSize += frame->memoryUsage();
+}
+
+bool ApiTrace::canUnloadFrame(ApiTraceFrame *frame) const
+{
+    if (m_pinnedFrames.contains(frame) ||
+        isFrameLoading(frame) ||
+        frame->isEmpty()) {
+        return false;
+    }
+
+    /* calls carrying edits, errors or states can't be parsed back */
+    foreach (ApiTraceCall *call, frame->calls()) {
+        if (call->edited() || call->hasError() || call->hasState()) {
+            return false;
+        }
+    }
+
+    for (int i = 0; i < m_queuedErrors.count(); ++i) {
+        if (m_queuedErrors[i].first == frame) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/*
+ * Drops the least recently used frames until the loaded ones fit within the
+ * cache budget.
+ */
+void ApiTrace::unloadFrames()
+{
+    /* the loader may be about to hand us calls of cached frames */
+    if (m_pendingLookups > 0) {
+        return;
+    }
+
+    QList<ApiTraceFrame*>::iterator itr = m_cachedFrames.begin();
+    while (m_cachedFramesSize > m_frameCacheSize &&
+           itr != m_cachedFrames.end()) {
+        ApiTraceFrame *frame = *itr;
+        if (!canUnloadFrame(frame)) {
+            ++itr;
+            continue;
+        }
+
+        m_cachedFramesSize -= frame->memoryUsage();
+        itr = m_cachedFrames.erase(itr);
+
+        emit beginUnloadingFrame(frame, frame->numChildren());
+        frame->unloadCalls();
+        emit endUnloadingFrame(frame);
+
+        emit loaderFrameUnloaded(frame);
+    }
+}
+
 void ApiTrace::bindThumbnailsToFrames(const QList<QImage> &thumbnails)
 {
     QList<ApiTraceFrame *> frames = m_frames;
@@ -5,6 +5,7 @@
 
 #include "trace_api.hpp"
 
+#include <QHash>
 #include <QObject>
 #include <QSet>
 
@@ -77,6 +78,12 @@ public:
 
     trace::API api() const;
 
+    quint64 frameCacheSize() const;
+    void setFrameCacheSize(quint64 bytes);
+
+    void pinFrame(ApiTraceFrame *frame);
+    void unpinFrame(ApiTraceFrame *frame);
+
 public slots:
     void setFileName(const QString &name);
     void save();
@@ -115,6 +122,8 @@ signals:
     void endAddingFrames();
     void beginLoadingFrame(ApiTraceFrame *frame, int numAdded);
     void endLoadingFrame(ApiTraceFrame *frame);
+    void beginUnloadingFrame(ApiTraceFrame *frame, int numRemoved);
+    void endUnloadingFrame(ApiTraceFrame *frame);
     void foundFrameStart(ApiTraceFrame *frame);
     void foundFrameEnd(ApiTraceFrame *frame);
     void foundCallIndex(ApiTraceCall *call);
@@ -124,6 +133,7 @@ signals:
     void loaderFindFrameStart(ApiTraceFrame *frame);
     void loaderFindFrameEnd(ApiTraceFrame *frame);
     void loaderFindCallIndex(int index);
+    void loaderFrameUnloaded(ApiTraceFrame *frame);
 
 private slots:
     void addFrames(const QList<ApiTraceFrame*> &frames);
@@ -136,10 +146,14 @@ private slots:
     void loaderSearchResult(const ApiTrace::SearchRequest &request,
                             ApiTrace::SearchResult result,
                             ApiTraceCall *call);
+    void loaderFoundCallIndex(ApiTraceCall *call);
 
 private:
     int callInFrame(int callIdx) const;
     bool isFrameLoading(ApiTraceFrame *frame) const;
+    void cacheFrame(ApiTraceFrame *frame, bool recentlyUsed);
+    bool canUnloadFrame(ApiTraceFrame *frame) const;
+    void unloadFrames();
 private:
     QString m_fileName;
     QString m_tempFileName;
@@ -158,6 +172,13 @@ private:
     QSet<ApiTraceCall*> m_errors;
     QList< QPair<ApiTraceFrame*, ApiTraceError> > m_queuedErrors;
     QSet<ApiTraceFrame*> m_loadingFrames;
+
+    /* Loaded frames, from the least to the most recently used */
+    QList<ApiTraceFrame*> m_cachedFrames;
+    quint64 m_cachedFramesSize;
+    quint64 m_frameCacheSize;
+    QHash<ApiTraceFrame*, int> m_pinnedFrames;
+    int m_pendingLookups;
 };
 
 #endif
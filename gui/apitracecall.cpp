@@ -10,6 +10,7 @@
 #define QT_USE_FAST_OPERATOR_PLUS
 #include <QStringBuilder>
 #include <QTextDocument>
+#include <QThread>
 
 const char * const styleSheet =
     ".call {\n"
@@ -186,16 +187,12 @@ void VariantVisitor::visit(trace::String *node)
 
 void VariantVisitor::visit(trace::Enum *e)
 {
-    ApiTraceEnumSignature *sig = 0;
+    ApiTraceEnumSignature *sig;
 
     if (m_loader) {
-        sig = m_loader->enumSignature(e->sig->id);
-    }
-    if (!sig) {
+        sig = m_loader->enumSignature(e->sig);
+    } else {
         sig = new ApiTraceEnumSignature(e->sig);
-        if (m_loader) {
-            m_loader->addEnumSignature(e->sig->id, sig);
-        }
     }
 
     m_variant = QVariant::fromValue(ApiEnum(sig, e->value));
@@ -504,8 +501,7 @@ ApiTraceState::ApiTraceState(const QVariantMap &parsedJson)
         Q_ASSERT(normalized == true);
         Q_UNUSED(normalized);
 
-        QByteArray dataArray =
-            image[QLatin1String("__data__")].toByteArray();
+        QVariant data = image[QLatin1String("__data__")];
 
         ApiTexture tex;
         tex.setSize(size);
@@ -513,7 +509,11 @@ ApiTraceState::ApiTraceState(const QVariantMap &parsedJson)
         tex.setFormatName(formatName);
         tex.setNumChannels(numChannels);
         tex.setLabel(itr.key());
-        tex.contentsFromBase64(dataArray);
+        if (data.type() == QVariant::Image) {
+            tex.setImage(data.value<QImage>());
+        } else {
+            tex.contentsFromBase64(data.toByteArray());
+        }
 
         m_textures.append(tex);
     }
@@ -535,8 +535,7 @@ ApiTraceState::ApiTraceState(const QVariantMap &parsedJson)
         Q_ASSERT(normalized == true);
         Q_UNUSED(normalized);
 
-        QByteArray dataArray =
-            buffer[QLatin1String("__data__")].toByteArray();
+        QVariant data = buffer[QLatin1String("__data__")];
 
         ApiFramebuffer fbo;
         fbo.setSize(size);
@@ -544,7 +543,11 @@ ApiTraceState::ApiTraceState(const QVariantMap &parsedJson)
         fbo.setFormatName(formatName);
         fbo.setNumChannels(numChannels);
         fbo.setType(itr.key());
-        fbo.contentsFromBase64(dataArray);
+        if (data.type() == QVariant::Image) {
+            fbo.setImage(data.value<QImage>());
+        } else {
+            fbo.contentsFromBase64(data.toByteArray());
+        }
         m_framebuffers.append(fbo);
     }
 }
@@ -663,7 +666,28 @@ ApiTraceCall::ApiTraceCall(ApiTraceFrame *parentFrame,
                            TraceLoader *loader,
                            const trace::Call *call)
     : ApiTraceEvent(ApiTraceEvent::Call),
-      m_parentFrame(parentFrame)
+      m_parentFrame(parentFrame),
+      m_loader(loader),
+      m_materialized(false)
+{
+    init(loader, call);
+    materialize(call);
+}
+
+ApiTraceCall::ApiTraceCall(ApiTraceFrame *parentFrame,
+                           TraceLoader *loader,
+                           const trace::Call *call,
+                           const trace::ParseBookmark &bookmark)
+    : ApiTraceEvent(ApiTraceEvent::Call),
+      m_parentFrame(parentFrame),
+      m_loader(loader),
+      m_bookmark(bookmark),
+      m_materialized(false)
+{
+    init(loader, call);
+}
+
+void ApiTraceCall::init(TraceLoader *loader, const trace::Call *call)
 {
     m_index = call->no;
 
@@ -679,27 +703,79 @@ ApiTraceCall::ApiTraceCall(ApiTraceFrame *parentFrame,
         m_signature = new ApiTraceCallSignature(name, argNames);
         loader->addSignature(call->sig->id, m_signature);
     }
+    for (int i = 0; i < call->args.size(); ++i) {
+        const trace::Value *value = call->args[i].value;
+        const trace::Repr *repr = dynamic_cast<const trace::Repr *>(value);
+        if (repr) {
+            value = repr->humanValue;
+        }
+        if (dynamic_cast<const trace::Blob *>(value)) {
+            m_hasBinaryData = true;
+            m_binaryDataIndex = i;
+        }
+    }
+    m_flags = call->flags;
+}
+
+bool ApiTraceCall::isMaterialized() const
+{
+    return m_materialized;
+}
+
+/*
+ * Converts the arguments of the given parse of this call.
+ */
+void ApiTraceCall::materialize(const trace::Call *call)
+{
+    Q_ASSERT(call->no == unsigned(m_index));
+
     if (call->ret) {
-        VariantVisitor retVisitor(loader);
+        VariantVisitor retVisitor(m_loader);
         call->ret->visit(retVisitor);
         m_returnValue = retVisitor.variant();
     }
     m_argValues.reserve(call->args.size());
     for (int i = 0; i < call->args.size(); ++i) {
         if (call->args[i].value) {
-            VariantVisitor argVisitor(loader);
+            VariantVisitor argVisitor(m_loader);
             call->args[i].value->visit(argVisitor);
             m_argValues.append(argVisitor.variant());
-            if (m_argValues[i].type() == QVariant::ByteArray) {
-                m_hasBinaryData = true;
-                m_binaryDataIndex = i;
-            }
         } else {
             m_argValues.append(QVariant());
         }
     }
     m_argValues.squeeze();
-    m_flags = call->flags;
+    m_materialized = true;
+}
+
+/*
+ * Has the loader parse this call again.  Other threads use a parser of
+ * their own, rather than waiting for the loader thread, which may be busy
+ * loading frames or searching.
+ */
+void ApiTraceCall::materialize() const
+{
+    if (m_materialized) {
+        return;
+    }
+
+    ApiTraceCall *call = const_cast<ApiTraceCall*>(this);
+    if (QThread::currentThread() == m_loader->thread()) {
+        m_loader->materializeCall(call);
+    } else {
+        m_loader->materializeCallAside(call);
+    }
+
+    // Don't try again if the call couldn't be parsed
+    if (!m_materialized) {
+        call->m_argValues.resize(m_signature->argNames().count());
+        call->m_materialized = true;
+    }
+}
+
+const trace::ParseBookmark &ApiTraceCall::bookmark() const
+{
+    return m_bookmark;
 }
 
 ApiTraceCall::~ApiTraceCall()
@@ -734,6 +810,7 @@ ApiTrace * ApiTraceCall::parentTrace() const
 
 QVector<QVariant> ApiTraceCall::originalValues() const
 {
+    materialize();
     return m_argValues;
 }
 
@@ -804,6 +881,7 @@ QStringList ApiTraceCall::argNames() const
 
 QVector<QVariant> ApiTraceCall::arguments() const
 {
+    materialize();
     if (m_editedValues.isEmpty())
         return m_argValues;
     else
@@ -812,6 +890,7 @@ QVector<QVariant> ApiTraceCall::arguments() const
 
 QVariant ApiTraceCall::returnValue() const
 {
+    materialize();
     return m_returnValue;
 }
 
@@ -989,6 +1068,58 @@ QString ApiTraceCall::searchText() const
     return m_searchText;
 }
 
+/*
+ * Converts a value as searchText() does, but without caching the enum
+ * signature in the loader, so that it can be done from any thread.
+ */
+static QString
+searchValueText(trace::Value *value)
+{
+    if (!value) {
+        return QLatin1String("?");
+    }
+
+    trace::Repr *repr = dynamic_cast<trace::Repr *>(value);
+    if (repr) {
+        value = repr->humanValue;
+    }
+
+    trace::Enum *e = dynamic_cast<trace::Enum *>(value);
+    if (e) {
+        ApiTraceEnumSignature sig(e->sig);
+        return sig.name(e->value);
+    }
+
+    VariantVisitor visitor(0);
+    value->visit(visitor);
+    return apiVariantToString(visitor.variant());
+}
+
+/*
+ * The text searchText() would return for the given call, without creating
+ * an ApiTraceCall for it.
+ */
+QString ApiTraceCall::searchText(const trace::Call *call)
+{
+    QString text = QString::fromStdString(call->sig->name) +
+                   QLatin1Literal("(");
+    for (unsigned i = 0; i < call->sig->num_args; ++i) {
+        trace::Value *value = i < call->args.size() ? call->args[i].value : 0;
+        text += QString::fromStdString(call->sig->arg_names[i]) +
+                QLatin1Literal(" = ") +
+                searchValueText(value);
+        if (i < call->sig->num_args - 1)
+            text += QLatin1String(", ");
+    }
+    text += QLatin1String(")");
+
+    if (call->ret) {
+        text += QLatin1Literal(" = ") +
+                searchValueText(call->ret);
+    }
+    return text;
+}
+
 int ApiTraceCall::numChildren() const
 {
     return 0;
@@ -1123,6 +1254,29 @@ void ApiTraceFrame::setCalls(const QVector<ApiTraceCall*> &calls,
     m_staticText = 0;
 }
 
+/*
+ * Frees the calls, which can be fetched again later from the trace file.
+ */
+void ApiTraceFrame::unloadCalls()
+{
+    qDeleteAll(m_calls);
+    m_calls.clear();
+    m_loaded = false;
+    delete m_staticText;
+    m_staticText = 0;
+}
+
+/*
+ * Rough upper bound of the memory held by the loaded calls: their blobs, as
+ * if all arguments were materialized, plus a fixed cost per call for the
+ * object, its arguments and cached texts.
+ */
+quint64 ApiTraceFrame::memoryUsage() const
+{
+    static const quint64 callOverhead = 1024;
+    return m_binaryDataSize + m_calls.count() * callOverhead;
+}
+
 bool ApiTraceFrame::isLoaded() const
 {
     return m_loaded;
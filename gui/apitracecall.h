@@ -9,6 +9,7 @@
 #include <QVariant>
 
 #include "trace_model.hpp"
+#include "trace_parser.hpp"
 
 
 class ApiTrace;
@@ -244,8 +245,15 @@ class ApiTraceCall : public ApiTraceEvent
 public:
     ApiTraceCall(ApiTraceFrame *parentFrame, TraceLoader *loader,
                  const trace::Call *tcall);
+    ApiTraceCall(ApiTraceFrame *parentFrame, TraceLoader *loader,
+                 const trace::Call *tcall,
+                 const trace::ParseBookmark &bookmark);
     ~ApiTraceCall();
 
+    bool isMaterialized() const;
+    void materialize(const trace::Call *tcall);
+    const trace::ParseBookmark &bookmark() const;
+
     int index() const;
     QString name() const;
     QStringList argNames() const;
@@ -275,18 +283,31 @@ public:
 
     QString toHtml() const;
     QString searchText() const;
+    static QString searchText(const trace::Call *call);
     QStaticText staticText() const;
     int numChildren() const;
     bool hasBinaryData() const;
     int binaryDataIndex() const;
+private:
+    void init(TraceLoader *loader, const trace::Call *tcall);
+    void materialize() const;
 private:
     int m_index;
     ApiTraceCallSignature *m_signature;
-    QVector<QVariant> m_argValues;
-    QVariant m_returnValue;
     trace::CallFlags m_flags;
     ApiTraceFrame *m_parentFrame;
 
+    /*
+     * Arguments are only converted into variants when first needed, by
+     * parsing the call again from the bookmark, as most calls of a big
+     * frame are never looked at.
+     */
+    TraceLoader *m_loader;
+    trace::ParseBookmark m_bookmark;
+    bool m_materialized;
+    QVector<QVariant> m_argValues;
+    QVariant m_returnValue;
+
     QVector<QVariant> m_editedValues;
 
     QString m_error;
@@ -320,6 +341,7 @@ public:
     QVector<ApiTraceCall*> calls() const;
     void setCalls(const QVector<ApiTraceCall*> &calls,
                   quint64 binaryDataSize);
+    void unloadCalls();
 
     ApiTraceCall *findNextCall(ApiTraceCall *from,
                                const QString &str,
@@ -330,6 +352,7 @@ public:
                                Qt::CaseSensitivity sensitivity) const;
 
     int binaryDataSize() const;
+    quint64 memoryUsage() const;
 
     bool isLoaded() const;
     void setLoaded(bool l);
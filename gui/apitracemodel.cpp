@@ -254,6 +254,10 @@ void ApiTraceModel::setApiTrace(ApiTrace *trace)
             this, SLOT(beginLoadingFrame(ApiTraceFrame*,int)));
     connect(m_trace, SIGNAL(endLoadingFrame(ApiTraceFrame*)),
             this, SLOT(endLoadingFrame(ApiTraceFrame*)));
+    connect(m_trace, SIGNAL(beginUnloadingFrame(ApiTraceFrame*,int)),
+            this, SLOT(beginUnloadingFrame(ApiTraceFrame*,int)));
+    connect(m_trace, SIGNAL(endUnloadingFrame(ApiTraceFrame*)),
+            this, SLOT(endUnloadingFrame(ApiTraceFrame*)));
 
 }
 
@@ -415,4 +419,19 @@ void ApiTraceModel::endLoadingFrame(ApiTraceFrame *frame)
     m_loadingFrames.remove(frame);
 }
 
+void ApiTraceModel::beginUnloadingFrame(ApiTraceFrame *frame, int numRemoved)
+{
+    QModelIndex index = createIndex(frame->number, 0, frame);
+    beginRemoveRows(index, 0, numRemoved - 1);
+}
+
+void ApiTraceModel::endUnloadingFrame(ApiTraceFrame *frame)
+{
+    QModelIndex index = createIndex(frame->number, 0, frame);
+
+    endRemoveRows();
+
+    emit dataChanged(index, index);
+}
+
 #include "apitracemodel.moc"
@@ -0,0 +1,231 @@
+#include "binarystate.h"
+
+#include <QImage>
+#include <QString>
+#include <QVariantList>
+#include <QVariantMap>
+
+#include <string.h>
+
+#include <string>
+
+#include <snappy.h>
+
+static const char binaryStateMagic[] = "APISTATE";
+static const int binaryStateMagicLength = 8;
+static const quint64 binaryStateVersion = 1;
+
+enum {
+    PIXELS_RAW = 0,
+    PIXELS_SNAPPY = 1
+};
+
+namespace {
+
+class BinaryStateParser
+{
+public:
+    BinaryStateParser(const QByteArray &data)
+        : m_data(data),
+          m_pos(0),
+          m_ok(true)
+    {
+    }
+
+    QVariant parse()
+    {
+        if (!isBinaryState(m_data)) {
+            m_ok = false;
+            return QVariant();
+        }
+        m_pos = binaryStateMagicLength;
+        if (readUInt() != binaryStateVersion) {
+            m_ok = false;
+            return QVariant();
+        }
+        return parseValue();
+    }
+
+    bool ok() const
+    {
+        return m_ok;
+    }
+
+private:
+    char peekByte()
+    {
+        if (m_pos >= m_data.size()) {
+            m_ok = false;
+            return 0;
+        }
+        return m_data.at(m_pos);
+    }
+
+    char readByte()
+    {
+        char c = peekByte();
+        ++m_pos;
+        return c;
+    }
+
+    quint64 readUInt()
+    {
+        quint64 value = 0;
+        unsigned shift = 0;
+        unsigned char c;
+        do {
+            c = readByte();
+            value |= quint64(c & 0x7f) << shift;
+            shift += 7;
+        } while ((c & 0x80) && m_ok);
+        return value;
+    }
+
+    QByteArray readBytes()
+    {
+        quint64 size = readUInt();
+        if (!m_ok || size > quint64(m_data.size() - m_pos)) {
+            m_ok = false;
+            return QByteArray();
+        }
+        QByteArray bytes = m_data.mid(m_pos, int(size));
+        m_pos += int(size);
+        return bytes;
+    }
+
+    template<class T>
+    T readRaw()
+    {
+        T value = 0;
+        if (m_pos + int(sizeof value) > m_data.size()) {
+            m_ok = false;
+            return value;
+        }
+        memcpy(&value, m_data.constData() + m_pos, sizeof value);
+        m_pos += sizeof value;
+        return value;
+    }
+
+    QVariant parseValue()
+    {
+        switch (readByte()) {
+        case 'Z':
+            return QVariant();
+        case 'T':
+            return QVariant(true);
+        case 'F':
+            return QVariant(false);
+        case 'u':
+            return QVariant(qulonglong(readUInt()));
+        case 's':
+            return QVariant(-qlonglong(readUInt()));
+        case 'f':
+            return QVariant(double(readRaw<float>()));
+        case 'd':
+            return QVariant(readRaw<double>());
+        case 'S':
+            return QVariant(QString::fromUtf8(readBytes()));
+        case '[': {
+            QVariantList list;
+            while (m_ok && peekByte() != ']') {
+                list.append(parseValue());
+            }
+            ++m_pos;
+            return list;
+        }
+        case '{': {
+            QVariantMap map;
+            while (m_ok && peekByte() != '}') {
+                QString name = parseValue().toString();
+                map[name] = parseValue();
+            }
+            ++m_pos;
+            return map;
+        }
+        case 'P':
+            return parsePixels();
+        default:
+            m_ok = false;
+            return QVariant();
+        }
+    }
+
+    QVariant parsePixels()
+    {
+        int width = int(readUInt());
+        int height = int(readUInt());
+        int channels = int(readUInt());
+        quint64 encoding = readUInt();
+        QByteArray pixels = readBytes();
+        if (!m_ok) {
+            return QVariant();
+        }
+
+        if (encoding == PIXELS_SNAPPY) {
+            std::string uncompressed;
+            if (!snappy::Uncompress(pixels.constData(), pixels.size(),
+                                    &uncompressed)) {
+                m_ok = false;
+                return QVariant();
+            }
+            pixels = QByteArray(uncompressed.data(), int(uncompressed.size()));
+        } else if (encoding != PIXELS_RAW) {
+            m_ok = false;
+            return QVariant();
+        }
+
+        if (channels < 1 || channels > 4 ||
+            pixels.size() < qint64(width) * height * channels) {
+            m_ok = false;
+            return QVariant();
+        }
+
+        QImage image(width, height, QImage::Format_ARGB32);
+        const uchar *src =
+            reinterpret_cast<const uchar *>(pixels.constData());
+        for (int y = 0; y < height; ++y) {
+            // Rows are stored bottom up
+            const uchar *row = src + (height - 1 - y) * width * channels;
+            QRgb *dst = reinterpret_cast<QRgb *>(image.scanLine(y));
+            for (int x = 0; x < width; ++x) {
+                const uchar *pixel = row + x * channels;
+                switch (channels) {
+                case 1:
+                    dst[x] = qRgb(pixel[0], pixel[0], pixel[0]);
+                    break;
+                case 2:
+                    dst[x] = qRgba(pixel[0], pixel[0], pixel[0], pixel[1]);
+                    break;
+                case 3:
+                    dst[x] = qRgb(pixel[0], pixel[1], pixel[2]);
+                    break;
+                default:
+                    dst[x] = qRgba(pixel[0], pixel[1], pixel[2], pixel[3]);
+                    break;
+                }
+            }
+        }
+        return image;
+    }
+
+    const QByteArray &m_data;
+    int m_pos;
+    bool m_ok;
+};
+
+}
+
+bool isBinaryState(const QByteArray &data)
+{
+    return data.startsWith(binaryStateMagic);
+}
+
+QVariant parseBinaryState(const QByteArray &data, bool *ok)
+{
+    BinaryStateParser parser(data);
+    QVariant result = parser.parse();
+    if (ok) {
+        *ok = parser.ok();
+    }
+    return result;
+}
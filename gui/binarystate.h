@@ -0,0 +1,21 @@
+#ifndef BINARYSTATE_H
+#define BINARYSTATE_H
+
+#include <QByteArray>
+#include <QVariant>
+
+/*
+ * Reader for the binary state dumps emitted by `glretrace -D`, described in
+ * retrace/state_writer.hpp.
+ */
+
+bool isBinaryState(const QByteArray &data);
+
+/**
+ * Parses a binary state dump into the same variant tree QJson produces for
+ * JSON dumps, except that images are decoded straight into QImage values
+ * rather than left as base64 encoded PNGs.
+ */
+QVariant parseBinaryState(const QByteArray &data, bool *ok);
+
+#endif
@@ -17,7 +17,9 @@ Q_DECLARE_METATYPE(QList<QImage>);
 
 static void usage(void)
 {
-    qWarning("usage: qapitrace [TRACE] [CALLNO]\n");
+    qWarning("usage: qapitrace [OPTIONS] [TRACE] [CALLNO]\n"
+             "\n"
+             "    --frame-cache MB    memory budget for the loaded frames (default 512)\n");
 }
 
 int main(int argc, char **argv)
@@ -25,6 +27,7 @@ int main(int argc, char **argv)
     QApplication app(argc, argv);
 
     qRegisterMetaType<QList<ApiTraceFrame*> >();
+    qRegisterMetaType<ApiTraceCall*>();
     qRegisterMetaType<QVector<ApiTraceCall*> >();
     qRegisterMetaType<ApiTraceState>();
     qRegisterMetaType<Qt::CaseSensitivity>();
@@ -33,6 +36,8 @@ int main(int argc, char **argv)
     qRegisterMetaType<QList<QImage> >();
     QStringList args = app.arguments();
 
+    quint64 frameCacheSize = 0;
+
     int i = 1;
     while (i < args.count()) {
         QString arg = args[i];
@@ -46,6 +51,9 @@ int main(int argc, char **argv)
                    arg == QLatin1String("--help")) {
             usage();
             exit(0);
+        } else if (arg == QLatin1String("--frame-cache") &&
+                   i < args.count()) {
+            frameCacheSize = args[i++].toULongLong() * 1024 * 1024;
         } else {
             usage();
             exit(1);
@@ -53,6 +61,9 @@ int main(int argc, char **argv)
     }
 
     MainWindow window;
+    if (frameCacheSize) {
+        window.setFrameCacheSize(frameCacheSize);
+    }
     window.show();
 
     if (i < args.count()) {
@@ -96,10 +96,29 @@ void MainWindow::loadTrace(const QString &fileName, int callNum)
     newTraceFile(fileName);
 }
 
+static ApiTraceFrame *
+frameOfEvent(ApiTraceEvent *event)
+{
+    if (!event) {
+        return NULL;
+    }
+    if (event->type() == ApiTraceEvent::Frame) {
+        return static_cast<ApiTraceFrame*>(event);
+    }
+    Q_ASSERT(event->type() == ApiTraceEvent::Call);
+    return static_cast<ApiTraceCall*>(event)->parentFrame();
+}
+
+void MainWindow::setFrameCacheSize(quint64 bytes)
+{
+    m_trace->setFrameCacheSize(bytes);
+}
+
 void MainWindow::callItemSelected(const QModelIndex &index)
 {
     ApiTraceEvent *event =
         index.data(ApiTraceModel::EventRole).value<ApiTraceEvent*>();
+    ApiTraceFrame *oldFrame = selectedFrame();
 
     if (event && event->type() == ApiTraceEvent::Call) {
         ApiTraceCall *call = static_cast<ApiTraceCall*>(event);
@@ -143,6 +162,11 @@ void MainWindow::callItemSelected(const QModelIndex &index)
         m_ui.detailsDock->hide();
         m_ui.vertexDataDock->hide();
     }
+
+    // Keep the selected frame from being unloaded behind our back
+    m_trace->pinFrame(selectedFrame());
+    m_trace->unpinFrame(oldFrame);
+
     if (m_selectedEvent && m_selectedEvent->hasState()) {
         fillStateForFrame();
     } else {
@@ -223,6 +247,7 @@ void MainWindow::replayFinished(const QString &message)
 
     m_progressBar->hide();
     statusBar()->showMessage(message, 2000);
+    m_trace->unpinFrame(frameOfEvent(m_stateEvent));
     m_stateEvent = 0;
     m_ui.actionShowErrorsDock->setEnabled(m_trace->hasErrors());
     m_ui.errorsDock->setVisible(m_trace->hasErrors());
@@ -237,6 +262,7 @@ void MainWindow::replayError(const QString &message)
     m_ui.actionReplay->setEnabled(true);
     m_ui.actionLookupState->setEnabled(true);
     m_ui.actionShowThumbnails->setEnabled(true);
+    m_trace->unpinFrame(frameOfEvent(m_stateEvent));
     m_stateEvent = 0;
     m_nonDefaultsLookupEvent = 0;
 
@@ -357,6 +383,8 @@ void MainWindow::lookupState()
                "Please wait until it finishes and try again."));
         return;
     }
+    m_trace->pinFrame(frameOfEvent(m_selectedEvent));
+    m_trace->unpinFrame(frameOfEvent(m_stateEvent));
     m_stateEvent = m_selectedEvent;
     replayTrace(true, false);
 }
@@ -39,6 +39,8 @@ public:
     MainWindow();
     ~MainWindow();
 
+    void setFrameCacheSize(quint64 bytes);
+
 public slots:
     void loadTrace(const QString &fileName, int callNum = -1);
 
@@ -1,6 +1,7 @@
 #include "retracer.h"
 
 #include "apitracecall.h"
+#include "binarystate.h"
 #include "thumbnail.h"
 
 #include "image.hpp"
@@ -124,6 +125,19 @@ qint64 BlockingIODevice::writeData(const char * data, qint64 maxSize)
 
 Q_DECLARE_METATYPE(QList<ApiTraceError>);
 
+static bool
+parseRetraceError(const QString &line, ApiTraceError &error)
+{
+    QRegExp regexp("(^\\d+): +(\\b\\w+\\b): ([^\\r\\n]+)[\\r\\n]*$");
+    if (regexp.indexIn(line) == -1) {
+        return false;
+    }
+    error.callIndex = regexp.cap(1).toInt();
+    error.type = regexp.cap(2);
+    error.message = regexp.cap(3);
+    return true;
+}
+
 Retracer::Retracer(QObject *parent)
     : QThread(parent),
       m_benchmarking(false),
@@ -145,6 +159,28 @@ Retracer::Retracer(QObject *parent)
 
     qputenv("PATH",
             m_processEnvironment.value("PATH").toLatin1());
+
+    m_server = new RetraceServer();
+    connect(m_server, SIGNAL(finished(const QString&)),
+            this, SIGNAL(finished(const QString&)));
+    connect(m_server, SIGNAL(foundState(ApiTraceState*)),
+            this, SIGNAL(foundState(ApiTraceState*)));
+    connect(m_server, SIGNAL(retraceErrors(const QList<ApiTraceError>&)),
+            this, SIGNAL(retraceErrors(const QList<ApiTraceError>&)));
+
+    m_serverThread = new QThread();
+    m_server->moveToThread(m_serverThread);
+    m_serverThread->start();
+}
+
+Retracer::~Retracer()
+{
+    QMetaObject::invokeMethod(m_server, "stop",
+                              Qt::BlockingQueuedConnection);
+    m_serverThread->quit();
+    m_serverThread->wait();
+    delete m_serverThread;
+    delete m_server;
 }
 
 QString Retracer::fileName() const
@@ -262,8 +298,14 @@ void Retracer::run()
     }
 
     if (m_captureState) {
-        arguments << QLatin1String("-D");
-        arguments << QString::number(m_captureCall);
+        // Wait for the server, so that the replay is over when we return
+        QMetaObject::invokeMethod(m_server, "captureState",
+                                  Qt::BlockingQueuedConnection,
+                                  Q_ARG(QString, prog),
+                                  Q_ARG(QStringList, arguments),
+                                  Q_ARG(QString, m_fileName),
+                                  Q_ARG(qlonglong, m_captureCall));
+        return;
     } else if (m_captureThumbnails) {
         arguments << QLatin1String("-s"); // emit snapshots
         arguments << QLatin1String("-"); // emit to stdout
@@ -397,14 +439,10 @@ void Retracer::run()
 
     QList<ApiTraceError> errors;
     process.setReadChannel(QProcess::StandardError);
-    QRegExp regexp("(^\\d+): +(\\b\\w+\\b): ([^\\r\\n]+)[\\r\\n]*$");
     while (!process.atEnd()) {
         QString line = process.readLine();
-        if (regexp.indexIn(line) != -1) {
-            ApiTraceError error;
-            error.callIndex = regexp.cap(1).toInt();
-            error.type = regexp.cap(2);
-            error.message = regexp.cap(3);
+        ApiTraceError error;
+        if (parseRetraceError(line, error)) {
             errors.append(error);
         }
     }
@@ -430,4 +468,177 @@ void Retracer::run()
     emit finished(msg);
 }
 
+
+RetraceServer::RetraceServer(QObject *parent)
+    : QObject(parent),
+      m_process(0),
+      m_callNo(-1)
+{
+}
+
+RetraceServer::~RetraceServer()
+{
+    // stop() must have been called from our thread
+    Q_ASSERT(!m_process);
+}
+
+/**
+ * Fetch the state through a long-lived `glretrace --server` process, which
+ * keeps its replay position between lookups, so that inspecting successive
+ * calls doesn't require replaying the trace from the start every time.
+ *
+ * The server answers the `state` request in the binary APISTATE format,
+ * unless --json is among the arguments, so both formats are accepted.
+ */
+void RetraceServer::captureState(const QString &prog,
+                                 const QStringList &arguments,
+                                 const QString &fileName,
+                                 qlonglong callNo)
+{
+    QString msg = QLatin1String("State fetched.");
+
+    QStringList serverArguments = arguments;
+    serverArguments << QLatin1String("--server");
+    serverArguments << fileName;
+
+    // Start a new server whenever the replay settings change
+    if (m_process &&
+        (m_process->state() != QProcess::Running ||
+         m_arguments != serverArguments)) {
+        stop();
+    }
+
+    if (!m_process) {
+        m_process = new QProcess;
+        m_process->start(prog, serverArguments, QIODevice::ReadWrite);
+        if (!m_process->waitForStarted(-1)) {
+            stop();
+            emit finished(QLatin1String("Could not start process"));
+            return;
+        }
+        m_arguments = serverArguments;
+        m_callNo = -1;
+    }
+
+    QByteArray payload;
+    bool ok = true;
+
+    // The server only replays forward, so rewind when the call was passed
+    if (callNo < m_callNo) {
+        ok = request("restart\n", payload);
+        m_callNo = -1;
+    }
+
+    if (ok) {
+        QByteArray advance = "advance " + QByteArray::number(callNo) + "\n";
+        ok = request(advance, payload);
+        if (ok) {
+            m_callNo = callNo;
+        }
+    }
+
+    QVariantMap parsedJson;
+    if (ok) {
+        ok = request("state\n", payload);
+        if (ok) {
+            if (isBinaryState(payload)) {
+                parsedJson = parseBinaryState(payload, &ok).toMap();
+                if (!ok) {
+                    msg = QLatin1String("failed to parse state");
+                }
+            } else {
+                QJson::Parser jsonParser;
+                parsedJson = jsonParser.parse(payload, &ok).toMap();
+                if (!ok) {
+                    msg = QLatin1String("failed to parse JSON");
+                }
+            }
+        } else {
+            msg = QLatin1String("Failed to fetch state");
+        }
+    } else {
+        msg = QLatin1String("Failed to replay up to the call");
+    }
+
+    QList<ApiTraceError> errors;
+    foreach (const QByteArray &line, m_process->readAllStandardError().split('\n')) {
+        ApiTraceError error;
+        if (parseRetraceError(QString::fromUtf8(line), error)) {
+            errors.append(error);
+        }
+    }
+
+    if (m_process->state() != QProcess::Running) {
+        msg = QLatin1String("Process crashed");
+        stop();
+    }
+
+    if (ok) {
+        ApiTraceState *state = new ApiTraceState(parsedJson);
+        emit foundState(state);
+    }
+
+    if (!errors.isEmpty()) {
+        emit retraceErrors(errors);
+    }
+
+    emit finished(msg);
+}
+
+/**
+ * Send a request to the server, and wait for its reply, which consists of a
+ * "ok SIZE" or "error SIZE" line followed by SIZE bytes of payload.
+ */
+bool RetraceServer::request(const QByteArray &request, QByteArray &payload)
+{
+    payload.clear();
+
+    m_process->write(request);
+    if (!m_process->waitForBytesWritten(-1)) {
+        return false;
+    }
+
+    m_process->setReadChannel(QProcess::StandardOutput);
+    while (!m_process->canReadLine()) {
+        if (!m_process->waitForReadyRead(-1)) {
+            return false;
+        }
+    }
+
+    QList<QByteArray> header = m_process->readLine().trimmed().split(' ');
+    if (header.size() != 2) {
+        return false;
+    }
+
+    qint64 size = header[1].toLongLong();
+    while (payload.size() < size) {
+        if (!m_process->bytesAvailable() &&
+            !m_process->waitForReadyRead(-1)) {
+            return false;
+        }
+        payload += m_process->read(size - payload.size());
+    }
+
+    return header[0] == "ok";
+}
+
+void RetraceServer::stop()
+{
+    if (!m_process) {
+        return;
+    }
+
+    if (m_process->state() == QProcess::Running) {
+        m_process->write("quit\n");
+        m_process->closeWriteChannel();
+        if (!m_process->waitForFinished(1000)) {
+            m_process->kill();
+            m_process->waitForFinished(-1);
+        }
+    }
+
+    delete m_process;
+    m_process = 0;
+}
+
 #include "retracer.moc"
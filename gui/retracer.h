@@ -9,11 +9,45 @@
 
 class ApiTraceState;
 
+/**
+ * Owns the long-lived `glretrace --server` process.  It lives in a thread of
+ * its own, as the process must be used and destroyed from the thread that
+ * created it, while each Retracer::run() executes in a new thread.
+ */
+class RetraceServer : public QObject
+{
+    Q_OBJECT
+public:
+    RetraceServer(QObject *parent=0);
+    ~RetraceServer();
+
+public slots:
+    void captureState(const QString &prog,
+                      const QStringList &arguments,
+                      const QString &fileName,
+                      qlonglong callNo);
+    void stop();
+
+signals:
+    void finished(const QString &output);
+    void foundState(ApiTraceState *state);
+    void retraceErrors(const QList<ApiTraceError> &errors);
+
+private:
+    bool request(const QByteArray &request, QByteArray &payload);
+
+private:
+    QProcess *m_process;
+    QStringList m_arguments;
+    qlonglong m_callNo;
+};
+
 class Retracer : public QThread
 {
     Q_OBJECT
 public:
     Retracer(QObject *parent=0);
+    ~Retracer();
 
     QString fileName() const;
     void setFileName(const QString &name);
@@ -54,6 +88,10 @@ private:
     bool m_captureThumbnails;
     qlonglong m_captureCall;
 
+    /* Long-lived retrace process serving state lookups */
+    RetraceServer *m_server;
+    QThread *m_serverThread;
+
     QProcessEnvironment m_processEnvironment;
 };
 
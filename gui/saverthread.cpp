@@ -1,8 +1,8 @@
 #include "saverthread.h"
 
+#include "trace_copier.hpp"
 #include "trace_writer.hpp"
 #include "trace_model.hpp"
-#include "trace_parser.hpp"
 
 #include <QFile>
 #include <QHash>
@@ -334,6 +334,44 @@ void SaverThread::saveFile(const QString &writeFileName,
     start();
 }
 
+namespace {
+
+/**
+ * Copies the calls that were not edited verbatim, and only parses the edited
+ * ones, so that saving a large trace costs little more than copying it.
+ */
+class EditCopier : public trace::Copier
+{
+public:
+    EditCopier(const QMap<int, ApiTraceCall*> &callIndexMap)
+        : m_callIndexMap(callIndexMap)
+    {
+    }
+
+protected:
+    Action filterCall(unsigned call_no, unsigned thread_id,
+                      const trace::FunctionSig *sig,
+                      trace::CallFlags flags)
+    {
+        return m_callIndexMap.contains(call_no) ? REWRITE : COPY;
+    }
+
+    void rewriteCall(trace::Writer &writer, trace::Call *call)
+    {
+        QVector<QVariant> values = m_callIndexMap[call->no]->editedValues();
+        for (int i = 0; i < values.count(); ++i) {
+            const QVariant &val = values[i];
+            overwriteValue(call, val, i);
+        }
+        writer.writeCall(call);
+    }
+
+private:
+    const QMap<int, ApiTraceCall*> &m_callIndexMap;
+};
+
+}
+
 void SaverThread::run()
 {
     qDebug() << "Saving  " << m_readFileName
@@ -347,22 +385,9 @@ void SaverThread::run()
     trace::Writer writer;
     writer.open(m_writeFileName.toLocal8Bit());
 
-    trace::Parser parser;
-    parser.open(m_readFileName.toLocal8Bit());
-
-    trace::Call *call;
-    while ((call = parser.parse_call())) {
-        if (callIndexMap.contains(call->no)) {
-            QVector<QVariant> values = callIndexMap[call->no]->editedValues();
-            for (int i = 0; i < values.count(); ++i) {
-                const QVariant &val = values[i];
-                overwriteValue(call, val, i);
-            }
-            writer.writeCall(call);
-        } else {
-            writer.writeCall(call);
-        }
-    }
+    EditCopier copier(callIndexMap);
+    copier.open(m_readFileName.toLocal8Bit());
+    copier.copy(writer);
 
     writer.close();
 
@@ -1,31 +1,75 @@
 #include "traceloader.h"
 
 #include "apitrace.h"
+
 #include <QDebug>
 #include <QFile>
+#include <QFuture>
+#include <QThread>
+#include <QTimer>
+#include <QtConcurrentRun>
+
 
 #define FRAMES_TO_CACHE 100
 
+/* How long the user must be idle before neighbouring frames get loaded */
+#define PREFETCH_DELAY 500
+
+/* Minimum number of calls handed to a search thread at once */
+#define SEARCH_CHUNK_CALLS 16384
+
+/* Number of calls whose arguments get converted at once */
+#define CALLS_TO_MATERIALIZE 128
+
 static ApiTraceCall *
 apiCallFromTraceCall(const trace::Call *call,
                      const QHash<QString, QUrl> &helpHash,
                      ApiTraceFrame *frame,
-                     TraceLoader *loader)
+                     TraceLoader *loader,
+                     const trace::ParseBookmark *bookmark = 0)
 {
-    ApiTraceCall *apiCall = new ApiTraceCall(frame, loader, call);
+    ApiTraceCall *apiCall = bookmark
+                          ? new ApiTraceCall(frame, loader, call, *bookmark)
+                          : new ApiTraceCall(frame, loader, call);
 
     apiCall->setHelpUrl(helpHash.value(apiCall->name()));
 
     return apiCall;
 }
 
+static quint64
+callBinaryDataSize(const trace::Call *call)
+{
+    quint64 size = 0;
+    for (unsigned i = 0; i < call->args.size(); ++i) {
+        const trace::Value *value = call->args[i].value;
+        const trace::Repr *repr = dynamic_cast<const trace::Repr *>(value);
+        if (repr) {
+            value = repr->humanValue;
+        }
+        const trace::Blob *blob = dynamic_cast<const trace::Blob *>(value);
+        if (blob) {
+            size += blob->size;
+        }
+    }
+    return size;
+}
+
 TraceLoader::TraceLoader(QObject *parent)
-    : QObject(parent)
+    : QObject(parent),
+      m_asideParser(0)
 {
+    /* a child, so that it follows the loader to its thread */
+    m_prefetchTimer = new QTimer(this);
+    m_prefetchTimer->setSingleShot(true);
+    connect(m_prefetchTimer, SIGNAL(timeout()),
+            this, SLOT(prefetchFrame()));
 }
 
 TraceLoader::~TraceLoader()
 {
+    closeSearchParsers();
+    delete m_asideParser;
     m_parser.close();
     qDeleteAll(m_signatures);
     qDeleteAll(m_enumSignatures);
@@ -44,9 +88,20 @@ void TraceLoader::loadTrace(const QString &filename)
         m_enumSignatures.clear();
         m_frameBookmarks.clear();
         m_createdFrames.clear();
+        m_loadedFrames.clear();
+        m_prefetchTimer->stop();
+        m_prefetchQueue.clear();
+        m_functionNames.clear();
+        closeSearchParsers();
+        m_asideMutex.lock();
+        delete m_asideParser;
+        m_asideParser = 0;
+        m_asideMutex.unlock();
         m_parser.close();
     }
 
+    m_fileName = filename;
+
     if (!m_parser.open(filename.toLatin1())) {
         qDebug() << "error: failed to open " << filename;
         return;
@@ -56,6 +111,17 @@ void TraceLoader::loadTrace(const QString &filename)
 
     if (m_parser.supportsOffsets()) {
         scanTrace();
+
+        // All signatures are known after scanning
+        trace::Parser *parser = new trace::Parser;
+        if (parser->open(filename.toLatin1())) {
+            parser->copySignatures(m_parser);
+            m_asideMutex.lock();
+            m_asideParser = parser;
+            m_asideMutex.unlock();
+        } else {
+            delete parser;
+        }
     } else {
         //Load the entire file into memory
         parseTrace();
@@ -67,6 +133,53 @@ void TraceLoader::loadTrace(const QString &filename)
 void TraceLoader::loadFrame(ApiTraceFrame *currentFrame)
 {
     fetchFrameContents(currentFrame);
+    schedulePrefetch(currentFrame);
+}
+
+void TraceLoader::forgetFrame(ApiTraceFrame *frame)
+{
+    m_loadedFrames.remove(frame);
+}
+
+/*
+ * Queues the frames around the one just requested, as the user is likely to
+ * browse into them next, and loads them once the user has been idle for a
+ * while.
+ */
+void TraceLoader::schedulePrefetch(ApiTraceFrame *frame)
+{
+    if (!m_parser.supportsOffsets()) {
+        return;
+    }
+
+    static const int offsets[] = { 1, 2, -1 };
+
+    m_prefetchQueue.clear();
+    int frameIdx = frame->number;
+    for (unsigned i = 0; i < sizeof offsets / sizeof offsets[0]; ++i) {
+        ApiTraceFrame *neighbour = m_createdFrames.value(frameIdx + offsets[i]);
+        if (neighbour && !m_loadedFrames.contains(neighbour)) {
+            m_prefetchQueue.append(neighbour);
+        }
+    }
+
+    if (!m_prefetchQueue.isEmpty()) {
+        m_prefetchTimer->start(PREFETCH_DELAY);
+    }
+}
+
+void TraceLoader::prefetchFrame()
+{
+    if (m_prefetchQueue.isEmpty()) {
+        return;
+    }
+
+    fetchFrameContents(m_prefetchQueue.takeFirst());
+
+    /* one frame at a time, so that requests in between aren't delayed */
+    if (!m_prefetchQueue.isEmpty()) {
+        m_prefetchTimer->start(0);
+    }
 }
 
 int TraceLoader::numberOfFrames() const
@@ -110,6 +223,7 @@ void TraceLoader::scanTrace()
 
     trace::Call *call;
     trace::ParseBookmark startBookmark;
+    FunctionMask functions;
     int numOfFrames = 0;
     int numOfCalls = 0;
     int lastPercentReport = 0;
@@ -119,9 +233,19 @@ void TraceLoader::scanTrace()
     while ((call = m_parser.scan_call())) {
         ++numOfCalls;
 
+        unsigned id = call->sig->id;
+        functions.add(id);
+        if (id >= unsigned(m_functionNames.size())) {
+            m_functionNames.resize(id + 1);
+        }
+        if (m_functionNames[id].isNull()) {
+            m_functionNames[id] = QString::fromStdString(call->sig->name);
+        }
+
         if (call->flags & trace::CALL_FLAG_END_FRAME) {
             FrameBookmark frameBookmark(startBookmark);
             frameBookmark.numberOfCalls = numOfCalls;
+            frameBookmark.functions = functions;
 
             currentFrame = new ApiTraceFrame();
             currentFrame->number = numOfFrames;
@@ -138,6 +262,7 @@ void TraceLoader::scanTrace()
                 lastPercentReport = m_parser.percentRead();
             }
             m_parser.getBookmark(startBookmark);
+            functions = FunctionMask();
             numOfCalls = 0;
         }
         delete call;
@@ -147,6 +272,7 @@ void TraceLoader::scanTrace()
         //trace::File::Bookmark endBookmark = m_parser.currentBookmark();
         FrameBookmark frameBookmark(startBookmark);
         frameBookmark.numberOfCalls = numOfCalls;
+        frameBookmark.functions = functions;
 
         currentFrame = new ApiTraceFrame();
         currentFrame->number = numOfFrames;
@@ -184,11 +310,7 @@ void TraceLoader::parseTrace()
         ApiTraceCall *apiCall =
                 apiCallFromTraceCall(call, m_helpHash, currentFrame, this);
         calls.append(apiCall);
-        if (apiCall->hasBinaryData()) {
-            QByteArray data =
-                    apiCall->arguments()[apiCall->binaryDataIndex()].toByteArray();
-            binaryDataSize += data.size();
-        }
+        binaryDataSize += callBinaryDataSize(call);
         if (call->flags & trace::CALL_FLAG_END_FRAME) {
             calls.squeeze();
             currentFrame->setCalls(calls, binaryDataSize);
@@ -239,118 +361,234 @@ void TraceLoader::addSignature(unsigned id, ApiTraceCallSignature *signature)
     m_signatures[id] = signature;
 }
 
-ApiTraceEnumSignature * TraceLoader::enumSignature(unsigned id)
+ApiTraceEnumSignature * TraceLoader::enumSignature(const trace::EnumSig *sig)
 {
-    if (id >= m_enumSignatures.count()) {
+    QMutexLocker locker(&m_enumSignaturesMutex);
+
+    unsigned id = sig->id;
+    if (id >= unsigned(m_enumSignatures.count())) {
         m_enumSignatures.resize(id + 1);
-        return NULL;
-    } else {
-        return m_enumSignatures[id];
     }
+    if (!m_enumSignatures[id]) {
+        m_enumSignatures[id] = new ApiTraceEnumSignature(sig);
+    }
+    return m_enumSignatures[id];
 }
 
-void TraceLoader::addEnumSignature(unsigned id, ApiTraceEnumSignature *signature)
+/*
+ * Matches calls against a search string, as ApiTraceCall::contains() does,
+ * but straight on the parsed trace::Call, so that no GUI objects need to be
+ * built for the calls that don't match.
+ */
+class CallMatcher
 {
-    m_enumSignatures[id] = signature;
-}
+public:
+    CallMatcher(const QString &text, Qt::CaseSensitivity cs)
+        : m_text(text),
+          m_cs(cs)
+    {
+    }
 
-void TraceLoader::searchNext(const ApiTrace::SearchRequest &request)
+    bool matches(const trace::Call *call) const
+    {
+        return ApiTraceCall::searchText(call).contains(m_text, m_cs);
+    }
+
+private:
+    QString m_text;
+    Qt::CaseSensitivity m_cs;
+};
+
+/* Consecutive frames to search, in search order */
+struct SearchChunk
 {
-    Q_ASSERT(m_parser.supportsOffsets());
-    if (m_parser.supportsOffsets()) {
-        int startFrame = m_createdFrames.indexOf(request.frame);
-        const FrameBookmark &frameBookmark = m_frameBookmarks[startFrame];
-        m_parser.setBookmark(frameBookmark.start);
-        trace::Call *call = 0;
-        while ((call = m_parser.parse_call())) {
-
-            if (callContains(call, request.text, request.cs)) {
-                unsigned frameIdx = callInFrame(call->no);
-                ApiTraceFrame *frame = m_createdFrames[frameIdx];
-                const QVector<ApiTraceCall*> calls =
-                        fetchFrameContents(frame);
-                for (int i = 0; i < calls.count(); ++i) {
-                    if (calls[i]->index() == call->no) {
-                        emit searchResult(request, ApiTrace::SearchResult_Found,
-                                          calls[i]);
-                        break;
-                    }
-                }
-                delete call;
-                return;
+    QVector<trace::ParseBookmark> starts;
+    QVector<int> numberOfCalls;
+};
+
+/*
+ * Runs on a search thread, returning the number of the first matching call
+ * in the chunk, or -1.
+ */
+static int
+searchChunk(trace::Parser *parser,
+            const SearchChunk *chunk,
+            const CallMatcher *matcher,
+            bool backwards)
+{
+    for (int i = 0; i < chunk->starts.count(); ++i) {
+        int found = -1;
+
+        parser->setBookmark(chunk->starts[i]);
+        for (int j = 0; j < chunk->numberOfCalls[i]; ++j) {
+            trace::Call *call = parser->parse_call();
+            if (!call) {
+                break;
+            }
+            bool match = matcher->matches(call);
+            if (match) {
+                found = call->no;
             }
-
             delete call;
+
+            // Backwards, we need the last match of the frame
+            if (match && !backwards) {
+                break;
+            }
+        }
+
+        if (found >= 0) {
+            return found;
         }
     }
-    emit searchResult(request, ApiTrace::SearchResult_NotFound, 0);
+    return -1;
 }
 
-void TraceLoader::searchPrev(const ApiTrace::SearchRequest &request)
+void TraceLoader::openSearchParsers()
 {
-    Q_ASSERT(m_parser.supportsOffsets());
-    if (m_parser.supportsOffsets()) {
-        int startFrame = m_createdFrames.indexOf(request.frame);
-        trace::Call *call = 0;
-        QList<trace::Call*> frameCalls;
-        int frameIdx = startFrame;
+    if (!m_searchParsers.isEmpty()) {
+        return;
+    }
 
-        const FrameBookmark &frameBookmark = m_frameBookmarks[frameIdx];
-        int numCallsToParse = frameBookmark.numberOfCalls;
-        m_parser.setBookmark(frameBookmark.start);
+    int numThreads = qMax(QThread::idealThreadCount(), 1);
+    for (int i = 0; i < numThreads; ++i) {
+        trace::Parser *parser = new trace::Parser;
+        if (!parser->open(m_fileName.toLatin1())) {
+            delete parser;
+            break;
+        }
+        parser->copySignatures(m_parser);
+        m_searchParsers.append(parser);
+    }
+}
+
+void TraceLoader::closeSearchParsers()
+{
+    qDeleteAll(m_searchParsers);
+    m_searchParsers.clear();
+}
 
-        while ((call = m_parser.parse_call())) {
+/*
+ * Searches the frames from the request one, handing chunks of frames to as
+ * many threads as there are cores, each with its own parser.  Returns the
+ * number of the matching call, or -1.
+ */
+int TraceLoader::searchFrames(const ApiTrace::SearchRequest &request,
+                              bool backwards)
+{
+    CallMatcher matcher(request.text, request.cs);
 
-            frameCalls.append(call);
-            --numCallsToParse;
+    /*
+     * When the text is part of the name of some functions, skip the frames
+     * which call none of them.
+     */
+    FunctionMask functions;
+    bool byFunction = false;
+    for (int id = 0; id < m_functionNames.size(); ++id) {
+        if (!m_functionNames[id].isNull() &&
+            m_functionNames[id].contains(request.text, request.cs)) {
+            functions.add(id);
+            byFunction = true;
+        }
+    }
 
-            if (numCallsToParse == 0) {
-                bool foundCall = searchCallsBackwards(frameCalls,
-                                                      frameIdx,
-                                                      request);
+    QVector<SearchChunk> chunks;
+    SearchChunk chunk;
+    int chunkCalls = 0;
+    int step = backwards ? -1 : 1;
+    for (int frameIdx = m_createdFrames.indexOf(request.frame);
+         frameIdx >= 0 && frameIdx < numberOfFrames();
+         frameIdx += step) {
+        const FrameBookmark &frameBookmark = m_frameBookmarks[frameIdx];
+        if (byFunction &&
+            !frameBookmark.functions.intersects(functions)) {
+            continue;
+        }
 
-                qDeleteAll(frameCalls);
-                frameCalls.clear();
-                if (foundCall) {
-                    return;
-                }
+        chunk.starts.append(frameBookmark.start);
+        chunk.numberOfCalls.append(frameBookmark.numberOfCalls);
+        chunkCalls += frameBookmark.numberOfCalls;
+        if (chunkCalls >= SEARCH_CHUNK_CALLS) {
+            chunks.append(chunk);
+            chunk = SearchChunk();
+            chunkCalls = 0;
+        }
+    }
+    if (!chunk.starts.isEmpty()) {
+        chunks.append(chunk);
+    }
 
-                --frameIdx;
+    openSearchParsers();
+    if (m_searchParsers.isEmpty()) {
+        return -1;
+    }
 
-                if (frameIdx >= 0) {
-                    const FrameBookmark &frameBookmark =
-                            m_frameBookmarks[frameIdx];
-                    m_parser.setBookmark(frameBookmark.start);
-                    numCallsToParse = frameBookmark.numberOfCalls;
-                }
+    int numThreads = m_searchParsers.count();
+    for (int first = 0; first < chunks.count(); first += numThreads) {
+        QList< QFuture<int> > results;
+        for (int i = 0; i < numThreads && first + i < chunks.count(); ++i) {
+            results.append(QtConcurrent::run(searchChunk,
+                                             m_searchParsers[i],
+                                             &chunks[first + i],
+                                             &matcher,
+                                             backwards));
+        }
+
+        // Wait for all threads, but take the match from the earliest chunk
+        int found = -1;
+        for (int i = 0; i < results.count(); ++i) {
+            int callNo = results[i].result();
+            if (found < 0) {
+                found = callNo;
             }
         }
+        if (found >= 0) {
+            return found;
+        }
+    }
+
+    return -1;
+}
+
+void TraceLoader::searchNext(const ApiTrace::SearchRequest &request)
+{
+    Q_ASSERT(m_parser.supportsOffsets());
+    if (m_parser.supportsOffsets()) {
+        int callNo = searchFrames(request, false);
+        if (callNo >= 0) {
+            emitSearchResult(request, callNo);
+            return;
+        }
     }
     emit searchResult(request, ApiTrace::SearchResult_NotFound, 0);
 }
 
-bool TraceLoader::searchCallsBackwards(const QList<trace::Call*> &calls,
-                                       int frameIdx,
-                                       const ApiTrace::SearchRequest &request)
-{
-    for (int i = calls.count() - 1; i >= 0; --i) {
-        trace::Call *call = calls[i];
-        if (callContains(call, request.text, request.cs)) {
-            ApiTraceFrame *frame = m_createdFrames[frameIdx];
-            const QVector<ApiTraceCall*> apiCalls =
-                    fetchFrameContents(frame);
-            for (int i = 0; i < apiCalls.count(); ++i) {
-                if (apiCalls[i]->index() == call->no) {
-                    emit searchResult(request,
-                                      ApiTrace::SearchResult_Found,
-                                      apiCalls[i]);
-                    break;
-                }
-            }
-            return true;
+void TraceLoader::searchPrev(const ApiTrace::SearchRequest &request)
+{
+    Q_ASSERT(m_parser.supportsOffsets());
+    if (m_parser.supportsOffsets()) {
+        int callNo = searchFrames(request, true);
+        if (callNo >= 0) {
+            emitSearchResult(request, callNo);
+            return;
+        }
+    }
+    emit searchResult(request, ApiTrace::SearchResult_NotFound, 0);
+}
+
+void TraceLoader::emitSearchResult(const ApiTrace::SearchRequest &request,
+                                   int callNo)
+{
+    ApiTraceFrame *frame = m_createdFrames[callInFrame(callNo)];
+    const QVector<ApiTraceCall*> calls = fetchFrameContents(frame);
+    for (int i = 0; i < calls.count(); ++i) {
+        if (calls[i]->index() == callNo) {
+            emit searchResult(request, ApiTrace::SearchResult_Found,
+                              calls[i]);
+            return;
         }
     }
-    return false;
+    emit searchResult(request, ApiTrace::SearchResult_NotFound, 0);
 }
 
 int TraceLoader::callInFrame(int callIdx) const
@@ -370,27 +608,19 @@ int TraceLoader::callInFrame(int callIdx) const
     return 0;
 }
 
-bool TraceLoader::callContains(trace::Call *call,
-                               const QString &str,
-                               Qt::CaseSensitivity sensitivity)
-{
-    /*
-     * FIXME: do string comparison directly on trace::Call
-     */
-    ApiTraceCall *apiCall = apiCallFromTraceCall(call, m_helpHash,
-                                                 0, this);
-    bool result = apiCall->contains(str, sensitivity);
-    delete apiCall;
-    return result;
-}
-
 QVector<ApiTraceCall*>
 TraceLoader::fetchFrameContents(ApiTraceFrame *currentFrame)
 {
     Q_ASSERT(currentFrame);
 
-    if (currentFrame->isLoaded()) {
-        return currentFrame->calls();
+    /*
+     * Don't look at the frame itself, as the ApiTrace may be loading or
+     * unloading it concurrently.
+     */
+    QHash<ApiTraceFrame*, QVector<ApiTraceCall*> >::const_iterator itr =
+        m_loadedFrames.constFind(currentFrame);
+    if (itr != m_loadedFrames.constEnd()) {
+        return itr.value();
     }
 
     if (m_parser.supportsOffsets()) {
@@ -405,19 +635,27 @@ TraceLoader::fetchFrameContents(ApiTraceFrame *currentFrame)
             m_parser.setBookmark(frameBookmark.start);
 
             trace::Call *call;
+            trace::ParseBookmark callBookmark;
             int parsedCalls = 0;
-            while ((call = m_parser.parse_call())) {
+            while (true) {
+                /*
+                 * Calls are parsed again from the last point where none was
+                 * pending, as the ones entered before would be missed.
+                 */
+                if (!m_parser.hasPendingCalls()) {
+                    m_parser.getBookmark(callBookmark);
+                }
+                call = m_parser.parse_call();
+                if (!call) {
+                    break;
+                }
+
                 ApiTraceCall *apiCall =
                     apiCallFromTraceCall(call, m_helpHash,
-                                         currentFrame, this);
+                                         currentFrame, this, &callBookmark);
                 calls[parsedCalls] = apiCall;
                 Q_ASSERT(calls[parsedCalls]);
-                if (apiCall->hasBinaryData()) {
-                    QByteArray data =
-                        apiCall->arguments()[
-                            apiCall->binaryDataIndex()].toByteArray();
-                    binaryDataSize += data.size();
-                }
+                binaryDataSize += callBinaryDataSize(call);
 
                 ++parsedCalls;
 
@@ -433,6 +671,7 @@ TraceLoader::fetchFrameContents(ApiTraceFrame *currentFrame)
             calls.squeeze();
 
             Q_ASSERT(parsedCalls == currentFrame->numChildrenToLoad());
+            m_loadedFrames.insert(currentFrame, calls);
             emit frameContentsLoaded(currentFrame,
                                      calls, binaryDataSize);
             return calls;
@@ -441,19 +680,73 @@ TraceLoader::fetchFrameContents(ApiTraceFrame *currentFrame)
     return QVector<ApiTraceCall*>();
 }
 
-void TraceLoader::findFrameStart(ApiTraceFrame *frame)
+/*
+ * Converts the arguments of the given call, and of the calls following it in
+ * its frame, parsing them again from the call bookmark.
+ */
+static void
+materializeCalls(trace::Parser &parser,
+                 const QVector<ApiTraceCall*> &calls,
+                 ApiTraceCall *apiCall)
 {
-    if (!frame->isLoaded()) {
-        loadFrame(frame);
+    int first = calls.indexOf(apiCall);
+    if (first < 0) {
+        return;
     }
+
+    parser.setBookmark(apiCall->bookmark());
+
+    int next = first;
+    trace::Call *call;
+    while (next < calls.count() &&
+           next < first + CALLS_TO_MATERIALIZE &&
+           (call = parser.parse_call())) {
+        // Skip the calls before ours which share its bookmark
+        if (next > first || call->no == unsigned(apiCall->index())) {
+            ApiTraceCall *nextCall = calls[next];
+            if (nextCall->index() != int(call->no)) {
+                delete call;
+                break;
+            }
+            if (!nextCall->isMaterialized()) {
+                nextCall->materialize(call);
+            }
+            ++next;
+        }
+        delete call;
+    }
+}
+
+void TraceLoader::materializeCall(ApiTraceCall *apiCall)
+{
+    materializeCalls(m_parser,
+                     m_loadedFrames.value(apiCall->parentFrame()),
+                     apiCall);
+}
+
+/*
+ * Same as materializeCall(), but for the thread owning the frame of the
+ * call, with the aside parser.
+ */
+void TraceLoader::materializeCallAside(ApiTraceCall *apiCall)
+{
+    QMutexLocker locker(&m_asideMutex);
+    if (m_asideParser) {
+        materializeCalls(*m_asideParser,
+                         apiCall->parentFrame()->calls(),
+                         apiCall);
+    }
+}
+
+void TraceLoader::findFrameStart(ApiTraceFrame *frame)
+{
+    fetchFrameContents(frame);
     emit foundFrameStart(frame);
 }
 
 void TraceLoader::findFrameEnd(ApiTraceFrame *frame)
 {
-    if (!frame->isLoaded()) {
-        loadFrame(frame);
-    }
+    fetchFrameContents(frame);
     emit foundFrameEnd(frame);
 }
 
@@ -7,8 +7,15 @@
 #include "trace_parser.hpp"
 
 #include <QObject>
+#include <QHash>
 #include <QList>
 #include <QMap>
+#include <QMutex>
+#include <QVector>
+
+#include <string.h>
+
+class QTimer;
 
 class TraceLoader : public QObject
 {
@@ -21,8 +28,11 @@ public:
     ApiTraceCallSignature *signature(unsigned id);
     void addSignature(unsigned id, ApiTraceCallSignature *signature);
 
-    ApiTraceEnumSignature *enumSignature(unsigned id);
-    void addEnumSignature(unsigned id, ApiTraceEnumSignature *signature);
+    /* Can be called from any thread */
+    ApiTraceEnumSignature *enumSignature(const trace::EnumSig *sig);
+
+    void materializeCall(ApiTraceCall *call);
+    void materializeCallAside(ApiTraceCall *call);
 
 public slots:
     void loadTrace(const QString &filename);
@@ -31,6 +41,10 @@ public slots:
     void findFrameEnd(ApiTraceFrame *frame);
     void findCallIndex(int index);
     void search(const ApiTrace::SearchRequest &request);
+    void forgetFrame(ApiTraceFrame *frame);
+
+private slots:
+    void prefetchFrame();
 
 signals:
     void startedParsing();
@@ -50,6 +64,34 @@ signals:
     void foundFrameEnd(ApiTraceFrame *frame);
     void foundCallIndex(ApiTraceCall *call);
 private:
+    /* Bloom filter of the functions called in a frame, by signature id */
+    struct FunctionMask {
+        enum { NUM_BITS = 256 };
+
+        FunctionMask()
+        {
+            memset(bits, 0, sizeof bits);
+        }
+
+        void add(unsigned id)
+        {
+            id %= NUM_BITS;
+            bits[id / 32] |= 1u << (id % 32);
+        }
+
+        bool intersects(const FunctionMask &other) const
+        {
+            for (int i = 0; i < NUM_BITS / 32; ++i) {
+                if (bits[i] & other.bits[i]) {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        quint32 bits[NUM_BITS / 32];
+    };
+
     struct FrameBookmark {
         FrameBookmark()
             : numberOfCalls(0)
@@ -61,6 +103,7 @@ private:
 
         trace::ParseBookmark start;
         int numberOfCalls;
+        FunctionMask functions;
     };
     int numberOfFrames() const;
     int numberOfCallsInFrame(int frameIdx) const;
@@ -69,30 +112,50 @@ private:
     void guessApi(const trace::Call *call);
     void scanTrace();
     void parseTrace();
+    void schedulePrefetch(ApiTraceFrame *frame);
 
     void searchNext(const ApiTrace::SearchRequest &request);
     void searchPrev(const ApiTrace::SearchRequest &request);
+    int searchFrames(const ApiTrace::SearchRequest &request, bool backwards);
+    void emitSearchResult(const ApiTrace::SearchRequest &request, int callNo);
+    void openSearchParsers();
+    void closeSearchParsers();
 
     int callInFrame(int callIdx) const;
-    bool callContains(trace::Call *call,
-                      const QString &str,
-                      Qt::CaseSensitivity sensitivity);
      QVector<ApiTraceCall*> fetchFrameContents(ApiTraceFrame *frame);
-     bool searchCallsBackwards(const QList<trace::Call*> &calls,
-                               int frameIdx,
-                               const ApiTrace::SearchRequest &request);
 
 private:
     trace::Parser m_parser;
+    QString m_fileName;
+
+    /* Additional parsers for the search threads */
+    QVector<trace::Parser*> m_searchParsers;
+
+    /*
+     * Additional parser for materializing calls from the GUI thread, so that
+     * it doesn't wait for whatever the loader is busy with.
+     */
+    trace::Parser *m_asideParser;
+    QMutex m_asideMutex;
+
+    /* Function names, by signature id */
+    QVector<QString> m_functionNames;
 
     typedef QMap<int, FrameBookmark> FrameBookmarks;
     FrameBookmarks m_frameBookmarks;
     QList<ApiTraceFrame*> m_createdFrames;
 
+    /* Frames whose calls were handed over to the ApiTrace */
+    QHash<ApiTraceFrame*, QVector<ApiTraceCall*> > m_loadedFrames;
+
+    QTimer *m_prefetchTimer;
+    QList<ApiTraceFrame*> m_prefetchQueue;
+
     QHash<QString, QUrl> m_helpHash;
 
     QVector<ApiTraceCallSignature*> m_signatures;
     QVector<ApiTraceEnumSignature*> m_enumSignatures;
+    QMutex m_enumSignaturesMutex;
 };
 
 #endif
@@ -37,6 +37,11 @@
 
 #include <string.h>
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define HAVE_SSE2 1
+#include <emmintrin.h>
+#endif
+
 #include "os.hpp"
 #include "glimports.hpp"
 
@@ -330,63 +335,190 @@ _glDrawArrays_count(GLint first, GLsizei count)
 
 #define _glDrawArraysEXT_count _glDrawArrays_count
 
+/*
+ * Maximum index in an index array.
+ *
+ * These are the bottleneck of tracing applications which draw from user
+ * arrays, so they process 16 bytes at a time where SSE2 is available.
+ * Unsigned 16/32bit comparisons are not available in SSE2, so the values are
+ * biased to make signed comparisons equivalent.
+ */
+
 static inline GLuint
-_glDrawElementsBaseVertex_count(GLsizei count, GLenum type, const GLvoid *indices, GLint basevertex)
+_gl_max_index_ubyte(const GLubyte *p, GLsizei count)
 {
-    GLvoid *temp = 0;
-    GLint element_array_buffer = 0;
-
-    if (!count) {
-        return 0;
+    GLuint maxindex = 0;
+    GLsizei i = 0;
+#ifdef HAVE_SSE2
+    if (count >= 16) {
+        __m128i vmax = _mm_setzero_si128();
+        for (; i + 16 <= count; i += 16) {
+            vmax = _mm_max_epu8(vmax, _mm_loadu_si128((const __m128i *)(p + i)));
+        }
+        vmax = _mm_max_epu8(vmax, _mm_srli_si128(vmax, 8));
+        vmax = _mm_max_epu8(vmax, _mm_srli_si128(vmax, 4));
+        vmax = _mm_max_epu8(vmax, _mm_srli_si128(vmax, 2));
+        vmax = _mm_max_epu8(vmax, _mm_srli_si128(vmax, 1));
+        maxindex = _mm_cvtsi128_si32(vmax) & 0xff;
     }
+#endif
+    for (; i < count; ++i) {
+        if (p[i] > maxindex) {
+            maxindex = p[i];
+        }
+    }
+    return maxindex;
+}
 
-    _glGetIntegerv(GL_ELEMENT_ARRAY_BUFFER_BINDING, &element_array_buffer);
-    if (element_array_buffer) {
-        // Read indices from index buffer object
-        GLintptr offset = (GLintptr)indices;
-        GLsizeiptr size = count*_gl_type_size(type);
-        GLvoid *temp = malloc(size);
-        if (!temp) {
-            return 0;
+static inline GLuint
+_gl_max_index_ushort(const GLushort *p, GLsizei count)
+{
+    GLuint maxindex = 0;
+    GLsizei i = 0;
+#ifdef HAVE_SSE2
+    if (count >= 8) {
+        const __m128i bias = _mm_set1_epi16((short)0x8000);
+        __m128i vmax = bias;
+        for (; i + 8 <= count; i += 8) {
+            __m128i v = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(p + i)), bias);
+            vmax = _mm_max_epi16(vmax, v);
         }
-        memset(temp, 0, size);
-        _glGetBufferSubData(GL_ELEMENT_ARRAY_BUFFER, offset, size, temp);
-        indices = temp;
-    } else {
-        if (!indices) {
-            return 0;
+        vmax = _mm_max_epi16(vmax, _mm_srli_si128(vmax, 8));
+        vmax = _mm_max_epi16(vmax, _mm_srli_si128(vmax, 4));
+        vmax = _mm_max_epi16(vmax, _mm_srli_si128(vmax, 2));
+        maxindex = (_mm_cvtsi128_si32(vmax) & 0xffff) ^ 0x8000;
+    }
+#endif
+    for (; i < count; ++i) {
+        if (p[i] > maxindex) {
+            maxindex = p[i];
         }
     }
+    return maxindex;
+}
+
+#ifdef HAVE_SSE2
+static inline __m128i
+_gl_max_epi32_sse2(__m128i a, __m128i b)
+{
+    __m128i mask = _mm_cmpgt_epi32(a, b);
+    return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+#endif
 
+static inline GLuint
+_gl_max_index_uint(const GLuint *p, GLsizei count)
+{
     GLuint maxindex = 0;
-    GLsizei i;
-    if (type == GL_UNSIGNED_BYTE) {
-        const GLubyte *p = (const GLubyte *)indices;
-        for (i = 0; i < count; ++i) {
-            if (p[i] > maxindex) {
-                maxindex = p[i];
-            }
-        }
-    } else if (type == GL_UNSIGNED_SHORT) {
-        const GLushort *p = (const GLushort *)indices;
-        for (i = 0; i < count; ++i) {
-            if (p[i] > maxindex) {
-                maxindex = p[i];
-            }
+    GLsizei i = 0;
+#ifdef HAVE_SSE2
+    if (count >= 4) {
+        const __m128i bias = _mm_set1_epi32((int)0x80000000);
+        __m128i vmax = bias;
+        for (; i + 4 <= count; i += 4) {
+            __m128i v = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(p + i)), bias);
+            vmax = _gl_max_epi32_sse2(vmax, v);
         }
-    } else if (type == GL_UNSIGNED_INT) {
-        const GLuint *p = (const GLuint *)indices;
-        for (i = 0; i < count; ++i) {
-            if (p[i] > maxindex) {
-                maxindex = p[i];
-            }
+        vmax = _gl_max_epi32_sse2(vmax, _mm_srli_si128(vmax, 8));
+        vmax = _gl_max_epi32_sse2(vmax, _mm_srli_si128(vmax, 4));
+        maxindex = (GLuint)_mm_cvtsi128_si32(vmax) ^ 0x80000000;
+    }
+#endif
+    for (; i < count; ++i) {
+        if (p[i] > maxindex) {
+            maxindex = p[i];
         }
-    } else {
+    }
+    return maxindex;
+}
+
+static inline GLuint
+_gl_max_index(GLsizei count, GLenum type, const GLvoid *indices)
+{
+    switch (type) {
+    case GL_UNSIGNED_BYTE:
+        return _gl_max_index_ubyte((const GLubyte *)indices, count);
+    case GL_UNSIGNED_SHORT:
+        return _gl_max_index_ushort((const GLushort *)indices, count);
+    case GL_UNSIGNED_INT:
+        return _gl_max_index_uint((const GLuint *)indices, count);
+    default:
         os::log("apitrace: warning: %s: unknown GLenum 0x%04X\n", __FUNCTION__, type);
+        return 0;
     }
+}
+
 
+/*
+ * Maximum index of an index range stored in the bound element array buffer.
+ */
+static inline GLuint
+_gl_element_array_max_index(GLsizei count, GLenum type, GLintptr offset)
+{
+    GLsizeiptr size = count*_gl_type_size(type);
+    GLvoid *temp = malloc(size);
+    if (!temp) {
+        return 0;
+    }
+    memset(temp, 0, size);
+    _glGetBufferSubData(GL_ELEMENT_ARRAY_BUFFER, offset, size, temp);
+    GLuint maxindex = _gl_max_index(count, type, temp);
+    free(temp);
+    return maxindex;
+}
+
+
+/*
+ * The tracer defines _GL_SIZE_ELEMENT_ARRAY_HOOKS and implements these with
+ * its shadowed buffer bindings and a per share group cache of the maximum
+ * indices, so that repeated draws of static meshes don't need to query the
+ * binding nor read back and scan the indices.
+ */
+#ifdef _GL_SIZE_ELEMENT_ARRAY_HOOKS
+
+static inline GLint
+_gl_element_array_buffer_binding(void);
+
+static inline GLuint
+_gl_element_array_buffer_max_index(GLint buffer, GLsizei count, GLenum type, GLintptr offset);
+
+#else
+
+static inline GLint
+_gl_element_array_buffer_binding(void)
+{
+    GLint element_array_buffer = 0;
+    _glGetIntegerv(GL_ELEMENT_ARRAY_BUFFER_BINDING, &element_array_buffer);
+    return element_array_buffer;
+}
+
+static inline GLuint
+_gl_element_array_buffer_max_index(GLint buffer, GLsizei count, GLenum type, GLintptr offset)
+{
+    return _gl_element_array_max_index(count, type, offset);
+}
+
+#endif /* !_GL_SIZE_ELEMENT_ARRAY_HOOKS */
+
+
+static inline GLuint
+_glDrawElementsBaseVertex_count(GLsizei count, GLenum type, const GLvoid *indices, GLint basevertex)
+{
+    GLint element_array_buffer;
+    GLuint maxindex;
+
+    if (!count) {
+        return 0;
+    }
+
+    element_array_buffer = _gl_element_array_buffer_binding();
     if (element_array_buffer) {
-        free(temp);
+        maxindex = _gl_element_array_buffer_max_index(element_array_buffer, count, type, (GLintptr)indices);
+    } else {
+        if (!indices) {
+            return 0;
+        }
+        maxindex = _gl_max_index(count, type, indices);
     }
 
     maxindex += basevertex;
@@ -602,8 +734,8 @@ _align(X x, Y y) {
     return (x + (y - 1)) & ~(y - 1);
 }
 
-static inline size_t
-_gl_image_size(GLenum format, GLenum type, GLsizei width, GLsizei height, GLsizei depth, GLboolean has_unpack_subimage) {
+static inline unsigned
+_gl_pixel_bits(GLenum format, GLenum type) {
     unsigned num_channels = _gl_format_channels(format);
 
     unsigned bits_per_pixel;
@@ -659,6 +791,13 @@ _gl_image_size(GLenum format, GLenum type, GLsizei width, GLsizei height, GLsize
         break;
     }
 
+    return bits_per_pixel;
+}
+
+static inline size_t
+_gl_image_size(GLenum format, GLenum type, GLsizei width, GLsizei height, GLsizei depth, GLboolean has_unpack_subimage) {
+    unsigned bits_per_pixel = _gl_pixel_bits(format, type);
+
     GLint alignment = 4;
     GLint row_length = 0;
     GLint image_height = 0;
@@ -764,6 +903,14 @@ _glClearBuffer_size(GLenum buffer)
     }
 }
 
+static inline size_t
+_glClearBufferData_size(GLenum format, GLenum type)
+{
+    return (_gl_pixel_bits(format, type) + 7)/8;
+}
+
+#define _glClearBufferSubData_size _glClearBufferData_size
+
 /* 
  * attribute list, terminated by the given terminator.
  */
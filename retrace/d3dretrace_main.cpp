@@ -30,6 +30,7 @@
 
 #include "d3dstate.hpp"
 #include "retrace.hpp"
+#include "state_writer.hpp"
 #include "d3dretrace.hpp"
 
 
@@ -58,6 +59,12 @@ retrace::addCallbacks(retrace::Retracer &retracer)
 }
 
 
+bool
+retrace::isPrewarmCall(const trace::FunctionSig *sig) {
+    return false;
+}
+
+
 image::Image *
 retrace::getSnapshot(void) {
     if (!d3dretrace::pLastDirect3DDevice9) {
@@ -75,16 +82,34 @@ retrace::dumpState(std::ostream &os)
         return false;
     }
 
-    d3dstate::dumpDevice(os, d3dretrace::pLastDirect3DDevice9);
+    StateWriter *writer = retrace::createStateWriter(os);
+    d3dstate::dumpDevice(*writer, d3dretrace::pLastDirect3DDevice9);
+    delete writer;
 
     return true;
 }
 
 
+void
+retrace::beginProfile(trace::Call &call) {
+}
+
+void
+retrace::endProfile(trace::Call &call, long long cpuStart, long long cpuEnd) {
+}
+
 void
 retrace::flushRendering(void) {
 }
 
+void
+retrace::resetContexts(void) {
+}
+
+void
+retrace::dumpStatistics(std::ostream &os) {
+}
+
 void
 retrace::waitForInput(void) {
 }
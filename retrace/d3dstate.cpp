@@ -27,17 +27,15 @@
 #include <iostream>
 
 #include "d3d9imports.hpp"
-#include "json.hpp"
+#include "state_writer.hpp"
 
 
 namespace d3dstate {
 
 
 void
-dumpDevice(std::ostream &os, IDirect3DDevice9 *pDevice)
+dumpDevice(StateWriter &writer, IDirect3DDevice9 *pDevice)
 {
-    JSONWriter json(os);
-
     /* TODO */
 }
 
@@ -32,6 +32,8 @@
 
 struct IDirect3DDevice9;
 
+class StateWriter;
+
 
 namespace image {
     class Image;
@@ -46,7 +48,7 @@ getRenderTargetImage(IDirect3DDevice9 *pDevice);
 
 
 void
-dumpDevice(std::ostream &os, IDirect3DDevice9 *pDevice);
+dumpDevice(StateWriter &writer, IDirect3DDevice9 *pDevice);
 
 
 } /* namespace d3dstate */
@@ -27,6 +27,7 @@
 #define _GLRETRACE_HPP_
 
 #include "glws.hpp"
+#include "glimports.hpp"
 #include "retrace.hpp"
 
 
@@ -54,6 +55,25 @@ createContext(glws::Context *shareContext = 0);
 bool
 makeCurrent(trace::Call &call, glws::Drawable *drawable, glws::Context *context);
 
+void
+destroyContext(glws::Context *context);
+
+void
+destroyDrawable(glws::Drawable *drawable);
+
+/**
+ * Destroy every context and drawable created so far, along with the
+ * objects they contain.
+ */
+void
+destroyAllContexts(void);
+
+// Forget the contexts and drawables of each window system
+void resetGlxContexts(void);
+void resetWglContexts(void);
+void resetCglContexts(void);
+void resetEglContexts(void);
+
 
 void
 checkGlError(trace::Call &call);
@@ -66,6 +86,29 @@ extern const retrace::Entry egl_callbacks[];
 
 void frame_complete(trace::Call &call);
 
+void cacheCreateShader(GLuint shader, GLenum type);
+void cacheBeginShaderSource(GLuint shader);
+void cacheShaderSource(GLuint shader, GLsizei count, const GLchar * const *string, const GLint *length);
+bool cacheCompileShader(GLuint shader, unsigned callNo);
+void cacheCompileAttachedShaders(GLuint program);
+void cacheCreateProgram(GLuint program);
+void cacheBindAttribLocation(GLuint program, GLuint index, const GLchar *name);
+void cacheBindFragDataLocation(GLuint program, GLuint color, GLuint index, const GLchar *name);
+void cacheTransformFeedbackVaryings(GLuint program, GLsizei count, const GLchar * const *varyings, GLenum bufferMode);
+void cacheProgramParameter(GLuint program, GLenum pname, GLint value);
+bool cacheBeginLinkProgram(GLuint program);
+void cacheEndLinkProgram(GLuint program);
+void cacheDestroyContext(glws::Context *context);
+void cacheResetObjects(void);
+void dumpProgramCacheStatistics(std::ostream &os);
+
+void beginProfile(trace::Call &call);
+void endProfile(trace::Call &call, long long cpuStart, long long cpuEnd);
+void profileFrame(void);
+void flushProfile(void);
+void profileDestroyContext(glws::Context *context);
+void dumpProfileStatistics(std::ostream &os);
+
 void updateDrawable(int width, int height);
 
 } /* namespace glretrace */
@@ -279,6 +279,22 @@ class GlRetracer(Retracer):
             print r'            retrace::warning(call) << "no current context\n";'
             print r'        }'
 
+        # Keep track of shaders and programs for the program binary cache
+        if function.name == 'glShaderSource':
+            print r'    glretrace::cacheBeginShaderSource(shader);'
+        if function.name == 'glCompileShader':
+            # Compilation is deferred until link time
+            print r'    if (glretrace::cacheCompileShader(shader, call.no)) {'
+            print r'        return;'
+            print r'    }'
+        if function.name == 'glLinkProgram':
+            print r'    if (glretrace::cacheBeginLinkProgram(program)) {'
+            print r'        return;'
+            print r'    }'
+        if function.name == 'glLinkProgramARB':
+            # Shaders compiled with glCompileShader may be linked here too
+            print r'    glretrace::cacheCompileAttachedShaders((GLuint)(uintptr_t)programObj);'
+
         if function.name in ('glBindProgramPipeline', 'glBindProgramPipelineEXT'):
             # Note if glBindProgramPipeline has ever been called
             print r'    if (pipeline) {'
@@ -316,6 +332,27 @@ class GlRetracer(Retracer):
         else:
             Retracer.invokeFunction(self, function)
 
+        if function.name == 'glCreateShader':
+            print r'    glretrace::cacheCreateShader(_result, type);'
+        if function.name == 'glCreateProgram':
+            print r'    glretrace::cacheCreateProgram(_result);'
+        if function.name == 'glShaderSource':
+            print r'    glretrace::cacheShaderSource(shader, count, string, length);'
+        if function.name == 'glBindAttribLocation':
+            print r'    glretrace::cacheBindAttribLocation(program, index, name);'
+        if function.name == 'glBindAttribLocationARB':
+            print r'    glretrace::cacheBindAttribLocation((GLuint)(uintptr_t)programObj, index, name);'
+        if function.name in ('glBindFragDataLocation', 'glBindFragDataLocationEXT'):
+            print r'    glretrace::cacheBindFragDataLocation(program, color, 0, name);'
+        if function.name == 'glBindFragDataLocationIndexed':
+            print r'    glretrace::cacheBindFragDataLocation(program, colorNumber, index, name);'
+        if function.name in ('glTransformFeedbackVaryings', 'glTransformFeedbackVaryingsEXT'):
+            print r'    glretrace::cacheTransformFeedbackVaryings(program, count, varyings, bufferMode);'
+        if function.name in ('glProgramParameteri', 'glProgramParameteriARB', 'glProgramParameteriEXT'):
+            print r'    glretrace::cacheProgramParameter(program, pname, value);'
+        if function.name == 'glLinkProgram':
+            print r'    glretrace::cacheEndLinkProgram(program);'
+
         # Error checking
         if function.name == "glBegin":
             print '    glretrace::insideGlBeginEnd = true;'
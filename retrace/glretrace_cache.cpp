@@ -0,0 +1,619 @@
+/**************************************************************************
+ *
+ * Copyright 2012 Jose Fonseca
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+/**
+ * On-disk cache of linked program binaries.
+ *
+ * Shader compilation is deferred until link time, and programs whose
+ * shaders, bindings, and driver match a previous run are loaded with
+ * glProgramBinary (ARB_get_program_binary) instead of being compiled and
+ * linked.  Whenever the driver refuses a cached binary we fall back to
+ * compiling and linking as usual.
+ */
+
+
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <iostream>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "os_string.hpp"
+#include "retrace.hpp"
+#include "glproc.hpp"
+#include "glretrace.hpp"
+
+
+namespace glretrace {
+
+
+struct ShaderState
+{
+    GLenum type;
+
+    /** Source as given by the last glShaderSource call */
+    std::string source;
+
+    /** Source at the time of the last glCompileShader call */
+    std::string compiledSource;
+
+    bool compiled;
+
+    /** Whether glCompileShader has been called but not yet executed */
+    bool pending;
+
+    /** Number of the glCompileShader call, for reporting errors */
+    unsigned compileCallNo;
+
+    ShaderState() :
+        type(0),
+        compiled(false),
+        pending(false),
+        compileCallNo(0)
+    {}
+};
+
+
+struct ProgramState
+{
+    std::map<std::string, GLuint> attribLocations;
+    std::map<std::string, std::pair<GLuint, GLuint> > fragDataLocations;
+    std::vector<std::string> feedbackVaryings;
+    GLenum feedbackBufferMode;
+    GLint separable;
+
+    ProgramState() :
+        feedbackBufferMode(0),
+        separable(GL_FALSE)
+    {}
+};
+
+
+typedef std::map<GLuint, ShaderState> ShaderMap;
+typedef std::map<GLuint, ProgramState> ProgramMap;
+
+static ShaderMap shaders;
+static ProgramMap programs;
+
+// Keys of the programs which missed the cache, to be stored once linked
+static std::map<GLuint, std::string> pendingKeys;
+
+static std::map<glws::Context *, bool> supportedContexts;
+
+static struct {
+    unsigned hits;
+    unsigned misses;
+    unsigned rejected;
+    unsigned uncacheable;
+    unsigned stored;
+} stats;
+
+
+static const char
+magic[8] = {'A', 'P', 'I', 'P', 'R', 'O', 'G', '1'};
+
+
+static inline bool
+isEnabled(void) {
+    return retrace::programCacheDir != NULL;
+}
+
+
+static bool
+isSupported(void) {
+    if (!currentContext) {
+        return false;
+    }
+
+    std::map<glws::Context *, bool>::iterator it = supportedContexts.find(currentContext);
+    if (it != supportedContexts.end()) {
+        return it->second;
+    }
+
+    GLint num_formats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &num_formats);
+    while (glGetError() != GL_NO_ERROR) {}
+
+    bool supported = num_formats > 0;
+    if (!supported) {
+        std::cerr << "warning: program binaries not supported; program cache disabled for this context\n";
+    }
+    supportedContexts[currentContext] = supported;
+    return supported;
+}
+
+
+static void
+appendString(std::string &key, const char *s) {
+    if (s) {
+        key.append(s);
+    }
+    key.push_back('\0');
+}
+
+
+static void
+appendUInt(std::string &key, unsigned long long value) {
+    char buf[32];
+    snprintf(buf, sizeof buf, "%llu", value);
+    appendString(key, buf);
+}
+
+
+/**
+ * Build the key which uniquely identifies the program binary that would be
+ * produced by linking the program now.
+ *
+ * Returns false if the program can't be cached, e.g., because not all the
+ * attached shaders were seen by us.
+ */
+static bool
+getProgramKey(GLuint program, std::string &key) {
+    key.clear();
+
+    appendString(key, (const char *)glGetString(GL_VENDOR));
+    appendString(key, (const char *)glGetString(GL_RENDERER));
+    appendString(key, (const char *)glGetString(GL_VERSION));
+
+    GLint attached_shaders = 0;
+    glGetProgramiv(program, GL_ATTACHED_SHADERS, &attached_shaders);
+    if (attached_shaders <= 0) {
+        return false;
+    }
+
+    std::vector<GLuint> names(attached_shaders);
+    GLsizei count = 0;
+    glGetAttachedShaders(program, attached_shaders, &count, &names[0]);
+
+    // The order in which attached shaders are reported is unspecified
+    std::vector<std::pair<GLenum, const std::string *> > sources;
+    for (GLsizei i = 0; i < count; ++i) {
+        ShaderMap::const_iterator it = shaders.find(names[i]);
+        if (it == shaders.end() || !it->second.compiled) {
+            return false;
+        }
+        sources.push_back(std::make_pair(it->second.type, &it->second.compiledSource));
+    }
+    std::sort(sources.begin(), sources.end());
+
+    appendUInt(key, sources.size());
+    for (unsigned i = 0; i < sources.size(); ++i) {
+        appendUInt(key, sources[i].first);
+        appendUInt(key, sources[i].second->size());
+        key.append(*sources[i].second);
+    }
+
+    const ProgramState &state = programs[program];
+
+    appendUInt(key, state.attribLocations.size());
+    std::map<std::string, GLuint>::const_iterator ait;
+    for (ait = state.attribLocations.begin(); ait != state.attribLocations.end(); ++ait) {
+        appendString(key, ait->first.c_str());
+        appendUInt(key, ait->second);
+    }
+
+    appendUInt(key, state.fragDataLocations.size());
+    std::map<std::string, std::pair<GLuint, GLuint> >::const_iterator fit;
+    for (fit = state.fragDataLocations.begin(); fit != state.fragDataLocations.end(); ++fit) {
+        appendString(key, fit->first.c_str());
+        appendUInt(key, fit->second.first);
+        appendUInt(key, fit->second.second);
+    }
+
+    appendUInt(key, state.feedbackVaryings.size());
+    for (unsigned i = 0; i < state.feedbackVaryings.size(); ++i) {
+        appendString(key, state.feedbackVaryings[i].c_str());
+    }
+    appendUInt(key, state.feedbackBufferMode);
+
+    appendUInt(key, state.separable);
+
+    return true;
+}
+
+
+/**
+ * 64bit FNV-1a hash, used for naming the cache files only -- the full key is
+ * stored in the file and compared on load.
+ */
+static unsigned long long
+hashKey(const std::string &key) {
+    unsigned long long hash = 14695981039346656037ULL;
+    for (std::string::const_iterator it = key.begin(); it != key.end(); ++it) {
+        hash ^= (unsigned char)*it;
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+
+static os::String
+getCacheFileName(const std::string &key) {
+    os::String filename(retrace::programCacheDir);
+    filename.join(os::String::format("%016llx.bin", hashKey(key)));
+    return filename;
+}
+
+
+static bool
+readUInt32(FILE *fp, uint32_t &value) {
+    return fread(&value, sizeof value, 1, fp) == 1;
+}
+
+
+static bool
+loadBinary(const std::string &key, GLenum &format, std::vector<char> &binary) {
+    os::String filename = getCacheFileName(key);
+    FILE *fp = fopen(filename, "rb");
+    if (!fp) {
+        return false;
+    }
+
+    bool success = false;
+    char buf[sizeof magic];
+    uint32_t binaryFormat = 0;
+    uint32_t keySize = 0;
+    uint32_t binarySize = 0;
+    if (fread(buf, sizeof buf, 1, fp) == 1 &&
+        memcmp(buf, magic, sizeof magic) == 0 &&
+        readUInt32(fp, binaryFormat) &&
+        readUInt32(fp, keySize) &&
+        readUInt32(fp, binarySize) &&
+        keySize == key.size() &&
+        binarySize > 0) {
+        std::vector<char> storedKey(keySize);
+        if (fread(&storedKey[0], keySize, 1, fp) == 1 &&
+            memcmp(&storedKey[0], key.data(), keySize) == 0) {
+            binary.resize(binarySize);
+            if (fread(&binary[0], binarySize, 1, fp) == 1) {
+                format = binaryFormat;
+                success = true;
+            }
+        }
+    }
+
+    fclose(fp);
+    return success;
+}
+
+
+static void
+storeBinary(GLuint program, const std::string &key) {
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0) {
+        return;
+    }
+
+    std::vector<char> binary(length);
+    GLsizei written = 0;
+    GLenum format = 0;
+    glGetProgramBinary(program, length, &written, &format, &binary[0]);
+    if (written <= 0) {
+        return;
+    }
+
+    os::String filename = getCacheFileName(key);
+    FILE *fp = fopen(filename, "wb");
+    if (!fp) {
+        static bool warned = false;
+        if (!warned) {
+            std::cerr << "warning: failed to write " << filename << "\n";
+            warned = true;
+        }
+        return;
+    }
+
+    uint32_t header[3];
+    header[0] = format;
+    header[1] = key.size();
+    header[2] = written;
+    fwrite(magic, sizeof magic, 1, fp);
+    fwrite(header, sizeof header, 1, fp);
+    fwrite(key.data(), key.size(), 1, fp);
+    fwrite(&binary[0], written, 1, fp);
+    fclose(fp);
+
+    ++stats.stored;
+}
+
+
+static void
+compilePendingShader(GLuint shader, ShaderState &state) {
+    if (!state.pending) {
+        return;
+    }
+
+    glCompileShader(shader);
+    state.pending = false;
+
+    // Report the errors which the glCompileShader call would have reported
+    // had it not been deferred
+    if (retrace::debug) {
+        GLint compile_status = 0;
+        glGetShaderiv(shader, GL_COMPILE_STATUS, &compile_status);
+        if (!compile_status) {
+            GLint info_log_length = 0;
+            glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &info_log_length);
+            std::vector<GLchar> infoLog(info_log_length + 1);
+            glGetShaderInfoLog(shader, info_log_length + 1, NULL, &infoLog[0]);
+            std::cerr << state.compileCallNo << ": warning: " << &infoLog[0] << "\n";
+        }
+    }
+}
+
+
+/**
+ * Execute the deferred compilations of the shaders attached to a program.
+ */
+static void
+compileAttachedShaders(GLuint program) {
+    GLint attached_shaders = 0;
+    glGetProgramiv(program, GL_ATTACHED_SHADERS, &attached_shaders);
+    if (attached_shaders > 0) {
+        std::vector<GLuint> names(attached_shaders);
+        GLsizei count = 0;
+        glGetAttachedShaders(program, attached_shaders, &count, &names[0]);
+        for (GLsizei i = 0; i < count; ++i) {
+            ShaderMap::iterator it = shaders.find(names[i]);
+            if (it != shaders.end()) {
+                compilePendingShader(names[i], it->second);
+            }
+        }
+    }
+}
+
+
+void
+cacheCreateShader(GLuint shader, GLenum type) {
+    if (!isEnabled()) {
+        return;
+    }
+
+    ShaderState &state = shaders[shader];
+    state = ShaderState();
+    state.type = type;
+}
+
+
+void
+cacheBeginShaderSource(GLuint shader) {
+    if (!isEnabled()) {
+        return;
+    }
+
+    // Replacing the source of a shader doesn't affect the compiled shader, so
+    // the deferred compilation must happen now.
+    ShaderMap::iterator it = shaders.find(shader);
+    if (it != shaders.end()) {
+        compilePendingShader(shader, it->second);
+    }
+}
+
+
+void
+cacheShaderSource(GLuint shader, GLsizei count, const GLchar * const *string, const GLint *length) {
+    if (!isEnabled()) {
+        return;
+    }
+
+    std::string &source = shaders[shader].source;
+    source.clear();
+    for (GLsizei i = 0; i < count; ++i) {
+        if (!string[i]) {
+            continue;
+        }
+        if (length && length[i] >= 0) {
+            source.append(string[i], length[i]);
+        } else {
+            source.append(string[i]);
+        }
+    }
+}
+
+
+bool
+cacheCompileShader(GLuint shader, unsigned callNo) {
+    if (!isEnabled()) {
+        return false;
+    }
+
+    ShaderMap::iterator it = shaders.find(shader);
+    if (it == shaders.end() || !it->second.type) {
+        return false;
+    }
+
+    ShaderState &state = it->second;
+    state.compiledSource = state.source;
+    state.compiled = true;
+    state.pending = true;
+    state.compileCallNo = callNo;
+    return true;
+}
+
+
+void
+cacheCompileAttachedShaders(GLuint program) {
+    if (!isEnabled()) {
+        return;
+    }
+
+    compileAttachedShaders(program);
+}
+
+
+void
+cacheCreateProgram(GLuint program) {
+    if (!isEnabled()) {
+        return;
+    }
+
+    programs[program] = ProgramState();
+}
+
+
+void
+cacheBindAttribLocation(GLuint program, GLuint index, const GLchar *name) {
+    if (!isEnabled() || !name) {
+        return;
+    }
+
+    programs[program].attribLocations[name] = index;
+}
+
+
+void
+cacheBindFragDataLocation(GLuint program, GLuint color, GLuint index, const GLchar *name) {
+    if (!isEnabled() || !name) {
+        return;
+    }
+
+    programs[program].fragDataLocations[name] = std::make_pair(color, index);
+}
+
+
+void
+cacheTransformFeedbackVaryings(GLuint program, GLsizei count, const GLchar * const *varyings, GLenum bufferMode) {
+    if (!isEnabled()) {
+        return;
+    }
+
+    ProgramState &state = programs[program];
+    state.feedbackVaryings.clear();
+    for (GLsizei i = 0; i < count; ++i) {
+        state.feedbackVaryings.push_back(varyings[i] ? varyings[i] : "");
+    }
+    state.feedbackBufferMode = bufferMode;
+}
+
+
+void
+cacheProgramParameter(GLuint program, GLenum pname, GLint value) {
+    if (!isEnabled()) {
+        return;
+    }
+
+    if (pname == GL_PROGRAM_SEPARABLE) {
+        programs[program].separable = value;
+    }
+}
+
+
+bool
+cacheBeginLinkProgram(GLuint program) {
+    if (!isEnabled()) {
+        return false;
+    }
+
+    pendingKeys.erase(program);
+
+    std::string key;
+    bool cacheable = isSupported() && getProgramKey(program, key);
+
+    if (cacheable) {
+        GLenum format = 0;
+        std::vector<char> binary;
+        if (loadBinary(key, format, binary)) {
+            glProgramBinary(program, format, &binary[0], binary.size());
+            GLint link_status = GL_FALSE;
+            glGetProgramiv(program, GL_LINK_STATUS, &link_status);
+            if (link_status) {
+                ++stats.hits;
+                return true;
+            }
+            // The driver refused the binary (e.g., after a driver upgrade
+            // which kept the same version string)
+            while (glGetError() != GL_NO_ERROR) {}
+            ++stats.rejected;
+        } else {
+            ++stats.misses;
+        }
+    } else {
+        ++stats.uncacheable;
+    }
+
+    compileAttachedShaders(program);
+
+    if (cacheable) {
+        glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+        pendingKeys[program] = key;
+    }
+
+    return false;
+}
+
+
+void
+cacheEndLinkProgram(GLuint program) {
+    std::map<GLuint, std::string>::iterator it = pendingKeys.find(program);
+    if (it == pendingKeys.end()) {
+        return;
+    }
+
+    GLint link_status = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &link_status);
+    if (link_status) {
+        storeBinary(program, it->second);
+    }
+
+    pendingKeys.erase(it);
+}
+
+
+void
+cacheDestroyContext(glws::Context *context) {
+    supportedContexts.erase(context);
+}
+
+
+void
+cacheResetObjects(void) {
+    shaders.clear();
+    programs.clear();
+    pendingKeys.clear();
+}
+
+
+void
+dumpProgramCacheStatistics(std::ostream &os) {
+    if (!isEnabled()) {
+        return;
+    }
+
+    os << "Program cache: "
+       << stats.hits << " hits, "
+       << stats.misses << " misses, "
+       << stats.rejected << " rejected, "
+       << stats.uncacheable << " uncacheable, "
+       << stats.stored << " stored\n";
+}
+
+
+} /* namespace glretrace */
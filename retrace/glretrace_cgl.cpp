@@ -104,6 +104,13 @@ static void retrace_CGLFlushDrawable(trace::Call &call) {
 }
 
 
+void glretrace::resetCglContexts(void) {
+    drawable_map.clear();
+    context_map.clear();
+    sharedContext = NULL;
+}
+
+
 const retrace::Entry glretrace::cgl_callbacks[] = {
     {"CGLSetCurrentContext", &retrace_CGLSetCurrentContext},
     {"CGLGetCurrentContext", &retrace::ignore},
@@ -128,7 +128,7 @@ static void retrace_eglDestroySurface(trace::Call &call) {
     if (it != drawable_map.end()) {
         if (it->second != currentDrawable) {
             // TODO: reference count
-            delete it->second;
+            glretrace::destroyDrawable(it->second);
         }
         drawable_map.erase(it);
     }
@@ -201,7 +201,7 @@ static void retrace_eglDestroyContext(trace::Call &call) {
     it = context_map.find(orig_context);
 
     if (it != context_map.end()) {
-        delete it->second;
+        glretrace::destroyContext(it->second);
         context_map.erase(it);
     }
 }
@@ -224,6 +224,14 @@ static void retrace_eglSwapBuffers(trace::Call &call) {
     }
 }
 
+void glretrace::resetEglContexts(void) {
+    drawable_map.clear();
+    context_map.clear();
+    profile_map.clear();
+    current_api = EGL_OPENGL_ES_API;
+    last_profile = glws::PROFILE_COMPAT;
+}
+
 const retrace::Entry glretrace::egl_callbacks[] = {
     {"eglGetError", &retrace::ignore},
     {"eglGetDisplay", &retrace::ignore},
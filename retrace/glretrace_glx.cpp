@@ -93,13 +93,13 @@ static void retrace_glXMakeCurrent(trace::Call &call) {
 
 
 static void retrace_glXDestroyContext(trace::Call &call) {
-    glws::Context *context = getContext(call.arg(1).toUIntPtr());
+    ContextMap::iterator it;
+    it = context_map.find(call.arg(1).toUIntPtr());
 
-    if (!context) {
-        return;
+    if (it != context_map.end()) {
+        glretrace::destroyContext(it->second);
+        context_map.erase(it);
     }
-
-    delete context;
 }
 
 static void retrace_glXSwapBuffers(trace::Call &call) {
@@ -126,6 +126,11 @@ static void retrace_glXMakeContextCurrent(trace::Call &call) {
     glretrace::makeCurrent(call, new_drawable, new_context);
 }
 
+void glretrace::resetGlxContexts(void) {
+    drawable_map.clear();
+    context_map.clear();
+}
+
 const retrace::Entry glretrace::glx_callbacks[] = {
     //{"glXBindChannelToWindowSGIX", &retrace_glXBindChannelToWindowSGIX},
     //{"glXBindSwapBarrierNV", &retrace_glXBindSwapBarrierNV},
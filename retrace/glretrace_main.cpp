@@ -26,10 +26,13 @@
 
 #include <string.h>
 
+#include <algorithm>
+
 #include "retrace.hpp"
 #include "glproc.hpp"
 #include "glstate.hpp"
 #include "glretrace.hpp"
+#include "state_writer.hpp"
 
 
 namespace glretrace {
@@ -86,6 +89,10 @@ checkGlError(trace::Call &call) {
 void frame_complete(trace::Call &call) {
     retrace::frameComplete(call);
 
+    if (retrace::profilingGpu) {
+        profileFrame();
+    }
+
     if (!currentDrawable) {
         return;
     }
@@ -101,7 +108,7 @@ void frame_complete(trace::Call &call) {
 
 void
 retrace::setUp(void) {
-    glws::init();
+    glws::init(retrace::headless);
 }
 
 
@@ -116,6 +123,64 @@ retrace::addCallbacks(retrace::Retracer &retracer)
 }
 
 
+/*
+ * Sorted list of the GL calls that build shaders/programs, which are worth
+ * retracing when prewarming.
+ */
+static const char *
+prewarmCallNames[] = {
+    "glAttachObjectARB",
+    "glAttachShader",
+    "glBindAttribLocation",
+    "glBindAttribLocationARB",
+    "glBindFragDataLocation",
+    "glBindFragDataLocationEXT",
+    "glBindFragDataLocationIndexed",
+    "glBindProgramARB",
+    "glCompileShader",
+    "glCompileShaderARB",
+    "glCreateProgram",
+    "glCreateProgramObjectARB",
+    "glCreateShader",
+    "glCreateShaderObjectARB",
+    "glCreateShaderProgramEXT",
+    "glCreateShaderProgramv",
+    "glDetachObjectARB",
+    "glDetachShader",
+    "glGenProgramsARB",
+    "glLinkProgram",
+    "glLinkProgramARB",
+    "glProgramBinary",
+    "glProgramParameteri",
+    "glProgramParameteriARB",
+    "glProgramParameteriEXT",
+    "glProgramStringARB",
+    "glShaderBinary",
+    "glShaderSource",
+    "glShaderSourceARB",
+    "glTransformFeedbackVaryings",
+    "glTransformFeedbackVaryingsEXT",
+};
+
+
+bool
+retrace::isPrewarmCall(const trace::FunctionSig *sig) {
+    const char *name = sig->name;
+
+    // Window system calls create and bind the contexts and drawables
+    if (strncmp(name, "glX", 3) == 0 ||
+        strncmp(name, "wgl", 3) == 0 ||
+        strncmp(name, "egl", 3) == 0 ||
+        strncmp(name, "CGL", 3) == 0) {
+        return true;
+    }
+
+    const char **begin = prewarmCallNames;
+    const char **end = prewarmCallNames + sizeof prewarmCallNames / sizeof prewarmCallNames[0];
+    return std::binary_search(begin, end, name, retrace::stringComparer());
+}
+
+
 image::Image *
 retrace::getSnapshot(void) {
     if (!glretrace::currentDrawable) {
@@ -135,14 +200,38 @@ retrace::dumpState(std::ostream &os)
         return false;
     }
 
-    glstate::dumpCurrentContext(os);
+    StateWriter *writer = retrace::createStateWriter(os);
+    glstate::dumpCurrentContext(*writer);
+    delete writer;
 
     return true;
 }
 
+void
+retrace::beginProfile(trace::Call &call) {
+    glretrace::beginProfile(call);
+}
+
+void
+retrace::endProfile(trace::Call &call, long long cpuStart, long long cpuEnd) {
+    glretrace::endProfile(call, cpuStart, cpuEnd);
+}
+
 void
 retrace::flushRendering(void) {
     glFlush();
+    glretrace::flushProfile();
+}
+
+void
+retrace::resetContexts(void) {
+    glretrace::destroyAllContexts();
+}
+
+void
+retrace::dumpStatistics(std::ostream &os) {
+    glretrace::dumpProgramCacheStatistics(os);
+    glretrace::dumpProfileStatistics(os);
 }
 
 void
@@ -0,0 +1,499 @@
+/**************************************************************************
+ *
+ * Copyright 2012 Jose Fonseca
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+/**
+ * GPU profiling of the retraced draw calls and frames.
+ *
+ * Every call flagged as rendering is bracketed by a pair of GL_TIMESTAMP
+ * queries (ARB_timer_query), and so is every frame.  Timestamp queries are
+ * used instead of GL_TIME_ELAPSED ones so that they can't conflict with the
+ * application's own timer queries.
+ *
+ * Query results are collected in call order at the end of every frame, as
+ * long as they are available, so that the pipeline is not stalled; we only
+ * wait for results that are more than a few frames old, when switching
+ * contexts, and at the end of the trace.  Contexts which don't support timer
+ * queries are still profiled on the CPU.
+ */
+
+
+#include <assert.h>
+#include <stdio.h>
+
+#include <deque>
+#include <iostream>
+#include <map>
+#include <vector>
+
+#include "os_time.hpp"
+#include "retrace.hpp"
+#include "glproc.hpp"
+#include "glretrace.hpp"
+
+
+namespace glretrace {
+
+
+/**
+ * Number of frames whose results may be pending before we wait for them.
+ */
+static const unsigned maxPendingFrames = 3;
+
+
+struct ContextState
+{
+    bool supported;
+    bool hasPrograms;
+    bool hasFramebuffers;
+
+    /** Query names no longer in use, for reuse. */
+    std::vector<GLuint> freeQueries;
+
+    ContextState() :
+        supported(false),
+        hasPrograms(false),
+        hasFramebuffers(false)
+    {}
+};
+
+
+struct Record
+{
+    bool frame;
+    unsigned no;
+    /** Owned by the parser, which outlives the records. */
+    const char *name;
+
+    /** Zero when not profiled on the GPU. */
+    GLuint startQuery;
+    GLuint endQuery;
+
+    long long cpuStart;
+    long long cpuEnd;
+
+    /** -1 when unknown. */
+    GLint program;
+    GLint framebuffer;
+
+    Record() :
+        frame(false),
+        no(0),
+        name(NULL),
+        startQuery(0),
+        endQuery(0),
+        cpuStart(0),
+        cpuEnd(0),
+        program(-1),
+        framebuffer(-1)
+    {}
+};
+
+
+struct Totals
+{
+    unsigned calls;
+    unsigned gpuCalls;
+    unsigned long long gpuTime;
+    unsigned long long cpuTime;
+
+    Totals() :
+        calls(0),
+        gpuCalls(0),
+        gpuTime(0),
+        cpuTime(0)
+    {}
+
+    void
+    add(bool gpu, unsigned long long gpuDuration, unsigned long long cpuDuration) {
+        ++calls;
+        if (gpu) {
+            ++gpuCalls;
+            gpuTime += gpuDuration;
+        }
+        cpuTime += cpuDuration;
+    }
+};
+
+
+typedef std::map<GLint, Totals> TotalsMap;
+
+
+static std::map<glws::Context *, ContextState> contexts;
+
+static std::deque<Record> records;
+static unsigned pendingFrames = 0;
+
+static Record currentCall;
+static bool callPending = false;
+
+static unsigned frameNo = 0;
+
+// Start of the frame being collected, or -1 if no call was collected yet
+static long long frameGpuStart = -1;
+static long long frameCpuStart = -1;
+
+// Base of the CPU and GPU times reported, with the GPU one adjusted so
+// that both times are on the same timeline
+static bool haveCpuBase = false;
+static bool haveGpuBase = false;
+static long long cpuBase = 0;
+static GLint64 gpuBase = 0;
+
+static Totals totals;
+static TotalsMap programTotals;
+static TotalsMap framebufferTotals;
+
+
+static inline long long
+toNanoseconds(long long cpuTime) {
+    return (long long)(cpuTime * (1.0e9 / os::timeFrequency));
+}
+
+
+static ContextState *
+getContextState(void) {
+    if (!currentContext) {
+        return NULL;
+    }
+
+    std::map<glws::Context *, ContextState>::iterator it = contexts.find(currentContext);
+    if (it != contexts.end()) {
+        return &it->second;
+    }
+
+    ContextState &state = contexts[currentContext];
+
+    const char *version = (const char *)glGetString(GL_VERSION);
+    const char *extensions = (const char *)glGetString(GL_EXTENSIONS);
+    int major = 0;
+    int minor = 0;
+    if (version && sscanf(version, "%d.%d", &major, &minor) == 2) {
+        // Not OpenGL ES, whose version strings start with "OpenGL ES"
+        state.supported = major > 3 || (major == 3 && minor >= 3);
+        state.hasPrograms = major >= 2;
+        state.hasFramebuffers = major >= 3;
+        if (extensions) {
+            state.supported = state.supported ||
+                glws::checkExtension("GL_ARB_timer_query", extensions);
+            state.hasFramebuffers = state.hasFramebuffers ||
+                glws::checkExtension("GL_ARB_framebuffer_object", extensions) ||
+                glws::checkExtension("GL_EXT_framebuffer_object", extensions);
+        }
+    }
+
+    if (state.supported) {
+        GLint bits = 0;
+        glGetQueryiv(GL_TIMESTAMP, GL_QUERY_COUNTER_BITS, &bits);
+        state.supported = bits > 0;
+    }
+    while (glGetError() != GL_NO_ERROR) {}
+
+    if (!haveCpuBase) {
+        cpuBase = os::getTime();
+        haveCpuBase = true;
+    }
+
+    if (!state.supported) {
+        std::cerr << "warning: timer queries not supported; GPU profiling disabled for this context\n";
+    } else if (!haveGpuBase) {
+        GLint64 gpuTime = 0;
+        glGetInteger64v(GL_TIMESTAMP, &gpuTime);
+        gpuBase = gpuTime - toNanoseconds(os::getTime() - cpuBase);
+        haveGpuBase = true;
+    }
+
+    return &state;
+}
+
+
+static GLuint
+issueTimestamp(ContextState &state) {
+    GLuint query;
+    if (state.freeQueries.empty()) {
+        glGenQueries(1, &query);
+    } else {
+        query = state.freeQueries.back();
+        state.freeQueries.pop_back();
+    }
+    glQueryCounter(query, GL_TIMESTAMP);
+    return query;
+}
+
+
+static void
+printTime(long long time, bool valid) {
+    if (valid) {
+        std::cout << " " << time;
+    } else {
+        std::cout << " -";
+    }
+}
+
+
+static void
+printHandle(GLint handle) {
+    if (handle >= 0) {
+        std::cout << " " << handle;
+    } else {
+        std::cout << " -";
+    }
+}
+
+
+/**
+ * Report the oldest record, if its results are available or if told to
+ * wait for them.
+ */
+static bool
+collectRecord(bool wait) {
+    assert(!records.empty());
+
+    Record &record = records.front();
+    bool gpu = record.endQuery != 0;
+
+    GLuint64 gpuStart = 0;
+    GLuint64 gpuEnd = 0;
+    if (gpu) {
+        if (!wait) {
+            GLuint available = GL_FALSE;
+            glGetQueryObjectuiv(record.endQuery, GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available) {
+                return false;
+            }
+        }
+
+        // Queries complete in order, so the end query is the one to wait for
+        glGetQueryObjectui64v(record.endQuery, GL_QUERY_RESULT, &gpuEnd);
+        if (record.startQuery) {
+            glGetQueryObjectui64v(record.startQuery, GL_QUERY_RESULT, &gpuStart);
+        }
+
+        ContextState &state = contexts[currentContext];
+        state.freeQueries.push_back(record.endQuery);
+        if (record.startQuery) {
+            state.freeQueries.push_back(record.startQuery);
+        }
+    }
+
+    long long gpuTime = (long long)(gpuStart - gpuBase);
+    long long cpuTime = toNanoseconds(record.cpuStart - cpuBase);
+
+    if (record.frame) {
+        // Frames start where the previous frame ended
+        long long gpuEndTime = (long long)(gpuEnd - gpuBase);
+        long long cpuEndTime = toNanoseconds(record.cpuEnd - cpuBase);
+        gpuTime = frameGpuStart >= 0 ? frameGpuStart : gpuEndTime;
+        cpuTime = frameCpuStart >= 0 ? frameCpuStart : cpuEndTime;
+        gpu = gpu && frameGpuStart >= 0;
+
+        std::cout << "frame " << record.no;
+        printTime(gpuTime, gpu);
+        printTime(gpuEndTime - gpuTime, gpu);
+        printTime(cpuTime, true);
+        printTime(cpuEndTime - cpuTime, true);
+        std::cout << "\n";
+
+        frameGpuStart = record.endQuery ? gpuEndTime : -1;
+        frameCpuStart = cpuEndTime;
+        --pendingFrames;
+    } else {
+        gpu = gpu && record.startQuery;
+        unsigned long long gpuDuration = gpu ? gpuEnd - gpuStart : 0;
+        unsigned long long cpuDuration = toNanoseconds(record.cpuEnd - record.cpuStart);
+
+        std::cout << "call " << record.no;
+        printTime(gpuTime, gpu);
+        printTime(gpuDuration, gpu);
+        printTime(cpuTime, true);
+        printTime(cpuDuration, true);
+        printHandle(record.program);
+        printHandle(record.framebuffer);
+        std::cout << " " << record.name << "\n";
+
+        if (frameGpuStart < 0 && gpu) {
+            frameGpuStart = gpuTime;
+        }
+        if (frameCpuStart < 0) {
+            frameCpuStart = cpuTime;
+        }
+
+        totals.add(gpu, gpuDuration, cpuDuration);
+        programTotals[record.program].add(gpu, gpuDuration, cpuDuration);
+        framebufferTotals[record.framebuffer].add(gpu, gpuDuration, cpuDuration);
+    }
+
+    records.pop_front();
+    return true;
+}
+
+
+static void
+printHeader(void) {
+    static bool printed = false;
+    if (!printed) {
+        std::cout << "# call no gpu_start gpu_dura cpu_start cpu_dura program framebuffer name\n";
+        std::cout << "# frame no gpu_start gpu_dura cpu_start cpu_dura\n";
+        printed = true;
+    }
+}
+
+
+void
+beginProfile(trace::Call &call) {
+    printHeader();
+
+    assert(!callPending);
+    currentCall = Record();
+    currentCall.no = call.no;
+    currentCall.name = call.name();
+    callPending = true;
+
+    // Nothing may be queried between glBegin/glEnd
+    if (insideGlBeginEnd) {
+        return;
+    }
+
+    ContextState *state = getContextState();
+    if (!state) {
+        return;
+    }
+
+    if (state->hasPrograms) {
+        glGetIntegerv(GL_CURRENT_PROGRAM, &currentCall.program);
+    }
+    if (state->hasFramebuffers) {
+        glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &currentCall.framebuffer);
+    }
+
+    if (state->supported) {
+        currentCall.startQuery = issueTimestamp(*state);
+    }
+}
+
+
+void
+endProfile(trace::Call &call, long long cpuStart, long long cpuEnd) {
+    assert(callPending);
+    callPending = false;
+
+    currentCall.cpuStart = cpuStart;
+    currentCall.cpuEnd = cpuEnd;
+
+    if (currentCall.startQuery) {
+        ContextState *state = getContextState();
+        assert(state && state->supported);
+        currentCall.endQuery = issueTimestamp(*state);
+    }
+
+    records.push_back(currentCall);
+}
+
+
+void
+profileFrame(void) {
+    printHeader();
+
+    Record record;
+    record.frame = true;
+    record.no = frameNo++;
+    record.cpuEnd = os::getTime();
+
+    ContextState *state = insideGlBeginEnd ? NULL : getContextState();
+    if (state && state->supported) {
+        record.endQuery = issueTimestamp(*state);
+    }
+
+    records.push_back(record);
+    ++pendingFrames;
+
+    // Collect whatever is ready, and wait only for old frames
+    while (!records.empty() && collectRecord(false)) {}
+    while (pendingFrames > maxPendingFrames) {
+        collectRecord(true);
+    }
+}
+
+
+void
+flushProfile(void) {
+    while (!records.empty()) {
+        collectRecord(true);
+    }
+}
+
+
+/*
+ * Forget the state of a context being destroyed, as its query names die
+ * with it and a later context may be allocated at the same address.
+ */
+void
+profileDestroyContext(glws::Context *context) {
+    contexts.erase(context);
+}
+
+
+static void
+dumpTotals(std::ostream &os, const char *label, const Totals &t) {
+    os << "  " << label << ": " << t.calls << " calls,";
+    if (t.gpuCalls) {
+        os << " gpu " << t.gpuTime * 1.0e-6 << " ms,";
+    } else {
+        os << " gpu - ms,";
+    }
+    os << " cpu " << t.cpuTime * 1.0e-6 << " ms\n";
+}
+
+
+static void
+dumpTotalsMap(std::ostream &os, const char *kind, const TotalsMap &map) {
+    for (TotalsMap::const_iterator it = map.begin(); it != map.end(); ++it) {
+        char label[64];
+        if (it->first >= 0) {
+            snprintf(label, sizeof label, "%s %i", kind, it->first);
+        } else {
+            snprintf(label, sizeof label, "%s -", kind);
+        }
+        dumpTotals(os, label, it->second);
+    }
+}
+
+
+void
+dumpProfileStatistics(std::ostream &os) {
+    if (!retrace::profilingGpu) {
+        return;
+    }
+
+    os << "GPU profile:\n";
+    dumpTotals(os, "total", totals);
+    os << "GPU profile per program:\n";
+    dumpTotalsMap(os, "program", programTotals);
+    os << "GPU profile per framebuffer:\n";
+    dumpTotalsMap(os, "framebuffer", framebufferTotals);
+}
+
+
+} /* namespace glretrace */
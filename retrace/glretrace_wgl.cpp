@@ -106,7 +106,7 @@ static void retrace_wglShareLists(trace::Call &call) {
 
         context_map[hglrc2] = new_context;
         
-        delete old_context;
+        glretrace::destroyContext(old_context);
     }
 }
 
@@ -232,6 +232,12 @@ static void retrace_glAddSwapHintRectWIN(trace::Call &call) {
 static void retrace_wglGetProcAddress(trace::Call &call) {
 }
 
+void glretrace::resetWglContexts(void) {
+    drawable_map.clear();
+    pbuffer_map.clear();
+    context_map.clear();
+}
+
 const retrace::Entry glretrace::wgl_callbacks[] = {
     {"glAddSwapHintRectWIN", &retrace_glAddSwapHintRectWIN},
     {"wglAllocateMemoryNV", &retrace_wglAllocateMemoryNV},
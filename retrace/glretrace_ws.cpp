@@ -31,6 +31,8 @@
 
 #include <string.h>
 
+#include <set>
+
 #include "retrace.hpp"
 #include "glproc.hpp"
 #include "glstate.hpp"
@@ -44,6 +46,12 @@ glws::Drawable *currentDrawable = NULL;
 glws::Context *currentContext = NULL;
 
 
+// Every drawable and context created so far, so that they can all be
+// destroyed before retracing again
+static std::set<glws::Drawable *> drawables;
+static std::set<glws::Context *> contexts;
+
+
 static glws::Visual *
 visuals[glws::PROFILE_MAX];
 
@@ -78,6 +86,7 @@ createDrawable(glws::Profile profile) {
         return NULL;
     }
 
+    drawables.insert(draw);
     return draw;
 }
 
@@ -97,6 +106,7 @@ createContext(glws::Context *shareContext, glws::Profile profile) {
         return NULL;
     }
 
+    contexts.insert(ctx);
     return ctx;
 }
 
@@ -121,6 +131,11 @@ makeCurrent(trace::Call &call, glws::Drawable *drawable, glws::Context *context)
         }
     }
 
+    // Query results can only be fetched from the context which issued them
+    if (retrace::profilingGpu && context != currentContext) {
+        flushProfile();
+    }
+
     bool success = glws::makeCurrent(drawable, context);
 
     if (!success) {
@@ -141,6 +156,69 @@ makeCurrent(trace::Call &call, glws::Drawable *drawable, glws::Context *context)
 }
 
 
+static void
+releaseCurrent(void) {
+    if (currentContext) {
+        glFlush();
+    }
+    glws::makeCurrent(NULL, NULL);
+    currentDrawable = NULL;
+    currentContext = NULL;
+}
+
+
+void
+destroyContext(glws::Context *context) {
+    if (context == currentContext) {
+        // Query results must be fetched before the context goes away
+        if (retrace::profilingGpu) {
+            flushProfile();
+        }
+        releaseCurrent();
+    }
+
+    cacheDestroyContext(context);
+    profileDestroyContext(context);
+
+    contexts.erase(context);
+    delete context;
+}
+
+
+void
+destroyDrawable(glws::Drawable *drawable) {
+    if (drawable == currentDrawable) {
+        releaseCurrent();
+    }
+
+    drawables.erase(drawable);
+    delete drawable;
+}
+
+
+void
+destroyAllContexts(void) {
+    if (currentContext && retrace::profilingGpu) {
+        flushProfile();
+    }
+    releaseCurrent();
+
+    while (!contexts.empty()) {
+        destroyContext(*contexts.begin());
+    }
+    while (!drawables.empty()) {
+        destroyDrawable(*drawables.begin());
+    }
+
+    resetGlxContexts();
+    resetWglContexts();
+    resetCglContexts();
+    resetEglContexts();
+
+    cacheResetObjects();
+
+    insideGlBeginEnd = false;
+}
 
 
 /**
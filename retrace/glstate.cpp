@@ -30,7 +30,7 @@
 #include <iostream>
 
 #include "image.hpp"
-#include "json.hpp"
+#include "state_writer.hpp"
 #include "glproc.hpp"
 #include "glsize.hpp"
 #include "glstate.hpp"
@@ -120,10 +120,8 @@ static const GLenum bindings[] = {
 #define NUM_BINDINGS sizeof(bindings)/sizeof(bindings[0])
 
 
-void dumpCurrentContext(std::ostream &os)
+void dumpCurrentContext(StateWriter &writer)
 {
-    JSONWriter json(os);
-
 #ifndef NDEBUG
     GLint old_bindings[NUM_BINDINGS];
     for (unsigned i = 0; i < NUM_BINDINGS; ++i) {
@@ -134,10 +132,10 @@ void dumpCurrentContext(std::ostream &os)
 
     Context context;
 
-    dumpParameters(json, context);
-    dumpShadersUniforms(json, context);
-    dumpTextures(json, context);
-    dumpFramebuffer(json, context);
+    dumpParameters(writer, context);
+    dumpShadersUniforms(writer, context);
+    dumpTextures(writer, context);
+    dumpFramebuffer(writer, context);
 
 #ifndef NDEBUG
     for (unsigned i = 0; i < NUM_BINDINGS; ++i) {
@@ -27,11 +27,12 @@
 #define _GLSTATE_HPP_
 
 
-#include <ostream>
-
 #include "glimports.hpp"
 
 
+class StateWriter;
+
+
 namespace image {
     class Image;
 }
@@ -42,7 +43,7 @@ namespace glstate {
 
 const char *enumToString(GLenum pname);
 
-void dumpCurrentContext(std::ostream &os);
+void dumpCurrentContext(StateWriter &writer);
 
 image::Image *
 getDrawBufferImage(void);
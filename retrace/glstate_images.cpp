@@ -24,13 +24,14 @@
  **************************************************************************/
 
 
+#include <assert.h>
 #include <string.h>
 
 #include <algorithm>
 #include <iostream>
 
 #include "image.hpp"
-#include "json.hpp"
+#include "state_writer.hpp"
 #include "glproc.hpp"
 #include "glsize.hpp"
 #include "glstate.hpp"
@@ -351,7 +352,7 @@ isDepthFormat(GLenum internalFormat)
 
 
 static inline void
-dumpActiveTextureLevel(JSONWriter &json, Context &context, GLenum target, GLint level)
+dumpActiveTextureLevel(StateWriter &writer, Context &context, GLenum target, GLint level)
 {
     ImageDesc desc;
     if (!getActiveTextureLevelDesc(context, target, level, desc)) {
@@ -365,9 +366,9 @@ dumpActiveTextureLevel(JSONWriter &json, Context &context, GLenum target, GLint
     snprintf(label, sizeof label, "%s, %s, level = %d",
              enumToString(active_texture), enumToString(target), level);
 
-    json.beginMember(label);
+    writer.beginMember(label);
 
-    json.beginObject();
+    writer.beginObject();
 
     GLuint channels;
     GLenum format;
@@ -380,19 +381,19 @@ dumpActiveTextureLevel(JSONWriter &json, Context &context, GLenum target, GLint
     }
 
     // Tell the GUI this is no ordinary object, but an image
-    json.writeStringMember("__class__", "image");
+    writer.writeStringMember("__class__", "image");
 
-    json.writeNumberMember("__width__", desc.width);
-    json.writeNumberMember("__height__", desc.height);
-    json.writeNumberMember("__depth__", desc.depth);
+    writer.writeNumberMember("__width__", desc.width);
+    writer.writeNumberMember("__height__", desc.height);
+    writer.writeNumberMember("__depth__", desc.depth);
 
-    json.writeStringMember("__format__", enumToString(desc.internalFormat));
+    writer.writeStringMember("__format__", enumToString(desc.internalFormat));
 
     // Hardcoded for now, but we could chose types more adequate to the
     // texture internal format
-    json.writeStringMember("__type__", "uint8");
-    json.writeBoolMember("__normalized__", true);
-    json.writeNumberMember("__channels__", channels);
+    writer.writeStringMember("__type__", "uint8");
+    writer.writeBoolMember("__normalized__", true);
+    writer.writeNumberMember("__channels__", channels);
 
     GLubyte *pixels = new GLubyte[desc.depth*desc.width*desc.height*channels];
 
@@ -406,21 +407,17 @@ dumpActiveTextureLevel(JSONWriter &json, Context &context, GLenum target, GLint
 
     context.restorePixelPackState();
 
-    json.beginMember("__data__");
-    char *pngBuffer;
-    int pngBufferSize;
-    image::writePixelsToBuffer(pixels, desc.width, desc.height, channels, true, &pngBuffer, &pngBufferSize);
-    json.writeBase64(pngBuffer, pngBufferSize);
-    free(pngBuffer);
-    json.endMember(); // __data__
+    writer.beginMember("__data__");
+    writer.writeImage(pixels, desc.width, desc.height, channels);
+    writer.endMember(); // __data__
 
     delete [] pixels;
-    json.endObject();
+    writer.endObject();
 }
 
 
 static inline void
-dumpTexture(JSONWriter &json, Context &context, GLenum target, GLenum binding)
+dumpTexture(StateWriter &writer, Context &context, GLenum target, GLenum binding)
 {
     GLint texture_binding = 0;
     glGetIntegerv(binding, &texture_binding);
@@ -437,10 +434,10 @@ dumpTexture(JSONWriter &json, Context &context, GLenum target, GLenum binding)
 
         if (target == GL_TEXTURE_CUBE_MAP) {
             for (int face = 0; face < 6; ++face) {
-                dumpActiveTextureLevel(json, context, GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, level);
+                dumpActiveTextureLevel(writer, context, GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, level);
             }
         } else {
-            dumpActiveTextureLevel(json, context, target, level);
+            dumpActiveTextureLevel(writer, context, target, level);
         }
 
         ++level;
@@ -449,10 +446,10 @@ dumpTexture(JSONWriter &json, Context &context, GLenum target, GLenum binding)
 
 
 void
-dumpTextures(JSONWriter &json, Context &context)
+dumpTextures(StateWriter &writer, Context &context)
 {
-    json.beginMember("textures");
-    json.beginObject();
+    writer.beginMember("textures");
+    writer.beginObject();
     GLint active_texture = GL_TEXTURE0;
     glGetIntegerv(GL_ACTIVE_TEXTURE, &active_texture);
 
@@ -472,15 +469,15 @@ dumpTextures(JSONWriter &json, Context &context)
     for (GLint unit = 0; unit < max_units; ++unit) {
         GLenum texture = GL_TEXTURE0 + unit;
         glActiveTexture(texture);
-        dumpTexture(json, context, GL_TEXTURE_1D, GL_TEXTURE_BINDING_1D);
-        dumpTexture(json, context, GL_TEXTURE_2D, GL_TEXTURE_BINDING_2D);
-        dumpTexture(json, context, GL_TEXTURE_3D, GL_TEXTURE_BINDING_3D);
-        dumpTexture(json, context, GL_TEXTURE_RECTANGLE, GL_TEXTURE_BINDING_RECTANGLE);
-        dumpTexture(json, context, GL_TEXTURE_CUBE_MAP, GL_TEXTURE_BINDING_CUBE_MAP);
+        dumpTexture(writer, context, GL_TEXTURE_1D, GL_TEXTURE_BINDING_1D);
+        dumpTexture(writer, context, GL_TEXTURE_2D, GL_TEXTURE_BINDING_2D);
+        dumpTexture(writer, context, GL_TEXTURE_3D, GL_TEXTURE_BINDING_3D);
+        dumpTexture(writer, context, GL_TEXTURE_RECTANGLE, GL_TEXTURE_BINDING_RECTANGLE);
+        dumpTexture(writer, context, GL_TEXTURE_CUBE_MAP, GL_TEXTURE_BINDING_CUBE_MAP);
     }
     glActiveTexture(active_texture);
-    json.endObject();
-    json.endMember(); // textures
+    writer.endObject();
+    writer.endMember(); // textures
 }
 
 
@@ -813,29 +810,29 @@ getDrawBufferImage() {
  * Dump the image of the currently bound read buffer.
  */
 static inline void
-dumpReadBufferImage(JSONWriter &json, GLint width, GLint height, GLenum format,
+dumpReadBufferImage(StateWriter &writer, GLint width, GLint height, GLenum format,
                     GLint internalFormat = GL_NONE)
 {
     GLint channels = _gl_format_channels(format);
 
     Context context;
 
-    json.beginObject();
+    writer.beginObject();
 
     // Tell the GUI this is no ordinary object, but an image
-    json.writeStringMember("__class__", "image");
+    writer.writeStringMember("__class__", "image");
 
-    json.writeNumberMember("__width__", width);
-    json.writeNumberMember("__height__", height);
-    json.writeNumberMember("__depth__", 1);
+    writer.writeNumberMember("__width__", width);
+    writer.writeNumberMember("__height__", height);
+    writer.writeNumberMember("__depth__", 1);
 
-    json.writeStringMember("__format__", enumToString(internalFormat));
+    writer.writeStringMember("__format__", enumToString(internalFormat));
 
     // Hardcoded for now, but we could chose types more adequate to the
     // texture internal format
-    json.writeStringMember("__type__", "uint8");
-    json.writeBoolMember("__normalized__", true);
-    json.writeNumberMember("__channels__", channels);
+    writer.writeStringMember("__type__", "uint8");
+    writer.writeBoolMember("__normalized__", true);
+    writer.writeNumberMember("__channels__", channels);
 
     GLenum type = GL_UNSIGNED_BYTE;
 
@@ -855,18 +852,12 @@ dumpReadBufferImage(JSONWriter &json, GLint width, GLint height, GLenum format,
 
     context.restorePixelPackState();
 
-    json.beginMember("__data__");
-    char *pngBuffer;
-    int pngBufferSize;
-    image::writePixelsToBuffer(pixels, width, height, channels, true, &pngBuffer, &pngBufferSize);
-    //std::cerr <<" Before = "<<(width * height * channels * sizeof *pixels)
-    //          <<", after = "<<pngBufferSize << ", ratio = " << double(width * height * channels * sizeof *pixels)/pngBufferSize;
-    json.writeBase64(pngBuffer, pngBufferSize);
-    free(pngBuffer);
-    json.endMember(); // __data__
+    writer.beginMember("__data__");
+    writer.writeImage(pixels, width, height, channels);
+    writer.endMember(); // __data__
 
     delete [] pixels;
-    json.endObject();
+    writer.endObject();
 }
 
 
@@ -972,7 +963,7 @@ downsampledFramebuffer(Context &context,
  * Dump images of current draw drawable/window.
  */
 static void
-dumpDrawableImages(JSONWriter &json, Context &context)
+dumpDrawableImages(StateWriter &writer, Context &context)
 {
     GLint width, height;
 
@@ -981,49 +972,46 @@ dumpDrawableImages(JSONWriter &json, Context &context)
     }
 
     GLint draw_buffer = GL_NONE;
+    GLint read_buffer = GL_NONE;
     if (context.ES) {
         draw_buffer = GL_BACK;
     } else {
         glGetIntegerv(GL_DRAW_BUFFER, &draw_buffer);
+        glGetIntegerv(GL_READ_BUFFER, &read_buffer);
         glReadBuffer(draw_buffer);
     }
 
     if (draw_buffer != GL_NONE) {
-        GLint read_buffer = GL_NONE;
-        if (!context.ES) {
-            glGetIntegerv(GL_READ_BUFFER, &read_buffer);
-        }
-
         GLint alpha_bits = 0;
 #if 0
         // XXX: Ignore alpha until we are able to match the traced visual
         glGetIntegerv(GL_ALPHA_BITS, &alpha_bits);
 #endif
         GLenum format = alpha_bits ? GL_RGBA : GL_RGB;
-        json.beginMember(enumToString(draw_buffer));
-        dumpReadBufferImage(json, width, height, format);
-        json.endMember();
+        writer.beginMember(enumToString(draw_buffer));
+        dumpReadBufferImage(writer, width, height, format);
+        writer.endMember();
+    }
 
-        if (!context.ES) {
-            glReadBuffer(read_buffer);
-        }
+    if (!context.ES) {
+        glReadBuffer(read_buffer);
     }
 
     if (!context.ES) {
         GLint depth_bits = 0;
         glGetIntegerv(GL_DEPTH_BITS, &depth_bits);
         if (depth_bits) {
-            json.beginMember("GL_DEPTH_COMPONENT");
-            dumpReadBufferImage(json, width, height, GL_DEPTH_COMPONENT);
-            json.endMember();
+            writer.beginMember("GL_DEPTH_COMPONENT");
+            dumpReadBufferImage(writer, width, height, GL_DEPTH_COMPONENT);
+            writer.endMember();
         }
 
         GLint stencil_bits = 0;
         glGetIntegerv(GL_STENCIL_BITS, &stencil_bits);
         if (stencil_bits) {
-            json.beginMember("GL_STENCIL_INDEX");
-            dumpReadBufferImage(json, width, height, GL_STENCIL_INDEX);
-            json.endMember();
+            writer.beginMember("GL_STENCIL_INDEX");
+            dumpReadBufferImage(writer, width, height, GL_STENCIL_INDEX);
+            writer.endMember();
         }
     }
 }
@@ -1035,21 +1023,21 @@ dumpDrawableImages(JSONWriter &json, Context &context)
  * In the case of a color attachment, it assumes it is already bound for read.
  */
 static void
-dumpFramebufferAttachment(JSONWriter &json, Context &context, GLenum target, GLenum attachment, GLenum format)
+dumpFramebufferAttachment(StateWriter &writer, Context &context, GLenum target, GLenum attachment, GLenum format)
 {
     ImageDesc desc;
     if (!getFramebufferAttachmentDesc(context, target, attachment, desc)) {
         return;
     }
 
-    json.beginMember(enumToString(attachment));
-    dumpReadBufferImage(json, desc.width, desc.height, format, desc.internalFormat);
-    json.endMember();
+    writer.beginMember(enumToString(attachment));
+    dumpReadBufferImage(writer, desc.width, desc.height, format, desc.internalFormat);
+    writer.endMember();
 }
 
 
 static void
-dumpFramebufferAttachments(JSONWriter &json, Context &context, GLenum target)
+dumpFramebufferAttachments(StateWriter &writer, Context &context, GLenum target)
 {
     GLint read_framebuffer = 0;
     glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &read_framebuffer);
@@ -1079,15 +1067,15 @@ dumpFramebufferAttachments(JSONWriter &json, Context &context, GLenum target)
                                                   GL_FRAMEBUFFER_ATTACHMENT_ALPHA_SIZE,
                                                   &alpha_size);
             GLenum format = alpha_size ? GL_RGBA : GL_RGB;
-            dumpFramebufferAttachment(json, context, target, attachment, format);
+            dumpFramebufferAttachment(writer, context, target, attachment, format);
         }
     }
 
     glReadBuffer(read_buffer);
 
     if (!context.ES) {
-        dumpFramebufferAttachment(json, context, target, GL_DEPTH_ATTACHMENT, GL_DEPTH_COMPONENT);
-        dumpFramebufferAttachment(json, context, target, GL_STENCIL_ATTACHMENT, GL_STENCIL_INDEX);
+        dumpFramebufferAttachment(writer, context, target, GL_DEPTH_ATTACHMENT, GL_DEPTH_COMPONENT);
+        dumpFramebufferAttachment(writer, context, target, GL_STENCIL_ATTACHMENT, GL_STENCIL_INDEX);
     }
 
     glBindFramebuffer(GL_READ_FRAMEBUFFER, read_framebuffer);
@@ -1095,18 +1083,18 @@ dumpFramebufferAttachments(JSONWriter &json, Context &context, GLenum target)
 
 
 void
-dumpFramebuffer(JSONWriter &json, Context &context)
+dumpFramebuffer(StateWriter &writer, Context &context)
 {
-    json.beginMember("framebuffer");
-    json.beginObject();
+    writer.beginMember("framebuffer");
+    writer.beginObject();
 
     GLint boundDrawFbo = 0, boundReadFbo = 0;
     glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &boundDrawFbo);
     glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &boundReadFbo);
     if (!boundDrawFbo) {
-        dumpDrawableImages(json, context);
+        dumpDrawableImages(writer, context);
     } else if (context.ES) {
-        dumpFramebufferAttachments(json, context, GL_FRAMEBUFFER);
+        dumpFramebufferAttachments(writer, context, GL_FRAMEBUFFER);
     } else {
         GLint colorRb = 0, stencilRb = 0, depthRb = 0;
         GLint draw_buffer0 = GL_NONE;
@@ -1165,7 +1153,7 @@ dumpFramebuffer(JSONWriter &json, Context &context)
                                              rbs, &numRbs);
         }
 
-        dumpFramebufferAttachments(json, context, GL_DRAW_FRAMEBUFFER);
+        dumpFramebufferAttachments(writer, context, GL_DRAW_FRAMEBUFFER);
 
         if (multisample) {
             glBindRenderbuffer(GL_RENDERBUFFER_BINDING, boundRb);
@@ -1177,8 +1165,8 @@ dumpFramebuffer(JSONWriter &json, Context &context)
         glBindFramebuffer(GL_DRAW_FRAMEBUFFER, boundDrawFbo);
     }
 
-    json.endObject();
-    json.endMember(); // framebuffer
+    writer.endObject();
+    writer.endMember(); // framebuffer
 }
 
 
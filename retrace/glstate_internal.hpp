@@ -30,7 +30,7 @@
 #include "glimports.hpp"
 
 
-class JSONWriter;
+class StateWriter;
 
 
 namespace glstate {
@@ -54,17 +54,17 @@ struct Context
 };
 
 
-void dumpBoolean(JSONWriter &json, GLboolean value);
+void dumpBoolean(StateWriter &writer, GLboolean value);
 
-void dumpEnum(JSONWriter &json, GLenum pname);
+void dumpEnum(StateWriter &writer, GLenum pname);
 
-void dumpParameters(JSONWriter &json, Context &context);
+void dumpParameters(StateWriter &writer, Context &context);
 
-void dumpShadersUniforms(JSONWriter &json, Context &context);
+void dumpShadersUniforms(StateWriter &writer, Context &context);
 
-void dumpTextures(JSONWriter &json, Context &context);
+void dumpTextures(StateWriter &writer, Context &context);
 
-void dumpFramebuffer(JSONWriter &json, Context &context);
+void dumpFramebuffer(StateWriter &writer, Context &context);
 
 
 } /* namespace glstate */
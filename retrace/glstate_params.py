@@ -194,32 +194,32 @@ glGetProgramARB = StateGetter('glGetProgram', {I: 'iv', F: 'fv', S: 'Stringv'},
 glGetFramebufferAttachmentParameter = StateGetter('glGetFramebufferAttachmentParameter', {I: 'iv'})
 
 
-class JsonWriter(Visitor):
+class StateWriter(Visitor):
     '''Type visitor that will dump a value of the specified type through the
-    JSON writer.
+    state writer.
     
-    It expects a previously declared JSONWriter instance named "json".'''
+    It expects a previously declared StateWriter instance named "writer".'''
 
     def visitLiteral(self, literal, instance):
         if literal.kind == 'Bool':
-            print '    json.writeBool(%s);' % instance
+            print '    writer.writeBool(%s);' % instance
         elif literal.kind in ('SInt', 'Uint', 'Float', 'Double'):
-            print '    json.writeNumber(%s);' % instance
+            print '    writer.writeNumber(%s);' % instance
         else:
             raise NotImplementedError
 
     def visitString(self, string, instance):
         assert string.length is None
-        print '    json.writeString((const char *)%s);' % instance
+        print '    writer.writeString((const char *)%s);' % instance
 
     def visitEnum(self, enum, instance):
         if enum is GLboolean:
-            print '    dumpBoolean(json, %s);' % instance
+            print '    dumpBoolean(writer, %s);' % instance
         elif enum is GLenum:
-            print '    dumpEnum(json, %s);' % instance
+            print '    dumpEnum(writer, %s);' % instance
         else:
             assert False
-            print '    json.writeNumber(%s);' % instance
+            print '    writer.writeNumber(%s);' % instance
 
     def visitBitmask(self, bitmask, instance):
         raise NotImplementedError
@@ -228,32 +228,32 @@ class JsonWriter(Visitor):
         self.visit(alias.type, instance)
 
     def visitOpaque(self, opaque, instance):
-        print '    json.writeNumber((size_t)%s);' % instance
+        print '    writer.writeNumber((size_t)%s);' % instance
 
     __index = 0
 
     def visitArray(self, array, instance):
-        index = '_i%u' % JsonWriter.__index
-        JsonWriter.__index += 1
-        print '    json.beginArray();'
+        index = '_i%u' % StateWriter.__index
+        StateWriter.__index += 1
+        print '    writer.beginArray();'
         print '    for (unsigned %s = 0; %s < %s; ++%s) {' % (index, index, array.length, index)
         self.visit(array.type, '%s[%s]' % (instance, index))
         print '    }'
-        print '    json.endArray();'
+        print '    writer.endArray();'
 
 
 
 class StateDumper:
-    '''Class to generate code to dump all GL state in JSON format via
-    stdout.'''
+    '''Class to generate code to dump all GL state via a state writer.'''
 
     def __init__(self):
         pass
 
     def dump(self):
+        print '#include <assert.h>'
         print '#include <string.h>'
         print
-        print '#include "json.hpp"'
+        print '#include "state_writer.hpp"'
         print '#include "glproc.hpp"'
         print '#include "glsize.hpp"'
         print '#include "glstate.hpp"'
@@ -263,17 +263,17 @@ class StateDumper:
         print
 
         print 'void'
-        print 'dumpBoolean(JSONWriter &json, GLboolean value)'
+        print 'dumpBoolean(StateWriter &writer, GLboolean value)'
         print '{'
         print '    switch (value) {'
         print '    case GL_FALSE:'
-        print '        json.writeString("GL_FALSE");'
+        print '        writer.writeString("GL_FALSE");'
         print '        break;'
         print '    case GL_TRUE:'
-        print '        json.writeString("GL_TRUE");'
+        print '        writer.writeString("GL_TRUE");'
         print '        break;'
         print '    default:'
-        print '        json.writeNumber(static_cast<GLint>(value));'
+        print '        writer.writeNumber(static_cast<GLint>(value));'
         print '        break;'
         print '    }'
         print '}'
@@ -293,28 +293,28 @@ class StateDumper:
         print
 
         print 'void'
-        print 'dumpEnum(JSONWriter &json, GLenum pname)'
+        print 'dumpEnum(StateWriter &writer, GLenum pname)'
         print '{'
         print '    const char *s = enumToString(pname);'
         print '    if (s) {'
-        print '        json.writeString(s);'
+        print '        writer.writeString(s);'
         print '    } else {'
-        print '        json.writeNumber(pname);'
+        print '        writer.writeNumber(pname);'
         print '    }'
         print '}'
         print
 
         print 'static void'
-        print 'dumpFramebufferAttachementParameters(JSONWriter &json, GLenum target, GLenum attachment)'
+        print 'dumpFramebufferAttachementParameters(StateWriter &writer, GLenum target, GLenum attachment)'
         print '{'
         self.dump_attachment_parameters('target', 'attachment')
         print '}'
         print
 
-        print 'void dumpParameters(JSONWriter &json, Context &context)'
+        print 'void dumpParameters(StateWriter &writer, Context &context)'
         print '{'
-        print '    json.beginMember("parameters");'
-        print '    json.beginObject();'
+        print '    writer.beginMember("parameters");'
+        print '    writer.beginObject();'
         
         self.dump_atoms(glGet)
         
@@ -325,8 +325,8 @@ class StateDumper:
         self.dump_texture_parameters()
         self.dump_framebuffer_parameters()
 
-        print '    json.endObject();'
-        print '    json.endMember(); // parameters'
+        print '    writer.endObject();'
+        print '    writer.endMember(); // parameters'
         print '}'
         print
         
@@ -335,10 +335,10 @@ class StateDumper:
     def dump_material_params(self):
         print '    if (!context.ES) {'
         for face in ['GL_FRONT', 'GL_BACK']:
-            print '    json.beginMember("%s");' % face
-            print '    json.beginObject();'
+            print '    writer.beginMember("%s");' % face
+            print '    writer.beginObject();'
             self.dump_atoms(glGetMaterial, face)
-            print '    json.endObject();'
+            print '    writer.endObject();'
         print '    }'
         print
 
@@ -350,11 +350,11 @@ class StateDumper:
         print '        if (glIsEnabled(light)) {'
         print '            char name[32];'
         print '            snprintf(name, sizeof name, "GL_LIGHT%i", index);'
-        print '            json.beginMember(name);'
-        print '            json.beginObject();'
+        print '            writer.beginMember(name);'
+        print '            writer.beginObject();'
         self.dump_atoms(glGetLight, '    GL_LIGHT0 + index')
-        print '            json.endObject();'
-        print '            json.endMember(); // GL_LIGHTi'
+        print '            writer.endObject();'
+        print '            writer.endMember(); // GL_LIGHTi'
         print '        }'
         print '    }'
         print
@@ -370,12 +370,12 @@ class StateDumper:
     def dump_texenv_params(self):
         for target in ['GL_TEXTURE_ENV', 'GL_TEXTURE_FILTER_CONTROL', 'GL_POINT_SPRITE']:
             print '    if (!context.ES) {'
-            print '        json.beginMember("%s");' % target
-            print '        json.beginObject();'
+            print '        writer.beginMember("%s");' % target
+            print '        writer.beginObject();'
             for _, _, name in glGetTexEnv.iter():
                 if self.texenv_param_target(name) == target:
                     self.dump_atom(glGetTexEnv, target, name) 
-            print '        json.endObject();'
+            print '        writer.endObject();'
             print '    }'
 
     def dump_vertex_attribs(self):
@@ -384,11 +384,11 @@ class StateDumper:
         print '    for (GLint index = 0; index < max_vertex_attribs; ++index) {'
         print '        char name[32];'
         print '        snprintf(name, sizeof name, "GL_VERTEX_ATTRIB_ARRAY%i", index);'
-        print '        json.beginMember(name);'
-        print '        json.beginObject();'
+        print '        writer.beginMember(name);'
+        print '        writer.beginObject();'
         self.dump_atoms(glGetVertexAttrib, 'index')
-        print '        json.endObject();'
-        print '        json.endMember(); // GL_VERTEX_ATTRIB_ARRAYi'
+        print '        writer.endObject();'
+        print '        writer.endMember(); // GL_VERTEX_ATTRIB_ARRAYi'
         print '    }'
         print
 
@@ -400,10 +400,10 @@ class StateDumper:
     def dump_program_params(self):
         for target in self.program_targets:
             print '    if (glIsEnabled(%s)) {' % target
-            print '        json.beginMember("%s");' % target
-            print '        json.beginObject();'
+            print '        writer.beginMember("%s");' % target
+            print '        writer.beginObject();'
             self.dump_atoms(glGetProgramARB, target)
-            print '        json.endObject();'
+            print '        writer.endObject();'
             print '    }'
 
     def dump_texture_parameters(self):
@@ -418,9 +418,9 @@ class StateDumper:
         print '        for (GLint unit = 0; unit < max_units; ++unit) {'
         print '            char name[32];'
         print '            snprintf(name, sizeof name, "GL_TEXTURE%i", unit);'
-        print '            json.beginMember(name);'
+        print '            writer.beginMember(name);'
         print '            glActiveTexture(GL_TEXTURE0 + unit);'
-        print '            json.beginObject();'
+        print '            writer.beginObject();'
         print '            GLboolean enabled;'
         print '            GLint binding;'
         print
@@ -428,29 +428,29 @@ class StateDumper:
             print '            // %s' % target
             print '            enabled = GL_FALSE;'
             print '            glGetBooleanv(%s, &enabled);' % target
-            print '            json.beginMember("%s");' % target
-            print '            dumpBoolean(json, enabled);'
-            print '            json.endMember();'
+            print '            writer.beginMember("%s");' % target
+            print '            dumpBoolean(writer, enabled);'
+            print '            writer.endMember();'
             print '            binding = 0;'
             print '            glGetIntegerv(%s, &binding);' % binding
-            print '            json.writeNumberMember("%s", binding);' % binding
+            print '            writer.writeNumberMember("%s", binding);' % binding
             print '            if (enabled || binding) {'
-            print '                json.beginMember("%s");' % target
-            print '                json.beginObject();'
+            print '                writer.beginMember("%s");' % target
+            print '                writer.beginObject();'
             self.dump_atoms(glGetTexParameter, target)
             print '                if (!context.ES) {'
             # We only dump the first level parameters
             self.dump_atoms(glGetTexLevelParameter, target, "0")
             print '                }'
-            print '                json.endObject();'
-            print '                json.endMember(); // %s' % target
+            print '                writer.endObject();'
+            print '                writer.endMember(); // %s' % target
             print '            }'
             print
         print '            if (unit < max_texture_coords) {'
         self.dump_texenv_params()
         print '            }'
-        print '            json.endObject();'
-        print '            json.endMember(); // GL_TEXTUREi'
+        print '            writer.endObject();'
+        print '            writer.endMember(); // GL_TEXTUREi'
         print '        }'
         print '        glActiveTexture(active_texture);'
         print '    }'
@@ -466,16 +466,16 @@ class StateDumper:
             print '            framebuffer = 0;'
             print '            glGetIntegerv(%s, &framebuffer);' % binding
             print '            if (framebuffer) {'
-            print '                json.beginMember("%s");' % target
-            print '                json.beginObject();'
+            print '                writer.beginMember("%s");' % target
+            print '                writer.beginObject();'
             print '                for (GLint i = 0; i < max_color_attachments; ++i) {'
             print '                    GLint color_attachment = GL_COLOR_ATTACHMENT0 + i;'
-            print '                    dumpFramebufferAttachementParameters(json, %s, color_attachment);' % target
+            print '                    dumpFramebufferAttachementParameters(writer, %s, color_attachment);' % target
             print '                }'
-            print '                dumpFramebufferAttachementParameters(json, %s, GL_DEPTH_ATTACHMENT);' % target
-            print '                dumpFramebufferAttachementParameters(json, %s, GL_STENCIL_ATTACHMENT);' % target
-            print '                json.endObject();'
-            print '                json.endMember(); // %s' % target
+            print '                dumpFramebufferAttachementParameters(writer, %s, GL_DEPTH_ATTACHMENT);' % target
+            print '                dumpFramebufferAttachementParameters(writer, %s, GL_STENCIL_ATTACHMENT);' % target
+            print '                writer.endObject();'
+            print '                writer.endMember(); // %s' % target
             print '            }'
             print
         print '    }'
@@ -486,11 +486,11 @@ class StateDumper:
         print '                GLint object_type = GL_NONE;'
         print '                glGetFramebufferAttachmentParameteriv(%s, %s, GL_FRAMEBUFFER_ATTACHMENT_OBJECT_TYPE, &object_type);' % (target, attachment)
         print '                if (object_type != GL_NONE) {'
-        print '                    json.beginMember(enumToString(%s));' % attachment
-        print '                    json.beginObject();'
+        print '                    writer.beginMember(enumToString(%s));' % attachment
+        print '                    writer.beginObject();'
         self.dump_atoms(glGetFramebufferAttachmentParameter, target, attachment)
-        print '                    json.endObject();'
-        print '                    json.endMember(); // GL_x_ATTACHMENT'
+        print '                    writer.endObject();'
+        print '                    writer.endMember(); // GL_x_ATTACHMENT'
         print '                }'
         print '            }'
 
@@ -515,9 +515,9 @@ class StateDumper:
         #print '                std::cerr << "warning: %s(%s) failed\\n";' % (inflection, name)
         print '                while (glGetError() != GL_NO_ERROR) {}'
         print '            } else {'
-        print '                json.beginMember("%s");' % name
-        JsonWriter().visit(type, value)
-        print '                json.endMember();'
+        print '                writer.beginMember("%s");' % name
+        StateWriter().visit(type, value)
+        print '                writer.endMember();'
         print '            }'
         print '        }'
         print
@@ -24,6 +24,7 @@
  **************************************************************************/
 
 
+#include <assert.h>
 #include <string.h>
 
 #include <algorithm>
@@ -31,7 +32,7 @@
 #include <map>
 #include <sstream>
 
-#include "json.hpp"
+#include "state_writer.hpp"
 #include "glproc.hpp"
 #include "glsize.hpp"
 #include "glstate.hpp"
@@ -113,7 +114,7 @@ getShaderObjSource(ShaderMap &shaderMap, GLhandleARB shaderObj)
 
 
 static inline void
-dumpProgram(JSONWriter &json, GLint program)
+dumpProgram(StateWriter &writer, GLint program)
 {
     GLint attached_shaders = 0;
     glGetProgramiv(program, GL_ATTACHED_SHADERS, &attached_shaders);
@@ -133,15 +134,15 @@ dumpProgram(JSONWriter &json, GLint program)
     delete [] shaders;
 
     for (ShaderMap::const_iterator it = shaderMap.begin(); it != shaderMap.end(); ++it) {
-        json.beginMember(it->first);
-        json.writeString(it->second);
-        json.endMember();
+        writer.beginMember(it->first);
+        writer.writeString(it->second);
+        writer.endMember();
     }
 }
 
 
 static inline void
-dumpProgramObj(JSONWriter &json, GLhandleARB programObj)
+dumpProgramObj(StateWriter &writer, GLhandleARB programObj)
 {
     GLint attached_shaders = 0;
     glGetObjectParameterivARB(programObj, GL_OBJECT_ATTACHED_OBJECTS_ARB, &attached_shaders);
@@ -161,9 +162,9 @@ dumpProgramObj(JSONWriter &json, GLhandleARB programObj)
     delete [] shaderObjs;
 
     for (ShaderMap::const_iterator it = shaderMap.begin(); it != shaderMap.end(); ++it) {
-        json.beginMember(it->first);
-        json.writeString(it->second);
-        json.endMember();
+        writer.beginMember(it->first);
+        writer.writeString(it->second);
+        writer.endMember();
     }
 }
 
@@ -203,12 +204,12 @@ resolveUniformName(const GLchar *name,  GLint size)
 
 
 static void
-dumpUniformValues(JSONWriter &json, GLenum type, const void *values, GLint matrix_stride = 0, GLboolean is_row_major = GL_FALSE) {
+dumpUniformValues(StateWriter &writer, GLenum type, const void *values, GLint matrix_stride = 0, GLboolean is_row_major = GL_FALSE) {
     GLenum elemType;
     GLint numCols, numRows;
     _gl_uniform_size(type, elemType, numCols, numRows);
     if (!numCols || !numRows) {
-        json.writeNull();
+        writer.writeNull();
     }
 
     size_t elemSize = _gl_type_size(elemType);
@@ -224,12 +225,12 @@ dumpUniformValues(JSONWriter &json, GLenum type, const void *values, GLint matri
     }
 
     if (numRows > 1) {
-        json.beginArray();
+        writer.beginArray();
     }
 
     for (GLint row = 0; row < numRows; ++row) {
         if (numCols > 1) {
-            json.beginArray();
+            writer.beginArray();
         }
 
         for (GLint col = 0; col < numCols; ++col) {
@@ -245,34 +246,34 @@ dumpUniformValues(JSONWriter &json, GLenum type, const void *values, GLint matri
 
             switch (elemType) {
             case GL_FLOAT:
-                json.writeNumber(*u.fvalue);
+                writer.writeNumber(*u.fvalue);
                 break;
             case GL_DOUBLE:
-                json.writeNumber(*u.dvalue);
+                writer.writeNumber(*u.dvalue);
                 break;
             case GL_INT:
-                json.writeNumber(*u.ivalue);
+                writer.writeNumber(*u.ivalue);
                 break;
             case GL_UNSIGNED_INT:
-                json.writeNumber(*u.uivalue);
+                writer.writeNumber(*u.uivalue);
                 break;
             case GL_BOOL:
-                json.writeBool(*u.uivalue);
+                writer.writeBool(*u.uivalue);
                 break;
             default:
                 assert(0);
-                json.writeNull();
+                writer.writeNull();
                 break;
             }
         }
 
         if (numCols > 1) {
-            json.endArray();
+            writer.endArray();
         }
     }
 
     if (numRows > 1) {
-        json.endArray();
+        writer.endArray();
     }
 }
 
@@ -281,7 +282,7 @@ dumpUniformValues(JSONWriter &json, GLenum type, const void *values, GLint matri
  * Dump an uniform that belows to an uniform block.
  */
 static void
-dumpUniformBlock(JSONWriter &json, GLint program, GLint size, GLenum type, const GLchar *name, GLuint index, GLuint block_index) {
+dumpUniformBlock(StateWriter &writer, GLint program, GLint size, GLenum type, const GLchar *name, GLuint index, GLuint block_index) {
 
     GLint offset = 0;
     GLint array_stride = 0;
@@ -341,13 +342,13 @@ dumpUniformBlock(JSONWriter &json, GLint program, GLint size, GLenum type, const
 
             std::string elemName = ss.str();
 
-            json.beginMember(elemName);
+            writer.beginMember(elemName);
 
             const GLbyte *row = raw_data + offset + array_stride*i;
 
-            dumpUniformValues(json, type, row, matrix_stride, is_row_major);
+            dumpUniformValues(writer, type, row, matrix_stride, is_row_major);
 
-            json.endMember();
+            writer.endMember();
         }
 
         glUnmapBuffer(GL_UNIFORM_BUFFER);
@@ -358,7 +359,7 @@ dumpUniformBlock(JSONWriter &json, GLint program, GLint size, GLenum type, const
 
 
 static void
-dumpUniform(JSONWriter &json, GLint program, GLint size, GLenum type, const GLchar *name) {
+dumpUniform(StateWriter &writer, GLint program, GLint size, GLenum type, const GLchar *name) {
     GLenum elemType;
     GLint numCols, numRows;
     _gl_uniform_size(type, elemType, numCols, numRows);
@@ -393,7 +394,7 @@ dumpUniform(JSONWriter &json, GLint program, GLint size, GLenum type, const GLch
             continue;
         }
 
-        json.beginMember(elemName);
+        writer.beginMember(elemName);
 
         switch (elemType) {
         case GL_FLOAT:
@@ -416,15 +417,15 @@ dumpUniform(JSONWriter &json, GLint program, GLint size, GLenum type, const GLch
             break;
         }
 
-        dumpUniformValues(json, type, &u);
+        dumpUniformValues(writer, type, &u);
 
-        json.endMember();
+        writer.endMember();
     }
 }
 
 
 static void
-dumpUniformARB(JSONWriter &json, GLhandleARB programObj, GLint size, GLenum type, const GLchar *name) {
+dumpUniformARB(StateWriter &writer, GLhandleARB programObj, GLint size, GLenum type, const GLchar *name) {
     GLenum elemType;
     GLint numCols, numRows;
     _gl_uniform_size(type, elemType, numCols, numRows);
@@ -454,7 +455,7 @@ dumpUniformARB(JSONWriter &json, GLhandleARB programObj, GLint size, GLenum type
 
         std::string elemName = ss.str();
 
-        json.beginMember(elemName);
+        writer.beginMember(elemName);
 
         GLint location = glGetUniformLocationARB(programObj, elemName.c_str());
         if (location == -1) {
@@ -485,15 +486,15 @@ dumpUniformARB(JSONWriter &json, GLhandleARB programObj, GLint size, GLenum type
             break;
         }
 
-        dumpUniformValues(json, type, &u);
+        dumpUniformValues(writer, type, &u);
 
-        json.endMember();
+        writer.endMember();
     }
 }
 
 
 static inline void
-dumpProgramUniforms(JSONWriter &json, GLint program)
+dumpProgramUniforms(StateWriter &writer, GLint program)
 {
     GLint active_uniforms = 0;
     glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &active_uniforms);
@@ -520,14 +521,14 @@ dumpProgramUniforms(JSONWriter &json, GLint program)
 
         GLint location = glGetUniformLocation(program, name);
         if (location != -1) {
-            dumpUniform(json, program, size, type, name);
+            dumpUniform(writer, program, size, type, name);
             continue;
         }
 
         GLint block_index = -1;
         glGetActiveUniformsiv(program, 1, &index, GL_UNIFORM_BLOCK_INDEX, &block_index);
         if (block_index != -1) {
-            dumpUniformBlock(json, program, size, type, name, index, block_index);
+            dumpUniformBlock(writer, program, size, type, name, index, block_index);
             continue;
         }
 
@@ -539,7 +540,7 @@ dumpProgramUniforms(JSONWriter &json, GLint program)
 
 
 static inline void
-dumpProgramObjUniforms(JSONWriter &json, GLhandleARB programObj)
+dumpProgramObjUniforms(StateWriter &writer, GLhandleARB programObj)
 {
     GLint active_uniforms = 0;
     glGetObjectParameterivARB(programObj, GL_OBJECT_ACTIVE_UNIFORMS_ARB, &active_uniforms);
@@ -564,7 +565,7 @@ dumpProgramObjUniforms(JSONWriter &json, GLhandleARB programObj)
         continue;
     }
 
-        dumpUniformARB(json, programObj, size, type, name);
+        dumpUniformARB(writer, programObj, size, type, name);
     }
 
     delete [] name;
@@ -572,7 +573,7 @@ dumpProgramObjUniforms(JSONWriter &json, GLhandleARB programObj)
 
 
 static inline void
-dumpArbProgram(JSONWriter &json, GLenum target)
+dumpArbProgram(StateWriter &writer, GLenum target)
 {
     if (!glIsEnabled(target)) {
         return;
@@ -589,16 +590,16 @@ dumpArbProgram(JSONWriter &json, GLenum target)
     glGetProgramStringARB(target, GL_PROGRAM_STRING_ARB, source);
     source[program_length] = 0;
 
-    json.beginMember(enumToString(target));
-    json.writeString(source);
-    json.endMember();
+    writer.beginMember(enumToString(target));
+    writer.writeString(source);
+    writer.endMember();
 
     delete [] source;
 }
 
 
 static inline void
-dumpArbProgramUniforms(JSONWriter &json, GLenum target, const char *prefix)
+dumpArbProgramUniforms(StateWriter &writer, GLenum target, const char *prefix)
 {
     if (!glIsEnabled(target)) {
         return;
@@ -623,14 +624,14 @@ dumpArbProgramUniforms(JSONWriter &json, GLenum target, const char *prefix)
         char name[256];
         snprintf(name, sizeof name, "%sprogram.local[%i]", prefix, index);
 
-        json.beginMember(name);
-        json.beginArray();
-        json.writeNumber(params[0]);
-        json.writeNumber(params[1]);
-        json.writeNumber(params[2]);
-        json.writeNumber(params[3]);
-        json.endArray();
-        json.endMember();
+        writer.beginMember(name);
+        writer.beginArray();
+        writer.writeNumber(params[0]);
+        writer.writeNumber(params[1]);
+        writer.writeNumber(params[2]);
+        writer.writeNumber(params[3]);
+        writer.endArray();
+        writer.endMember();
     }
 
     GLint max_program_env_parameters = 0;
@@ -646,31 +647,31 @@ dumpArbProgramUniforms(JSONWriter &json, GLenum target, const char *prefix)
         char name[256];
         snprintf(name, sizeof name, "%sprogram.env[%i]", prefix, index);
 
-        json.beginMember(name);
-        json.beginArray();
-        json.writeNumber(params[0]);
-        json.writeNumber(params[1]);
-        json.writeNumber(params[2]);
-        json.writeNumber(params[3]);
-        json.endArray();
-        json.endMember();
+        writer.beginMember(name);
+        writer.beginArray();
+        writer.writeNumber(params[0]);
+        writer.writeNumber(params[1]);
+        writer.writeNumber(params[2]);
+        writer.writeNumber(params[3]);
+        writer.endArray();
+        writer.endMember();
     }
 }
 
 static void
-dumpProgramUniformsStage(JSONWriter &json, GLint program, const char *stage)
+dumpProgramUniformsStage(StateWriter &writer, GLint program, const char *stage)
 {
     if (program) {
-        json.beginMember(stage);
-        json.beginObject();
-        dumpProgramUniforms(json, program);
-        json.endObject();
-        json.endMember();
+        writer.beginMember(stage);
+        writer.beginObject();
+        dumpProgramUniforms(writer, program);
+        writer.endObject();
+        writer.endMember();
     }
 }
 
 void
-dumpShadersUniforms(JSONWriter &json, Context &context)
+dumpShadersUniforms(StateWriter &writer, Context &context)
 {
     GLint pipeline = 0;
     GLint vertex_program = 0;
@@ -699,43 +700,43 @@ dumpShadersUniforms(JSONWriter &json, Context &context)
         }
     }
 
-    json.beginMember("shaders");
-    json.beginObject();
+    writer.beginMember("shaders");
+    writer.beginObject();
     if (pipeline) {
-        dumpProgram(json, vertex_program);
-        dumpProgram(json, fragment_program);
-        dumpProgram(json, geometry_program);
-        dumpProgram(json, tess_control_program);
-        dumpProgram(json, tess_evaluation_program);
+        dumpProgram(writer, vertex_program);
+        dumpProgram(writer, fragment_program);
+        dumpProgram(writer, geometry_program);
+        dumpProgram(writer, tess_control_program);
+        dumpProgram(writer, tess_evaluation_program);
     } else if (program) {
-        dumpProgram(json, program);
+        dumpProgram(writer, program);
     } else if (programObj) {
-        dumpProgramObj(json, programObj);
+        dumpProgramObj(writer, programObj);
     } else {
-        dumpArbProgram(json, GL_FRAGMENT_PROGRAM_ARB);
-        dumpArbProgram(json, GL_VERTEX_PROGRAM_ARB);
+        dumpArbProgram(writer, GL_FRAGMENT_PROGRAM_ARB);
+        dumpArbProgram(writer, GL_VERTEX_PROGRAM_ARB);
     }
-    json.endObject();
-    json.endMember(); // shaders
+    writer.endObject();
+    writer.endMember(); // shaders
 
-    json.beginMember("uniforms");
-    json.beginObject();
+    writer.beginMember("uniforms");
+    writer.beginObject();
     if (pipeline) {
-        dumpProgramUniformsStage(json, vertex_program, "GL_VERTEX_SHADER");
-        dumpProgramUniformsStage(json, fragment_program, "GL_FRAGMENT_SHADER");
-        dumpProgramUniformsStage(json, geometry_program, "GL_GEOMETRY_SHADER");
-        dumpProgramUniformsStage(json, tess_control_program, "GL_TESS_CONTROL_SHADER");
-        dumpProgramUniformsStage(json, tess_evaluation_program, "GL_TESS_EVALUATION_SHADER");
+        dumpProgramUniformsStage(writer, vertex_program, "GL_VERTEX_SHADER");
+        dumpProgramUniformsStage(writer, fragment_program, "GL_FRAGMENT_SHADER");
+        dumpProgramUniformsStage(writer, geometry_program, "GL_GEOMETRY_SHADER");
+        dumpProgramUniformsStage(writer, tess_control_program, "GL_TESS_CONTROL_SHADER");
+        dumpProgramUniformsStage(writer, tess_evaluation_program, "GL_TESS_EVALUATION_SHADER");
     } else if (program) {
-        dumpProgramUniforms(json, program);
+        dumpProgramUniforms(writer, program);
     } else if (programObj) {
-        dumpProgramObjUniforms(json, programObj);
+        dumpProgramObjUniforms(writer, programObj);
     } else {
-        dumpArbProgramUniforms(json, GL_FRAGMENT_PROGRAM_ARB, "fp.");
-        dumpArbProgramUniforms(json, GL_VERTEX_PROGRAM_ARB, "vp.");
+        dumpArbProgramUniforms(writer, GL_FRAGMENT_PROGRAM_ARB, "fp.");
+        dumpArbProgramUniforms(writer, GL_VERTEX_PROGRAM_ARB, "vp.");
     }
-    json.endObject();
-    json.endMember(); // uniforms
+    writer.endObject();
+    writer.endMember(); // uniforms
 }
 
 
@@ -139,8 +139,14 @@ public:
 };
 
 
+/**
+ * Initialize the window system.
+ *
+ * When headless, no window system connection is made, and drawables are
+ * rendered offscreen.
+ */
 void
-init(void);
+init(bool headless = false);
 
 void
 cleanup(void);
@@ -155,7 +155,12 @@ public:
 
 
 void
-init(void) {
+init(bool headless) {
+    if (headless) {
+        std::cerr << "error: headless replay is only supported with EGL\n";
+        exit(1);
+    }
+
     [NSApplication sharedApplication];
 
     autoreleasePool = [[NSAutoreleasePool alloc] init];
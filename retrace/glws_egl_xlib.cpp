@@ -42,6 +42,18 @@ static Display *display = NULL;
 static EGLDisplay eglDisplay = EGL_NO_DISPLAY;
 static int screen = 0;
 
+/*
+ * Whether we render to pbuffers instead of X windows.
+ */
+static bool headless = false;
+
+
+#ifndef EGL_PLATFORM_SURFACELESS_MESA
+#define EGL_PLATFORM_SURFACELESS_MESA 0x31DD
+#endif
+
+typedef EGLDisplay (EGLAPIENTRY *PFN_EGLGETPLATFORMDISPLAYEXT)(EGLenum platform, void *native_display, const EGLint *attrib_list);
+
 
 class EglVisual : public Visual
 {
@@ -55,7 +67,9 @@ public:
     {}
 
     ~EglVisual() {
-        XFree(visinfo);
+        if (visinfo) {
+            XFree(visinfo);
+        }
     }
 };
 
@@ -93,8 +107,13 @@ public:
     EGLint api;
 
     EglDrawable(const Visual *vis, int w, int h) :
-        Drawable(vis, w, h), api(EGL_OPENGL_ES_API)
+        Drawable(vis, w, h), window(0), surface(EGL_NO_SURFACE), api(EGL_OPENGL_ES_API)
     {
+        if (headless) {
+            createPbuffer();
+            return;
+        }
+
         XVisualInfo *visinfo = static_cast<const EglVisual *>(visual)->visinfo;
 
         Window root = RootWindow(display, screen);
@@ -140,6 +159,17 @@ public:
         surface = eglCreateWindowSurface(eglDisplay, config, (EGLNativeWindowType)window, NULL);
     }
 
+    void createPbuffer(void) {
+        EGLConfig config = static_cast<const EglVisual *>(visual)->config;
+
+        Attributes<EGLint> attribs;
+        attribs.add(EGL_WIDTH, width);
+        attribs.add(EGL_HEIGHT, height);
+        attribs.end(EGL_NONE);
+
+        surface = eglCreatePbufferSurface(eglDisplay, config, attribs);
+    }
+
     void waitForEvent(int type) {
         XEvent event;
         do {
@@ -150,6 +180,9 @@ public:
 
     ~EglDrawable() {
         eglDestroySurface(eglDisplay, surface);
+        if (headless) {
+            return;
+        }
         eglWaitClient();
         XDestroyWindow(display, window);
         eglWaitNative(EGL_CORE_NATIVE_ENGINE);
@@ -163,6 +196,20 @@ public:
 
         eglWaitClient();
 
+        if (headless) {
+            // Pbuffers can't be resized, so replace the pbuffer with a new
+            // one, rebinding it if current.
+            Drawable::resize(w, h);
+
+            EGLSurface old_surface = surface;
+            createPbuffer();
+            if (eglGetCurrentSurface(EGL_DRAW) == old_surface) {
+                eglMakeCurrent(eglDisplay, surface, surface, eglGetCurrentContext());
+            }
+            eglDestroySurface(eglDisplay, old_surface);
+            return;
+        }
+
         // We need to ensure that pending events are processed here, and XSync
         // with discard = True guarantees that, but it appears the limited
         // event processing we do so far is sufficient
@@ -189,6 +236,11 @@ public:
             return;
         }
 
+        if (headless) {
+            Drawable::show();
+            return;
+        }
+
         eglWaitClient();
 
         XMapWindow(display, window);
@@ -235,37 +287,69 @@ load(const char *filename)
     }
 }
 
+/**
+ * Get an EGL display which doesn't need any window system, preferably
+ * through Mesa's surfaceless platform.
+ */
+static EGLDisplay
+getHeadlessDisplay(void)
+{
+    const char *extensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+    if (extensions &&
+        checkExtension("EGL_EXT_platform_base", extensions) &&
+        checkExtension("EGL_MESA_platform_surfaceless", extensions)) {
+        PFN_EGLGETPLATFORMDISPLAYEXT pfnGetPlatformDisplayEXT =
+            (PFN_EGLGETPLATFORMDISPLAYEXT)eglGetProcAddress("eglGetPlatformDisplayEXT");
+        if (pfnGetPlatformDisplayEXT) {
+            return pfnGetPlatformDisplayEXT(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+        }
+    }
+
+    return eglGetDisplay(EGL_DEFAULT_DISPLAY);
+}
+
 void
-init(void) {
+init(bool _headless) {
     load("libEGL.so.1");
 
-    display = XOpenDisplay(NULL);
-    if (!display) {
-        std::cerr << "error: unable to open display " << XDisplayName(NULL) << "\n";
-        exit(1);
-    }
+    headless = _headless;
+
+    if (headless) {
+        eglDisplay = getHeadlessDisplay();
+    } else {
+        display = XOpenDisplay(NULL);
+        if (!display) {
+            std::cerr << "error: unable to open display " << XDisplayName(NULL) << "\n";
+            exit(1);
+        }
+
+        screen = DefaultScreen(display);
 
-    screen = DefaultScreen(display);
+        eglDisplay = eglGetDisplay((EGLNativeDisplayType)display);
+    }
 
-    eglDisplay = eglGetDisplay((EGLNativeDisplayType)display);
     if (eglDisplay == EGL_NO_DISPLAY) {
         std::cerr << "error: unable to get EGL display\n";
-        XCloseDisplay(display);
+        cleanup();
         exit(1);
     }
 
     EGLint major, minor;
     if (!eglInitialize(eglDisplay, &major, &minor)) {
         std::cerr << "error: unable to initialize EGL display\n";
-        XCloseDisplay(display);
+        eglDisplay = EGL_NO_DISPLAY;
+        cleanup();
         exit(1);
     }
 }
 
 void
 cleanup(void) {
-    if (display) {
+    if (eglDisplay != EGL_NO_DISPLAY) {
         eglTerminate(eglDisplay);
+        eglDisplay = EGL_NO_DISPLAY;
+    }
+    if (display) {
         XCloseDisplay(display);
         display = NULL;
     }
@@ -321,7 +405,7 @@ createVisual(bool doubleBuffer, Profile profile) {
     for (int i = 0; i < 7; i++) {
         Attributes<EGLint> attribs;
 
-        attribs.add(EGL_SURFACE_TYPE, EGL_WINDOW_BIT);
+        attribs.add(EGL_SURFACE_TYPE, headless ? EGL_PBUFFER_BIT : EGL_WINDOW_BIT);
         attribs.add(EGL_RED_SIZE, 1);
         attribs.add(EGL_GREEN_SIZE, 1);
         attribs.add(EGL_BLUE_SIZE, 1);
@@ -332,7 +416,12 @@ createVisual(bool doubleBuffer, Profile profile) {
         attribs.end(EGL_NONE);
 
         EGLint num_configs, vid;
-        if (eglChooseConfig(eglDisplay, attribs, &visual->config, 1, &num_configs) &&
+        if (headless) {
+            if (eglChooseConfig(eglDisplay, attribs, &visual->config, 1, &num_configs) &&
+                num_configs == 1) {
+                break;
+            }
+        } else if (eglChooseConfig(eglDisplay, attribs, &visual->config, 1, &num_configs) &&
             num_configs == 1 &&
             eglGetConfigAttrib(eglDisplay, visual->config, EGL_NATIVE_VISUAL_ID, &vid)) {
             XVisualInfo templ;
@@ -344,7 +433,7 @@ createVisual(bool doubleBuffer, Profile profile) {
         }
     }
 
-    assert(visual->visinfo);
+    assert(headless || visual->visinfo);
 
     return visual;
 }
@@ -429,6 +518,10 @@ makeCurrent(Drawable *drawable, Context *context)
 
 bool
 processEvents(void) {
+    if (!display) {
+        return true;
+    }
+
     while (XPending(display) > 0) {
         XEvent event;
         XNextEvent(display, &event);
@@ -214,7 +214,12 @@ public:
 };
 
 void
-init(void) {
+init(bool headless) {
+    if (headless) {
+        std::cerr << "error: headless replay is only supported with EGL\n";
+        exit(1);
+    }
+
     display = XOpenDisplay(NULL);
     if (!display) {
         std::cerr << "error: unable to open display " << XDisplayName(NULL) << "\n";
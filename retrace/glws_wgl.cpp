@@ -247,7 +247,12 @@ public:
 
 
 void
-init(void) {
+init(bool headless) {
+    if (headless) {
+        std::cerr << "error: headless replay is only supported with EGL\n";
+        exit(1);
+    }
+
     /*
      * OpenGL library must be loaded by the time we call GDI.
      */
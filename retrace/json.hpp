@@ -31,7 +31,10 @@
 #define _JSON_HPP_
 
 #include <assert.h>
+#include <locale.h>
 #include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
 #include <wchar.h>
 
 #include <iomanip>
@@ -39,8 +42,11 @@
 #include <ostream>
 #include <string>
 
+#include "image.hpp"
+#include "state_writer.hpp"
 
-class JSONWriter
+
+class JSONWriter : public StateWriter
 {
 private:
     std::ostream &os;
@@ -217,14 +223,14 @@ public:
         newline();
     }
 
-    inline void beginObject() {
+    inline void beginObject(void) {
         separator();
         os << "{";
         ++level;
         value = false;
     }
 
-    inline void endObject() {
+    inline void endObject(void) {
         --level;
         if (value)
             newline();
@@ -252,7 +258,7 @@ public:
         space = 0;
     }
 
-    inline void beginArray() {
+    inline void beginArray(void) {
         separator();
         os << "[";
         ++level;
@@ -339,6 +345,30 @@ public:
         }
     }
     
+    inline void writeSInt(signed long long n) {
+        writeNumber(n);
+    }
+
+    inline void writeUInt(unsigned long long n) {
+        writeNumber(n);
+    }
+
+    inline void writeFloat(float n) {
+        writeNumber(n);
+    }
+
+    inline void writeDouble(double n) {
+        writeNumber(n);
+    }
+
+    void writeImage(const void *pixels, unsigned width, unsigned height, unsigned channels) {
+        char *pngBuffer;
+        int pngBufferSize;
+        image::writePixelsToBuffer((unsigned char *)pixels, width, height, channels, true, &pngBuffer, &pngBufferSize);
+        writeBase64(pngBuffer, pngBufferSize);
+        free(pngBuffer);
+    }
+
     inline void writeStringMember(const char *name, const char *s) {
         beginMember(name);
         writeString(s);
@@ -112,7 +112,13 @@ void Retracer::retrace(trace::Call &call) {
     assert(callback);
     assert(callbacks[id] == callback);
 
-    if (retrace::profiling) {
+    if (retrace::profilingGpu && (call.flags & trace::CALL_FLAG_RENDER)) {
+        beginProfile(call);
+        long long startTime = os::getTime();
+        callback(call);
+        long long stopTime = os::getTime();
+        endProfile(call, startTime, stopTime);
+    } else if (retrace::profiling) {
         long long startTime = os::getTime();
         callback(call);
         long long stopTime = os::getTime();
@@ -38,6 +38,9 @@
 #include "trace_parser.hpp"
 
 
+class StateWriter;
+
+
 namespace image {
     class Image;
 }
@@ -147,15 +150,35 @@ extern bool debug;
  */
 extern bool profiling;
 
+/**
+ * Profile the rendering calls and frames on the GPU, besides the CPU.
+ */
+extern bool profilingGpu;
+
 /**
  * State dumping.
  */
 extern bool dumpingState;
 
+/**
+ * Dump state as JSON instead of the binary state format.
+ */
+extern bool dumpStateAsJSON;
+
 
 extern bool doubleBuffer;
 extern bool coreProfile;
 
+/**
+ * Render offscreen, without connecting to the window system.
+ */
+extern bool headless;
+
+/**
+ * Directory where to cache program binaries, or NULL if disabled.
+ */
+extern const char *programCacheDir;
+
 
 std::ostream &warning(trace::Call &call);
 
@@ -212,15 +235,48 @@ addCallbacks(retrace::Retracer &retracer);
 void
 frameComplete(trace::Call &call);
 
+/**
+ * Whether calls of the given signature must be retraced when prewarming,
+ * i.e., whether they set up contexts or build shaders/programs.
+ */
+bool
+isPrewarmCall(const trace::FunctionSig *sig);
+
 image::Image *
 getSnapshot(void);
 
+/**
+ * Create a writer for dumping state in the selected format.
+ */
+StateWriter *
+createStateWriter(std::ostream &os);
+
 bool
 dumpState(std::ostream &os);
 
+/**
+ * Start and finish profiling a rendering call, whose callback took from
+ * cpuStart to cpuEnd.
+ */
+void
+beginProfile(trace::Call &call);
+
+void
+endProfile(trace::Call &call, long long cpuStart, long long cpuEnd);
+
 void
 flushRendering(void);
 
+/**
+ * Destroy the contexts created by the calls retraced so far, along with
+ * their objects, so that the trace can be retraced again from the start.
+ */
+void
+resetContexts(void);
+
+void
+dumpStatistics(std::ostream &os);
+
 void
 waitForInput(void);
 
@@ -24,8 +24,16 @@
  **************************************************************************/
 
 
+#include <math.h>
 #include <string.h>
+
+#include <algorithm>
+#include <fstream>
+#include <functional>
 #include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
 
 #include "os_binary.hpp"
 #include "os_time.hpp"
@@ -33,6 +41,7 @@
 #include "trace_callset.hpp"
 #include "trace_dump.hpp"
 #include "retrace.hpp"
+#include "state_writer.hpp"
 
 
 static bool waitOnFinish = false;
@@ -44,6 +53,24 @@ static trace::CallSet compareFrequency;
 
 static unsigned dumpStateCallNo = ~0;
 
+static trace::CallSet stateDeltaCalls;
+static unsigned stateDeltaCallNo = 0;
+static StateNode *lastDumpedState = NULL;
+
+enum PrewarmMode {
+    PREWARM_NONE = 0,
+    PREWARM_SHADERS,
+    PREWARM_FULL
+};
+
+static PrewarmMode prewarmMode = PREWARM_NONE;
+static bool dumpFrameTimes = false;
+static unsigned worstFrameCount = 5;
+static std::ofstream frameCsv;
+static unsigned loopCount = 1;
+
+static bool serverMode = false;
+
 
 namespace retrace {
 
@@ -54,18 +81,49 @@ trace::Parser parser;
 int verbosity = 0;
 bool debug = true;
 bool profiling = false;
+bool profilingGpu = false;
 bool dumpingState = false;
+bool dumpStateAsJSON = false;
 
 
 bool doubleBuffer = true;
 bool coreProfile = false;
+bool headless = false;
+
+const char *programCacheDir = NULL;
+
+
+StateWriter *
+createStateWriter(std::ostream &os) {
+    StateWriterFactory createWriter;
+    if (dumpStateAsJSON) {
+        createWriter = createJSONStateWriter;
+    } else {
+        createWriter = createBinaryStateWriter;
+    }
+
+    if (!stateDeltaCalls.empty()) {
+        return createDeltaStateWriter(os, createWriter, stateDeltaCallNo, &lastDumpedState);
+    }
+
+    return createWriter(os);
+}
 
 
 static unsigned frameNo = 0;
+static long long lastFrameTime = 0;
+static std::vector<long long> frameTimes;
+// Number of the call which ended each frame
+static std::vector<unsigned> frameEndCalls;
 
 
 void
 frameComplete(trace::Call &call) {
+    long long frameTime = os::getTime();
+    frameTimes.push_back(frameTime - lastFrameTime);
+    frameEndCalls.push_back(call.no);
+    lastFrameTime = frameTime;
+
     ++frameNo;
 }
 
@@ -116,6 +174,310 @@ takeSnapshot(unsigned call_no) {
 }
 
 
+/**
+ * Replay the trace without timing it, so that one-time costs such as
+ * context creation and shader compilation are not accounted in the timed
+ * replay that follows.
+ *
+ * When not replaying the whole trace, calls are merely scanned, and only
+ * the ones that set up contexts or build shaders/programs are parsed and
+ * retraced.
+ *
+ * The contexts created here are destroyed afterwards, so what carries over
+ * to the timed replay are the program binaries stored with --pcache, and
+ * whatever the driver caches on its own.
+ */
+static void
+prewarmLoop(PrewarmMode mode) {
+    retrace::Retracer retracer;
+
+    bool wasProfilingGpu = retrace::profilingGpu;
+    retrace::profilingGpu = false;
+
+    addCallbacks(retracer);
+
+    trace::Call *call;
+
+    if (mode == PREWARM_FULL) {
+        while ((call = retrace::parser.parse_call())) {
+            retracer.retrace(*call);
+            delete call;
+        }
+    } else {
+        while ((call = retrace::parser.scan_call(&isPrewarmCall))) {
+            if (isPrewarmCall(call->sig)) {
+                retracer.retrace(*call);
+            }
+            delete call;
+        }
+    }
+
+    flushRendering();
+
+    // The contexts of the timed replay don't exist yet, so they can't share
+    // objects with ours, which are of no further use
+    resetContexts();
+
+    retrace::profilingGpu = wasProfilingGpu;
+}
+
+
+struct FrameStatistics {
+    long long min;
+    long long max;
+    double avg;
+    double stddev;
+    long long p50;
+    long long p90;
+    long long p95;
+    long long p99;
+};
+
+
+/**
+ * Nearest-rank percentile of the sorted frame times.
+ */
+static long long
+percentile(const std::vector<long long> &sorted, unsigned p) {
+    size_t rank = (sorted.size() * p + 99) / 100;
+    return sorted[rank ? rank - 1 : 0];
+}
+
+
+static void
+getFrameStatistics(const std::vector<long long> &sorted, FrameStatistics &stats) {
+    assert(!sorted.empty());
+
+    double total = 0;
+    for (unsigned i = 0; i < sorted.size(); ++i) {
+        total += sorted[i];
+    }
+    stats.avg = total / sorted.size();
+
+    double variance = 0;
+    for (unsigned i = 0; i < sorted.size(); ++i) {
+        double deviation = sorted[i] - stats.avg;
+        variance += deviation * deviation;
+    }
+    stats.stddev = sqrt(variance / sorted.size());
+
+    stats.min = sorted.front();
+    stats.max = sorted.back();
+    stats.p50 = percentile(sorted, 50);
+    stats.p90 = percentile(sorted, 90);
+    stats.p95 = percentile(sorted, 95);
+    stats.p99 = percentile(sorted, 99);
+}
+
+
+/**
+ * Histogram of the frame times, in power of two buckets of milliseconds.
+ */
+static void
+dumpFrameHistogram(std::ostream &os, const std::vector<long long> &sorted) {
+    double msecs = 1.0e3 / os::timeFrequency;
+
+    std::vector<unsigned> buckets;
+    for (unsigned i = 0; i < sorted.size(); ++i) {
+        unsigned bucket = 0;
+        double ms = sorted[i] * msecs;
+        while (ms >= 1.0) {
+            ms *= 0.5;
+            ++bucket;
+        }
+        if (bucket >= buckets.size()) {
+            buckets.resize(bucket + 1);
+        }
+        ++buckets[bucket];
+    }
+
+    unsigned first = 0;
+    while (!buckets[first]) {
+        ++first;
+    }
+    unsigned maxCount = *std::max_element(buckets.begin(), buckets.end());
+
+    os << "Frame time histogram:\n";
+    for (unsigned bucket = first; bucket < buckets.size(); ++bucket) {
+        char label[32];
+        snprintf(label, sizeof label, "%5u-%-5u ms", bucket ? 1U << (bucket - 1) : 0, 1U << bucket);
+        unsigned width = (buckets[bucket] * 40 + maxCount - 1) / maxCount;
+        os << "  " << label << " " << buckets[bucket] << "\t" << std::string(width, '#') << "\n";
+    }
+}
+
+
+static void
+dumpWorstFrames(std::ostream &os) {
+    unsigned count = std::min<size_t>(worstFrameCount, frameTimes.size());
+    if (!count) {
+        return;
+    }
+
+    std::vector<std::pair<long long, unsigned> > frames;
+    for (unsigned i = 0; i < frameTimes.size(); ++i) {
+        frames.push_back(std::make_pair(frameTimes[i], i));
+    }
+    std::partial_sort(frames.begin(), frames.begin() + count, frames.end(),
+                      std::greater<std::pair<long long, unsigned> >());
+
+    double msecs = 1.0e3 / os::timeFrequency;
+
+    os << "Worst frames:\n";
+    for (unsigned i = 0; i < count; ++i) {
+        unsigned frame = frames[i].second;
+        unsigned firstCall = frame ? frameEndCalls[frame - 1] + 1 : 0;
+        os << "  frame " << frame
+           << " (calls " << firstCall << "-" << frameEndCalls[frame] << ") "
+           << frames[i].first * msecs << " ms\n";
+    }
+}
+
+
+static void
+writeFrameCsv(unsigned run) {
+    double msecs = 1.0e3 / os::timeFrequency;
+
+    for (unsigned i = 0; i < frameTimes.size(); ++i) {
+        unsigned firstCall = i ? frameEndCalls[i - 1] + 1 : 0;
+        frameCsv << run << ","
+                 << i << ","
+                 << firstCall << ","
+                 << frameEndCalls[i] << ","
+                 << frameTimes[i] * msecs << "\n";
+    }
+    frameCsv.flush();
+}
+
+
+static void
+dumpFrameStatistics(std::ostream &os) {
+    if (frameTimes.empty()) {
+        return;
+    }
+
+    std::vector<long long> sorted(frameTimes);
+    std::sort(sorted.begin(), sorted.end());
+
+    FrameStatistics stats;
+    getFrameStatistics(sorted, stats);
+
+    double msecs = 1.0e3 / os::timeFrequency;
+
+    os << "Frame times:"
+          " min " << stats.min * msecs << " ms,"
+          " avg " << stats.avg * msecs << " ms,"
+          " max " << stats.max * msecs << " ms,"
+          " stddev " << stats.stddev * msecs << " ms\n";
+
+    os << "Frame time percentiles:"
+          " 50% " << stats.p50 * msecs << " ms,"
+          " 90% " << stats.p90 * msecs << " ms,"
+          " 95% " << stats.p95 * msecs << " ms,"
+          " 99% " << stats.p99 * msecs << " ms\n";
+
+    // Frames much slower than the typical one are perceived as stutter,
+    // however high the average frame rate is
+    unsigned stutters = sorted.end() - std::upper_bound(sorted.begin(), sorted.end(), 2 * stats.p50);
+    os << "Stutter: " << stutters << " frames over twice the median frame time\n";
+
+    dumpFrameHistogram(os, sorted);
+    dumpWorstFrames(os);
+
+    if (dumpFrameTimes) {
+        for (unsigned i = 0; i < frameTimes.size(); ++i) {
+            os << "frame " << i << " " << frameTimes[i] * msecs << " ms\n";
+        }
+    }
+}
+
+
+struct RunStatistics {
+    unsigned frames;
+    double secs;
+    double avgFrameTime;
+    long long p99FrameTime;
+};
+
+// Runs of the trace being replayed
+static std::vector<RunStatistics> runs;
+
+
+static void
+recordRun(double secs) {
+    RunStatistics run;
+    run.frames = frameNo;
+    run.secs = secs;
+    run.avgFrameTime = 0;
+    run.p99FrameTime = 0;
+
+    if (!frameTimes.empty()) {
+        std::vector<long long> sorted(frameTimes);
+        std::sort(sorted.begin(), sorted.end());
+        FrameStatistics stats;
+        getFrameStatistics(sorted, stats);
+        run.avgFrameTime = stats.avg;
+        run.p99FrameTime = stats.p99;
+    }
+
+    runs.push_back(run);
+}
+
+
+static void
+dumpMeanAndStddev(std::ostream &os, const char *label, const std::vector<double> &values, const char *unit) {
+    double mean = 0;
+    for (unsigned i = 0; i < values.size(); ++i) {
+        mean += values[i];
+    }
+    mean /= values.size();
+
+    double variance = 0;
+    for (unsigned i = 0; i < values.size(); ++i) {
+        variance += (values[i] - mean) * (values[i] - mean);
+    }
+    double stddev = sqrt(variance / values.size());
+
+    os << "  " << label << ": mean " << mean << unit << ", stddev " << stddev << unit;
+    if (mean) {
+        os << " (" << stddev * 100.0 / mean << "%)";
+    }
+    os << "\n";
+}
+
+
+/**
+ * Variance across the runs of the same trace, for telling real differences
+ * from noise.
+ */
+static void
+dumpRunStatistics(std::ostream &os) {
+    if (runs.size() < 2) {
+        return;
+    }
+
+    double msecs = 1.0e3 / os::timeFrequency;
+
+    std::vector<double> fps;
+    std::vector<double> avgFrameTimes;
+    std::vector<double> p99FrameTimes;
+
+    os << "Runs:\n";
+    for (unsigned i = 0; i < runs.size(); ++i) {
+        const RunStatistics &run = runs[i];
+        fps.push_back(run.secs ? run.frames / run.secs : 0);
+        avgFrameTimes.push_back(run.avgFrameTime * msecs);
+        p99FrameTimes.push_back(run.p99FrameTime * msecs);
+        os << "  run " << i << ": " << fps.back() << " fps,"
+              " avg " << avgFrameTimes.back() << " ms,"
+              " 99% " << p99FrameTimes.back() << " ms\n";
+    }
+    dumpMeanAndStddev(os, "fps", fps, "");
+    dumpMeanAndStddev(os, "avg frame time", avgFrameTimes, " ms");
+    dumpMeanAndStddev(os, "99% frame time", p99FrameTimes, " ms");
+}
+
+
 static void
 mainLoop() {
     retrace::Retracer retracer;
@@ -124,8 +486,11 @@ mainLoop() {
 
     long long startTime = 0; 
     frameNo = 0;
+    frameTimes.clear();
+    frameEndCalls.clear();
 
     startTime = os::getTime();
+    lastFrameTime = startTime;
     trace::Call *call;
 
     while ((call = retrace::parser.parse_call())) {
@@ -155,6 +520,11 @@ mainLoop() {
             takeSnapshot(call->no);
         }
 
+        if (stateDeltaCalls.contains(*call)) {
+            stateDeltaCallNo = call->no;
+            dumpState(std::cout);
+        }
+
         if (call->no >= dumpStateCallNo &&
             dumpState(std::cout)) {
             exit(0);
@@ -169,11 +539,18 @@ mainLoop() {
     long long endTime = os::getTime();
     float timeInterval = (endTime - startTime) * (1.0 / os::timeFrequency);
 
-    if ((retrace::verbosity >= -1) || (retrace::profiling)) {
+    if (frameCsv.is_open()) {
+        writeFrameCsv(runs.size());
+    }
+    recordRun(timeInterval);
+
+    if ((retrace::verbosity >= -1) || (retrace::profiling) || (retrace::profilingGpu)) {
         std::cout << 
             "Rendered " << frameNo << " frames"
             " in " <<  timeInterval << " secs,"
             " average of " << (frameNo/timeInterval) << " fps\n";
+        dumpFrameStatistics(std::cout);
+        dumpStatistics(std::cout);
     }
 
     if (waitOnFinish) {
@@ -184,6 +561,106 @@ mainLoop() {
 }
 
 
+static void
+serverReply(const char *status, const std::string &payload = std::string()) {
+    std::cout << status << " " << payload.size() << "\n";
+    std::cout.write(payload.data(), payload.size());
+    std::cout.flush();
+}
+
+
+/**
+ * Serve requests read from stdin, one per line, keeping the replay position
+ * and the contexts between requests, so that clients inspecting successive
+ * calls don't need to replay the trace from the start every time.
+ *
+ * Requests are:
+ *
+ *   advance CALLNO   retrace all calls up to and including CALLNO
+ *   state            dump the state, in the binary APISTATE format, or as
+ *                    JSON when --json is given
+ *   snapshot         take a PNM snapshot of the current drawable
+ *   restart          rewind to the start of the trace
+ *   quit
+ *
+ * Every reply consists of a "ok SIZE" or "error SIZE" line, followed by SIZE
+ * bytes of payload.
+ */
+static void
+serverLoop(const char *filename) {
+    retrace::Retracer retracer;
+
+    addCallbacks(retracer);
+
+    trace::Call *call = retrace::parser.parse_call();
+    long long lastCallNo = -1;
+
+    std::string line;
+    while (std::getline(std::cin, line)) {
+        std::istringstream request(line);
+        std::string command;
+        request >> command;
+
+        if (command == "advance") {
+            unsigned long long callNo;
+            if (!(request >> callNo)) {
+                serverReply("error", "expected call number\n");
+                continue;
+            }
+            if ((long long)callNo < lastCallNo) {
+                serverReply("error", "call already retraced\n");
+                continue;
+            }
+            while (call && call->no <= callNo) {
+                retracer.retrace(*call);
+                lastCallNo = call->no;
+                delete call;
+                call = retrace::parser.parse_call();
+            }
+            serverReply("ok");
+        } else if (command == "state") {
+            std::ostringstream os;
+            if (dumpState(os)) {
+                serverReply("ok", os.str());
+            } else {
+                serverReply("error", "failed to dump state\n");
+            }
+        } else if (command == "snapshot") {
+            image::Image *src = getSnapshot();
+            if (src) {
+                char comment[21];
+                snprintf(comment, sizeof comment, "%lli", lastCallNo);
+                std::ostringstream os;
+                src->writePNM(os, comment);
+                serverReply("ok", os.str());
+                delete src;
+            } else {
+                serverReply("error", "failed to take snapshot\n");
+            }
+        } else if (command == "restart") {
+            delete call;
+            // The contexts and objects will be recreated by the replay
+            resetContexts();
+            retrace::parser.close();
+            if (!retrace::parser.open(filename)) {
+                serverReply("error", "failed to reopen trace\n");
+                return;
+            }
+            call = retrace::parser.parse_call();
+            lastCallNo = -1;
+            serverReply("ok");
+        } else if (command == "quit") {
+            serverReply("ok");
+            break;
+        } else if (!command.empty()) {
+            serverReply("error", "unknown command " + command + "\n");
+        }
+    }
+
+    delete call;
+}
+
+
 } /* namespace retrace */
 
 
@@ -195,15 +672,34 @@ usage(const char *argv0) {
         "\n"
         "  -b           benchmark mode (no error checking or warning messages)\n"
         "  -p           profiling mode (run whole trace, dump profiling info)\n"
+        "  --pgpu       profile draw calls and frames on the GPU (GL only)\n"
         "  -c PREFIX    compare against snapshots\n"
         "  -C CALLSET   calls to compare (default is every frame)\n"
         "  -core        use core profile\n"
         "  -db          use a double buffer visual (default)\n"
         "  -sb          use a single buffer visual\n"
+        "  --headless   render offscreen without a window system (EGL only)\n"
+        "  --pcache DIR cache program binaries in DIR\n"
+        "  --prewarm    build shaders/programs before the timed replay\n"
+        "               (use with --pcache)\n"
+        "  --prewarm-full\n"
+        "               replay the whole trace once before the timed replay\n"
+        "  --frame-times\n"
+        "               print the time of every frame\n"
+        "  --frame-csv FILE\n"
+        "               write the time and calls of every frame to FILE\n"
+        "  --worst-frames N\n"
+        "               report the N slowest frames (default 5)\n"
+        "  --loop K     replay the trace K times, and report the variance\n"
+        "               across runs\n"
+        "  --server     serve replay requests from stdin\n"
         "  -s PREFIX    take snapshots; `-` for PNM stdout output\n"
         "  -S CALLSET   calls to snapshot (default is every frame)\n"
         "  -v           increase output verbosity\n"
         "  -D CALLNO    dump state at specific call no\n"
+        "  --json       dump state as JSON instead of the binary format\n"
+        "  --state-deltas CALLSET\n"
+        "               dump the state changes after every call in CALLSET\n"
         "  -w           waitOnFinish on final frame\n";
 }
 
@@ -233,6 +729,10 @@ int main(int argc, char **argv)
             retrace::debug = false;
             retrace::profiling = true;
             retrace::verbosity = -1;
+        } else if (!strcmp(arg, "--pgpu")) {
+            retrace::debug = false;
+            retrace::profilingGpu = true;
+            retrace::verbosity = -1;
         } else if (!strcmp(arg, "-c")) {
             comparePrefix = argv[++i];
             if (compareFrequency.empty()) {
@@ -247,12 +747,46 @@ int main(int argc, char **argv)
             dumpStateCallNo = atoi(argv[++i]);
             dumpingState = true;
             retrace::verbosity = -2;
+            os::setBinaryMode(stdout);
+        } else if (!strcmp(arg, "--json")) {
+            retrace::dumpStateAsJSON = true;
+        } else if (!strcmp(arg, "--state-deltas")) {
+            stateDeltaCalls = trace::CallSet(argv[++i]);
+            dumpingState = true;
+            retrace::verbosity = -2;
+            os::setBinaryMode(stdout);
         } else if (!strcmp(arg, "-core")) {
             retrace::coreProfile = true;
         } else if (!strcmp(arg, "-db")) {
             retrace::doubleBuffer = true;
         } else if (!strcmp(arg, "-sb")) {
             retrace::doubleBuffer = false;
+        } else if (!strcmp(arg, "--headless")) {
+            retrace::headless = true;
+        } else if (!strcmp(arg, "--pcache")) {
+            retrace::programCacheDir = argv[++i];
+        } else if (!strcmp(arg, "--prewarm")) {
+            prewarmMode = PREWARM_SHADERS;
+        } else if (!strcmp(arg, "--prewarm-full")) {
+            prewarmMode = PREWARM_FULL;
+        } else if (!strcmp(arg, "--frame-times")) {
+            dumpFrameTimes = true;
+        } else if (!strcmp(arg, "--frame-csv")) {
+            const char *filename = argv[++i];
+            frameCsv.open(filename);
+            if (!frameCsv) {
+                std::cerr << "error: failed to open " << filename << "\n";
+                return 1;
+            }
+            frameCsv << "run,frame,first_call,last_call,time_ms\n";
+        } else if (!strcmp(arg, "--worst-frames")) {
+            worstFrameCount = atoi(argv[++i]);
+        } else if (!strcmp(arg, "--loop")) {
+            loopCount = std::max(atoi(argv[++i]), 1);
+        } else if (!strcmp(arg, "--server")) {
+            serverMode = true;
+            retrace::verbosity = -2;
+            os::setBinaryMode(stdout);
         } else if (!strcmp(arg, "--help")) {
             usage(argv[0]);
             return 0;
@@ -281,17 +815,56 @@ int main(int argc, char **argv)
         }
     }
 
+    if (retrace::profiling && retrace::profilingGpu) {
+        // Both profilers write their records to stdout, in different formats
+        std::cerr << "error: -p and --pgpu can't be used together\n";
+        return 1;
+    }
+
     retrace::setUp();
 
     for ( ; i < argc; ++i) {
-        if (!retrace::parser.open(argv[i])) {
-            std::cerr << "error: failed to open " << argv[i] << "\n";
-            return 1;
+        if (prewarmMode != PREWARM_NONE) {
+            if (!retrace::parser.open(argv[i])) {
+                std::cerr << "error: failed to open " << argv[i] << "\n";
+                return 1;
+            }
+
+            retrace::prewarmLoop(prewarmMode);
+
+            retrace::parser.close();
         }
 
-        retrace::mainLoop();
+        retrace::runs.clear();
+
+        for (unsigned run = 0; run < loopCount; ++run) {
+            if (!retrace::parser.open(argv[i])) {
+                std::cerr << "error: failed to open " << argv[i] << "\n";
+                return 1;
+            }
 
-        retrace::parser.close();
+            if (serverMode) {
+                retrace::serverLoop(argv[i]);
+            } else {
+                retrace::mainLoop();
+            }
+
+            retrace::parser.close();
+
+            if (serverMode) {
+                break;
+            }
+
+            if (run + 1 < loopCount) {
+                // Start the next run afresh rather than piling up the
+                // contexts and objects of every run
+                retrace::resetContexts();
+            }
+        }
+
+        if ((retrace::verbosity >= -1) || (retrace::profiling) || (retrace::profilingGpu)) {
+            retrace::dumpRunStatistics(std::cout);
+        }
     }
 
     // XXX: X often hangs on XCloseDisplay
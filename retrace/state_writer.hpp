@@ -0,0 +1,169 @@
+/**************************************************************************
+ *
+ * Copyright 2012 Jose Fonseca
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ **************************************************************************/
+
+/*
+ * Abstract interface for writing state dumps.
+ */
+
+#ifndef _STATE_WRITER_HPP_
+#define _STATE_WRITER_HPP_
+
+
+#include <stddef.h>
+
+#include <ostream>
+#include <string>
+
+
+/**
+ * Sink for the hierarchical state dumps.
+ *
+ * The top level object is opened on construction and closed on destruction,
+ * so callers only need to emit its members.
+ */
+class StateWriter
+{
+public:
+    virtual ~StateWriter() {}
+
+    virtual void beginObject(void) = 0;
+    virtual void endObject(void) = 0;
+
+    virtual void beginMember(const char * name) = 0;
+    virtual void endMember(void) = 0;
+
+    virtual void beginArray(void) = 0;
+    virtual void endArray(void) = 0;
+
+    virtual void writeString(const char *s) = 0;
+    virtual void writeNull(void) = 0;
+    virtual void writeBool(bool b) = 0;
+    virtual void writeSInt(signed long long n) = 0;
+    virtual void writeUInt(unsigned long long n) = 0;
+    virtual void writeFloat(float n) = 0;
+    virtual void writeDouble(double n) = 0;
+
+    /**
+     * Write the 8-bit pixels of an image as the current value.
+     *
+     * Rows are stored bottom up, as returned by glReadPixels.
+     */
+    virtual void writeImage(const void *pixels, unsigned width, unsigned height, unsigned channels) = 0;
+
+    inline void beginMember(const std::string &name) {
+        beginMember(name.c_str());
+    }
+
+    inline void writeString(const std::string &s) {
+        writeString(s.c_str());
+    }
+
+    inline void writeNumber(char n) { writeSInt(n); }
+    inline void writeNumber(signed char n) { writeSInt(n); }
+    inline void writeNumber(unsigned char n) { writeUInt(n); }
+    inline void writeNumber(signed short n) { writeSInt(n); }
+    inline void writeNumber(unsigned short n) { writeUInt(n); }
+    inline void writeNumber(signed int n) { writeSInt(n); }
+    inline void writeNumber(unsigned int n) { writeUInt(n); }
+    inline void writeNumber(signed long n) { writeSInt(n); }
+    inline void writeNumber(unsigned long n) { writeUInt(n); }
+    inline void writeNumber(signed long long n) { writeSInt(n); }
+    inline void writeNumber(unsigned long long n) { writeUInt(n); }
+    inline void writeNumber(float n) { writeFloat(n); }
+    inline void writeNumber(double n) { writeDouble(n); }
+
+    inline void writeStringMember(const char *name, const char *s) {
+        beginMember(name);
+        writeString(s);
+        endMember();
+    }
+
+    inline void writeBoolMember(const char *name, bool b) {
+        beginMember(name);
+        writeBool(b);
+        endMember();
+    }
+
+    template<class T>
+    inline void writeNumberMember(const char *name, T n) {
+        beginMember(name);
+        writeNumber(n);
+        endMember();
+    }
+};
+
+
+/**
+ * Human readable JSON, with images embedded as base64 encoded PNGs.
+ */
+StateWriter *
+createJSONStateWriter(std::ostream &os);
+
+/**
+ * Compact binary state format.
+ *
+ * The stream starts with the "APISTATE" magic and a format version varint,
+ * followed by the top level object.  Every value is prefixed by a one byte
+ * marker:
+ *
+ *   'Z'                                null
+ *   'T', 'F'                           true, false
+ *   'u' varint                         unsigned integer
+ *   's' varint                         negative integer, stored as -n
+ *   'f' float32, 'd' float64           little endian IEEE numbers
+ *   'S' varint bytes                   UTF-8 string
+ *   '[' value* ']'                     array
+ *   '{' (string value)* '}'            object, with 'S' member names
+ *   'P' width height channels encoding size bytes
+ *                                      8-bit pixels, rows bottom up, either
+ *                                      raw (encoding 0) or snappy compressed
+ *                                      (encoding 1)
+ *
+ * Varints are little endian base-128 numbers, like in the trace format.
+ */
+StateWriter *
+createBinaryStateWriter(std::ostream &os);
+
+
+typedef StateWriter *(*StateWriterFactory)(std::ostream &os);
+
+class StateNode;
+
+/**
+ * Writer for incremental state dumps.
+ *
+ * The state is recorded in memory and, once complete, only what changed
+ * since the state in *previous is written to os, through a writer created
+ * with createWriter, and tagged with the "__call__" number.  The recorded
+ * state then replaces *previous, which should initially be NULL.
+ *
+ * See state_writer_delta.cpp for how the differences are encoded.
+ */
+StateWriter *
+createDeltaStateWriter(std::ostream &os, StateWriterFactory createWriter,
+                       unsigned callNo, StateNode **previous);
+
+
+#endif /* _STATE_WRITER_HPP_ */
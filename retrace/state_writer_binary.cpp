@@ -0,0 +1,199 @@
+/**************************************************************************
+ *
+ * Copyright 2012 Jose Fonseca
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+/*
+ * Binary state writer.
+ *
+ * See state_writer.hpp for a description of the format.  Images are stored
+ * as raw pixels, optionally snappy compressed, which is an order of magnitude
+ * faster to produce and consume than base64 encoded PNGs.
+ */
+
+
+#include <assert.h>
+#include <string.h>
+
+#include <snappy.h>
+
+#include "state_writer.hpp"
+
+
+#define BINARY_STATE_VERSION 1
+
+
+enum {
+    PIXELS_RAW = 0,
+    PIXELS_SNAPPY = 1,
+};
+
+
+class BinaryStateWriter : public StateWriter
+{
+private:
+    std::ostream &os;
+
+    inline void
+    _write(const void *buf, size_t size) {
+        os.write((const char *)buf, size);
+    }
+
+    inline void
+    _writeByte(char c) {
+        os.put(c);
+    }
+
+    void
+    _writeVarUInt(unsigned long long value) {
+        char buf[2 * sizeof value];
+        unsigned len;
+
+        len = 0;
+        do {
+            assert(len < sizeof buf);
+            buf[len] = 0x80 | (value & 0x7f);
+            value >>= 7;
+            ++len;
+        } while (value);
+
+        buf[len - 1] &= 0x7f;
+
+        _write(buf, len);
+    }
+
+    inline void
+    _writeBytes(const char *s, size_t len) {
+        _writeVarUInt(len);
+        _write(s, len);
+    }
+
+public:
+    BinaryStateWriter(std::ostream &_os) :
+        os(_os)
+    {
+        _write("APISTATE", 8);
+        _writeVarUInt(BINARY_STATE_VERSION);
+        beginObject();
+    }
+
+    ~BinaryStateWriter() {
+        endObject();
+        os.flush();
+    }
+
+    void beginObject(void) {
+        _writeByte('{');
+    }
+
+    void endObject(void) {
+        _writeByte('}');
+    }
+
+    void beginMember(const char * name) {
+        _writeByte('S');
+        _writeBytes(name, strlen(name));
+    }
+
+    void endMember(void) {
+    }
+
+    void beginArray(void) {
+        _writeByte('[');
+    }
+
+    void endArray(void) {
+        _writeByte(']');
+    }
+
+    void writeString(const char *s) {
+        if (!s) {
+            writeNull();
+            return;
+        }
+
+        _writeByte('S');
+        _writeBytes(s, strlen(s));
+    }
+
+    void writeNull(void) {
+        _writeByte('Z');
+    }
+
+    void writeBool(bool b) {
+        _writeByte(b ? 'T' : 'F');
+    }
+
+    void writeSInt(signed long long n) {
+        if (n < 0) {
+            _writeByte('s');
+            _writeVarUInt(0ULL - (unsigned long long)n);
+        } else {
+            writeUInt(n);
+        }
+    }
+
+    void writeUInt(unsigned long long n) {
+        _writeByte('u');
+        _writeVarUInt(n);
+    }
+
+    void writeFloat(float n) {
+        _writeByte('f');
+        _write(&n, sizeof n);
+    }
+
+    void writeDouble(double n) {
+        _writeByte('d');
+        _write(&n, sizeof n);
+    }
+
+    void writeImage(const void *pixels, unsigned width, unsigned height, unsigned channels) {
+        size_t size = (size_t)width * height * channels;
+
+        _writeByte('P');
+        _writeVarUInt(width);
+        _writeVarUInt(height);
+        _writeVarUInt(channels);
+
+        // Render targets are often mostly flat, so compression pays off, but
+        // fall back to raw pixels when it doesn't
+        std::string compressed;
+        snappy::Compress((const char *)pixels, size, &compressed);
+        if (compressed.size() < size) {
+            _writeVarUInt(PIXELS_SNAPPY);
+            _writeBytes(compressed.data(), compressed.size());
+        } else {
+            _writeVarUInt(PIXELS_RAW);
+            _writeBytes((const char *)pixels, size);
+        }
+    }
+};
+
+
+StateWriter *
+createBinaryStateWriter(std::ostream &os)
+{
+    return new BinaryStateWriter(os);
+}
@@ -0,0 +1,444 @@
+/**************************************************************************
+ *
+ * Copyright 2012 Jose Fonseca
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+/*
+ * Incremental state dumps.
+ *
+ * The state is recorded into an in-memory tree, which is then compared
+ * against the tree of the previous dump, and only the differences are
+ * written out:
+ *
+ * - members that were added or whose value changed are written with their
+ *   new value, except for objects present in both dumps, which are written
+ *   recursively as deltas;
+ *
+ * - members that disappeared are listed in a "__removed__" array of the
+ *   object that contained them;
+ *
+ * - arrays and scalars are always replaced as a whole.
+ *
+ * Image pixels are compared by hash, and are dropped from memory once
+ * written, so that only the previous dump's hashes need to be kept.
+ */
+
+
+#include <assert.h>
+#include <string.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "state_writer.hpp"
+
+
+class StateNode
+{
+public:
+    enum Kind {
+        NODE_NULL,
+        NODE_BOOL,
+        NODE_SINT,
+        NODE_UINT,
+        NODE_FLOAT,
+        NODE_DOUBLE,
+        NODE_STRING,
+        NODE_ARRAY,
+        NODE_OBJECT,
+        NODE_IMAGE,
+    };
+
+    Kind kind;
+
+    union {
+        bool b;
+        signed long long sint;
+        unsigned long long uint;
+        float f;
+        double d;
+    };
+
+    // String value
+    std::string string;
+
+    // Array elements, or object members
+    std::vector<std::string> names;
+    std::vector<StateNode *> children;
+
+    // Image
+    unsigned width;
+    unsigned height;
+    unsigned channels;
+    unsigned long long hash;
+    std::string pixels;
+
+    StateNode(Kind _kind) :
+        kind(_kind),
+        uint(0),
+        width(0),
+        height(0),
+        channels(0),
+        hash(0)
+    {}
+
+    ~StateNode() {
+        for (unsigned i = 0; i < children.size(); ++i) {
+            delete children[i];
+        }
+    }
+};
+
+
+static unsigned long long
+hashBytes(const void *data, size_t size)
+{
+    // FNV-1a
+    const unsigned char *bytes = (const unsigned char *)data;
+    unsigned long long hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+
+static bool
+equalNodes(const StateNode *a, const StateNode *b)
+{
+    if (a->kind != b->kind) {
+        return false;
+    }
+
+    switch (a->kind) {
+    case StateNode::NODE_NULL:
+        return true;
+    case StateNode::NODE_BOOL:
+        return a->b == b->b;
+    case StateNode::NODE_SINT:
+        return a->sint == b->sint;
+    case StateNode::NODE_UINT:
+        return a->uint == b->uint;
+    case StateNode::NODE_FLOAT:
+        return memcmp(&a->f, &b->f, sizeof a->f) == 0;
+    case StateNode::NODE_DOUBLE:
+        return memcmp(&a->d, &b->d, sizeof a->d) == 0;
+    case StateNode::NODE_STRING:
+        return a->string == b->string;
+    case StateNode::NODE_ARRAY:
+    case StateNode::NODE_OBJECT:
+        if (a->names != b->names ||
+            a->children.size() != b->children.size()) {
+            return false;
+        }
+        for (unsigned i = 0; i < a->children.size(); ++i) {
+            if (!equalNodes(a->children[i], b->children[i])) {
+                return false;
+            }
+        }
+        return true;
+    case StateNode::NODE_IMAGE:
+        return a->width == b->width &&
+               a->height == b->height &&
+               a->channels == b->channels &&
+               a->hash == b->hash;
+    }
+
+    assert(0);
+    return false;
+}
+
+
+static void
+writeNode(StateWriter &writer, StateNode *node)
+{
+    switch (node->kind) {
+    case StateNode::NODE_NULL:
+        writer.writeNull();
+        break;
+    case StateNode::NODE_BOOL:
+        writer.writeBool(node->b);
+        break;
+    case StateNode::NODE_SINT:
+        writer.writeSInt(node->sint);
+        break;
+    case StateNode::NODE_UINT:
+        writer.writeUInt(node->uint);
+        break;
+    case StateNode::NODE_FLOAT:
+        writer.writeFloat(node->f);
+        break;
+    case StateNode::NODE_DOUBLE:
+        writer.writeDouble(node->d);
+        break;
+    case StateNode::NODE_STRING:
+        writer.writeString(node->string);
+        break;
+    case StateNode::NODE_ARRAY:
+        writer.beginArray();
+        for (unsigned i = 0; i < node->children.size(); ++i) {
+            writeNode(writer, node->children[i]);
+        }
+        writer.endArray();
+        break;
+    case StateNode::NODE_OBJECT:
+        writer.beginObject();
+        for (unsigned i = 0; i < node->children.size(); ++i) {
+            writer.beginMember(node->names[i]);
+            writeNode(writer, node->children[i]);
+            writer.endMember();
+        }
+        writer.endObject();
+        break;
+    case StateNode::NODE_IMAGE:
+        assert(node->pixels.size() == (size_t)node->width * node->height * node->channels);
+        writer.writeImage(node->pixels.data(), node->width, node->height, node->channels);
+        break;
+    }
+}
+
+
+/**
+ * Write the members of curr which differ from prev.
+ */
+static void
+writeObjectDelta(StateWriter &writer, const StateNode *prev, const StateNode *curr)
+{
+    assert(prev->kind == StateNode::NODE_OBJECT);
+    assert(curr->kind == StateNode::NODE_OBJECT);
+
+    typedef std::map<std::string, const StateNode *> MemberMap;
+    MemberMap prevMembers;
+    for (unsigned i = 0; i < prev->children.size(); ++i) {
+        prevMembers[prev->names[i]] = prev->children[i];
+    }
+
+    for (unsigned i = 0; i < curr->children.size(); ++i) {
+        StateNode *child = curr->children[i];
+        const std::string &name = curr->names[i];
+
+        MemberMap::iterator it = prevMembers.find(name);
+        if (it == prevMembers.end()) {
+            writer.beginMember(name);
+            writeNode(writer, child);
+            writer.endMember();
+            continue;
+        }
+
+        const StateNode *prevChild = it->second;
+        prevMembers.erase(it);
+
+        if (equalNodes(prevChild, child)) {
+            continue;
+        }
+
+        writer.beginMember(name);
+        if (prevChild->kind == StateNode::NODE_OBJECT &&
+            child->kind == StateNode::NODE_OBJECT) {
+            writer.beginObject();
+            writeObjectDelta(writer, prevChild, child);
+            writer.endObject();
+        } else {
+            writeNode(writer, child);
+        }
+        writer.endMember();
+    }
+
+    if (!prevMembers.empty()) {
+        writer.beginMember("__removed__");
+        writer.beginArray();
+        for (unsigned i = 0; i < prev->children.size(); ++i) {
+            if (prevMembers.find(prev->names[i]) != prevMembers.end()) {
+                writer.writeString(prev->names[i]);
+            }
+        }
+        writer.endArray();
+        writer.endMember();
+    }
+}
+
+
+/**
+ * Release the pixels of all images, as only their hashes are needed to
+ * compare against subsequent dumps.
+ */
+static void
+discardPixels(StateNode *node)
+{
+    if (node->kind == StateNode::NODE_IMAGE) {
+        std::string().swap(node->pixels);
+    }
+    for (unsigned i = 0; i < node->children.size(); ++i) {
+        discardPixels(node->children[i]);
+    }
+}
+
+
+class DeltaStateWriter : public StateWriter
+{
+private:
+    std::ostream &os;
+    StateWriterFactory createWriter;
+    unsigned callNo;
+    StateNode **previous;
+
+    StateNode *root;
+    std::vector<StateNode *> stack;
+    std::string memberName;
+
+    void
+    addValue(StateNode *node) {
+        assert(!stack.empty());
+        StateNode *parent = stack.back();
+        if (parent->kind == StateNode::NODE_OBJECT) {
+            parent->names.push_back(memberName);
+        } else {
+            assert(parent->kind == StateNode::NODE_ARRAY);
+        }
+        parent->children.push_back(node);
+    }
+
+public:
+    DeltaStateWriter(std::ostream &_os, StateWriterFactory _createWriter,
+                     unsigned _callNo, StateNode **_previous) :
+        os(_os),
+        createWriter(_createWriter),
+        callNo(_callNo),
+        previous(_previous)
+    {
+        root = new StateNode(StateNode::NODE_OBJECT);
+        stack.push_back(root);
+    }
+
+    ~DeltaStateWriter() {
+        assert(stack.size() == 1);
+
+        StateNode empty(StateNode::NODE_OBJECT);
+        const StateNode *prev = *previous ? *previous : &empty;
+
+        StateWriter *writer = createWriter(os);
+        writer->writeNumberMember("__call__", callNo);
+        writeObjectDelta(*writer, prev, root);
+        delete writer;
+
+        discardPixels(root);
+        delete *previous;
+        *previous = root;
+    }
+
+    void beginObject(void) {
+        StateNode *node = new StateNode(StateNode::NODE_OBJECT);
+        addValue(node);
+        stack.push_back(node);
+    }
+
+    void endObject(void) {
+        assert(stack.back()->kind == StateNode::NODE_OBJECT);
+        stack.pop_back();
+    }
+
+    void beginMember(const char * name) {
+        memberName = name;
+    }
+
+    void endMember(void) {
+    }
+
+    void beginArray(void) {
+        StateNode *node = new StateNode(StateNode::NODE_ARRAY);
+        addValue(node);
+        stack.push_back(node);
+    }
+
+    void endArray(void) {
+        assert(stack.back()->kind == StateNode::NODE_ARRAY);
+        stack.pop_back();
+    }
+
+    void writeString(const char *s) {
+        if (!s) {
+            writeNull();
+            return;
+        }
+
+        StateNode *node = new StateNode(StateNode::NODE_STRING);
+        node->string = s;
+        addValue(node);
+    }
+
+    void writeNull(void) {
+        addValue(new StateNode(StateNode::NODE_NULL));
+    }
+
+    void writeBool(bool b) {
+        StateNode *node = new StateNode(StateNode::NODE_BOOL);
+        node->b = b;
+        addValue(node);
+    }
+
+    void writeSInt(signed long long n) {
+        StateNode *node = new StateNode(StateNode::NODE_SINT);
+        node->sint = n;
+        addValue(node);
+    }
+
+    void writeUInt(unsigned long long n) {
+        StateNode *node = new StateNode(StateNode::NODE_UINT);
+        node->uint = n;
+        addValue(node);
+    }
+
+    void writeFloat(float n) {
+        StateNode *node = new StateNode(StateNode::NODE_FLOAT);
+        node->f = n;
+        addValue(node);
+    }
+
+    void writeDouble(double n) {
+        StateNode *node = new StateNode(StateNode::NODE_DOUBLE);
+        node->d = n;
+        addValue(node);
+    }
+
+    void writeImage(const void *pixels, unsigned width, unsigned height, unsigned channels) {
+        StateNode *node = new StateNode(StateNode::NODE_IMAGE);
+        size_t size = (size_t)width * height * channels;
+        node->width = width;
+        node->height = height;
+        node->channels = channels;
+        node->pixels.assign((const char *)pixels, size);
+        node->hash = hashBytes(pixels, size);
+        addValue(node);
+    }
+};
+
+
+StateWriter *
+createDeltaStateWriter(std::ostream &os, StateWriterFactory createWriter,
+                       unsigned callNo, StateNode **previous)
+{
+    return new DeltaStateWriter(os, createWriter, callNo, previous);
+}
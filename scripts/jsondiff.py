@@ -25,9 +25,11 @@
 ##########################################################################/
 
 
+import copy
 import json
 import optparse
 import re
+import struct
 import sys
 
 
@@ -283,17 +285,174 @@ assert _strip_comments('''// a comment
 "'''
 
 
+class BinaryStateParser:
+    '''Parser for the binary state format emitted by `glretrace -D`.
+
+    See retrace/state_writer.hpp for the format description.'''
+
+    magic = 'APISTATE'
+
+    def __init__(self, data, object_hook = None):
+        self.data = data
+        self.pos = 0
+        self.object_hook = object_hook
+
+    def parse(self):
+        if self.data[self.pos : self.pos + len(self.magic)] != self.magic:
+            raise ValueError('not a binary state dump')
+        self.pos += len(self.magic)
+        version = self.read_uint()
+        if version != 1:
+            raise ValueError('unsupported binary state version %u' % version)
+        return self.parse_value()
+
+    def read_byte(self):
+        c = self.data[self.pos]
+        self.pos += 1
+        return c
+
+    def read_uint(self):
+        value = 0
+        shift = 0
+        while True:
+            c = ord(self.read_byte())
+            value |= (c & 0x7f) << shift
+            shift += 7
+            if not c & 0x80:
+                return value
+
+    def read_bytes(self):
+        size = self.read_uint()
+        data = self.data[self.pos : self.pos + size]
+        self.pos += size
+        return data
+
+    def read_struct(self, fmt):
+        size = struct.calcsize(fmt)
+        value, = struct.unpack(fmt, self.data[self.pos : self.pos + size])
+        self.pos += size
+        return value
+
+    def parse_value(self):
+        marker = self.read_byte()
+        if marker == 'Z':
+            return None
+        elif marker == 'T':
+            return True
+        elif marker == 'F':
+            return False
+        elif marker == 'u':
+            return self.read_uint()
+        elif marker == 's':
+            return -self.read_uint()
+        elif marker == 'f':
+            # Round to the precision JSON dumps use for floats
+            return float('%.7g' % self.read_struct('<f'))
+        elif marker == 'd':
+            return self.read_struct('<d')
+        elif marker == 'S':
+            return self.read_bytes().decode('utf-8')
+        elif marker == '[':
+            array = []
+            while self.data[self.pos] != ']':
+                array.append(self.parse_value())
+            self.pos += 1
+            return array
+        elif marker == '{':
+            obj = {}
+            while self.data[self.pos] != '}':
+                name = self.parse_value()
+                obj[name] = self.parse_value()
+            self.pos += 1
+            if self.object_hook is not None:
+                obj = self.object_hook(obj)
+            return obj
+        elif marker == 'P':
+            width = self.read_uint()
+            height = self.read_uint()
+            channels = self.read_uint()
+            encoding = self.read_uint()
+            # Pixels are kept in their stored encoding, which suffices to
+            # compare them
+            return self.read_bytes()
+        else:
+            raise ValueError('unexpected marker %r at offset %u' % (marker, self.pos - 1))
+
+
 def load(stream, strip_images = True, strip_comments = True):
     if strip_images:
         object_hook = strip_object_hook
     else:
         object_hook = None
+    data = stream.read()
+    if data.startswith(BinaryStateParser.magic):
+        parser = BinaryStateParser(data, object_hook = object_hook)
+        return parser.parse()
     if strip_comments:
-        data = stream.read()
         data = _strip_comments(data)
-        return json.loads(data, strict=False, object_hook = object_hook)
+    return json.loads(data, strict=False, object_hook = object_hook)
+
+
+def strip_state_images(node):
+    '''Apply strip_object_hook to an already loaded state.'''
+    if isinstance(node, dict):
+        for name, value in node.items():
+            node[name] = strip_state_images(value)
+        return strip_object_hook(node)
+    elif isinstance(node, list):
+        return [strip_state_images(value) for value in node]
+    else:
+        return node
+
+
+def merge(state, delta):
+    '''Apply an incremental state dump, as produced by `glretrace
+    --state-deltas`, to the state reconstructed from the previous ones.'''
+
+    for name in delta.get('__removed__', []):
+        state.pop(name, None)
+    for name, value in delta.iteritems():
+        if name == '__removed__':
+            continue
+        if isinstance(value, dict) and isinstance(state.get(name), dict):
+            merge(state[name], value)
+        else:
+            state[name] = value
+    return state
+
+
+def load_deltas(stream, strip_images = True):
+    '''Read a sequence of incremental state dumps, and generate the full
+    state after every call, as (call_no, state) tuples.
+
+    The same state object is updated in place between iterations.'''
+
+    data = stream.read()
+    if data.startswith(BinaryStateParser.magic):
+        parser = BinaryStateParser(data)
+        def documents():
+            while parser.pos < len(data):
+                yield parser.parse()
     else:
-        return json.load(stream, strict=False, object_hook = object_hook)
+        decoder = json.JSONDecoder(strict=False)
+        def documents():
+            pos = 0
+            while True:
+                while pos < len(data) and data[pos].isspace():
+                    pos += 1
+                if pos >= len(data):
+                    break
+                document, pos = decoder.raw_decode(data, pos)
+                yield document
+
+    state = {}
+    for delta in documents():
+        call_no = delta.pop('__call__')
+        merge(state, delta)
+        if strip_images:
+            yield call_no, strip_state_images(copy.deepcopy(state))
+        else:
+            yield call_no, state
 
 
 def main():
@@ -309,8 +468,8 @@ def main():
     if len(args) != 2:
         optparser.error('incorrect number of arguments')
 
-    a = load(open(sys.argv[1], 'rt'), options.strip_images)
-    b = load(open(sys.argv[2], 'rt'), options.strip_images)
+    a = load(open(args[0], 'rb'), options.strip_images)
+    b = load(open(args[1], 'rb'), options.strip_images)
 
     if False:
         dumper = Dumper()
@@ -51,6 +51,8 @@ if __name__ == '__main__':
     print '#define GL_GLEXT_PROTOTYPES'
     print
     print '#include "glproc.hpp"'
+    print '// The element array binding and index ranges are tracked by gltrace'
+    print '#define _GL_SIZE_ELEMENT_ARRAY_HOOKS'
     print '#include "glsize.hpp"'
     print
 
@@ -27,6 +27,8 @@
 #define _GLTRACE_HPP_
 
 
+#include <stdint.h>
+
 #include "glimports.hpp"
 
 
@@ -39,16 +41,70 @@ enum Profile {
     PROFILE_ES2,
 };
 
+struct SharedState;
+
 struct Context {
     enum Profile profile;
     bool user_arrays;
     bool user_arrays_arb;
     bool user_arrays_nv;
+
+    // State shared with the other contexts of the same share group
+    SharedState *shared;
+    unsigned refs;
 };
     
+/**
+ * The context current in this thread.
+ */
 Context *
 getContext(void);
 
+/*
+ * Keep track of the contexts and of their share groups.  Contexts are
+ * identified by their window system handle.
+ */
+
+void
+createContext(uintptr_t context_id, uintptr_t shared_context_id);
+
+void
+shareContext(uintptr_t context_id, uintptr_t shared_context_id);
+
+void
+destroyContext(uintptr_t context_id);
+
+void
+setContext(uintptr_t context_id);
+
+void
+clearContext(void);
+
+/*
+ * Cache of the maximum index of the index ranges read from element array
+ * buffers, kept per share group as buffer names are not unique across share
+ * groups.  Whoever sees the buffer contents change must invalidate it.
+ */
+
+bool
+lookupMaxIndex(GLuint buffer, GLintptr offset, GLsizei count, GLenum type, GLuint *maxindex);
+
+void
+storeMaxIndex(GLuint buffer, GLintptr offset, GLsizei count, GLenum type, GLuint maxindex);
+
+void
+invalidateMaxIndices(GLuint buffer);
+
+void
+clearMaxIndices(void);
+
+/**
+ * Buffers mapped persistently can change at any time, so their indices are
+ * not cached while mapped.
+ */
+void
+setBufferPersistentlyMapped(GLuint buffer, bool mapped);
+
 const GLubyte *
 _glGetString_override(GLenum name);
 
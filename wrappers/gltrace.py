@@ -108,9 +108,14 @@ class GlTracer(Tracer):
     # arrays available in PROFILE_ES1
     arrays_es1 = ("Vertex", "Normal", "Color", "TexCoord")
 
+    def fixedArrays(self):
+        '''Conventional arrays other than the per-unit texture coordinates.'''
+        return [array for array in self.arrays if array[1] != 'TEXTURE_COORD']
+
     def header(self, api):
         Tracer.header(self, api)
 
+        print '#include "os_thread.hpp"'
         print '#include "gltrace.hpp"'
         print
         
@@ -121,14 +126,6 @@ class GlTracer(Tracer):
         print '    VERTEX_ATTRIB_NV,'
         print '};'
         print
-        print 'gltrace::Context *'
-        print 'gltrace::getContext(void)'
-        print '{'
-        print '    // TODO return the context set by other APIs (GLX, EGL, and etc.)'
-        print '    static gltrace::Context _ctx = { gltrace::PROFILE_COMPAT, false, false, false };'
-        print '    return &_ctx;'
-        print '}'
-        print
         print 'static vertex_attrib _get_vertex_attrib(void) {'
         print '    gltrace::Context *ctx = gltrace::getContext();'
         print '    if (ctx->user_arrays_arb || ctx->user_arrays_nv) {'
@@ -149,6 +146,378 @@ class GlTracer(Tracer):
         print '}'
         print
 
+        print 'static void _trace_user_arrays(GLuint count);'
+        print
+
+        # Buffer mappings
+        print '// whether glMapBufferRange(GL_MAP_WRITE_BIT) has ever been called'
+        print 'static bool _checkBufferMapRange = false;'
+        print
+        print '// whether glBufferParameteriAPPLE(GL_BUFFER_FLUSHING_UNMAP_APPLE, GL_FALSE) has ever been called'
+        print 'static bool _checkBufferFlushingUnmapAPPLE = false;'
+        print
+        # Buffer mapping information, necessary for old Mesa 2.1 drivers which
+        # do not support glGetBufferParameteriv(GL_BUFFER_ACCESS_FLAGS/GL_BUFFER_MAP_LENGTH)
+        print 'struct buffer_mapping {'
+        print '    void *map;'
+        print '    GLint length;'
+        print '    bool write;'
+        print '    bool explicit_flush;'
+        print '    GLint buffer;'
+        print '};'
+        print
+
+        # Shadow of the buffer state, maintained from the intercepted calls, so
+        # that we don't need to query the driver, as glGet* calls force
+        # multithreaded drivers to synchronize.  It is kept per thread, that
+        # is, for the current context, and is forgotten whenever contexts are
+        # made current.  Negative bindings denote unknown state, which must be
+        # queried instead.
+        print 'struct buffer_shadow {'
+        print '    GLint binding;'
+        print '    struct buffer_mapping mapping;'
+        print '};'
+        print
+        print 'struct array_shadow {'
+        print '    GLint enabled;'
+        print '    GLint binding;'
+        print '    bool params; // whether the pointer parameters below are known'
+        print '    GLint size;'
+        print '    GLint type;'
+        print '    GLint normalized;'
+        print '    GLint stride;'
+        print '    const GLvoid *pointer;'
+        print
+        print '    void invalidate(void) {'
+        print '        enabled = -1;'
+        print '        binding = -1;'
+        print '        params = false;'
+        print '    }'
+        print '};'
+        print
+        print 'struct shadow_state {'
+        print '    struct buffer_shadow buffers[%u];' % len(self.buffer_targets)
+        print '    struct array_shadow arrays[%u];' % len(self.fixedArrays())
+        print '    struct array_shadow texcoords[32];'
+        print '    struct array_shadow attribs[32];'
+        print '    GLint client_active_texture;'
+        print '    GLint max_texture_coords;'
+        print '    GLint max_vertex_attribs;'
+        print
+        print '    shadow_state() {'
+        print '        invalidate();'
+        print '    }'
+        print
+        print '    void invalidate(void) {'
+        print '        for (unsigned i = 0; i < sizeof buffers / sizeof buffers[0]; ++i) {'
+        print '            buffers[i].binding = -1;'
+        print '            buffers[i].mapping.map = NULL;'
+        print '            buffers[i].mapping.buffer = -1;'
+        print '        }'
+        print '        client_active_texture = -1;'
+        print '        max_texture_coords = -1;'
+        print '        max_vertex_attribs = -1;'
+        print '        invalidate_arrays();'
+        print '    }'
+        print
+        print '    // Forget the vertex array state, e.g., when binding another vertex array object'
+        print '    void invalidate_arrays(void) {'
+        print '        for (unsigned i = 0; i < sizeof arrays / sizeof arrays[0]; ++i) {'
+        print '            arrays[i].invalidate();'
+        print '        }'
+        print '        for (unsigned i = 0; i < sizeof texcoords / sizeof texcoords[0]; ++i) {'
+        print '            texcoords[i].invalidate();'
+        print '        }'
+        print '        for (unsigned i = 0; i < sizeof attribs / sizeof attribs[0]; ++i) {'
+        print '            attribs[i].invalidate();'
+        print '        }'
+        print '    }'
+        print '};'
+        print
+        print 'static os::thread_specific_ptr<struct shadow_state> _shadow_state_ptr;'
+        print
+        print 'static inline struct shadow_state *'
+        print 'get_shadow_state(void) {'
+        print '    struct shadow_state *state = _shadow_state_ptr.get();'
+        print '    if (!state) {'
+        print '        state = new struct shadow_state;'
+        print '        _shadow_state_ptr.reset(state);'
+        print '    }'
+        print '    return state;'
+        print '}'
+        print
+        print 'static inline struct buffer_shadow *'
+        print 'get_buffer_shadow(GLenum target) {'
+        print '    unsigned index;'
+        print '    switch (target) {'
+        for index, target in enumerate(self.buffer_targets):
+            print '    case GL_%s:' % target
+            print '        index = %u;' % index
+            print '        break;'
+        print '    default:'
+        print '        return NULL;'
+        print '    }'
+        print '    return &get_shadow_state()->buffers[index];'
+        print '}'
+        print
+        print 'static inline struct buffer_mapping *'
+        print 'get_buffer_mapping(GLenum target) {'
+        print '    struct buffer_shadow *shadow = get_buffer_shadow(target);'
+        print '    if (!shadow) {'
+        print '        os::log("apitrace: warning: unknown buffer target 0x%04X\\n", target);'
+        print '        return NULL;'
+        print '    }'
+        print '    return &shadow->mapping;'
+        print '}'
+        print
+        print '// Get the buffer bound to target, querying the driver only when unknown'
+        print 'static inline GLint'
+        print 'get_buffer_binding(GLenum target, GLenum binding_pname) {'
+        print '    struct buffer_shadow *shadow = get_buffer_shadow(target);'
+        print '    if (shadow && shadow->binding >= 0) {'
+        print '        return shadow->binding;'
+        print '    }'
+        print '    GLint binding = 0;'
+        print '    _glGetIntegerv(binding_pname, &binding);'
+        print '    if (shadow) {'
+        print '        shadow->binding = binding;'
+        print '    }'
+        print '    return binding;'
+        print '}'
+        print
+        print '// Get the buffer bound to target, querying the driver when unknown and'
+        print '// possible, or -1'
+        print 'static inline GLint'
+        print 'get_bound_buffer(GLenum target) {'
+        print '    switch (target) {'
+        for target in self.buffer_targets:
+            if target in self.queryable_buffer_targets:
+                print '    case GL_%s:' % target
+                print '        return get_buffer_binding(GL_%s, GL_%s_BINDING);' % (target, target)
+        print '    default:'
+        print '        struct buffer_shadow *shadow = get_buffer_shadow(target);'
+        print '        return shadow ? shadow->binding : -1;'
+        print '    }'
+        print '}'
+        print
+        print '// Get the mapping of the buffer bound to target, if known'
+        print 'static inline struct buffer_mapping *'
+        print 'get_bound_buffer_mapping(GLenum target) {'
+        print '    struct buffer_shadow *shadow = get_buffer_shadow(target);'
+        print '    if (shadow &&'
+        print '        shadow->binding > 0 &&'
+        print '        shadow->mapping.map &&'
+        print '        shadow->mapping.buffer == shadow->binding) {'
+        print '        return &shadow->mapping;'
+        print '    }'
+        print '    return NULL;'
+        print '}'
+        print
+        print 'static inline void'
+        print 'update_buffer_binding(GLenum target, GLuint buffer) {'
+        print '    struct buffer_shadow *shadow = get_buffer_shadow(target);'
+        print '    if (shadow) {'
+        print '        shadow->binding = buffer;'
+        print '    }'
+        print '}'
+        print
+        print '// Forget the cached index ranges of the buffer bound to target'
+        print 'static inline void'
+        print 'invalidate_buffer_indices(GLenum target) {'
+        print '    struct buffer_shadow *shadow = get_buffer_shadow(target);'
+        print '    if (shadow && shadow->binding >= 0) {'
+        print '        gltrace::invalidateMaxIndices(shadow->binding);'
+        print '    } else {'
+        print '        gltrace::clearMaxIndices();'
+        print '    }'
+        print '}'
+        print
+
+        print '// Note whether the buffer bound to target is persistently mapped'
+        print 'static inline void'
+        print 'set_buffer_persistently_mapped(GLenum target, bool mapped) {'
+        print '    GLint buffer = get_bound_buffer(target);'
+        print '    if (buffer >= 0) {'
+        print '        gltrace::setBufferPersistentlyMapped(buffer, mapped);'
+        print '    } else {'
+        print '        gltrace::clearMaxIndices();'
+        print '    }'
+        print '}'
+        print
+
+        # Hooks for _glDrawElementsBaseVertex_count
+        print 'static inline GLint'
+        print '_gl_element_array_buffer_binding(void) {'
+        print '    return get_buffer_binding(GL_ELEMENT_ARRAY_BUFFER, GL_ELEMENT_ARRAY_BUFFER_BINDING);'
+        print '}'
+        print
+        print 'static inline GLuint'
+        print '_gl_element_array_buffer_max_index(GLint buffer, GLsizei count, GLenum type, GLintptr offset) {'
+        print '    GLuint maxindex;'
+        print '    if (!gltrace::lookupMaxIndex(buffer, offset, count, type, &maxindex)) {'
+        print '        maxindex = _gl_element_array_max_index(count, type, offset);'
+        print '        gltrace::storeMaxIndex(buffer, offset, count, type, maxindex);'
+        print '    }'
+        print '    return maxindex;'
+        print '}'
+        print
+        print 'static inline void'
+        print 'delete_buffer_shadows(GLsizei n, const GLuint *buffers) {'
+        print '    struct shadow_state *state = get_shadow_state();'
+        print '    for (GLsizei i = 0; i < n; ++i) {'
+        print '        GLint buffer = buffers[i];'
+        print '        for (unsigned j = 0; j < sizeof state->buffers / sizeof state->buffers[0]; ++j) {'
+        print '            struct buffer_shadow *shadow = &state->buffers[j];'
+        print '            if (shadow->binding == buffer) {'
+        print '                shadow->binding = 0;'
+        print '            }'
+        print '            if (shadow->mapping.buffer == buffer) {'
+        print '                shadow->mapping.map = NULL;'
+        print '                shadow->mapping.buffer = -1;'
+        print '            }'
+        print '        }'
+        print '        // Arrays sourced from the deleted buffer revert to binding zero'
+        print '        struct array_shadow *arrays[] = { state->arrays, state->texcoords, state->attribs };'
+        print '        unsigned counts[] = {'
+        print '            sizeof state->arrays / sizeof state->arrays[0],'
+        print '            sizeof state->texcoords / sizeof state->texcoords[0],'
+        print '            sizeof state->attribs / sizeof state->attribs[0],'
+        print '        };'
+        print '        for (unsigned j = 0; j < sizeof arrays / sizeof arrays[0]; ++j) {'
+        print '            for (unsigned k = 0; k < counts[j]; ++k) {'
+        print '                if (arrays[j][k].binding == buffer) {'
+        print '                    arrays[j][k].binding = 0;'
+        print '                }'
+        print '            }'
+        print '        }'
+        print '    }'
+        print '}'
+        print
+
+        # Vertex array shadows
+        print 'static inline GLint'
+        print 'get_client_active_texture(void) {'
+        print '    struct shadow_state *state = get_shadow_state();'
+        print '    if (state->client_active_texture < 0) {'
+        print '        GLint texture = GL_TEXTURE0;'
+        print '        _glGetIntegerv(GL_CLIENT_ACTIVE_TEXTURE, &texture);'
+        print '        state->client_active_texture = texture;'
+        print '    }'
+        print '    return state->client_active_texture;'
+        print '}'
+        print
+        print 'static inline GLint'
+        print 'get_max_texture_coords(gltrace::Profile profile) {'
+        print '    struct shadow_state *state = get_shadow_state();'
+        print '    if (state->max_texture_coords < 0) {'
+        print '        GLint max_texture_coords = 0;'
+        print '        if (profile == gltrace::PROFILE_COMPAT)'
+        print '            _glGetIntegerv(GL_MAX_TEXTURE_COORDS, &max_texture_coords);'
+        print '        else'
+        print '            _glGetIntegerv(GL_MAX_TEXTURE_UNITS, &max_texture_coords);'
+        print '        state->max_texture_coords = max_texture_coords;'
+        print '    }'
+        print '    return state->max_texture_coords;'
+        print '}'
+        print
+        print 'static inline GLint'
+        print 'get_max_vertex_attribs(void) {'
+        print '    struct shadow_state *state = get_shadow_state();'
+        print '    if (state->max_vertex_attribs < 0) {'
+        print '        GLint max_vertex_attribs = 0;'
+        print '        _glGetIntegerv(GL_MAX_VERTEX_ATTRIBS, &max_vertex_attribs);'
+        print '        state->max_vertex_attribs = max_vertex_attribs;'
+        print '    }'
+        print '    return state->max_vertex_attribs;'
+        print '}'
+        print
+        print '// Shadow of the texture coordinate array of the given unit, if any'
+        print 'static inline struct array_shadow *'
+        print 'get_texcoord_shadow(GLint unit) {'
+        print '    struct shadow_state *state = get_shadow_state();'
+        print '    if (unit < 0 || unit >= (GLint)(sizeof state->texcoords / sizeof state->texcoords[0])) {'
+        print '        return NULL;'
+        print '    }'
+        print '    return &state->texcoords[unit];'
+        print '}'
+        print
+        print '// Shadow of a conventional array, for the client active texture unit'
+        print 'static inline struct array_shadow *'
+        print 'get_array_shadow(GLenum array) {'
+        print '    switch (array) {'
+        for index, (camelcase_name, uppercase_name) in enumerate(self.fixedArrays()):
+            print '    case GL_%s_ARRAY:' % uppercase_name
+            print '        return &get_shadow_state()->arrays[%u];' % index
+        print '    case GL_TEXTURE_COORD_ARRAY:'
+        print '        return get_texcoord_shadow(get_client_active_texture() - GL_TEXTURE0);'
+        print '    default:'
+        print '        return NULL;'
+        print '    }'
+        print '}'
+        print
+        print '// Shadow of a generic vertex attribute array, if any'
+        print 'static inline struct array_shadow *'
+        print 'get_attrib_shadow(GLuint index) {'
+        print '    struct shadow_state *state = get_shadow_state();'
+        print '    if (index >= sizeof state->attribs / sizeof state->attribs[0]) {'
+        print '        return NULL;'
+        print '    }'
+        print '    return &state->attribs[index];'
+        print '}'
+        print
+        print '// Whether a conventional array is enabled and sourced from user memory,'
+        print '// querying the driver only for the state not shadowed yet'
+        print 'static inline bool'
+        print 'is_user_array(struct array_shadow *shadow, GLenum array, GLenum binding_pname) {'
+        print '    struct array_shadow unknown;'
+        print '    if (!shadow) {'
+        print '        unknown.invalidate();'
+        print '        shadow = &unknown;'
+        print '    }'
+        print '    if (shadow->enabled < 0) {'
+        print '        shadow->enabled = _glIsEnabled(array);'
+        print '    }'
+        print '    if (!shadow->enabled) {'
+        print '        return false;'
+        print '    }'
+        print '    if (shadow->binding < 0) {'
+        print '        GLint binding = 0;'
+        print '        _glGetIntegerv(binding_pname, &binding);'
+        print '        shadow->binding = binding;'
+        print '    }'
+        print '    return shadow->binding == 0;'
+        print '}'
+        print
+        for suffix in ['', 'ARB']:
+            if suffix:
+                SUFFIX = '_' + suffix
+            else:
+                SUFFIX = suffix
+            print '// Same as above, for glVertexAttribPointer%s' % suffix
+            print 'static inline bool'
+            print 'is_user_attrib%s(struct array_shadow *shadow, GLuint index) {' % suffix
+            print '    struct array_shadow unknown;'
+            print '    if (!shadow) {'
+            print '        unknown.invalidate();'
+            print '        shadow = &unknown;'
+            print '    }'
+            print '    if (shadow->enabled < 0) {'
+            print '        GLint enabled = 0;'
+            print '        _glGetVertexAttribiv%s(index, GL_VERTEX_ATTRIB_ARRAY_ENABLED%s, &enabled);' % (suffix, SUFFIX)
+            print '        shadow->enabled = enabled;'
+            print '    }'
+            print '    if (!shadow->enabled) {'
+            print '        return false;'
+            print '    }'
+            print '    if (shadow->binding < 0) {'
+            print '        GLint binding = 0;'
+            print '        _glGetVertexAttribiv%s(index, GL_VERTEX_ATTRIB_ARRAY_BUFFER_BINDING%s, &binding);' % (suffix, SUFFIX)
+            print '        shadow->binding = binding;'
+            print '    }'
+            print '    return shadow->binding == 0;'
+            print '}'
+            print
+
         # Whether we need user arrays
         print 'static inline bool _need_user_arrays(void)'
         print '{'
@@ -157,7 +526,10 @@ class GlTracer(Tracer):
         print '        return false;'
         print '    }'
         print
+        print '    struct shadow_state *_state = get_shadow_state();'
+        print
 
+        fixed_arrays = self.fixedArrays()
         for camelcase_name, uppercase_name in self.arrays:
             # in which profile is the array available?
             profile_check = 'ctx->profile == gltrace::PROFILE_COMPAT'
@@ -169,16 +541,33 @@ class GlTracer(Tracer):
             binding_name = 'GL_%s_ARRAY_BUFFER_BINDING' % uppercase_name
             print '    // %s' % function_name
             print '  if (%s) {' % profile_check
-            self.array_prolog(api, uppercase_name)
-            print '    if (_glIsEnabled(%s)) {' % enable_name
-            print '        GLint _binding = 0;'
-            print '        _glGetIntegerv(%s, &_binding);' % binding_name
-            print '        if (!_binding) {'
-            self.array_cleanup(api, uppercase_name)
-            print '            return true;'
-            print '        }'
-            print '    }'
-            self.array_epilog(api, uppercase_name)
+            if uppercase_name == 'TEXTURE_COORD':
+                print '    GLint client_active_texture = get_client_active_texture();'
+                print '    GLint texture = client_active_texture;'
+                print '    GLint max_texture_coords = get_max_texture_coords(ctx->profile);'
+                print '    bool user_texcoords = false;'
+                print '    for (GLint unit = 0; unit < max_texture_coords && !user_texcoords; ++unit) {'
+                print '        struct array_shadow *shadow = get_texcoord_shadow(unit);'
+                print '        if (!shadow || shadow->enabled < 0 || (shadow->enabled && shadow->binding < 0)) {'
+                print '            // unknown state can only be queried for the client active texture'
+                print '            if (texture != (GLint)(GL_TEXTURE0 + unit)) {'
+                print '                texture = GL_TEXTURE0 + unit;'
+                print '                _glClientActiveTexture(texture);'
+                print '            }'
+                print '        }'
+                print '        user_texcoords = is_user_array(shadow, %s, %s);' % (enable_name, binding_name)
+                print '    }'
+                print '    if (texture != client_active_texture) {'
+                print '        _glClientActiveTexture(client_active_texture);'
+                print '    }'
+                print '    if (user_texcoords) {'
+                print '        return true;'
+                print '    }'
+            else:
+                index = fixed_arrays.index((camelcase_name, uppercase_name))
+                print '    if (is_user_array(&_state->arrays[%u], %s, %s)) {' % (index, enable_name, binding_name)
+                print '        return true;'
+                print '    }'
             print '  }'
             print
 
@@ -188,40 +577,21 @@ class GlTracer(Tracer):
         print
         print '    vertex_attrib _vertex_attrib = _get_vertex_attrib();'
         print
-        print '    // glVertexAttribPointer'
-        print '    if (_vertex_attrib == VERTEX_ATTRIB) {'
-        print '        GLint _max_vertex_attribs = 0;'
-        print '        _glGetIntegerv(GL_MAX_VERTEX_ATTRIBS, &_max_vertex_attribs);'
-        print '        for (GLint index = 0; index < _max_vertex_attribs; ++index) {'
-        print '            GLint _enabled = 0;'
-        print '            _glGetVertexAttribiv(index, GL_VERTEX_ATTRIB_ARRAY_ENABLED, &_enabled);'
-        print '            if (_enabled) {'
-        print '                GLint _binding = 0;'
-        print '                _glGetVertexAttribiv(index, GL_VERTEX_ATTRIB_ARRAY_BUFFER_BINDING, &_binding);'
-        print '                if (!_binding) {'
-        print '                    return true;'
-        print '                }'
-        print '            }'
-        print '        }'
-        print '    }'
-        print
-        print '    // glVertexAttribPointerARB'
-        print '    if (_vertex_attrib == VERTEX_ATTRIB_ARB) {'
-        print '        GLint _max_vertex_attribs = 0;'
-        print '        _glGetIntegerv(GL_MAX_VERTEX_ATTRIBS_ARB, &_max_vertex_attribs);'
-        print '        for (GLint index = 0; index < _max_vertex_attribs; ++index) {'
-        print '            GLint _enabled = 0;'
-        print '            _glGetVertexAttribivARB(index, GL_VERTEX_ATTRIB_ARRAY_ENABLED_ARB, &_enabled);'
-        print '            if (_enabled) {'
-        print '                GLint _binding = 0;'
-        print '                _glGetVertexAttribivARB(index, GL_VERTEX_ATTRIB_ARRAY_BUFFER_BINDING_ARB, &_binding);'
-        print '                if (!_binding) {'
-        print '                    return true;'
-        print '                }'
-        print '            }'
-        print '        }'
-        print '    }'
-        print
+        for suffix in ['', 'ARB']:
+            if suffix:
+                SUFFIX = '_' + suffix
+            else:
+                SUFFIX = suffix
+            print '    // glVertexAttribPointer%s' % suffix
+            print '    if (_vertex_attrib == VERTEX_ATTRIB%s) {' % SUFFIX
+            print '        GLint _max_vertex_attribs = get_max_vertex_attribs();'
+            print '        for (GLint index = 0; index < _max_vertex_attribs; ++index) {'
+            print '            if (is_user_attrib%s(get_attrib_shadow(index), index)) {' % suffix
+            print '                return true;'
+            print '            }'
+            print '        }'
+            print '    }'
+            print
         print '    // glVertexAttribPointerNV'
         print '    if (_vertex_attrib == VERTEX_ATTRIB_NV) {'
         print '        for (GLint index = 0; index < 16; ++index) {'
@@ -238,41 +608,6 @@ class GlTracer(Tracer):
         print '}'
         print
 
-        print 'static void _trace_user_arrays(GLuint count);'
-        print
-
-        # Buffer mappings
-        print '// whether glMapBufferRange(GL_MAP_WRITE_BIT) has ever been called'
-        print 'static bool _checkBufferMapRange = false;'
-        print
-        print '// whether glBufferParameteriAPPLE(GL_BUFFER_FLUSHING_UNMAP_APPLE, GL_FALSE) has ever been called'
-        print 'static bool _checkBufferFlushingUnmapAPPLE = false;'
-        print
-        # Buffer mapping information, necessary for old Mesa 2.1 drivers which
-        # do not support glGetBufferParameteriv(GL_BUFFER_ACCESS_FLAGS/GL_BUFFER_MAP_LENGTH)
-        print 'struct buffer_mapping {'
-        print '    void *map;'
-        print '    GLint length;'
-        print '    bool write;'
-        print '    bool explicit_flush;'
-        print '};'
-        print
-        for target in self.buffer_targets:
-            print 'struct buffer_mapping _%s_mapping;' % target.lower();
-        print
-        print 'static inline struct buffer_mapping *'
-        print 'get_buffer_mapping(GLenum target) {'
-        print '    switch (target) {'
-        for target in self.buffer_targets:
-            print '    case GL_%s:' % target
-            print '        return & _%s_mapping;' % target.lower()
-        print '    default:'
-        print '        os::log("apitrace: warning: unknown buffer target 0x%04X\\n", target);'
-        print '        return NULL;'
-        print '    }'
-        print '}'
-        print
-
         # Generate a helper function to determine whether a parameter name
         # refers to a symbolic value or not
         print 'static bool'
@@ -439,8 +774,7 @@ class GlTracer(Tracer):
     def traceFunctionImplBody(self, function):
         # Defer tracing of user array pointers...
         if function.name in self.array_pointer_function_names:
-            print '    GLint _array_buffer = 0;'
-            print '    _glGetIntegerv(GL_ARRAY_BUFFER_BINDING, &_array_buffer);'
+            print '    GLint _array_buffer = get_buffer_binding(GL_ARRAY_BUFFER, GL_ARRAY_BUFFER_BINDING);'
             print '    if (!_array_buffer) {'
             print '        gltrace::Context *ctx = gltrace::getContext();'
             print '        ctx->user_arrays = true;'
@@ -495,11 +829,22 @@ class GlTracer(Tracer):
             print '    }'
 
         # ... to the draw calls
+        # (but not when the draw itself is filtered out)
         if function.name in self.draw_function_names:
-            print '    if (_need_user_arrays()) {'
+            print '    if (!trace::localWriter.isFiltered(&_%s_sig, %s)) {' % (function.name, str(function.sideeffects).lower())
+            print '        bool _user_arrays;'
+            print '        GLuint _count = 0;'
+            print '        {'
+            print '            trace::WriterPhaseTimer _timer(trace::PHASE_QUERY);'
+            print '            _user_arrays = _need_user_arrays();'
+            print '            if (_user_arrays) {'
             arg_names = ', '.join([arg.name for arg in function.args[1:]])
-            print '        GLuint _count = _%s_count(%s);' % (function.name, arg_names)
-            print '        _trace_user_arrays(_count);'
+            print '                _count = _%s_count(%s);' % (function.name, arg_names)
+            print '            }'
+            print '        }'
+            print '        if (_user_arrays) {'
+            print '            _trace_user_arrays(_count);'
+            print '        }'
             print '    }'
         
         # Emit a fake memcpy on buffer uploads
@@ -512,6 +857,19 @@ class GlTracer(Tracer):
                 suffix = 'ARB'
             else:
                 suffix = ''
+            print '    struct buffer_mapping *_mapping = get_bound_buffer_mapping(target);'
+            print '    if (_mapping) {'
+            print '        bool flush = _mapping->write && !_mapping->explicit_flush;'
+            print '        if (flush && _checkBufferFlushingUnmapAPPLE) {'
+            print '            GLint flushing_unmap = GL_TRUE;'
+            print '            _glGetBufferParameteriv%s(target, GL_BUFFER_FLUSHING_UNMAP_APPLE, &flushing_unmap);' % suffix
+            print '            flush = flushing_unmap;'
+            print '        }'
+            print '        if (flush && _mapping->length > 0) {'
+            self.emit_memcpy('_mapping->map', '_mapping->map', '_mapping->length')
+            print '        }'
+            print '        _mapping->map = NULL;'
+            print '    } else {'
             print '    GLint access = 0;'
             print '    _glGetBufferParameteriv%s(target, GL_BUFFER_ACCESS, &access);' % suffix
             print '    if (access != GL_READ_ONLY) {'
@@ -555,6 +913,7 @@ class GlTracer(Tracer):
             print '            }'
             print '        }'
             print '    }'
+            print '    }'
         if function.name == 'glUnmapBufferOES':
             print '    GLint access = 0;'
             print '    _glGetBufferParameteriv(target, GL_BUFFER_ACCESS_OES, &access);'
@@ -581,13 +940,23 @@ class GlTracer(Tracer):
             print '    }'
         if function.name == 'glFlushMappedBufferRange':
             print '    GLvoid *map = NULL;'
-            print '    _glGetBufferPointerv(target, GL_BUFFER_MAP_POINTER, &map);'
+            print '    struct buffer_mapping *_mapping = get_bound_buffer_mapping(target);'
+            print '    if (_mapping) {'
+            print '        map = _mapping->map;'
+            print '    } else {'
+            print '        _glGetBufferPointerv(target, GL_BUFFER_MAP_POINTER, &map);'
+            print '    }'
             print '    if (map && length > 0) {'
             self.emit_memcpy('(char *)map + offset', '(const char *)map + offset', 'length')
             print '    }'
         if function.name == 'glFlushMappedBufferRangeAPPLE':
             print '    GLvoid *map = NULL;'
-            print '    _glGetBufferPointerv(target, GL_BUFFER_MAP_POINTER, &map);'
+            print '    struct buffer_mapping *_mapping = get_bound_buffer_mapping(target);'
+            print '    if (_mapping) {'
+            print '        map = _mapping->map;'
+            print '    } else {'
+            print '        _glGetBufferPointerv(target, GL_BUFFER_MAP_POINTER, &map);'
+            print '    }'
             print '    if (map && size > 0) {'
             self.emit_memcpy('(char *)map + offset', '(const char *)map + offset', 'size')
             print '    }'
@@ -683,6 +1052,269 @@ class GlTracer(Tracer):
 
         Tracer.invokeFunction(self, function)
 
+        self.updateContextState(function)
+        self.updateShadowState(function)
+
+    # Context creation functions, and the name of their share context
+    # argument
+    create_context_functions = {
+        'glXCreateContext': 'shareList',
+        'glXCreateNewContext': 'shareList',
+        'glXCreateContextAttribsARB': 'share_context',
+        'glXCreateContextWithConfigSGIX': 'share_list',
+        'wglCreateContext': None,
+        'wglCreateLayerContext': None,
+        'wglCreateContextAttribsARB': 'hShareContext',
+        'eglCreateContext': 'share_context',
+    }
+
+    destroy_context_function_names = set((
+        'glXDestroyContext',
+        'glXFreeContextEXT',
+        'wglDeleteContext',
+        'eglDestroyContext',
+        'CGLDestroyContext',
+    ))
+
+    def updateContextState(self, function):
+        # Track which contexts share objects, so that state derived from
+        # buffer contents can be kept per share group
+        if function.name in self.create_context_functions:
+            share_arg = self.create_context_functions[function.name]
+            share = '(uintptr_t)%s' % share_arg if share_arg else '0'
+            print '    if (_result) {'
+            print '        gltrace::createContext((uintptr_t)_result, %s);' % share
+            print '    }'
+        if function.name == 'CGLCreateContext':
+            print '    if (_result == kCGLNoError && ctx) {'
+            print '        gltrace::createContext((uintptr_t)*ctx, (uintptr_t)share);'
+            print '    }'
+        if function.name == 'wglShareLists':
+            print '    if (_result) {'
+            print '        gltrace::shareContext((uintptr_t)hglrc2, (uintptr_t)hglrc1);'
+            print '    }'
+        if function.name in self.destroy_context_function_names:
+            print '    gltrace::destroyContext((uintptr_t)%s);' % function.args[-1].name
+        if function.name in self.make_current_function_names:
+            # The context is always the last argument
+            ctx = function.args[-1].name
+            if function.name == 'CGLSetCurrentContext':
+                print '    if (_result == kCGLNoError) {'
+            else:
+                print '    if (_result) {'
+            print '        if (%s) {' % ctx
+            print '            gltrace::setContext((uintptr_t)%s);' % ctx
+            print '        } else {'
+            print '            gltrace::clearContext();'
+            print '        }'
+            print '    }'
+
+    make_current_function_names = set((
+        'glXMakeCurrent',
+        'glXMakeContextCurrent',
+        'glXMakeCurrentReadSGI',
+        'wglMakeCurrent',
+        'wglMakeContextCurrentARB',
+        'wglMakeContextCurrentEXT',
+        'eglMakeCurrent',
+        'CGLSetCurrentContext',
+    ))
+
+    array_invalidate_function_names = set((
+        'glInterleavedArrays',
+        'glVertexAttribPointerNV',
+        'glEnableClientStateIndexedEXT',
+        'glDisableClientStateIndexedEXT',
+        'glMultiTexCoordPointerEXT',
+        'glVertexArrayVertexOffsetEXT',
+        'glVertexArrayColorOffsetEXT',
+        'glVertexArrayEdgeFlagOffsetEXT',
+        'glVertexArrayIndexOffsetEXT',
+        'glVertexArrayNormalOffsetEXT',
+        'glVertexArrayTexCoordOffsetEXT',
+        'glVertexArrayMultiTexCoordOffsetEXT',
+        'glVertexArrayFogCoordOffsetEXT',
+        'glVertexArraySecondaryColorOffsetEXT',
+        'glVertexArrayVertexAttribOffsetEXT',
+        'glVertexArrayVertexAttribIOffsetEXT',
+        'glVertexArrayVertexAttribLOffsetEXT',
+        'glEnableVertexArrayEXT',
+        'glDisableVertexArrayEXT',
+        'glEnableVertexArrayAttribEXT',
+        'glDisableVertexArrayAttribEXT',
+    ))
+
+    def updateArrayShadowState(self, function):
+        '''Keep the vertex array shadows in sync with the call just dispatched.'''
+
+        if function.name in ('glClientActiveTexture', 'glClientActiveTextureARB'):
+            print '    get_shadow_state()->client_active_texture = texture;'
+
+        if function.name in ('glEnableClientState', 'glDisableClientState'):
+            print '    {'
+            print '        struct array_shadow *_shadow = get_array_shadow(array);'
+            print '        if (_shadow) {'
+            print '            _shadow->enabled = %u;' % int(function.name.startswith('glEnable'))
+            print '        } else {'
+            print '            // e.g. NV_vertex_program arrays, which alias the conventional ones'
+            print '            get_shadow_state()->invalidate_arrays();'
+            print '        }'
+            print '    }'
+        if function.name in ('glEnableVertexAttribArray', 'glEnableVertexAttribArrayARB',
+                             'glDisableVertexAttribArray', 'glDisableVertexAttribArrayARB'):
+            print '    {'
+            print '        struct array_shadow *_shadow = get_attrib_shadow(index);'
+            print '        if (_shadow) {'
+            print '            _shadow->enabled = %u;' % int(function.name.startswith('glEnable'))
+            print '        }'
+            print '    }'
+
+        # Pointers record the array buffer binding too
+        shadow = None
+        for camelcase_name, uppercase_name in self.arrays:
+            if function.name in ('gl%sPointer' % camelcase_name, 'gl%sPointerEXT' % camelcase_name):
+                shadow = 'get_array_shadow(GL_%s_ARRAY)' % uppercase_name
+        if function.name in ('glVertexAttribPointer', 'glVertexAttribPointerARB',
+                             'glVertexAttribIPointer', 'glVertexAttribIPointerEXT',
+                             'glVertexAttribLPointer', 'glVertexAttribLPointerEXT'):
+            shadow = 'get_attrib_shadow(index)'
+        if shadow is not None:
+            print '    {'
+            print '        struct array_shadow *_shadow = %s;' % shadow
+            print '        if (_shadow) {'
+            print '            _shadow->binding = get_buffer_binding(GL_ARRAY_BUFFER, GL_ARRAY_BUFFER_BINDING);'
+            if function.name.startswith('glVertexAttribI') or function.name.startswith('glVertexAttribL'):
+                # Integer and double arrays are traced with their queried parameters
+                print '            _shadow->params = false;'
+            else:
+                arg_names = [arg.name for arg in function.args]
+                for name in ('size', 'type', 'normalized', 'stride', 'pointer'):
+                    if name in arg_names:
+                        print '            _shadow->%s = %s;' % (name, name)
+                print '            _shadow->params = true;'
+            print '        }'
+            print '    }'
+
+        if function.name in self.array_invalidate_function_names:
+            print '    get_shadow_state()->invalidate_arrays();'
+
+    # Calls which write pixels to the pixel pack buffer, if one is bound
+    pack_function_names = set((
+        'glReadPixels',
+        'glReadnPixelsARB',
+        'glGetTexImage',
+        'glGetnTexImageARB',
+        'glGetCompressedTexImage',
+        'glGetCompressedTexImageARB',
+        'glGetnCompressedTexImageARB',
+        'glGetTextureImageEXT',
+        'glGetCompressedTextureImageEXT',
+        'glGetMultiTexImageEXT',
+        'glGetCompressedMultiTexImageEXT',
+        'glGetPolygonStipple',
+        'glGetnPolygonStippleARB',
+        'glGetColorTable',
+        'glGetnColorTableARB',
+        'glGetConvolutionFilter',
+        'glGetnConvolutionFilterARB',
+        'glGetSeparableFilter',
+        'glGetnSeparableFilterARB',
+        'glGetHistogram',
+        'glGetnHistogramARB',
+        'glGetMinmax',
+        'glGetnMinmaxARB',
+    ))
+
+    def updateShadowState(self, function):
+        '''Keep the shadow state in sync with the call just dispatched.'''
+
+        if function.name in self.make_current_function_names:
+            print '    get_shadow_state()->invalidate();'
+        if function.name in ('glBindBuffer', 'glBindBufferARB'):
+            print '    update_buffer_binding(target, buffer);'
+        if function.name in ('glBindBufferBase', 'glBindBufferBaseEXT', 'glBindBufferBaseNV',
+                             'glBindBufferRange', 'glBindBufferRangeEXT', 'glBindBufferRangeNV',
+                             'glBindBufferOffsetEXT', 'glBindBufferOffsetNV'):
+            # Indexed bindings also bind to the generic binding point
+            print '    update_buffer_binding(target, buffer);'
+        if function.name in ('glDeleteBuffers', 'glDeleteBuffersARB'):
+            print '    delete_buffer_shadows(n, %s);' % function.args[1].name
+
+        # Forget the index ranges of buffers whose contents change
+        if function.name in ('glBufferData', 'glBufferDataARB',
+                             'glBufferSubData', 'glBufferSubDataARB',
+                             'glBufferStorage',
+                             'glClearBufferData', 'glClearBufferSubData',
+                             'glUnmapBuffer', 'glUnmapBufferARB', 'glUnmapBufferOES',
+                             'glFlushMappedBufferRange', 'glFlushMappedBufferRangeAPPLE'):
+            print '    invalidate_buffer_indices(target);'
+        if function.name == 'glCopyBufferSubData':
+            print '    invalidate_buffer_indices(writeTarget);'
+        if function.name in ('glNamedBufferDataEXT', 'glNamedBufferSubDataEXT',
+                             'glNamedBufferStorageEXT',
+                             'glUnmapNamedBufferEXT', 'glFlushMappedNamedBufferRangeEXT'):
+            print '    gltrace::invalidateMaxIndices(buffer);'
+        if function.name == 'glNamedCopyBufferSubDataEXT':
+            print '    gltrace::invalidateMaxIndices(writeBuffer);'
+        if function.name in ('glDeleteBuffers', 'glDeleteBuffersARB'):
+            # Deleting a buffer also unmaps it
+            print '    for (GLsizei _i = 0; _i < n; ++_i) {'
+            print '        gltrace::setBufferPersistentlyMapped(%s[_i], false);' % function.args[1].name
+            print '    }'
+        # Persistently mapped buffers can be written at any time
+        if function.name == 'glMapBufferRange':
+            print '    if (_result && (access & GL_MAP_PERSISTENT_BIT)) {'
+            print '        set_buffer_persistently_mapped(target, true);'
+            print '    }'
+        if function.name == 'glMapNamedBufferRangeEXT':
+            print '    if (_result && (access & GL_MAP_PERSISTENT_BIT)) {'
+            print '        gltrace::setBufferPersistentlyMapped(buffer, true);'
+            print '    }'
+        if function.name in ('glUnmapBuffer', 'glUnmapBufferARB'):
+            print '    set_buffer_persistently_mapped(target, false);'
+        if function.name == 'glUnmapNamedBufferEXT':
+            print '    gltrace::setBufferPersistentlyMapped(buffer, false);'
+        # Buffers can also be written by the GPU
+        if function.name in ('glEndTransformFeedback', 'glEndTransformFeedbackEXT', 'glEndTransformFeedbackNV',
+                             'glMemoryBarrier', 'glMemoryBarrierEXT'):
+            print '    gltrace::clearMaxIndices();'
+        if function.name in self.pack_function_names:
+            # Without querying the binding, as pixel pack buffers might not
+            # be supported
+            print '    if (get_buffer_shadow(GL_PIXEL_PACK_BUFFER)->binding != 0) {'
+            print '        invalidate_buffer_indices(GL_PIXEL_PACK_BUFFER);'
+            print '    }'
+        if function.name in ('glBindVertexArray', 'glBindVertexArrayAPPLE', 'glBindVertexArrayOES',
+                             'glDeleteVertexArrays', 'glDeleteVertexArraysAPPLE', 'glDeleteVertexArraysOES'):
+            # The element array buffer binding and the arrays are vertex array
+            # object state
+            print '    get_buffer_shadow(GL_ELEMENT_ARRAY_BUFFER)->binding = -1;'
+            print '    get_shadow_state()->invalidate_arrays();'
+        self.updateArrayShadowState(function)
+        if function.name in ('glPopClientAttrib', 'glClientAttribDefaultEXT', 'glPushClientAttribDefaultEXT'):
+            # These restore or reset the buffer bindings along with the arrays
+            print '    get_shadow_state()->invalidate();'
+        if function.name in ('glBufferData', 'glBufferDataARB'):
+            # Respecifying the storage implicitly unmaps the buffer
+            print '    {'
+            print '        struct buffer_shadow *_shadow = get_buffer_shadow(target);'
+            print '        if (_shadow && (_shadow->binding < 0 || _shadow->mapping.buffer == _shadow->binding)) {'
+            print '            _shadow->mapping.map = NULL;'
+            print '        }'
+            print '    }'
+
+    # Buffer targets whose binding can be queried with GL_<target>_BINDING
+    queryable_buffer_targets = set((
+        'ARRAY_BUFFER',
+        'ELEMENT_ARRAY_BUFFER',
+        'PIXEL_PACK_BUFFER',
+        'PIXEL_UNPACK_BUFFER',
+        'UNIFORM_BUFFER',
+        'TRANSFORM_FEEDBACK_BUFFER',
+        'DRAW_INDIRECT_BUFFER',
+        'ATOMIC_COUNTER_BUFFER',
+    ))
+
     buffer_targets = [
         'ARRAY_BUFFER',
         'ELEMENT_ARRAY_BUFFER',
@@ -713,6 +1345,7 @@ class GlTracer(Tracer):
             print '        _glGetBufferParameteriv(target, GL_BUFFER_SIZE, &mapping->length);'
             print '        mapping->write = (access != GL_READ_ONLY);'
             print '        mapping->explicit_flush = false;'
+            print '        mapping->buffer = get_buffer_shadow(target)->binding;'
             print '    }'
         if function.name == 'glMapBufferRange':
             print '    if (access & GL_MAP_WRITE_BIT) {'
@@ -724,6 +1357,7 @@ class GlTracer(Tracer):
             print '        mapping->length = length;'
             print '        mapping->write = access & GL_MAP_WRITE_BIT;'
             print '        mapping->explicit_flush = access & GL_MAP_FLUSH_EXPLICIT_BIT;'
+            print '        mapping->buffer = get_buffer_shadow(target)->binding;'
             print '    }'
 
     boolean_names = [
@@ -782,8 +1416,7 @@ class GlTracer(Tracer):
 
     def serializeArgValue(self, function, arg):
         if function.name in self.draw_function_names and arg.name == 'indices':
-            print '    GLint _element_array_buffer = 0;'
-            print '    _glGetIntegerv(GL_ELEMENT_ARRAY_BUFFER_BINDING, &_element_array_buffer);'
+            print '    GLint _element_array_buffer = get_buffer_binding(GL_ELEMENT_ARRAY_BUFFER, GL_ELEMENT_ARRAY_BUFFER_BINDING);'
             print '    if (!_element_array_buffer) {'
             if isinstance(arg.type, stdapi.Array):
                 print '        trace::localWriter.beginArray(%s);' % arg.type.length
@@ -809,7 +1442,7 @@ class GlTracer(Tracer):
             print '        gltrace::Context *ctx = gltrace::getContext();'
             print '        GLint _unpack_buffer = 0;'
             print '        if (ctx->profile == gltrace::PROFILE_COMPAT)'
-            print '            _glGetIntegerv(GL_PIXEL_UNPACK_BUFFER_BINDING, &_unpack_buffer);'
+            print '            _unpack_buffer = get_buffer_binding(GL_PIXEL_UNPACK_BUFFER, GL_PIXEL_UNPACK_BUFFER_BINDING);'
             print '        if (_unpack_buffer) {'
             print '            trace::localWriter.writePointer((uintptr_t)%s);' % arg.name
             print '        } else {'
@@ -855,22 +1488,33 @@ class GlTracer(Tracer):
             binding_name = 'GL_%s_ARRAY_BUFFER_BINDING' % uppercase_name
             function = api.getFunctionByName(function_name)
 
+            if uppercase_name == 'TEXTURE_COORD':
+                shadow = 'get_texcoord_shadow(unit)'
+            else:
+                shadow = '&get_shadow_state()->arrays[%u]' % self.fixedArrays().index((camelcase_name, uppercase_name))
+
             print '    // %s' % function.prototype()
             print '  if (%s) {' % profile_check
             self.array_trace_prolog(api, uppercase_name)
             self.array_prolog(api, uppercase_name)
-            print '    if (_glIsEnabled(%s)) {' % enable_name
-            print '        GLint _binding = 0;'
-            print '        _glGetIntegerv(%s, &_binding);' % binding_name
-            print '        if (!_binding) {'
+            print '    struct array_shadow *_shadow = %s;' % shadow
+            print '    if (is_user_array(_shadow, %s, %s)) {' % (enable_name, binding_name)
 
-            # Get the arguments via glGet*
+            # Get the arguments from the shadow state, or via glGet*
             for arg in function.args:
-                arg_get_enum = 'GL_%s_ARRAY_%s' % (uppercase_name, arg.name.upper())
                 arg_get_function, arg_type = TypeGetter().visit(arg.type)
                 print '            %s %s = 0;' % (arg_type, arg.name)
-                print '            _%s(%s, &%s);' % (arg_get_function, arg_get_enum, arg.name)
-            
+            print '            if (_shadow && _shadow->params) {'
+            for arg in function.args:
+                arg_get_function, arg_type = TypeGetter().visit(arg.type)
+                print '                %s = (%s)_shadow->%s;' % (arg.name, arg_type, arg.name)
+            print '            } else {'
+            for arg in function.args:
+                arg_get_enum = 'GL_%s_ARRAY_%s' % (uppercase_name, arg.name.upper())
+                arg_get_function, arg_type = TypeGetter().visit(arg.type)
+                print '                _%s(%s, &%s);' % (arg_get_function, arg_get_enum, arg.name)
+            print '            }'
+
             arg_names = ', '.join([arg.name for arg in function.args[:-1]])
             print '            size_t _size = _%s_size(%s, count);' % (function.name, arg_names)
 
@@ -889,7 +1533,6 @@ class GlTracer(Tracer):
             print '            trace::localWriter.endEnter();'
             print '            trace::localWriter.beginLeave(_call);'
             print '            trace::localWriter.endLeave();'
-            print '        }'
             print '    }'
             self.array_epilog(api, uppercase_name)
             self.array_trace_epilog(api, uppercase_name)
@@ -925,31 +1568,42 @@ class GlTracer(Tracer):
             if suffix == 'NV':
                 print '        GLint _max_vertex_attribs = 16;'
             else:
-                print '        GLint _max_vertex_attribs = 0;'
-                print '        _glGetIntegerv(GL_MAX_VERTEX_ATTRIBS, &_max_vertex_attribs);'
+                print '        GLint _max_vertex_attribs = get_max_vertex_attribs();'
             print '        for (GLint index = 0; index < _max_vertex_attribs; ++index) {'
-            print '            GLint _enabled = 0;'
             if suffix == 'NV':
+                # It doesn't seem possible to use VBOs with NV_vertex_program,
+                # and the NV attribute arrays alias the conventional ones, so
+                # they are not shadowed.
+                print '            GLint _enabled = 0;'
                 print '            _glGetIntegerv(GL_VERTEX_ATTRIB_ARRAY0_NV + index, &_enabled);'
+                print '            if (_enabled) {'
             else:
-                print '            _glGetVertexAttribiv%s(index, GL_VERTEX_ATTRIB_ARRAY_ENABLED%s, &_enabled);' % (suffix, SUFFIX)
-            print '            if (_enabled) {'
-            print '                GLint _binding = 0;'
-            if suffix != 'NV':
-                # It doesn't seem possible to use VBOs with NV_vertex_program.
-                print '                _glGetVertexAttribiv%s(index, GL_VERTEX_ATTRIB_ARRAY_BUFFER_BINDING%s, &_binding);' % (suffix, SUFFIX)
-            print '                if (!_binding) {'
+                print '            struct array_shadow *_shadow = get_attrib_shadow(index);'
+                print '            if (is_user_attrib%s(_shadow, index)) {' % suffix
 
-            # Get the arguments via glGet*
+            # Get the arguments from the shadow state, or via glGet*
+            for arg in function.args[1:]:
+                arg_get_function, arg_type = TypeGetter('glGetVertexAttrib', False, suffix).visit(arg.type)
+                print '                    %s %s = 0;' % (arg_type, arg.name)
+            if suffix == 'NV':
+                indent = '                    '
+            else:
+                indent = '                        '
+                print '                    if (_shadow && _shadow->params) {'
+                for arg in function.args[1:]:
+                    arg_get_function, arg_type = TypeGetter('glGetVertexAttrib', False, suffix).visit(arg.type)
+                    print '                        %s = (%s)_shadow->%s;' % (arg.name, arg_type, arg.name)
+                print '                    } else {'
             for arg in function.args[1:]:
                 if suffix == 'NV':
                     arg_get_enum = 'GL_ATTRIB_ARRAY_%s%s' % (arg.name.upper(), SUFFIX)
                 else:
                     arg_get_enum = 'GL_VERTEX_ATTRIB_ARRAY_%s%s' % (arg.name.upper(), SUFFIX)
                 arg_get_function, arg_type = TypeGetter('glGetVertexAttrib', False, suffix).visit(arg.type)
-                print '                    %s %s = 0;' % (arg_type, arg.name)
-                print '                    _%s(index, %s, &%s);' % (arg_get_function, arg_get_enum, arg.name)
-            
+                print '%s_%s(index, %s, &%s);' % (indent, arg_get_function, arg_get_enum, arg.name)
+            if suffix != 'NV':
+                print '                    }'
+
             arg_names = ', '.join([arg.name for arg in function.args[1:-1]])
             print '                    size_t _size = _%s_size(%s, count);' % (function.name, arg_names)
 
@@ -967,7 +1621,6 @@ class GlTracer(Tracer):
             print '                    trace::localWriter.endEnter();'
             print '                    trace::localWriter.beginLeave(_call);'
             print '                    trace::localWriter.endLeave();'
-            print '                }'
             print '            }'
             print '        }'
             print '    }'
@@ -983,13 +1636,8 @@ class GlTracer(Tracer):
 
     def array_prolog(self, api, uppercase_name):
         if uppercase_name == 'TEXTURE_COORD':
-            print '    GLint client_active_texture = 0;'
-            print '    _glGetIntegerv(GL_CLIENT_ACTIVE_TEXTURE, &client_active_texture);'
-            print '    GLint max_texture_coords = 0;'
-            print '    if (ctx->profile == gltrace::PROFILE_COMPAT)'
-            print '        _glGetIntegerv(GL_MAX_TEXTURE_COORDS, &max_texture_coords);'
-            print '    else'
-            print '        _glGetIntegerv(GL_MAX_TEXTURE_UNITS, &max_texture_coords);'
+            print '    GLint client_active_texture = get_client_active_texture();'
+            print '    GLint max_texture_coords = get_max_texture_coords(ctx->profile);'
             print '    for (GLint unit = 0; unit < max_texture_coords; ++unit) {'
             print '        GLint texture = GL_TEXTURE0 + unit;'
             print '        _glClientActiveTexture(texture);'
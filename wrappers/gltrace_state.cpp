@@ -0,0 +1,348 @@
+/**************************************************************************
+ *
+ * Copyright 2012 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+/*
+ * Tracking of the GL contexts, their share groups, and the state shared
+ * within them.
+ */
+
+
+#include <map>
+#include <set>
+
+#include "os_thread.hpp"
+#include "gltrace.hpp"
+
+
+namespace gltrace {
+
+
+struct IndexRange {
+    GLuint buffer;
+    GLintptr offset;
+    GLsizei count;
+    GLenum type;
+
+    bool operator < (const IndexRange &other) const {
+        if (buffer != other.buffer) return buffer < other.buffer;
+        if (offset != other.offset) return offset < other.offset;
+        if (count != other.count) return count < other.count;
+        return type < other.type;
+    }
+};
+
+typedef std::map<IndexRange, GLuint> IndexCache;
+
+
+struct SharedState {
+    unsigned refs;
+
+    // Protects the members below, as contexts of the same share group can
+    // be current in several threads
+    os::recursive_mutex mutex;
+
+    IndexCache maxIndices;
+    std::set<GLuint> persistentBuffers;
+
+    SharedState() :
+        refs(1)
+    {}
+};
+
+
+typedef std::map<uintptr_t, Context *> ContextMap;
+
+// Protects the context map and the reference counts
+static os::recursive_mutex contextMutex;
+static ContextMap contextMap;
+
+
+static Context *
+newContext(SharedState *shared)
+{
+    Context *ctx = new Context;
+    ctx->profile = PROFILE_COMPAT;
+    ctx->user_arrays = false;
+    ctx->user_arrays_arb = false;
+    ctx->user_arrays_nv = false;
+    ctx->refs = 1;
+    if (shared) {
+        ++shared->refs;
+        ctx->shared = shared;
+    } else {
+        ctx->shared = new SharedState;
+    }
+    return ctx;
+}
+
+
+static void
+unrefShared(SharedState *shared)
+{
+    if (--shared->refs == 0) {
+        delete shared;
+    }
+}
+
+
+static void
+unrefContext(Context *ctx)
+{
+    if (--ctx->refs == 0) {
+        unrefShared(ctx->shared);
+        delete ctx;
+    }
+}
+
+
+/*
+ * Holds a reference to the context current in a thread, released when the
+ * thread exits.
+ */
+struct ThreadState {
+    Context *current;
+
+    ThreadState() :
+        current(NULL)
+    {}
+
+    ~ThreadState() {
+        if (current) {
+            contextMutex.lock();
+            unrefContext(current);
+            contextMutex.unlock();
+        }
+    }
+};
+
+static os::thread_specific_ptr<ThreadState> threadState;
+
+
+static ThreadState *
+getThreadState(void)
+{
+    ThreadState *ts = threadState.get();
+    if (!ts) {
+        ts = new ThreadState;
+        threadState.reset(ts);
+    }
+    return ts;
+}
+
+
+Context *
+getContext(void)
+{
+    // Used when contexts are created through means we don't intercept
+    static Context *defaultContext = newContext(NULL);
+
+    Context *ctx = getThreadState()->current;
+    return ctx ? ctx : defaultContext;
+}
+
+
+void
+createContext(uintptr_t context_id, uintptr_t shared_context_id)
+{
+    contextMutex.lock();
+
+    SharedState *shared = NULL;
+    if (shared_context_id) {
+        ContextMap::iterator it = contextMap.find(shared_context_id);
+        if (it != contextMap.end()) {
+            shared = it->second->shared;
+        }
+    }
+
+    ContextMap::iterator it = contextMap.find(context_id);
+    if (it != contextMap.end()) {
+        // The handle was reused without us seeing the context destroyed
+        unrefContext(it->second);
+    }
+    contextMap[context_id] = newContext(shared);
+
+    contextMutex.unlock();
+}
+
+
+void
+shareContext(uintptr_t context_id, uintptr_t shared_context_id)
+{
+    contextMutex.lock();
+
+    ContextMap::iterator it = contextMap.find(context_id);
+    ContextMap::iterator shared_it = contextMap.find(shared_context_id);
+    if (it != contextMap.end() && shared_it != contextMap.end()) {
+        Context *ctx = it->second;
+        SharedState *shared = shared_it->second->shared;
+        if (ctx->shared != shared) {
+            ++shared->refs;
+            unrefShared(ctx->shared);
+            ctx->shared = shared;
+        }
+    }
+
+    contextMutex.unlock();
+}
+
+
+void
+destroyContext(uintptr_t context_id)
+{
+    contextMutex.lock();
+
+    ContextMap::iterator it = contextMap.find(context_id);
+    if (it != contextMap.end()) {
+        // Threads where it is still current keep a reference
+        unrefContext(it->second);
+        contextMap.erase(it);
+    }
+
+    contextMutex.unlock();
+}
+
+
+void
+setContext(uintptr_t context_id)
+{
+    ThreadState *ts = getThreadState();
+
+    contextMutex.lock();
+
+    Context *ctx;
+    ContextMap::iterator it = contextMap.find(context_id);
+    if (it != contextMap.end()) {
+        ctx = it->second;
+    } else {
+        // Created through means we don't intercept, e.g., glXImportContextEXT
+        ctx = newContext(NULL);
+        contextMap[context_id] = ctx;
+    }
+
+    if (ctx != ts->current) {
+        ++ctx->refs;
+        if (ts->current) {
+            unrefContext(ts->current);
+        }
+        ts->current = ctx;
+    }
+
+    contextMutex.unlock();
+}
+
+
+void
+clearContext(void)
+{
+    ThreadState *ts = getThreadState();
+
+    contextMutex.lock();
+
+    if (ts->current) {
+        unrefContext(ts->current);
+        ts->current = NULL;
+    }
+
+    contextMutex.unlock();
+}
+
+
+bool
+lookupMaxIndex(GLuint buffer, GLintptr offset, GLsizei count, GLenum type, GLuint *maxindex)
+{
+    SharedState *shared = getContext()->shared;
+    IndexRange range = {buffer, offset, count, type};
+    bool found = false;
+
+    shared->mutex.lock();
+    IndexCache::const_iterator it = shared->maxIndices.find(range);
+    if (it != shared->maxIndices.end()) {
+        *maxindex = it->second;
+        found = true;
+    }
+    shared->mutex.unlock();
+
+    return found;
+}
+
+
+void
+storeMaxIndex(GLuint buffer, GLintptr offset, GLsizei count, GLenum type, GLuint maxindex)
+{
+    SharedState *shared = getContext()->shared;
+    IndexRange range = {buffer, offset, count, type};
+
+    shared->mutex.lock();
+    if (shared->persistentBuffers.find(buffer) == shared->persistentBuffers.end()) {
+        shared->maxIndices[range] = maxindex;
+    }
+    shared->mutex.unlock();
+}
+
+
+void
+invalidateMaxIndices(GLuint buffer)
+{
+    SharedState *shared = getContext()->shared;
+    IndexRange first = {buffer, 0, 0, 0};
+
+    shared->mutex.lock();
+    IndexCache::iterator it = shared->maxIndices.lower_bound(first);
+    while (it != shared->maxIndices.end() && it->first.buffer == buffer) {
+        shared->maxIndices.erase(it++);
+    }
+    shared->mutex.unlock();
+}
+
+
+void
+clearMaxIndices(void)
+{
+    SharedState *shared = getContext()->shared;
+
+    shared->mutex.lock();
+    shared->maxIndices.clear();
+    shared->mutex.unlock();
+}
+
+
+void
+setBufferPersistentlyMapped(GLuint buffer, bool mapped)
+{
+    SharedState *shared = getContext()->shared;
+
+    shared->mutex.lock();
+    if (mapped) {
+        shared->persistentBuffers.insert(buffer);
+    } else {
+        shared->persistentBuffers.erase(buffer);
+    }
+    shared->mutex.unlock();
+    invalidateMaxIndices(buffer);
+}
+
+
+} /* namespace gltrace */
@@ -429,25 +429,51 @@ class Tracer:
         print
 
     def traceFunctionImplBody(self, function):
-        if not function.internal:
-            print '    unsigned _call = trace::localWriter.beginEnter(&_%s_sig);' % (function.name,)
-            for arg in function.args:
-                if not arg.output:
-                    self.unwrapArg(function, arg)
-                    self.serializeArg(function, arg)
-            print '    trace::localWriter.endEnter();'
+        if function.internal:
+            self.invokeFunction(function)
+            return
+
+        print '    unsigned _call = 0;'
+        print '    long long _start = 0;'
+        print '    bool _traced = !trace::localWriter.isFiltered(&_%s_sig, %s);' % (function.name, str(function.sideeffects).lower())
+        print '    if (_traced) {'
+        print '    _call = trace::localWriter.beginEnter(&_%s_sig);' % (function.name,)
+        for arg in function.args:
+            if not arg.output:
+                self.unwrapArg(function, arg)
+                self.serializeArg(function, arg)
+        print '    trace::localWriter.endEnter();'
+        print '    if (trace::localWriter.timingCalls()) {'
+        print '        _start = os::getTime();'
+        print '    }'
+        unwrapped_args = [arg for arg in function.args if not arg.output and self.needsWrapping(arg.type)]
+        if unwrapped_args:
+            print '    } else {'
+            for arg in unwrapped_args:
+                self.unwrapArg(function, arg)
+        print '    }'
         self.invokeFunction(function)
-        if not function.internal:
-            print '    trace::localWriter.beginLeave(_call);'
-            for arg in function.args:
-                if arg.output:
-                    self.serializeArg(function, arg)
-                    self.wrapArg(function, arg)
-            if function.type is not stdapi.Void:
-                self.serializeRet(function, "_result")
-            print '    trace::localWriter.endLeave();'
-            if function.type is not stdapi.Void:
-                self.wrapRet(function, "_result")
+        print '    if (_traced) {'
+        print '    long long _end = 0;'
+        print '    if (trace::localWriter.timingCalls()) {'
+        print '        _end = os::getTime();'
+        print '    }'
+        print '    trace::localWriter.beginLeave(_call);'
+        for arg in function.args:
+            if arg.output:
+                self.serializeArg(function, arg)
+        if function.type is not stdapi.Void:
+            self.serializeRet(function, "_result")
+        print '    if (trace::localWriter.timingCalls()) {'
+        print '        trace::localWriter.writeCallTime(_start, _end);'
+        print '    }'
+        print '    trace::localWriter.endLeave();'
+        print '    }'
+        for arg in function.args:
+            if arg.output:
+                self.wrapArg(function, arg)
+        if function.type is not stdapi.Void:
+            self.wrapRet(function, "_result")
 
     def invokeFunction(self, function, prefix='_', suffix=''):
         if function.type is stdapi.Void:
@@ -592,9 +618,17 @@ class Tracer:
                 self.unwrapArg(method, arg)
                 self.serializeArg(method, arg)
         print '    trace::localWriter.endEnter();'
+        print '    long long _start = 0;'
+        print '    if (trace::localWriter.timingCalls()) {'
+        print '        _start = os::getTime();'
+        print '    }'
         
         self.invokeMethod(interface, base, method)
 
+        print '    long long _end = 0;'
+        print '    if (trace::localWriter.timingCalls()) {'
+        print '        _end = os::getTime();'
+        print '    }'
         print '    trace::localWriter.beginLeave(_call);'
         for arg in method.args:
             if arg.output:
@@ -603,6 +637,9 @@ class Tracer:
 
         if method.type is not stdapi.Void:
             self.serializeRet(method, '_result')
+        print '    if (trace::localWriter.timingCalls()) {'
+        print '        trace::localWriter.writeCallTime(_start, _end);'
+        print '    }'
         print '    trace::localWriter.endLeave();'
         if method.type is not stdapi.Void:
             self.wrapRet(method, '_result')
@@ -55,6 +55,8 @@ if __name__ == '__main__':
     print '#define WGL_GLXEXT_PROTOTYPES'
     print
     print '#include "glproc.hpp"'
+    print '// The element array binding and index ranges are tracked by gltrace'
+    print '#define _GL_SIZE_ELEMENT_ARRAY_HOOKS'
     print '#include "glsize.hpp"'
     print
     api = API()